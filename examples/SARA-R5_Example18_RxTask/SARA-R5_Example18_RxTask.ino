@@ -0,0 +1,149 @@
+/*
+
+  SARA-R5 Example
+  ===============
+
+  RX Task
+
+  This example shows how a dedicated thread can own the SARA-R5 UART. The thread calls rxTask every millisecond.
+  rxTask frames the incoming lines, queues the URCs as events and passes the command responses to the command
+  which is waiting for them. The main loop sends commands as normal and calls bufferedPoll to dispatch the events.
+
+  RX task mode needs <atomic> and std::thread. It runs on ESP32 (where the RX thread can be pinned to the other core)
+  and on Linux hosts which provide the Arduino API.
+
+  Feel like supporting open source hardware?
+  Buy a board from SparkFun!
+
+  Licence: MIT
+  Please see LICENSE.md for full details
+
+*/
+
+#include <SparkFun_u-blox_SARA-R5_Arduino_Library.h> //Click here to get the library: http://librarymanager/All#SparkFun_u-blox_SARA-R5_Arduino_Library
+
+#ifndef SARA_R5_RX_TASK_ENABLED
+#error "RX task mode is not supported on this platform. It needs <atomic>"
+#endif
+
+#include <thread>
+#include <atomic>
+
+// Uncomment the next line to connect to the SARA-R5 using hardware Serial1
+#define saraSerial Serial1
+
+// Create a SARA_R5 object to use throughout the sketch
+// If you're using the MicroMod Asset Tracker and the MicroMod Artemis Processor Board,
+// the pin name is G2 which is connected to pin AD34.
+SARA_R5 mySARA;
+
+std::atomic<bool> rxRunning(false);
+std::atomic<uint32_t> rxCharacters(0);
+
+// The body of the RX thread. It owns the UART while RX task mode is enabled
+void rxThread()
+{
+  while (rxRunning)
+  {
+    rxCharacters += mySARA.rxTask();
+    delay(1);
+  }
+}
+
+std::thread *rx = nullptr;
+
+// processEPSRegistration is called by bufferedPoll - on the main thread - when a +CEREG URC arrives
+void processEPSRegistration(SARA_R5_registration_status_t status, unsigned int tac, unsigned int ci, int Act)
+{
+  Serial.print(F("EPS registration status: "));
+  Serial.print((int)status);
+  Serial.print(F("  TAC: 0x"));
+  Serial.print(tac, HEX);
+  Serial.print(F("  CI: 0x"));
+  Serial.println(ci, HEX);
+}
+
+void setup()
+{
+  Serial.begin(115200); // Start the serial console
+
+  // Wait for user to press key to begin
+  Serial.println(F("SARA-R5 Example"));
+  Serial.println(F("Press any key to begin"));
+
+  while (!Serial.available()) // Wait for the user to press a key (send any serial character)
+    ;
+  while (Serial.available()) // Empty the serial RX buffer
+    Serial.read();
+
+  //mySARA.enableDebugging(); // Uncomment this line to enable helpful debug messages on Serial
+
+  // For the MicroMod Asset Tracker, we need to invert the power pin so it pulls high instead of low
+  // Comment the next line if required
+  mySARA.invertPowerPin(true);
+
+  // Initialize the SARA. begin must be called before RX task mode is enabled
+  if (mySARA.begin(saraSerial, 9600) )
+  {
+    Serial.println(F("SARA-R5 connected!"));
+  }
+  else
+  {
+    Serial.println(F("Unable to communicate with the SARA."));
+    Serial.println(F("Manually power-on (hold the SARA On button for 3 seconds) on and try again."));
+    while (1) ; // Loop forever on fail
+  }
+
+  // Start the RX thread, then hand it the UART
+  rxRunning = true;
+  rx = new std::thread(rxThread);
+  if (mySARA.setRxTaskMode(true) != SARA_R5_SUCCESS)
+  {
+    Serial.println(F("setRxTaskMode failed! Freezing..."));
+    while (1) ; // Do nothing more
+  }
+
+  // Enable the +CEREG URC so there are events to dispatch. The command is sent while rxTask owns the UART
+  mySARA.setEpsRegistrationCallback(&processEPSRegistration);
+
+  Serial.println();
+  Serial.println(F("Press any key to stop the RX thread"));
+}
+
+void loop()
+{
+  static unsigned long lastQuery = 0;
+
+  // Commands are sent from the main thread as normal. rxTask passes the responses back
+  if (millis() - lastQuery > 10000)
+  {
+    lastQuery = millis();
+    String currentOperator = "";
+    if (mySARA.getOperator(&currentOperator) == SARA_R5_SUCCESS)
+    {
+      Serial.print(F("Connected to: "));
+      Serial.println(currentOperator);
+    }
+    Serial.print(F("RSSI: "));
+    Serial.println(mySARA.rssi());
+    Serial.print(F("Characters received by the RX thread: "));
+    Serial.print(rxCharacters);
+    Serial.print(F("  URC events dropped: "));
+    Serial.println(mySARA.getURCEventsDropped());
+  }
+
+  mySARA.bufferedPoll(); // Dispatch the URC events queued by the RX thread
+
+  if ((rx != nullptr) && Serial.available())
+  {
+    // Take the UART back before stopping the thread
+    mySARA.setRxTaskMode(false);
+    rxRunning = false;
+    rx->join();
+    delete rx;
+    rx = nullptr;
+    Serial.println(F("RX thread stopped. bufferedPoll now reads the UART"));
+    while (Serial.available())
+      Serial.read();
+  }
+}
@@ -16,6 +16,13 @@
 
 #include <SparkFun_u-blox_SARA-R5_Arduino_Library.h>
 
+// Hold the transaction lock until the end of the enclosing function
+#ifdef SARA_R5_THREAD_SAFE_ENABLED
+#define SARA_R5_LOCK_TRANSACTION(priority) SARA_R5_Transaction transaction(*this, priority)
+#else
+#define SARA_R5_LOCK_TRANSACTION(priority)
+#endif
+
 SARA_R5::SARA_R5(int powerPin, int resetPin, uint8_t maxInitTries)
 {
 #ifdef SARA_R5_SOFTWARE_SERIAL_ENABLED
@@ -36,9 +43,28 @@ SARA_R5::SARA_R5(int powerPin, int resetPin, uint8_t maxInitTries)
   _psdActionRequestCallback = nullptr;
   _pingRequestCallback = nullptr;
   _httpCommandRequestCallback = nullptr;
+  for (int i = 0; i < SARA_R5_NUM_HTTP_PROFILES; i++)
+  {
+    _httpCommandResult[i] = 0;
+    _httpStagingFile[i][0] = 0;
+  }
+  _mqttPublishFileResult = 0;
+  _httpScheduler = nullptr;
+  _mqttPipeline = nullptr;
+  _mqttInbound = nullptr;
+  _mqttsn = nullptr;
   _mqttCommandRequestCallback = nullptr;
+  _mqttsnCommandRequestCallback = nullptr;
   _registrationCallback = nullptr;
   _epsRegistrationCallback = nullptr;
+  for (int i = 0; i < 2; i++)
+  {
+    _registrationURC[i] = false;
+    memset(&_registrationState[i], 0, sizeof(SARA_R5_registration_state_t));
+    _registrationState[i].status = SARA_R5_REGISTRATION_INVALID;
+    _registrationState[i].Act = -1;
+  }
+  _registrationMaxAge = SARA_R5_REGISTRATION_MAX_AGE;
   _debugAtPort = nullptr;
   _debugPort = nullptr;
   _printDebug = false;
@@ -47,12 +73,80 @@ SARA_R5::SARA_R5(int powerPin, int resetPin, uint8_t maxInitTries)
   for (int i = 0; i < SARA_R5_NUM_SOCKETS; i++)
     _lastSocketProtocol[i] = 0; // Set to zero initially. Will be set to TCP/UDP by socketOpen etc.
   _autoTimeZoneForBegin = true;
+  _warmStartForBegin = false;
+  _bootTime = 0;
+  _warmStartKeepSockets = true;
   _bufferedPollReentrant = false;
   _pollReentrant = false;
-  _saraResponseBacklogLength = 0;
   _saraRXBuffer = nullptr;
-  _pruneBuffer = nullptr;
-  _saraResponseBacklog = nullptr;
+  _urcEventQueue = nullptr;
+  _urcEventHead = 0;
+  _urcEventTail = 0;
+  _urcLatest = nullptr;
+  _urcEventsDropped = 0;
+  _urcEventsCoalesced = 0;
+  _urcLineBuffer = nullptr;
+  _urcLineBufferLength = 0;
+  _urcTextBuffer = nullptr;
+  for (int i = 0; i < SARA_R5_URC_TEXT_SLOTS; i++)
+    _urcTextSlotFull[i] = false;
+  _rxTaskMode = false;
+  _commandLatency = nullptr;
+  _batch = nullptr;
+  _batchActive = false;
+  _batchSending = false;
+  _configShadow = nullptr;
+  _configShadowNext = 0;
+  _configShadowHits = 0;
+  _identity = nullptr;
+  _fileIndex = nullptr;
+  _signalHistory = nullptr;
+  _signalHistoryHead = 0;
+  _signalHistoryCount = 0;
+  for (int i = 0; i < SARA_R5_SIGNAL_NUM_FIELDS; i++)
+    _signalEwma[i] = 0.0;
+  _signalEwmaValid = 0;
+  _signalSampleBasePeriod = SARA_R5_SIGNAL_SAMPLE_PERIOD;
+  _signalSamplePeriod = SARA_R5_SIGNAL_SAMPLE_PERIOD;
+  _signalLastSample = 0;
+  _signalSampleAdaptive = true;
+  _operatorScan = nullptr;
+  _operatorScanCallback = nullptr;
+  _powerSaving.state = SARA_R5_POWER_STATE_UNKNOWN;
+  _powerSaving.lastChange = 0;
+  _powerSaving.statePending = false;
+  _powerSaving.requestedEDRX = -1;
+  _powerSaving.networkEDRX = -1;
+  _powerSaving.pagingTimeWindow = -1;
+  _powerSaving.lastWakeLatency = 0;
+  _powerSaving.minWakeLatency = 0;
+  _powerSaving.maxWakeLatency = 0;
+  _powerSaving.totalWakeLatency = 0;
+  _powerSaving.wakeCount = 0;
+  _powerSaving.queue = nullptr;
+  _powerSaving.queueLength = 0;
+  _powerSaving.queueAttempts = 0;
+  _powerSaving.queueDropped = 0;
+  _vIntPin = -1;
+  _powerStateCallback = nullptr;
+#ifdef SARA_R5_RX_TASK_ENABLED
+  _rxResponseRing = nullptr;
+  _rxResponseHead = 0;
+  _rxResponseTail = 0;
+  _rxResponseDropped = 0;
+  _rxResponseDroppedAtCommand = 0;
+#endif
+#ifdef SARA_R5_THREAD_SAFE_ENABLED
+  _transactionDepth = 0;
+  for (int i = 0; i < SARA_R5_NUM_PRIORITIES; i++)
+  {
+    _transactionNextTicket[i] = 0;
+    _transactionNowServing[i] = 0;
+  }
+#endif
+#ifdef SARA_R5_COROUTINES_ENABLED
+  _urcAwaiters = nullptr;
+#endif
 }
 
 SARA_R5::~SARA_R5(void) {
@@ -60,13 +154,77 @@ SARA_R5::~SARA_R5(void) {
     delete[] _saraRXBuffer;
     _saraRXBuffer = nullptr;
   }
-  if (nullptr != _pruneBuffer) {
-    delete[] _pruneBuffer;
-    _pruneBuffer = nullptr;
+  if (nullptr != _urcEventQueue) {
+    delete[] _urcEventQueue;
+    _urcEventQueue = nullptr;
+  }
+  if (nullptr != _urcLatest) {
+    delete[] _urcLatest;
+    _urcLatest = nullptr;
+  }
+  if (nullptr != _urcLineBuffer) {
+    delete[] _urcLineBuffer;
+    _urcLineBuffer = nullptr;
+  }
+  if (nullptr != _urcTextBuffer) {
+    delete[] _urcTextBuffer;
+    _urcTextBuffer = nullptr;
+  }
+#ifdef SARA_R5_RX_TASK_ENABLED
+  if (nullptr != _rxResponseRing) {
+    delete[] _rxResponseRing;
+    _rxResponseRing = nullptr;
+  }
+#endif
+  if (nullptr != _commandLatency) {
+    delete[] _commandLatency;
+    _commandLatency = nullptr;
+  }
+  if (nullptr != _batch) {
+    delete _batch;
+    _batch = nullptr;
+  }
+  if (nullptr != _configShadow) {
+    delete[] _configShadow;
+    _configShadow = nullptr;
+  }
+  if (nullptr != _identity) {
+    delete _identity;
+    _identity = nullptr;
+  }
+  if (nullptr != _fileIndex) {
+    delete _fileIndex;
+    _fileIndex = nullptr;
+  }
+  if (nullptr != _httpScheduler) {
+    delete _httpScheduler;
+    _httpScheduler = nullptr;
+  }
+  if (nullptr != _mqttPipeline) {
+    delete _mqttPipeline;
+    _mqttPipeline = nullptr;
+  }
+  if (nullptr != _mqttInbound) {
+    freeMQTTTopicNodes(_mqttInbound->root);
+    delete[] _mqttInbound->buffer;
+    delete _mqttInbound;
+    _mqttInbound = nullptr;
   }
-  if (nullptr != _saraResponseBacklog) {
-    delete[] _saraResponseBacklog;
-    _saraResponseBacklog = nullptr;
+  if (nullptr != _mqttsn) {
+    delete _mqttsn;
+    _mqttsn = nullptr;
+  }
+  if (nullptr != _signalHistory) {
+    delete[] _signalHistory;
+    _signalHistory = nullptr;
+  }
+  if (nullptr != _operatorScan) {
+    delete _operatorScan;
+    _operatorScan = nullptr;
+  }
+  if (nullptr != _powerSaving.queue) {
+    delete[] _powerSaving.queue;
+    _powerSaving.queue = nullptr;
   }
 }
 
@@ -85,29 +243,8 @@ bool SARA_R5::begin(SoftwareSerial &softSerial, unsigned long baud)
   }
   memset(_saraRXBuffer, 0, _RXBuffSize);
 
-  if (nullptr == _pruneBuffer)
-  {
-    _pruneBuffer = new char[_RXBuffSize];
-    if (nullptr == _pruneBuffer)
-    {
-      if (_printDebug == true)
-        _debugPort->println(F("begin: not enough memory for _pruneBuffer!"));
-      return false;
-    }
-  }
-  memset(_pruneBuffer, 0, _RXBuffSize);
-
-  if (nullptr == _saraResponseBacklog)
-  {
-    _saraResponseBacklog = new char[_RXBuffSize];
-    if (nullptr == _saraResponseBacklog)
-    {
-      if (_printDebug == true)
-        _debugPort->println(F("begin: not enough memory for _saraResponseBacklog!"));
-      return false;
-    }
-  }
-  memset(_saraResponseBacklog, 0, _RXBuffSize);
+  if (allocateURCQueue() == false)
+    return false;
 
   SARA_R5_error_t err;
 
@@ -136,29 +273,8 @@ bool SARA_R5::begin(HardwareSerial &hardSerial, unsigned long baud)
   }
   memset(_saraRXBuffer, 0, _RXBuffSize);
 
-  if (nullptr == _pruneBuffer)
-  {
-    _pruneBuffer = new char[_RXBuffSize];
-    if (nullptr == _pruneBuffer)
-    {
-      if (_printDebug == true)
-        _debugPort->println(F("begin: not enough memory for _pruneBuffer!"));
-      return false;
-    }
-  }
-  memset(_pruneBuffer, 0, _RXBuffSize);
-
-  if (nullptr == _saraResponseBacklog)
-  {
-    _saraResponseBacklog = new char[_RXBuffSize];
-    if (nullptr == _saraResponseBacklog)
-    {
-      if (_printDebug == true)
-        _debugPort->println(F("begin: not enough memory for _saraResponseBacklog!"));
-      return false;
-    }
-  }
-  memset(_saraResponseBacklog, 0, _RXBuffSize);
+  if (allocateURCQueue() == false)
+    return false;
 
   SARA_R5_error_t err;
 
@@ -192,8 +308,12 @@ void SARA_R5::enableAtDebugging(Print &debugPort)
 // See: https://github.com/sparkfun/SparkFun_LTE_Shield_Arduino_Library/pull/8
 // It does the same job as ::poll but also processed any 'old' data stored in the backlog first
 // It also has a built-in timeout - which ::poll does not
+// The backlog is now a queue of pre-parsed URC events. Any new serial data is added to the queue too
+// and then all queued events are dispatched to the callbacks
 bool SARA_R5::bufferedPoll(void)
 {
+  SARA_R5_LOCK_TRANSACTION(SARA_R5_PRIORITY_NORMAL); // Also serializes the consumer side of the URC event queue
+
   if (_bufferedPollReentrant == true) // Check for reentry (i.e. bufferedPoll has been called from inside a callback)
     return false;
 
@@ -203,29 +323,11 @@ bool SARA_R5::bufferedPoll(void)
   char c = 0;
   bool handled = false;
   unsigned long timeIn = millis();
-  char *event;
-  int backlogLen = _saraResponseBacklogLength;
-
-  memset(_saraRXBuffer, 0, _RXBuffSize); // Clear _saraRXBuffer
-
-  // Does the backlog contain any data? If it does, copy it into _saraRXBuffer and then clear the backlog
-  if (_saraResponseBacklogLength > 0)
-  {
-    //The backlog also logs reads from other tasks like transmitting.
-    if (_printDebug == true)
-    {
-      _debugPort->print(F("bufferedPoll: backlog found! backlogLen is "));
-      _debugPort->println(_saraResponseBacklogLength);
-    }
-    memcpy(_saraRXBuffer + avail, _saraResponseBacklog, _saraResponseBacklogLength);
-    avail += _saraResponseBacklogLength;
-    memset(_saraResponseBacklog, 0, _RXBuffSize); // Clear the backlog making sure it is NULL-terminated
-    _saraResponseBacklogLength = 0;
-  }
 
-  if ((hwAvailable() > 0) || (backlogLen > 0)) // If either new data is available, or backlog had data.
+  // In RX task mode, rxTask has already queued the URCs
+  if ((_rxTaskMode == false) && (hwAvailable() > 0)) // If new data is available
   {
-    //Check for incoming serial data. Copy it into the backlog
+    //Check for incoming serial data. Convert any URCs into events and add them to the queue
 
     // Important note:
     // On ESP32, Serial.available only provides an update every ~120 bytes during the reception of long messages:
@@ -238,998 +340,5158 @@ bool SARA_R5::bufferedPoll(void)
       if (hwAvailable() > 0) //hwAvailable can return -1 if the serial port is NULL
       {
         c = readChar();
-        // bufferedPoll is only interested in the URCs.
-        // The URCs are all readable.
-        // strtok does not like NULL characters.
-        // So we need to make sure no NULL characters are added to _saraRXBuffer
-        if (c == '\0')
-          c = '0'; // Convert any NULLs to ASCII Zeros
-        _saraRXBuffer[avail++] = c;
+        avail++;
+        if (bufferURCChar(c)) // bufferURCChar returns true when a complete URC has been queued
+        {
+          if (true == _printAtDebug) {
+            _debugAtPort->println(_urcLineBuffer); // The line is still in the buffer. Only the length has been reset
+          }
+        }
         timeIn = millis();
       } else {
         yield();
       }
     }
+  }
 
-    // _saraRXBuffer now contains the backlog (if any) and the new serial data (if any)
-
-    // A health warning about strtok:
-    // strtok will convert any delimiters it finds ("\r\n" in our case) into NULL characters.
-    // Also, be very careful that you do not use strtok within an strtok while loop.
-    // The next call of strtok(NULL, ...) in the outer loop will use the pointer saved from the inner loop!
-    // In our case, strtok is also used in pruneBacklog, which is called by waitForRespone or sendCommandWithResponse,
-    // which is called by the parse functions called by processURCEvent...
-    // The solution is to use strtok_r - the reentrant version of strtok
-
-    char *preservedEvent;
-    event = strtok_r(_saraRXBuffer, "\r\n", &preservedEvent); // Look for an 'event' (_saraRXBuffer contains something ending in \r\n)
-
-    if (event != nullptr)
-      if (_printDebug == true)
-        _debugPort->println(F("bufferedPoll: event(s) found! ===>"));
+#ifdef SARA_R5_RX_TASK_ENABLED
+  discardRxResponse(); // Track the operator scan and the power state, and free the response ring for the next command
+#endif
 
-    while (event != nullptr) // Keep going until all events have been processed
-    {
-      if (_printDebug == true)
-      {
-        _debugPort->print(F("bufferedPoll: start of event: "));
-        _debugPort->println(event);
-      }
+  // Now dispatch the queued events - including any which arrived while we were waiting for command responses
+  handled = dispatchURCEvents();
 
-      //Process the event
-      bool latestHandled = processURCEvent((const char *)event);
-      if (latestHandled) {
-        if ((true == _printAtDebug) && (nullptr != event)) {
-          _debugAtPort->print(event);
-        }
-        handled = true; // handled will be true if latestHandled has ever been true
-      }
-      if ((_saraResponseBacklogLength > 0) && ((avail + _saraResponseBacklogLength) < _RXBuffSize)) // Has any new data been added to the backlog?
-      {
-        if (_printDebug == true)
-        {
-          _debugPort->println(F("bufferedPoll: new backlog added!"));
-        }
-        memcpy(_saraRXBuffer + avail, _saraResponseBacklog, _saraResponseBacklogLength);
-        avail += _saraResponseBacklogLength;
-        memset(_saraResponseBacklog, 0, _RXBuffSize); //Clear out the backlog buffer again.
-        _saraResponseBacklogLength = 0;
-      }
+#ifdef SARA_R5_COROUTINES_ENABLED
+  expireURCAwaiters(); // Resume any coroutines whose URC has not arrived in time
+#endif
 
-      //Walk through any remaining events
-      event = strtok_r(nullptr, "\r\n", &preservedEvent);
+  if (isOperatorScanActive() && ((millis() - _operatorScan->start) > SARA_R5_3_MIN_TIMEOUT)) // AT+COPS=? takes up to 3 minutes
+  {
+    if (_printDebug == true)
+      _debugPort->println(F("bufferedPoll: operator scan timed out"));
+    _operatorScan->result = SARA_R5_ERROR_TIMEOUT;
+    _operatorScan->active = false;
+  }
 
-      if (_printDebug == true)
-        _debugPort->println(F("bufferedPoll: end of event")); //Just to denote end of processing event.
+  sampleSignalQuality(); // Read +CESQ if the signal sampler is enabled and a sample is due
 
-      if (event == nullptr)
-        if (_printDebug == true)
-          _debugPort->println(F("bufferedPoll: <=== end of event(s)!"));
-    }
+  updatePowerStateFromVInt();
+  if (_powerSaving.statePending == true)
+  {
+    _powerSaving.statePending = false;
+    if (_powerStateCallback != nullptr)
+      _powerStateCallback(_powerSaving.state);
   }
+  if ((_powerSaving.queueLength > 0) && (_powerSaving.state != SARA_R5_POWER_STATE_PSM))
+    flushPowerSavingQueue(); // Send the data queued by socketWriteWhenAwake
+
+  serviceHTTPQueue(); // Complete the HTTP requests whose results have arrived and start the queued ones
+  serviceMQTTPipeline(); // Complete the acknowledged MQTT messages and publish the queued ones
+  serviceMQTTInbound(); // Read and dispatch the unread MQTT messages
 
   _bufferedPollReentrant = false;
 
   return handled;
 } // /bufferedPoll
 
-// Parse incoming URC's - the associated parse functions pass the data to the user via the callbacks (if defined)
-bool SARA_R5::processURCEvent(const char *event)
+// Return true if this thread is inside bufferedPoll (i.e. a callback is running). Anything waiting for a URC
+// must give up: bufferedPoll would return immediately. Another thread's bufferedPoll is allowed to finish first
+bool SARA_R5::insideBufferedPoll(void)
 {
-  { // URC: +UUSORD (Read Socket Data)
-    int socket, length;
-    char *searchPtr = strstr(event, SARA_R5_READ_SOCKET_URC);
-    if (searchPtr != nullptr)
+  SARA_R5_LOCK_TRANSACTION(SARA_R5_PRIORITY_NORMAL);
+  return _bufferedPollReentrant;
+}
+
+// Allocate the URC event queue and buffers. Called by begin
+bool SARA_R5::allocateURCQueue(void)
+{
+  if (nullptr == _urcEventQueue)
+  {
+    _urcEventQueue = new SARA_R5_urc_event_t[SARA_R5_URC_EVENT_QUEUE_SIZE + 1]; // One entry is always left empty
+    if (nullptr == _urcEventQueue)
     {
-      searchPtr += strlen(SARA_R5_READ_SOCKET_URC); // Move searchPtr to first character - probably a space
-      while (*searchPtr == ' ') searchPtr++; // Skip spaces
-      int ret = sscanf(searchPtr, "%d,%d", &socket, &length);
-      if (ret == 2)
-      {
-        if (_printDebug == true)
-          _debugPort->println(F("processReadEvent: read socket data"));
-        // From the SARA_R5 AT Commands Manual:
-        // "For the UDP socket type the URC +UUSORD: <socket>,<length> notifies that a UDP packet has been received,
-        //  either when buffer is empty or after a UDP packet has been read and one or more packets are stored in the
-        //  buffer."
-        // So we need to check if this is a TCP socket or a UDP socket:
-        //  If UDP, we call parseSocketReadIndicationUDP.
-        //  Otherwise, we call parseSocketReadIndication.
-        if (_lastSocketProtocol[socket] == SARA_R5_UDP)
-        {
-          if (_printDebug == true)
-            _debugPort->println(F("processReadEvent: received +UUSORD but socket is UDP. Calling parseSocketReadIndicationUDP"));
-          parseSocketReadIndicationUDP(socket, length);
-        }
-        else
-          parseSocketReadIndication(socket, length);
-        return true;
-      }
+      if (_printDebug == true)
+        _debugPort->println(F("begin: not enough memory for _urcEventQueue!"));
+      return false;
     }
   }
-  { // URC: +UUSORF (Receive From command (UDP only))
-    int socket, length;
-    char *searchPtr = strstr(event, SARA_R5_READ_UDP_SOCKET_URC);
-    if (searchPtr != nullptr)
+  memset(_urcEventQueue, 0, (SARA_R5_URC_EVENT_QUEUE_SIZE + 1) * sizeof(SARA_R5_urc_event_t));
+  _urcEventHead = 0;
+  _urcEventTail = 0;
+
+  if (nullptr == _urcLatest)
+  {
+    _urcLatest = new SARA_R5_urc_latest_t[SARA_R5_URC_NUM_LATEST];
+    if (nullptr == _urcLatest)
     {
-      searchPtr += strlen(SARA_R5_READ_UDP_SOCKET_URC); // Move searchPtr to first character - probably a space
-      while (*searchPtr == ' ') searchPtr++; // skip spaces
-      int ret = sscanf(searchPtr, "%d,%d", &socket, &length);
-      if (ret == 2)
-      {
-        if (_printDebug == true)
-          _debugPort->println(F("processReadEvent: UDP receive"));
-        parseSocketReadIndicationUDP(socket, length);
-        return true;
-      }
+      if (_printDebug == true)
+        _debugPort->println(F("begin: not enough memory for _urcLatest!"));
+      return false;
     }
   }
-  { // URC: +UUSOLI (Set Listening Socket)
-    int socket = 0;
-    int listenSocket = 0;
-    unsigned int port = 0;
-    unsigned int listenPort = 0;
-    IPAddress remoteIP = {0,0,0,0};
-    IPAddress localIP = {0,0,0,0};
-    int remoteIPstore[4]  = {0,0,0,0};
-    int localIPstore[4] = {0,0,0,0};
+  for (int i = 0; i < SARA_R5_URC_NUM_LATEST; i++)
+  {
+    memset(&_urcLatest[i].event, 0, sizeof(SARA_R5_urc_event_t));
+    _urcLatest[i].sequence = 0;
+    _urcLatest[i].pending = false;
+  }
 
-    char *searchPtr = strstr(event, SARA_R5_LISTEN_SOCKET_URC);
-    if (searchPtr != nullptr)
+  if (nullptr == _urcLineBuffer)
+  {
+    _urcLineBuffer = new char[SARA_R5_URC_LINE_BUFFER_SIZE];
+    if (nullptr == _urcLineBuffer)
     {
-      searchPtr += strlen(SARA_R5_LISTEN_SOCKET_URC); // Move searchPtr to first character - probably a space
-      while (*searchPtr == ' ') searchPtr++; // skip spaces
-      int ret = sscanf(searchPtr,
-                      "%d,\"%d.%d.%d.%d\",%u,%d,\"%d.%d.%d.%d\",%u",
-                      &socket,
-                      &remoteIPstore[0], &remoteIPstore[1], &remoteIPstore[2], &remoteIPstore[3],
-                      &port, &listenSocket,
-                      &localIPstore[0], &localIPstore[1], &localIPstore[2], &localIPstore[3],
-                      &listenPort);
-      for (int i = 0; i <= 3; i++)
-      {
-        if (ret >= 5)
-          remoteIP[i] = (uint8_t)remoteIPstore[i];
-        if (ret >= 11)
-          localIP[i] = (uint8_t)localIPstore[i];
-      }
-      if (ret >= 5)
-      {
-        if (_printDebug == true)
-          _debugPort->println(F("processReadEvent: socket listen"));
-        parseSocketListenIndication(listenSocket, localIP, listenPort, socket, remoteIP, port);
-        return true;
-      }
+      if (_printDebug == true)
+        _debugPort->println(F("begin: not enough memory for _urcLineBuffer!"));
+      return false;
     }
   }
-  { // URC: +UUSOCL (Close Socket)
-    int socket;
-    char *searchPtr = strstr(event, SARA_R5_CLOSE_SOCKET_URC);
-    if (searchPtr != nullptr)
+  memset(_urcLineBuffer, 0, SARA_R5_URC_LINE_BUFFER_SIZE);
+  _urcLineBufferLength = 0;
+
+  if (nullptr == _urcTextBuffer)
+  {
+    _urcTextBuffer = new char[SARA_R5_URC_TEXT_SLOTS * SARA_R5_URC_TEXT_SLOT_SIZE];
+    if (nullptr == _urcTextBuffer)
     {
-      searchPtr += strlen(SARA_R5_CLOSE_SOCKET_URC); // Move searchPtr to first character - probably a space
-      while (*searchPtr == ' ') searchPtr++; // skip spaces
-      int ret = sscanf(searchPtr, "%d", &socket);
-      if (ret == 1)
-      {
-        if (_printDebug == true)
-          _debugPort->println(F("processReadEvent: socket close"));
-        if ((socket >= 0) && (socket <= 6))
-        {
-          if (_socketCloseCallback != nullptr)
-          {
-            _socketCloseCallback(socket);
-          }
-        }
-        return true;
-      }
+      if (_printDebug == true)
+        _debugPort->println(F("begin: not enough memory for _urcTextBuffer!"));
+      return false;
     }
   }
-  { // URC: +UULOC (Localization information - CellLocate and hybrid positioning)
-    ClockData clck;
-    PositionData gps;
-    SpeedData spd;
-    unsigned long uncertainty;
-    int scanNum;
-    int latH, lonH, alt;
-    unsigned int speedU, cogU;
-    char latL[10], lonL[10];
-    int dateStore[5];
+  memset(_urcTextBuffer, 0, SARA_R5_URC_TEXT_SLOTS * SARA_R5_URC_TEXT_SLOT_SIZE);
+  for (int i = 0; i < SARA_R5_URC_TEXT_SLOTS; i++)
+    _urcTextSlotFull[i] = false;
 
-    // Maybe we should also scan for +UUGIND and extract the activated gnss system?
+  return true;
+}
 
-    // This assumes the ULOC response type is "0" or "1" - as selected by gpsRequest detailed
-    char *searchPtr = strstr(event, SARA_R5_GNSS_REQUEST_LOCATION_URC);
-    if (searchPtr != nullptr)
-    {
-      searchPtr += strlen(SARA_R5_GNSS_REQUEST_LOCATION_URC); // Move searchPtr to first character - probably a space
-      while (*searchPtr == ' ') searchPtr++; // skip spaces
-      scanNum = sscanf(searchPtr,
-                        "%d/%d/%d,%d:%d:%d.%d,%d.%[^,],%d.%[^,],%d,%lu,%u,%u,%*s",
-                        &dateStore[0], &dateStore[1], &clck.date.year,
-                        &dateStore[2], &dateStore[3], &dateStore[4], &clck.time.ms,
-                        &latH, latL, &lonH, lonL, &alt, &uncertainty,
-                        &speedU, &cogU);
-      clck.date.day = dateStore[0];
-      clck.date.month = dateStore[1];
-      clck.time.hour = dateStore[2];
-      clck.time.minute = dateStore[3];
-      clck.time.second = dateStore[4];
+int SARA_R5::getURCEventsQueued(void)
+{
+  return (((int)_urcEventTail + SARA_R5_URC_EVENT_QUEUE_SIZE + 1) - (int)_urcEventHead) % (SARA_R5_URC_EVENT_QUEUE_SIZE + 1);
+}
 
-      if (scanNum >= 13)
-      {
-        // Found a Location string!
-        if (_printDebug == true)
-        {
-          _debugPort->println(F("processReadEvent: location"));
-        }
+// Add a character received from the module to the URC line buffer.
+// When a complete line has been received, check it for a URC and queue it as an event.
+// Returns true if a URC was queued.
+bool SARA_R5::bufferURCChar(char c)
+{
+  bool queued = false;
 
-        if (latH >= 0)
-          gps.lat = (float)latH + ((float)atol(latL) / pow(10, strlen(latL)));
-        else
-          gps.lat = (float)latH - ((float)atol(latL) / pow(10, strlen(latL)));
-        if (lonH >= 0)
-          gps.lon = (float)lonH + ((float)atol(lonL) / pow(10, strlen(lonL)));
-        else
-          gps.lon = (float)lonH - ((float)atol(lonL) / pow(10, strlen(lonL)));
-        gps.alt = (float)alt;
-        if (scanNum >= 15) // If detailed response, get speed data
-        {
-          spd.speed = (float)speedU;
-          spd.cog = (float)cogU;
-        }
+  if (nullptr == _urcLineBuffer) // Check begin has been called
+    return false;
 
-        // if (_printDebug == true)
-        // {
-        //   _debugPort->print(F("processReadEvent: location:  lat: "));
-        //   _debugPort->print(gps.lat, 7);
-        //   _debugPort->print(F(" lon: "));
-        //   _debugPort->print(gps.lon, 7);
-        //   _debugPort->print(F(" alt: "));
-        //   _debugPort->print(gps.alt, 2);
-        //   _debugPort->print(F(" speed: "));
-        //   _debugPort->print(spd.speed, 2);
-        //   _debugPort->print(F(" cog: "));
-        //   _debugPort->println(spd.cog, 2);
-        // }
+  if (_rxTaskMode == false) // In RX task mode this is the RX task. readChar tracks the characters on the application side
+    trackResponseChar(c);
 
-        if (_gpsRequestCallback != nullptr)
-        {
-          _gpsRequestCallback(clck, gps, spd, uncertainty);
-        }
-
-        return true;
-      }
+  if ((c == '\r') || (c == '\n'))
+  {
+    if (_urcLineBufferLength > 0)
+    {
+      _urcLineBuffer[_urcLineBufferLength] = '\0';
+      queued = queueURCLine(_urcLineBuffer);
+      _urcLineBufferLength = 0;
     }
   }
-  { // URC: +UUSIMSTAT (SIM Status)
-    SARA_R5_sim_states_t state;
-    int scanNum;
-    int stateStore;
+  else if (_urcLineBufferLength < (SARA_R5_URC_LINE_BUFFER_SIZE - 1)) // Leave room for the NULL. Discard the rest of long lines
+  {
+    // The URCs are all readable. strstr does not like NULL characters.
+    // So we need to make sure no NULL characters are added to _urcLineBuffer
+    if (c == '\0')
+      c = '0'; // Convert any NULLs to ASCII Zeros
+    _urcLineBuffer[_urcLineBufferLength++] = c;
+  }
 
-    char *searchPtr = strstr(event, SARA_R5_SIM_STATE_URC);
-    if (searchPtr != nullptr)
-    {
-      searchPtr += strlen(SARA_R5_SIM_STATE_URC); // Move searchPtr to first character - probably a space
-      while (*searchPtr == ' ') searchPtr++; // skip spaces
-      scanNum = sscanf(searchPtr, "%d", &stateStore);
+  return queued;
+}
 
-      if (scanNum == 1)
-      {
-        if (_printDebug == true)
-          _debugPort->println(F("processReadEvent: SIM status"));
+// Track the state which depends on every character received: the response to AT+COPS=? and the PSM wake-up.
+// Called by bufferURCChar - or by readChar in RX task mode, so the state only ever changes on the application side
+void SARA_R5::trackResponseChar(char c)
+{
+  if ((nullptr != _operatorScan) && (_operatorScan->active == true)) // Is the response to AT+COPS=? arriving?
+    operatorScanChar(c);
 
-        state = (SARA_R5_sim_states_t)stateStore;
+  if (_powerSaving.state == SARA_R5_POWER_STATE_PSM) // The module does not talk in its sleep
+    setPowerState(SARA_R5_POWER_STATE_AWAKE);
+}
 
-        if (_simStateReportCallback != nullptr)
-        {
-          _simStateReportCallback(state);
-        }
+// Check a line of text for a URC. If it contains one, convert it into an event and add it to the queue.
+// Non-actionable URCs and command responses are discarded.
+bool SARA_R5::queueURCLine(const char *line)
+{
+  SARA_R5_urc_event_t urc;
 
-        return true;
-      }
+  if (parseURCEvent(line, &urc))
+    return queueURCEvent(&urc);
+
+  // +UULOC and +UUPING contain strings and floats. We queue the text and parse it when the event is dispatched
+  memset(&urc, 0, sizeof(urc));
+  if (strstr(line, SARA_R5_GNSS_REQUEST_LOCATION_URC) != nullptr)
+    urc.type = SARA_R5_URC_EVENT_GNSS_LOCATION;
+  else if (strstr(line, SARA_R5_PING_COMMAND_URC) != nullptr)
+    urc.type = SARA_R5_URC_EVENT_PING;
+  else
+    return false;
+
+  int slot = 0;
+  while ((slot < SARA_R5_URC_TEXT_SLOTS) && (_urcTextSlotFull[slot] == true))
+    slot++;
+  if (slot == SARA_R5_URC_TEXT_SLOTS)
+  {
+    _urcEventsDropped++;
+    if (_printDebug == true)
+    {
+      _debugPort->print(F("queueURCLine: text slots are full! Dropped: "));
+      _debugPort->println(line);
     }
+    return false;
   }
-  { // URC: +UUPSDA (Packet Switched Data Action)
-    int result;
-    IPAddress remoteIP = {0, 0, 0, 0};
-    int scanNum;
-    int remoteIPstore[4];
 
-    char *searchPtr = strstr(event, SARA_R5_MESSAGE_PDP_ACTION_URC);
-    if (searchPtr != nullptr)
-    {
-      searchPtr += strlen(SARA_R5_MESSAGE_PDP_ACTION_URC); // Move searchPtr to first character - probably a space
-      while (*searchPtr == ' ') searchPtr++; // skip spaces
-      scanNum = sscanf(searchPtr, "%d,\"%d.%d.%d.%d\"",
-                        &result, &remoteIPstore[0], &remoteIPstore[1], &remoteIPstore[2], &remoteIPstore[3]);
+  char *text = &_urcTextBuffer[slot * SARA_R5_URC_TEXT_SLOT_SIZE];
+  strncpy(text, line, SARA_R5_URC_TEXT_SLOT_SIZE - 1);
+  text[SARA_R5_URC_TEXT_SLOT_SIZE - 1] = '\0';
 
-      if (scanNum == 5)
-      {
-        if (_printDebug == true)
-          _debugPort->println(F("processReadEvent: packet switched data action"));
+  // Mark the slot as full before queueing the event. The consumer frees it once the event has been dispatched
+  _urcTextSlotFull[slot] = true;
+  urc.param[0] = slot;
+  if (queueURCEvent(&urc) == false)
+  {
+    _urcTextSlotFull[slot] = false;
+    return false;
+  }
+  return true;
+}
 
-        for (int i = 0; i <= 3; i++)
-        {
-          remoteIP[i] = (uint8_t)remoteIPstore[i];
-        }
+// Return the index into _urcLatest for events which are coalesced, or -1 for events which are not
+int SARA_R5::urcLatestIndex(const SARA_R5_urc_event_t *urc)
+{
+  switch (urc->type)
+  {
+  case SARA_R5_URC_EVENT_SOCKET_READ:
+    if ((urc->param[0] >= 0) && (urc->param[0] < SARA_R5_NUM_SOCKETS))
+      return urc->param[0];
+    break;
+  case SARA_R5_URC_EVENT_SIM_STATE:
+    return SARA_R5_NUM_SOCKETS;
+  case SARA_R5_URC_EVENT_REGISTRATION:
+    return SARA_R5_NUM_SOCKETS + 1;
+  case SARA_R5_URC_EVENT_EPS_REGISTRATION:
+    return SARA_R5_NUM_SOCKETS + 2;
+  default:
+    break;
+  }
+  return -1;
+}
 
-        if (_psdActionRequestCallback != nullptr)
-        {
-          _psdActionRequestCallback(result, remoteIP);
-        }
+// Add an event to the URC event queue. This is the producer side of the queue.
+// The data-ready and status URCs are coalesced: their latest values are held in _urcLatest. If an event of the same type
+// (and, for +UUSORD, the same socket) is already waiting, only the latest values are updated. So a flood of +CEREG's
+// only ever occupies one slot in the queue.
+// If the queue is full, the new event is dropped and counted. Queued events are never evicted.
+bool SARA_R5::queueURCEvent(const SARA_R5_urc_event_t *urc)
+{
+  if ((nullptr == _urcEventQueue) || (nullptr == _urcLatest)) // Check begin has been called
+    return false;
 
-        return true;
-      }
+  int latest = urcLatestIndex(urc);
+  if (latest >= 0)
+  {
+    _urcLatest[latest].sequence = _urcLatest[latest].sequence + 1; // Odd: update in progress
+    SARA_R5_SPSC_FENCE_RELEASE(); // The odd sequence is visible before any of the new values
+    _urcLatest[latest].event = *urc;
+    SARA_R5_SPSC_FENCE_RELEASE(); // The new values are visible before the even sequence
+    _urcLatest[latest].sequence = _urcLatest[latest].sequence + 1; // Even: update complete
+    if (_urcLatest[latest].pending == true) // Is an event for these values already waiting in the queue?
+    {
+      _urcEventsCoalesced++;
+      return true;
     }
+    _urcLatest[latest].pending = true;
   }
-  { // URC: +UUHTTPCR (HTTP Command Result)
-    int profile, command, result;
-    int scanNum;
 
-    char *searchPtr = strstr(event, SARA_R5_HTTP_COMMAND_URC);
-    if (searchPtr != nullptr)
+  uint16_t tail = _urcEventTail;
+  uint16_t next = (tail + 1) % (SARA_R5_URC_EVENT_QUEUE_SIZE + 1);
+  if (next == _urcEventHead) // Is the queue full?
+  {
+    if (latest >= 0)
+      _urcLatest[latest].pending = false;
+    _urcEventsDropped++;
+    if (_printDebug == true)
     {
-      searchPtr += strlen(SARA_R5_HTTP_COMMAND_URC); // Move searchPtr to first character - probably a space
-      while (*searchPtr == ' ') searchPtr++; // skip spaces
-      scanNum = sscanf(searchPtr, "%d,%d,%d", &profile, &command, &result);
-
-      if (scanNum == 3)
-      {
-        if (_printDebug == true)
-          _debugPort->println(F("processReadEvent: HTTP command result"));
-
-        if ((profile >= 0) && (profile < SARA_R5_NUM_HTTP_PROFILES))
-        {
-          if (_httpCommandRequestCallback != nullptr)
-          {
-            _httpCommandRequestCallback(profile, command, result);
-          }
-        }
-
-        return true;
-      }
+      _debugPort->print(F("queueURCEvent: queue is full! Dropped event type "));
+      _debugPort->println((int)urc->type);
     }
+    return false;
   }
-  { // URC: +UUMQTTC (MQTT Command Result)
-    int command, result;
-    int scanNum;
-    int qos = -1;
-    String topic;
 
-    char *searchPtr = strstr(event, SARA_R5_MQTT_COMMAND_URC);
-    if (searchPtr != nullptr)
-    {
-      searchPtr += strlen(SARA_R5_MQTT_COMMAND_URC); // Move searchPtr to first character - probably a space
-      while (*searchPtr == ' ')
-      {
-        searchPtr++; // skip spaces
-      }
+  _urcEventQueue[tail] = *urc;
+  _urcEventTail = next; // Publish the event
+  return true;
+}
 
-      scanNum = sscanf(searchPtr, "%d,%d", &command, &result);
-      if ((scanNum == 2) && (command == SARA_R5_MQTT_COMMAND_SUBSCRIBE))
-      {
-        char topicC[100] = "";
-        scanNum = sscanf(searchPtr, "%*d,%*d,%d,\"%[^\"]\"", &qos, topicC);
-        topic = topicC;
-      }
-      if ((scanNum == 2) || (scanNum == 4))
-      {
-        if (_printDebug == true)
-        {
-          _debugPort->println(F("processReadEvent: MQTT command result"));
-        }
+// Dispatch all queued URC events to the callbacks - oldest first. This is the consumer side of the queue.
+// The callbacks may send commands which queue more events. Those are dispatched too.
+bool SARA_R5::dispatchURCEvents(void)
+{
+  bool handled = false;
 
-        if (_mqttCommandRequestCallback != nullptr)
-        {
-          _mqttCommandRequestCallback(command, result);
-        }
+  if ((nullptr == _urcEventQueue) || (nullptr == _urcLatest) || (_urcEventHead == _urcEventTail))
+    return false;
 
-        return true;
-      }
-    }
+  if (_printDebug == true)
+  {
+    _debugPort->print(F("dispatchURCEvents: events queued: "));
+    _debugPort->println(getURCEventsQueued());
   }
-  { // URC: +UUFTPCR (FTP Command Result)
-    int ftpCmd;
-    int ftpResult;
-    int scanNum;
-    char *searchPtr = strstr(event, SARA_R5_FTP_COMMAND_URC);
-    if (searchPtr != nullptr)
+
+  while (_urcEventHead != _urcEventTail)
+  {
+    uint16_t head = _urcEventHead;
+    SARA_R5_urc_event_t urc = _urcEventQueue[head]; // Take a copy. The producer can reuse the entry once head has moved on
+    _urcEventHead = (head + 1) % (SARA_R5_URC_EVENT_QUEUE_SIZE + 1);
+
+    int latest = urcLatestIndex(&urc);
+    if (latest >= 0)
     {
-      searchPtr += strlen(SARA_R5_FTP_COMMAND_URC); // Move searchPtr to first character - probably a space
-      while (*searchPtr == ' ')
+      // Clear pending first. If the producer updates the values after this, it will queue a new event
+      _urcLatest[latest].pending = false;
+      uint16_t sequence;
+      do
       {
-        searchPtr++; // skip spaces
-      }
+        sequence = _urcLatest[latest].sequence;
+        SARA_R5_SPSC_FENCE_ACQUIRE();
+        urc = _urcLatest[latest].event;
+        SARA_R5_SPSC_FENCE_ACQUIRE(); // Read the values before checking the sequence again
+      } while (((sequence & 1) == 1) || (sequence != _urcLatest[latest].sequence));
+    }
+
+    if (dispatchURCEvent(&urc))
+      handled = true; // handled will be true if any event has been handled
+#ifdef SARA_R5_COROUTINES_ENABLED
+    if (resumeURCAwaiters(&urc)) // Resume any coroutines which are waiting for this event - after the callbacks
+      handled = true;
+#endif
 
-      scanNum = sscanf(searchPtr, "%d,%d", &ftpCmd, &ftpResult);
-      if (scanNum == 2 && _ftpCommandRequestCallback != nullptr)
-      {
-        _ftpCommandRequestCallback(ftpCmd, ftpResult);
-        return true;
-      }
-    }
+    if ((urc.type == SARA_R5_URC_EVENT_GNSS_LOCATION) || (urc.type == SARA_R5_URC_EVENT_PING))
+      _urcTextSlotFull[urc.param[0]] = false; // Free the text slot
   }
-  { // URC: +UUPING (Ping Result)
-    int retry = 0;
-    int p_size = 0;
-    int ttl = 0;
-    String remote_host = "";
-    IPAddress remoteIP = {0, 0, 0, 0};
-    long rtt = 0;
-    int scanNum;
 
-    // Try to extract the UUPING retries and payload size
-    char *searchPtr = strstr(event, SARA_R5_PING_COMMAND_URC);
-    if (searchPtr != nullptr)
-    {
-      searchPtr += strlen(SARA_R5_PING_COMMAND_URC); // Move searchPtr to first character - probably a space
-      while (*searchPtr == ' ') searchPtr++; // skip spaces
-      scanNum = sscanf(searchPtr, "%d,%d,", &retry, &p_size);
+  return handled;
+}
 
-      if (scanNum == 2)
+#ifdef SARA_R5_RX_TASK_ENABLED
+// Enable or disable RX task mode. See the notes in the header file
+SARA_R5_error_t SARA_R5::setRxTaskMode(bool enable)
+{
+  if (enable == true)
+  {
+    if (nullptr == _rxResponseRing)
+    {
+      _rxResponseRing = new char[_RXBuffSize];
+      if (nullptr == _rxResponseRing)
       {
         if (_printDebug == true)
-        {
-          _debugPort->println(F("processReadEvent: ping"));
-        }
-
-        searchPtr = strchr(++searchPtr, '\"'); // Search to the first quote
-
-        // Extract the remote host name, stop at the next quote
-        while ((*(++searchPtr) != '\"') && (*searchPtr != '\0'))
-        {
-          remote_host.concat(*(searchPtr));
-        }
-
-        if (*searchPtr != '\0') // Make sure we found a quote
-        {
-          int remoteIPstore[4];
-          scanNum = sscanf(searchPtr, "\",\"%d.%d.%d.%d\",%d,%ld",
-                            &remoteIPstore[0], &remoteIPstore[1], &remoteIPstore[2], &remoteIPstore[3], &ttl, &rtt);
-          for (int i = 0; i <= 3; i++)
-          {
-            remoteIP[i] = (uint8_t)remoteIPstore[i];
-          }
-
-          if (scanNum == 6) // Make sure we extracted enough data
-          {
-            if (_pingRequestCallback != nullptr)
-            {
-              _pingRequestCallback(retry, p_size, remote_host, remoteIP, ttl, rtt);
-            }
-          }
-        }
-        return true;
+          _debugPort->println(F("setRxTaskMode: not enough memory for _rxResponseRing!"));
+        return SARA_R5_ERROR_OUT_OF_MEMORY;
       }
     }
+    _rxResponseHead = 0;
+    _rxResponseTail = 0;
   }
-  { // URC: +CREG
-    int status = 0;
-    unsigned int lac = 0, ci = 0, Act = 0;
-    char *searchPtr = strstr(event, SARA_R5_REGISTRATION_STATUS_URC);
-    if (searchPtr != nullptr)
-    {
-      searchPtr += strlen(SARA_R5_REGISTRATION_STATUS_URC); // Move searchPtr to first character - probably a space
-      while (*searchPtr == ' ') searchPtr++; // skip spaces
-      int scanNum = sscanf(searchPtr, "%d,\"%4x\",\"%4x\",%d", &status, &lac, &ci, &Act);
-      if (scanNum == 4)
-      {
-        if (_printDebug == true)
-          _debugPort->println(F("processReadEvent: CREG"));
+  _rxTaskMode = enable;
+  return SARA_R5_ERROR_SUCCESS;
+}
 
-        if (_registrationCallback != nullptr)
-        {
-          _registrationCallback((SARA_R5_registration_status_t)status, lac, ci, Act);
-        }
+// The body of the RX task. Call this repeatedly from a dedicated task or thread.
+// It reads everything the UART has received. Any URCs are queued as events (this is the producer side of the queue).
+// All characters are also added to the response ring for the command which is waiting for a response.
+int SARA_R5::rxTask(void)
+{
+  int count = 0;
 
-        return true;
-      }
+  if (_rxTaskMode == false)
+    return 0;
+
+  while (true)
+  {
+    int c = -1;
+    if (_hardSerial != nullptr)
+    {
+      if (_hardSerial->available() > 0)
+        c = _hardSerial->read();
     }
-  }
-  { // URC: +CEREG
-    int status = 0;
-    unsigned int tac = 0, ci = 0, Act = 0;
-    char *searchPtr = strstr(event, SARA_R5_EPSREGISTRATION_STATUS_URC);
-    if (searchPtr != nullptr)
+#ifdef SARA_R5_SOFTWARE_SERIAL_ENABLED
+    else if (_softSerial != nullptr)
     {
-      searchPtr += strlen(SARA_R5_EPSREGISTRATION_STATUS_URC); // Move searchPtr to first character - probably a space
-      while (*searchPtr == ' ') searchPtr++; // skip spaces
-      int scanNum = sscanf(searchPtr, "%d,\"%4x\",\"%4x\",%d", &status, &tac, &ci, &Act);
-      if (scanNum == 4)
-      {
-        if (_printDebug == true)
-          _debugPort->println(F("processReadEvent: CEREG"));
+      if (_softSerial->available() > 0)
+        c = _softSerial->read();
+    }
+#endif
+    if (c < 0)
+      break;
 
-        if (_epsRegistrationCallback != nullptr)
-        {
-          _epsRegistrationCallback((SARA_R5_registration_status_t)status, tac, ci, Act);
-        }
+    count++;
+    bufferURCChar((char)c);
 
-        return true;
-      }
+    uint16_t tail = _rxResponseTail;
+    uint16_t next = (tail + 1) % _RXBuffSize;
+    if (next == _rxResponseHead) // Is the response ring full?
+      _rxResponseDropped++;
+    else
+    {
+      _rxResponseRing[tail] = (char)c;
+      _rxResponseTail = next; // Publish the character
     }
   }
-  // NOTE: When adding new URC messages, remember to update pruneBacklog too!
 
-  return false;
+  return count;
 }
 
-// This is the original poll function.
-// It is 'blocking' - it does not return when serial data is available until it receives a `\n`.
-// ::bufferedPoll is the new improved version. It processes any data in the backlog and includes a timeout.
-bool SARA_R5::poll(void)
+// Discard the characters in the response ring which no command has read - the URCs which arrived while idle.
+// readChar tracks them first. Called by bufferedPoll and poll: they hold the transaction lock, so no command is waiting
+void SARA_R5::discardRxResponse(void)
 {
-  if (_pollReentrant == true) // Check for reentry (i.e. poll has been called from inside a callback)
-    return false;
-
-  _pollReentrant = true;
+  if (_rxTaskMode == false)
+    return;
+  int avail = hwAvailable();
+  while (avail-- > 0) // Only what has arrived so far. rxTask may keep adding more
+    readChar();
+}
+#endif
 
-  int avail = 0;
-  char c = 0;
-  bool handled = false;
+// Return true if rxTask has dropped characters since the last command was sent: its response is incomplete
+bool SARA_R5::rxResponseLost(void)
+{
+#ifdef SARA_R5_RX_TASK_ENABLED
+  return (_rxTaskMode == true) && (_rxResponseDropped != _rxResponseDroppedAtCommand);
+#else
+  return false;
+#endif
+}
 
-  memset(_saraRXBuffer, 0, _RXBuffSize); // Clear _saraRXBuffer
+#ifdef SARA_R5_THREAD_SAFE_ENABLED
+// Acquire the transaction lock. Blocks until every earlier caller of the same priority - and every caller of a
+// higher priority - has been served. If this thread already holds the lock, it is simply taken again
+void SARA_R5::lockTransaction(SARA_R5_priority_t priority)
+{
+  if ((priority < SARA_R5_PRIORITY_LOW) || (priority >= SARA_R5_NUM_PRIORITIES))
+    priority = SARA_R5_PRIORITY_NORMAL;
 
-  if (hwAvailable() > 0) //hwAvailable can return -1 if the serial port is NULL
-  {
-    while (c != '\n') // Copy characters into _saraRXBuffer. Stop at the first new line
-    {
-      if (hwAvailable() > 0) //hwAvailable can return -1 if the serial port is NULL
-      {
-        c = readChar();
-        _saraRXBuffer[avail++] = c;
-      } else {
-        yield();
-      }
-    }
+  std::unique_lock<std::mutex> lock(_transactionMutex);
 
-    // Now search for all supported URC's
-    handled = processURCEvent(_saraRXBuffer);
-    if (handled && (true == _printAtDebug)) {
-      _debugAtPort->write(_saraRXBuffer, avail);
-    }
-    if ((handled == false) && (strlen(_saraRXBuffer) > 2))
-    {
-      if (_printDebug == true)
-      {
-        _debugPort->print(F("poll: "));
-        _debugPort->println(_saraRXBuffer);
-      }
-    }
-    else
-    {
-    }
+  if (_transactionOwner == std::this_thread::get_id()) // Recursive call
+  {
+    _transactionDepth++;
+    return;
   }
 
-  _pollReentrant = false;
-
-  return handled;
-}
-
-void SARA_R5::setSocketListenCallback(void (*socketListenCallback)(int, IPAddress, unsigned int, int, IPAddress, unsigned int))
-{
-  _socketListenCallback = socketListenCallback;
-}
-
-void SARA_R5::setSocketReadCallback(void (*socketReadCallback)(int, String))
-{
-  _socketReadCallback = socketReadCallback;
-}
+  uint32_t ticket = _transactionNextTicket[priority]++;
 
-void SARA_R5::setSocketReadCallbackPlus(void (*socketReadCallbackPlus)(int, const char *, int, IPAddress, int)) // socket, data, length, remoteAddress, remotePort
-{
-  _socketReadCallbackPlus = socketReadCallbackPlus;
-}
+  _transactionCondition.wait(lock, [this, priority, ticket]() -> bool
+  {
+    if ((_transactionDepth > 0) || (_transactionNowServing[priority] != ticket))
+      return false;
+    for (int p = priority + 1; p < SARA_R5_NUM_PRIORITIES; p++)
+    {
+      if (_transactionNextTicket[p] != _transactionNowServing[p]) // Is a higher priority caller waiting?
+        return false;
+    }
+    return true;
+  });
 
-void SARA_R5::setSocketCloseCallback(void (*socketCloseCallback)(int))
-{
-  _socketCloseCallback = socketCloseCallback;
+  _transactionNowServing[priority]++;
+  _transactionOwner = std::this_thread::get_id();
+  _transactionDepth = 1;
 }
 
-void SARA_R5::setGpsReadCallback(void (*gpsRequestCallback)(ClockData time,
-                                                            PositionData gps, SpeedData spd, unsigned long uncertainty))
+void SARA_R5::unlockTransaction(void)
 {
-  _gpsRequestCallback = gpsRequestCallback;
-}
+  std::unique_lock<std::mutex> lock(_transactionMutex);
 
-void SARA_R5::setSIMstateReportCallback(void (*simStateReportCallback)(SARA_R5_sim_states_t state))
-{
-  _simStateReportCallback = simStateReportCallback;
-}
+  if ((_transactionDepth == 0) || (_transactionOwner != std::this_thread::get_id()))
+    return; // Not held by this thread
 
-void SARA_R5::setPSDActionCallback(void (*psdActionRequestCallback)(int result, IPAddress ip))
-{
-  _psdActionRequestCallback = psdActionRequestCallback;
+  _transactionDepth--;
+  if (_transactionDepth == 0)
+  {
+    _transactionOwner = std::thread::id();
+    lock.unlock();
+    _transactionCondition.notify_all(); // Let the waiting callers decide who goes next
+  }
 }
+#endif
 
-void SARA_R5::setPingCallback(void (*pingRequestCallback)(int retry, int p_size, String remote_hostname, IPAddress ip, int ttl, long rtt))
+#ifdef SARA_R5_COROUTINES_ENABLED
+SARA_R5_urc_awaiter::SARA_R5_urc_awaiter(SARA_R5 *sara, SARA_R5_urc_event_type_t type, int key, unsigned long timeout, SARA_R5_error_t err)
 {
-  _pingRequestCallback = pingRequestCallback;
+  _sara = sara;
+  _type = type;
+  _key = key;
+  _timeout = timeout;
+  _start = millis();
+  memset(&_result, 0, sizeof(_result));
+  _result.error = err;
+  _handle = nullptr;
+  _ready = false;
+  _next = nullptr;
 }
 
-void SARA_R5::setHTTPCommandCallback(void (*httpCommandRequestCallback)(int profile, int command, int result))
+// If the coroutine is destroyed while it is suspended, the awaiter is still in the list. Remove it
+SARA_R5_urc_awaiter::~SARA_R5_urc_awaiter()
 {
-  _httpCommandRequestCallback = httpCommandRequestCallback;
+  if (_handle == nullptr) // Never suspended
+    return;
+#ifdef SARA_R5_THREAD_SAFE_ENABLED
+  SARA_R5_Transaction transaction(*_sara, SARA_R5_PRIORITY_NORMAL);
+#endif
+  SARA_R5_urc_awaiter **link = &_sara->_urcAwaiters;
+  while (*link != nullptr)
+  {
+    if (*link == this)
+    {
+      *link = _next;
+      break;
+    }
+    link = &(*link)->_next;
+  }
 }
 
-void SARA_R5::setMQTTCommandCallback(void (*mqttCommandRequestCallback)(int command, int result))
+// Add this awaiter to the list. It is resumed by resumeURCAwaiters or expireURCAwaiters
+void SARA_R5_urc_awaiter::await_suspend(std::coroutine_handle<> handle)
 {
-  _mqttCommandRequestCallback = mqttCommandRequestCallback;
+#ifdef SARA_R5_THREAD_SAFE_ENABLED
+  SARA_R5_Transaction transaction(*_sara, SARA_R5_PRIORITY_NORMAL); // bufferedPoll may be resuming the list on another thread
+#endif
+  _handle = handle;
+  _ready = false;
+  _start = millis(); // Start the timeout from when the coroutine is suspended
+  _next = _sara->_urcAwaiters;
+  _sara->_urcAwaiters = this;
 }
 
-void SARA_R5::setFTPCommandCallback(void (*ftpCommandRequestCallback)(int command, int result))
+bool SARA_R5_urc_awaiter::matches(const SARA_R5_urc_event_t *urc)
 {
-    _ftpCommandRequestCallback = ftpCommandRequestCallback;
+  bool typeMatches = (urc->type == _type);
+  if ((_type == SARA_R5_URC_EVENT_SOCKET_READ) && (urc->type == SARA_R5_URC_EVENT_SOCKET_READ_UDP)) // +UUSORD or +UUSORF
+    typeMatches = true;
+  return (typeMatches && ((_key < 0) || (urc->param[0] == _key)));
 }
 
-SARA_R5_error_t SARA_R5::setRegistrationCallback(void (*registrationCallback)(SARA_R5_registration_status_t status, unsigned int lac, unsigned int ci, int Act))
+SARA_R5_urc_awaiter SARA_R5::awaitURC(SARA_R5_urc_event_type_t type, int key, unsigned long timeout)
 {
-  _registrationCallback = registrationCallback;
-
-  char *command = sara_r5_calloc_char(strlen(SARA_R5_REGISTRATION_STATUS) + 3);
-  if (command == nullptr)
-    return SARA_R5_ERROR_OUT_OF_MEMORY;
-  sprintf(command, "%s=%d", SARA_R5_REGISTRATION_STATUS, 2/*enable URC with location*/);
-  SARA_R5_error_t err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR,
-                                nullptr, SARA_R5_STANDARD_RESPONSE_TIMEOUT);
-  free(command);
-  return err;
+  return SARA_R5_urc_awaiter(this, type, key, timeout);
 }
 
-SARA_R5_error_t SARA_R5::setEpsRegistrationCallback(void (*registrationCallback)(SARA_R5_registration_status_t status, unsigned int tac, unsigned int ci, int Act))
+SARA_R5_urc_awaiter SARA_R5::sendHTTPGETAsync(int profile, String path, String responseFilename, unsigned long timeout)
 {
-  _epsRegistrationCallback = registrationCallback;
-
-  char *command = sara_r5_calloc_char(strlen(SARA_R5_EPSREGISTRATION_STATUS) + 3);
-  if (command == nullptr)
-    return SARA_R5_ERROR_OUT_OF_MEMORY;
-  sprintf(command, "%s=%d", SARA_R5_EPSREGISTRATION_STATUS, 2/*enable URC with location*/);
-  SARA_R5_error_t err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR,
-                                nullptr, SARA_R5_STANDARD_RESPONSE_TIMEOUT);
-  free(command);
-  return err;
+  SARA_R5_error_t err = sendHTTPGET(profile, path, responseFilename);
+  return SARA_R5_urc_awaiter(this, SARA_R5_URC_EVENT_HTTP_COMMAND, profile, timeout, err);
 }
 
-size_t SARA_R5::write(uint8_t c)
+SARA_R5_urc_awaiter SARA_R5::sendHTTPPOSTdataAsync(int profile, String path, String responseFilename, String data,
+                                                   SARA_R5_http_content_types_t httpContentType, unsigned long timeout)
 {
-  return hwWrite(c);
+  SARA_R5_error_t err = sendHTTPPOSTdata(profile, path, responseFilename, data, httpContentType);
+  return SARA_R5_urc_awaiter(this, SARA_R5_URC_EVENT_HTTP_COMMAND, profile, timeout, err);
 }
 
-size_t SARA_R5::write(const char *str)
+SARA_R5_urc_awaiter SARA_R5::connectMQTTAsync(unsigned long timeout)
 {
-  return hwPrint(str);
+  SARA_R5_error_t err = connectMQTT();
+  return SARA_R5_urc_awaiter(this, SARA_R5_URC_EVENT_MQTT_COMMAND, SARA_R5_MQTT_COMMAND_LOGIN, timeout, err);
 }
 
-size_t SARA_R5::write(const char *buffer, size_t size)
+SARA_R5_urc_awaiter SARA_R5::ftpGetFileAsync(const String& filename, unsigned long timeout)
 {
-  return hwWriteData(buffer, size);
+  SARA_R5_error_t err = ftpGetFile(filename);
+  return SARA_R5_urc_awaiter(this, SARA_R5_URC_EVENT_FTP_COMMAND, SARA_R5_FTP_COMMAND_GET_FILE, timeout, err);
 }
 
-SARA_R5_error_t SARA_R5::at(void)
+SARA_R5_urc_awaiter SARA_R5::performPDPactionAsync(int profile, SARA_R5_pdp_actions_t action, unsigned long timeout)
 {
-  SARA_R5_error_t err;
-
-  err = sendCommandWithResponse(nullptr, SARA_R5_RESPONSE_OK, nullptr,
-                                SARA_R5_STANDARD_RESPONSE_TIMEOUT);
-
-  return err;
+  SARA_R5_error_t err = performPDPaction(profile, action);
+  return SARA_R5_urc_awaiter(this, SARA_R5_URC_EVENT_PDP_ACTION, -1, timeout, err); // +UUPSDA does not include the profile
 }
 
-SARA_R5_error_t SARA_R5::enableEcho(bool enable)
+SARA_R5_urc_awaiter SARA_R5::socketReadAvailableAsync(int socket, unsigned long timeout)
 {
-  SARA_R5_error_t err;
-  char *command;
-
-  command = sara_r5_calloc_char(strlen(SARA_R5_COMMAND_ECHO) + 2);
-  if (command == nullptr)
-    return SARA_R5_ERROR_OUT_OF_MEMORY;
-  sprintf(command, "%s%d", SARA_R5_COMMAND_ECHO, enable ? 1 : 0);
-  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK,
-                                nullptr, SARA_R5_STANDARD_RESPONSE_TIMEOUT);
-  free(command);
-  return err;
+  SARA_R5_error_t err = SARA_R5_ERROR_SUCCESS;
+  if ((socket < 0) || (socket >= SARA_R5_NUM_SOCKETS))
+    err = SARA_R5_ERROR_UNEXPECTED_PARAM;
+  return SARA_R5_urc_awaiter(this, SARA_R5_URC_EVENT_SOCKET_READ, socket, timeout, err);
 }
 
-String SARA_R5::getManufacturerID(void)
+// Resume every coroutine which is waiting for this event. Returns true if any were resumed
+bool SARA_R5::resumeURCAwaiters(const SARA_R5_urc_event_t *urc)
 {
-  char *response;
-  char idResponse[16] = {0x00}; // E.g. u-blox
-  SARA_R5_error_t err;
+  SARA_R5_LOCK_TRANSACTION(SARA_R5_PRIORITY_NORMAL);
 
-  response = sara_r5_calloc_char(minimumResponseAllocation);
-
-  err = sendCommandWithResponse(SARA_R5_COMMAND_MANU_ID,
-                                SARA_R5_RESPONSE_OK_OR_ERROR, response, SARA_R5_STANDARD_RESPONSE_TIMEOUT);
-  if (err == SARA_R5_ERROR_SUCCESS)
+  // Mark the matching awaiters first. A resumed coroutine may await the same event again
+  // and that must wait for the next URC
+  for (SARA_R5_urc_awaiter *awaiter = _urcAwaiters; awaiter != nullptr; awaiter = awaiter->_next)
   {
-    if (sscanf(response, "\r\n%15s\r\n", idResponse) != 1)
+    if ((awaiter->_ready == false) && awaiter->matches(urc))
     {
-      memset(idResponse, 0, 16);
+      awaiter->_result.error = SARA_R5_ERROR_SUCCESS;
+      awaiter->_result.urc = *urc;
+      awaiter->_ready = true;
     }
   }
-  free(response);
-  return String(idResponse);
-}
-
-String SARA_R5::getModelID(void)
-{
-  char *response;
-  char idResponse[32] = {0x00}; // E.g. SARA-R510M8Q
-  SARA_R5_error_t err;
-
-  response = sara_r5_calloc_char(minimumResponseAllocation);
 
-  err = sendCommandWithResponse(SARA_R5_COMMAND_MODEL_ID,
-                                SARA_R5_RESPONSE_OK_OR_ERROR, response, SARA_R5_STANDARD_RESPONSE_TIMEOUT);
-  if (err == SARA_R5_ERROR_SUCCESS)
-  {
-    if (sscanf(response, "\r\n%31s\r\n", idResponse) != 1)
-    {
-      memset(idResponse, 0, 16);
-    }
-  }
-  free(response);
-  return String(idResponse);
+  return resumeReadyURCAwaiters();
 }
 
-String SARA_R5::getFirmwareVersion(void)
+// Resume every coroutine whose URC has not arrived in time, with SARA_R5_ERROR_TIMEOUT
+void SARA_R5::expireURCAwaiters(void)
 {
-  char *response;
-  char idResponse[16] = {0x00}; // E.g. 11.40
-  SARA_R5_error_t err;
-
-  response = sara_r5_calloc_char(minimumResponseAllocation);
+  SARA_R5_LOCK_TRANSACTION(SARA_R5_PRIORITY_NORMAL);
 
-  err = sendCommandWithResponse(SARA_R5_COMMAND_FW_VER_ID,
-                                SARA_R5_RESPONSE_OK_OR_ERROR, response, SARA_R5_STANDARD_RESPONSE_TIMEOUT);
-  if (err == SARA_R5_ERROR_SUCCESS)
+  for (SARA_R5_urc_awaiter *awaiter = _urcAwaiters; awaiter != nullptr; awaiter = awaiter->_next)
   {
-    if (sscanf(response, "\r\n%15s\r\n", idResponse) != 1)
+    if ((awaiter->_ready == false) && ((millis() - awaiter->_start) >= awaiter->_timeout))
     {
-      memset(idResponse, 0, 16);
+      if (_printDebug == true)
+      {
+        _debugPort->print(F("expireURCAwaiters: timeout waiting for event type "));
+        _debugPort->println((int)awaiter->_type);
+      }
+      awaiter->_result.error = SARA_R5_ERROR_TIMEOUT;
+      awaiter->_ready = true;
     }
   }
-  free(response);
-  return String(idResponse);
-}
-
-String SARA_R5::getSerialNo(void)
-{
-  char *response;
-  char idResponse[32] = {0x00}; // E.g. 357520070120767
-  SARA_R5_error_t err;
-
-  response = sara_r5_calloc_char(minimumResponseAllocation);
 
-  err = sendCommandWithResponse(SARA_R5_COMMAND_SERIAL_NO,
-                                SARA_R5_RESPONSE_OK_OR_ERROR, response, SARA_R5_STANDARD_RESPONSE_TIMEOUT);
-  if (err == SARA_R5_ERROR_SUCCESS)
-  {
-    if (sscanf(response, "\r\n%31s\r\n", idResponse) != 1)
-    {
-      memset(idResponse, 0, 16);
-    }
-  }
-  free(response);
-  return String(idResponse);
+  resumeReadyURCAwaiters();
 }
 
-String SARA_R5::getIMEI(void)
+// Remove the ready awaiters from the list and resume their coroutines - one at a time. The list is searched again after
+// each one: the coroutine may await again, or destroy other suspended coroutines. Returns true if any were resumed
+bool SARA_R5::resumeReadyURCAwaiters(void)
 {
-  char *response;
-  char imeiResponse[32] = {0x00}; // E.g. 004999010640000
-  SARA_R5_error_t err;
-
-  response = sara_r5_calloc_char(minimumResponseAllocation);
+  bool resumed = false;
 
-  err = sendCommandWithResponse(SARA_R5_COMMAND_IMEI,
-                                SARA_R5_RESPONSE_OK_OR_ERROR, response, SARA_R5_STANDARD_RESPONSE_TIMEOUT);
-  if (err == SARA_R5_ERROR_SUCCESS)
+  while (true)
   {
-    if (sscanf(response, "\r\n%31s\r\n", imeiResponse) != 1)
-    {
-      memset(imeiResponse, 0, 16);
-    }
-  }
-  free(response);
-  return String(imeiResponse);
-}
-
-String SARA_R5::getIMSI(void)
-{
-  char *response;
-  char imsiResponse[32] = {0x00}; // E.g. 222107701772423
-  SARA_R5_error_t err;
-
-  response = sara_r5_calloc_char(minimumResponseAllocation);
+    SARA_R5_urc_awaiter **link = &_urcAwaiters;
+    while ((*link != nullptr) && ((*link)->_ready == false))
+      link = &(*link)->_next;
+    if (*link == nullptr)
+      break;
 
-  err = sendCommandWithResponse(SARA_R5_COMMAND_IMSI,
-                                SARA_R5_RESPONSE_OK_OR_ERROR, response, SARA_R5_STANDARD_RESPONSE_TIMEOUT);
-  if (err == SARA_R5_ERROR_SUCCESS)
-  {
-    if (sscanf(response, "\r\n%31s\r\n", imsiResponse) != 1)
-    {
-      memset(imsiResponse, 0, 16);
-    }
+    SARA_R5_urc_awaiter *awaiter = *link;
+    *link = awaiter->_next;
+    awaiter->_next = nullptr;
+    std::coroutine_handle<> handle = awaiter->_handle;
+    awaiter->_handle = nullptr; // Unlinked. The destructor has nothing to do
+    resumed = true;
+    handle.resume(); // The awaiter is destroyed when the coroutine continues
   }
-  free(response);
-  return String(imsiResponse);
+
+  return resumed;
 }
+#endif
 
-String SARA_R5::getCCID(void)
+// Parse incoming URC's - the associated parse functions pass the data to the user via the callbacks (if defined)
+bool SARA_R5::processURCEvent(const char *event)
 {
-  char *response;
-  char ccidResponse[32] = {0x00}; // E.g. +CCID: 8939107900010087330
-  SARA_R5_error_t err;
-
-  response = sara_r5_calloc_char(minimumResponseAllocation);
-
-  err = sendCommandWithResponse(SARA_R5_COMMAND_CCID,
-                                SARA_R5_RESPONSE_OK_OR_ERROR, response, SARA_R5_STANDARD_RESPONSE_TIMEOUT);
-  if (err == SARA_R5_ERROR_SUCCESS)
-  {
-    char *searchPtr = strstr(response, "\r\n+CCID:");
-    if (searchPtr != nullptr)
+  { // URC: +UUSORD, +UUSORF, +UUSOLI, +UUSOCL, +UUSIMSTAT, +UUPSDA, +UUHTTPCR, +UUMQTTC, +UUMQTTSNC, +UUFTPCR, +CREG, +CEREG, +UUPSMR, +CEDRXP
+    SARA_R5_urc_event_t urc;
+    if (parseURCEvent(event, &urc))
     {
-      searchPtr += strlen("\r\n+CCID:"); // Move searchPtr to first character - probably a space
-      while (*searchPtr == ' ') searchPtr++; // skip spaces
-      if (sscanf(searchPtr, "%31s", ccidResponse) != 1)
-      {
-        ccidResponse[0] = 0;
-      }
+      bool handled = dispatchURCEvent(&urc);
+#ifdef SARA_R5_COROUTINES_ENABLED
+      if (resumeURCAwaiters(&urc))
+        handled = true;
+#endif
+      return handled;
     }
   }
-  free(response);
-  return String(ccidResponse);
-}
-
-String SARA_R5::getSubscriberNo(void)
-{
-  char *response;
-  char idResponse[128] = {0x00}; // E.g. +CNUM: "ABCD . AAA","123456789012",129
-  SARA_R5_error_t err;
+  { // URC: +UULOC (Localization information - CellLocate and hybrid positioning)
+    ClockData clck;
+    PositionData gps;
+    SpeedData spd;
+    unsigned long uncertainty;
+    int scanNum;
+    int latH, lonH, alt;
+    unsigned int speedU, cogU;
+    char latL[10], lonL[10];
+    int dateStore[5];
 
-  response = sara_r5_calloc_char(minimumResponseAllocation);
+    // Maybe we should also scan for +UUGIND and extract the activated gnss system?
 
-  err = sendCommandWithResponse(SARA_R5_COMMAND_CNUM,
-                                SARA_R5_RESPONSE_OK_OR_ERROR, response, SARA_R5_10_SEC_TIMEOUT);
-  if (err == SARA_R5_ERROR_SUCCESS)
-  {
-    char *searchPtr = strstr(response, "\r\n+CNUM:");
+    // This assumes the ULOC response type is "0" or "1" - as selected by gpsRequest detailed
+    char *searchPtr = strstr(event, SARA_R5_GNSS_REQUEST_LOCATION_URC);
     if (searchPtr != nullptr)
     {
-      searchPtr += strlen("\r\n+CNUM:"); // Move searchPtr to first character - probably a space
+      searchPtr += strlen(SARA_R5_GNSS_REQUEST_LOCATION_URC); // Move searchPtr to first character - probably a space
       while (*searchPtr == ' ') searchPtr++; // skip spaces
-      if (sscanf(searchPtr, "%127s", idResponse) != 1)
-      {
-        idResponse[0] = 0;
-      }
-    }
-  }
-  free(response);
-  return String(idResponse);
+      scanNum = sscanf(searchPtr,
+                        "%d/%d/%d,%d:%d:%d.%d,%d.%[^,],%d.%[^,],%d,%lu,%u,%u,%*s",
+                        &dateStore[0], &dateStore[1], &clck.date.year,
+                        &dateStore[2], &dateStore[3], &dateStore[4], &clck.time.ms,
+                        &latH, latL, &lonH, lonL, &alt, &uncertainty,
+                        &speedU, &cogU);
+      clck.date.day = dateStore[0];
+      clck.date.month = dateStore[1];
+      clck.time.hour = dateStore[2];
+      clck.time.minute = dateStore[3];
+      clck.time.second = dateStore[4];
+
+      if (scanNum >= 13)
+      {
+        // Found a Location string!
+        if (_printDebug == true)
+        {
+          _debugPort->println(F("processReadEvent: location"));
+        }
+
+        if (latH >= 0)
+          gps.lat = (float)latH + ((float)atol(latL) / pow(10, strlen(latL)));
+        else
+          gps.lat = (float)latH - ((float)atol(latL) / pow(10, strlen(latL)));
+        if (lonH >= 0)
+          gps.lon = (float)lonH + ((float)atol(lonL) / pow(10, strlen(lonL)));
+        else
+          gps.lon = (float)lonH - ((float)atol(lonL) / pow(10, strlen(lonL)));
+        gps.alt = (float)alt;
+        if (scanNum >= 15) // If detailed response, get speed data
+        {
+          spd.speed = (float)speedU;
+          spd.cog = (float)cogU;
+        }
+
+        // if (_printDebug == true)
+        // {
+        //   _debugPort->print(F("processReadEvent: location:  lat: "));
+        //   _debugPort->print(gps.lat, 7);
+        //   _debugPort->print(F(" lon: "));
+        //   _debugPort->print(gps.lon, 7);
+        //   _debugPort->print(F(" alt: "));
+        //   _debugPort->print(gps.alt, 2);
+        //   _debugPort->print(F(" speed: "));
+        //   _debugPort->print(spd.speed, 2);
+        //   _debugPort->print(F(" cog: "));
+        //   _debugPort->println(spd.cog, 2);
+        // }
+
+        if (_gpsRequestCallback != nullptr)
+        {
+          _gpsRequestCallback(clck, gps, spd, uncertainty);
+        }
+
+        return true;
+      }
+    }
+  }
+  { // URC: +UUPING (Ping Result)
+    int retry = 0;
+    int p_size = 0;
+    int ttl = 0;
+    String remote_host = "";
+    IPAddress remoteIP = {0, 0, 0, 0};
+    long rtt = 0;
+    int scanNum;
+
+    // Try to extract the UUPING retries and payload size
+    char *searchPtr = strstr(event, SARA_R5_PING_COMMAND_URC);
+    if (searchPtr != nullptr)
+    {
+      searchPtr += strlen(SARA_R5_PING_COMMAND_URC); // Move searchPtr to first character - probably a space
+      while (*searchPtr == ' ') searchPtr++; // skip spaces
+      scanNum = sscanf(searchPtr, "%d,%d,", &retry, &p_size);
+
+      if (scanNum == 2)
+      {
+        if (_printDebug == true)
+        {
+          _debugPort->println(F("processReadEvent: ping"));
+        }
+
+        searchPtr = strchr(++searchPtr, '\"'); // Search to the first quote
+
+        // Extract the remote host name, stop at the next quote
+        while ((*(++searchPtr) != '\"') && (*searchPtr != '\0'))
+        {
+          remote_host.concat(*(searchPtr));
+        }
+
+        if (*searchPtr != '\0') // Make sure we found a quote
+        {
+          int remoteIPstore[4];
+          scanNum = sscanf(searchPtr, "\",\"%d.%d.%d.%d\",%d,%ld",
+                            &remoteIPstore[0], &remoteIPstore[1], &remoteIPstore[2], &remoteIPstore[3], &ttl, &rtt);
+          for (int i = 0; i <= 3; i++)
+          {
+            remoteIP[i] = (uint8_t)remoteIPstore[i];
+          }
+
+          if (scanNum == 6) // Make sure we extracted enough data
+          {
+            if (_pingRequestCallback != nullptr)
+            {
+              _pingRequestCallback(retry, p_size, remote_host, remoteIP, ttl, rtt);
+            }
+          }
+        }
+        return true;
+      }
+    }
+  }
+
+  return false;
+}
+
+// Convert a URC into a compact event. Returns true if the event contains one of the URCs listed in SARA_R5_urc_event_type_t.
+// +UULOC and +UUPING are not converted. They contain strings and floats and are parsed by processURCEvent.
+bool SARA_R5::parseURCEvent(const char *event, SARA_R5_urc_event_t *urc)
+{
+  memset(urc, 0, sizeof(SARA_R5_urc_event_t));
+
+  { // URC: +UUSORD (Read Socket Data)
+    int socket, length;
+    char *searchPtr = strstr(event, SARA_R5_READ_SOCKET_URC);
+    if (searchPtr != nullptr)
+    {
+      searchPtr += strlen(SARA_R5_READ_SOCKET_URC); // Move searchPtr to first character - probably a space
+      while (*searchPtr == ' ') searchPtr++; // Skip spaces
+      int ret = sscanf(searchPtr, "%d,%d", &socket, &length);
+      if (ret == 2)
+      {
+        urc->type = SARA_R5_URC_EVENT_SOCKET_READ;
+        urc->param[0] = socket;
+        urc->param[1] = length;
+        return true;
+      }
+    }
+  }
+  { // URC: +UUSORF (Receive From command (UDP only))
+    int socket, length;
+    char *searchPtr = strstr(event, SARA_R5_READ_UDP_SOCKET_URC);
+    if (searchPtr != nullptr)
+    {
+      searchPtr += strlen(SARA_R5_READ_UDP_SOCKET_URC); // Move searchPtr to first character - probably a space
+      while (*searchPtr == ' ') searchPtr++; // skip spaces
+      int ret = sscanf(searchPtr, "%d,%d", &socket, &length);
+      if (ret == 2)
+      {
+        urc->type = SARA_R5_URC_EVENT_SOCKET_READ_UDP;
+        urc->param[0] = socket;
+        urc->param[1] = length;
+        return true;
+      }
+    }
+  }
+  { // URC: +UUSOLI (Set Listening Socket)
+    int socket = 0;
+    int listenSocket = 0;
+    unsigned int port = 0;
+    unsigned int listenPort = 0;
+    int remoteIPstore[4]  = {0,0,0,0};
+    int localIPstore[4] = {0,0,0,0};
+
+    char *searchPtr = strstr(event, SARA_R5_LISTEN_SOCKET_URC);
+    if (searchPtr != nullptr)
+    {
+      searchPtr += strlen(SARA_R5_LISTEN_SOCKET_URC); // Move searchPtr to first character - probably a space
+      while (*searchPtr == ' ') searchPtr++; // skip spaces
+      int ret = sscanf(searchPtr,
+                      "%d,\"%d.%d.%d.%d\",%u,%d,\"%d.%d.%d.%d\",%u",
+                      &socket,
+                      &remoteIPstore[0], &remoteIPstore[1], &remoteIPstore[2], &remoteIPstore[3],
+                      &port, &listenSocket,
+                      &localIPstore[0], &localIPstore[1], &localIPstore[2], &localIPstore[3],
+                      &listenPort);
+      for (int i = 0; i <= 3; i++)
+      {
+        if (ret >= 5)
+          urc->remoteIP[i] = (uint8_t)remoteIPstore[i];
+        if (ret >= 11)
+          urc->localIP[i] = (uint8_t)localIPstore[i];
+      }
+      if (ret >= 5)
+      {
+        urc->type = SARA_R5_URC_EVENT_SOCKET_LISTEN;
+        urc->param[0] = socket;
+        urc->param[1] = port;
+        urc->param[2] = listenSocket;
+        urc->param[3] = listenPort;
+        return true;
+      }
+    }
+  }
+  { // URC: +UUSOCL (Close Socket)
+    int socket;
+    char *searchPtr = strstr(event, SARA_R5_CLOSE_SOCKET_URC);
+    if (searchPtr != nullptr)
+    {
+      searchPtr += strlen(SARA_R5_CLOSE_SOCKET_URC); // Move searchPtr to first character - probably a space
+      while (*searchPtr == ' ') searchPtr++; // skip spaces
+      int ret = sscanf(searchPtr, "%d", &socket);
+      if (ret == 1)
+      {
+        urc->type = SARA_R5_URC_EVENT_SOCKET_CLOSE;
+        urc->param[0] = socket;
+        return true;
+      }
+    }
+  }
+  { // URC: +UUSIMSTAT (SIM Status)
+    int scanNum;
+    int stateStore;
+
+    char *searchPtr = strstr(event, SARA_R5_SIM_STATE_URC);
+    if (searchPtr != nullptr)
+    {
+      searchPtr += strlen(SARA_R5_SIM_STATE_URC); // Move searchPtr to first character - probably a space
+      while (*searchPtr == ' ') searchPtr++; // skip spaces
+      scanNum = sscanf(searchPtr, "%d", &stateStore);
+
+      if (scanNum == 1)
+      {
+        urc->type = SARA_R5_URC_EVENT_SIM_STATE;
+        urc->param[0] = stateStore;
+        return true;
+      }
+    }
+  }
+  { // URC: +UUPSDA (Packet Switched Data Action)
+    int result;
+    int scanNum;
+    int remoteIPstore[4];
+
+    char *searchPtr = strstr(event, SARA_R5_MESSAGE_PDP_ACTION_URC);
+    if (searchPtr != nullptr)
+    {
+      searchPtr += strlen(SARA_R5_MESSAGE_PDP_ACTION_URC); // Move searchPtr to first character - probably a space
+      while (*searchPtr == ' ') searchPtr++; // skip spaces
+      scanNum = sscanf(searchPtr, "%d,\"%d.%d.%d.%d\"",
+                        &result, &remoteIPstore[0], &remoteIPstore[1], &remoteIPstore[2], &remoteIPstore[3]);
+
+      if (scanNum == 5)
+      {
+        urc->type = SARA_R5_URC_EVENT_PDP_ACTION;
+        urc->param[0] = result;
+        for (int i = 0; i <= 3; i++)
+        {
+          urc->remoteIP[i] = (uint8_t)remoteIPstore[i];
+        }
+        return true;
+      }
+    }
+  }
+  { // URC: +UUHTTPCR (HTTP Command Result)
+    int profile, command, result;
+    int scanNum;
+
+    char *searchPtr = strstr(event, SARA_R5_HTTP_COMMAND_URC);
+    if (searchPtr != nullptr)
+    {
+      searchPtr += strlen(SARA_R5_HTTP_COMMAND_URC); // Move searchPtr to first character - probably a space
+      while (*searchPtr == ' ') searchPtr++; // skip spaces
+      scanNum = sscanf(searchPtr, "%d,%d,%d", &profile, &command, &result);
+
+      if (scanNum == 3)
+      {
+        urc->type = SARA_R5_URC_EVENT_HTTP_COMMAND;
+        urc->param[0] = profile;
+        urc->param[1] = command;
+        urc->param[2] = result;
+        return true;
+      }
+    }
+  }
+  { // URC: +UUMQTTC (MQTT Command Result)
+    int command, result;
+    int scanNum;
+    int qos = -1;
+
+    char *searchPtr = strstr(event, SARA_R5_MQTT_COMMAND_URC);
+    if (searchPtr != nullptr)
+    {
+      searchPtr += strlen(SARA_R5_MQTT_COMMAND_URC); // Move searchPtr to first character - probably a space
+      while (*searchPtr == ' ')
+      {
+        searchPtr++; // skip spaces
+      }
+
+      scanNum = sscanf(searchPtr, "%d,%d", &command, &result);
+      if ((scanNum == 2) && (command == SARA_R5_MQTT_COMMAND_SUBSCRIBE))
+      {
+        char topicC[100] = "";
+        scanNum = sscanf(searchPtr, "%*d,%*d,%d,\"%[^\"]\"", &qos, topicC);
+      }
+      if ((scanNum == 2) || (scanNum == 4))
+      {
+        urc->type = SARA_R5_URC_EVENT_MQTT_COMMAND;
+        urc->param[0] = command;
+        urc->param[1] = result;
+        urc->param[2] = qos;
+        return true;
+      }
+    }
+  }
+  { // URC: +UUMQTTSNC (MQTT-SN Command Result)
+    int command, result;
+    int param2 = -1, param3 = -1;
+    int scanNum;
+
+    char *searchPtr = strstr(event, SARA_R5_MQTTSN_COMMAND_URC);
+    if (searchPtr != nullptr)
+    {
+      searchPtr += strlen(SARA_R5_MQTTSN_COMMAND_URC); // Move searchPtr to first character - probably a space
+      while (*searchPtr == ' ')
+      {
+        searchPtr++; // skip spaces
+      }
+
+      scanNum = sscanf(searchPtr, "%d,%d,%d,%d", &command, &result, &param2, &param3);
+      if (scanNum >= 2)
+      {
+        urc->type = SARA_R5_URC_EVENT_MQTTSN_COMMAND;
+        urc->param[0] = command;
+        urc->param[1] = result;
+        urc->param[2] = param2;
+        urc->param[3] = param3;
+        return true;
+      }
+    }
+  }
+  { // URC: +UUFTPCR (FTP Command Result)
+    int ftpCmd;
+    int ftpResult;
+    int scanNum;
+    char *searchPtr = strstr(event, SARA_R5_FTP_COMMAND_URC);
+    if (searchPtr != nullptr)
+    {
+      searchPtr += strlen(SARA_R5_FTP_COMMAND_URC); // Move searchPtr to first character - probably a space
+      while (*searchPtr == ' ')
+      {
+        searchPtr++; // skip spaces
+      }
+
+      scanNum = sscanf(searchPtr, "%d,%d", &ftpCmd, &ftpResult);
+      if (scanNum == 2)
+      {
+        urc->type = SARA_R5_URC_EVENT_FTP_COMMAND;
+        urc->param[0] = ftpCmd;
+        urc->param[1] = ftpResult;
+        return true;
+      }
+    }
+  }
+  { // URC: +CREG
+    int status = 0;
+    unsigned int lac = 0, ci = 0;
+    int Act = -1;
+    char *searchPtr = strstr(event, SARA_R5_REGISTRATION_STATUS_URC);
+    if (searchPtr != nullptr)
+    {
+      searchPtr += strlen(SARA_R5_REGISTRATION_STATUS_URC); // Move searchPtr to first character - probably a space
+      while (*searchPtr == ' ') searchPtr++; // skip spaces
+      // The location is only included while registered. The E-UTRAN cell ID is 28 bits
+      int scanNum = sscanf(searchPtr, "%d,\"%x\",\"%x\",%d", &status, &lac, &ci, &Act);
+      if (scanNum == 1) // Status only. Check this is not the response to +CREG?: +CREG: <n>,<stat>
+      {
+        char *endPtr = searchPtr;
+        if (*endPtr == '-') endPtr++;
+        while ((*endPtr >= '0') && (*endPtr <= '9')) endPtr++;
+        if ((*endPtr != '\r') && (*endPtr != '\n') && (*endPtr != 0))
+          scanNum = 0;
+      }
+      if ((scanNum == 1) || (scanNum >= 3))
+      {
+        urc->type = SARA_R5_URC_EVENT_REGISTRATION;
+        urc->param[0] = status;
+        urc->param[1] = lac;
+        urc->param[2] = ci;
+        urc->param[3] = Act;
+        return true;
+      }
+    }
+  }
+  { // URC: +CEREG
+    int status = 0;
+    unsigned int tac = 0, ci = 0;
+    int Act = -1;
+    char *searchPtr = strstr(event, SARA_R5_EPSREGISTRATION_STATUS_URC);
+    if (searchPtr != nullptr)
+    {
+      searchPtr += strlen(SARA_R5_EPSREGISTRATION_STATUS_URC); // Move searchPtr to first character - probably a space
+      while (*searchPtr == ' ') searchPtr++; // skip spaces
+      // The location is only included while registered. The E-UTRAN cell ID is 28 bits
+      int scanNum = sscanf(searchPtr, "%d,\"%x\",\"%x\",%d", &status, &tac, &ci, &Act);
+      if (scanNum == 1) // Status only. Check this is not the response to +CEREG?: +CEREG: <n>,<stat>
+      {
+        char *endPtr = searchPtr;
+        if (*endPtr == '-') endPtr++;
+        while ((*endPtr >= '0') && (*endPtr <= '9')) endPtr++;
+        if ((*endPtr != '\r') && (*endPtr != '\n') && (*endPtr != 0))
+          scanNum = 0;
+      }
+      if ((scanNum == 1) || (scanNum >= 3))
+      {
+        urc->type = SARA_R5_URC_EVENT_EPS_REGISTRATION;
+        urc->param[0] = status;
+        urc->param[1] = tac;
+        urc->param[2] = ci;
+        urc->param[3] = Act;
+        return true;
+      }
+    }
+  }
+  { // URC: +UUPSMR (PSM state)
+    int state;
+    char *searchPtr = strstr(event, SARA_R5_PSM_STATE_URC);
+    if (searchPtr != nullptr)
+    {
+      searchPtr += strlen(SARA_R5_PSM_STATE_URC); // Move searchPtr to first character - probably a space
+      while (*searchPtr == ' ') searchPtr++; // skip spaces
+      if (sscanf(searchPtr, "%d", &state) == 1)
+      {
+        urc->type = SARA_R5_URC_EVENT_PSM_STATE;
+        urc->param[0] = state;
+        return true;
+      }
+    }
+  }
+  { // URC: +CEDRXP (eDRX parameters)
+    int act;
+    char values[3][5] = {{0}};
+    char *searchPtr = strstr(event, SARA_R5_EDRX_URC);
+    if (searchPtr != nullptr)
+    {
+      searchPtr += strlen(SARA_R5_EDRX_URC); // Move searchPtr to first character - probably a space
+      while (*searchPtr == ' ') searchPtr++; // skip spaces
+      // E.g. +CEDRXP: 4,"0101","0101","0011"
+      int scanNum = sscanf(searchPtr, "%d,\"%4[01]\",\"%4[01]\",\"%4[01]\"", &act, values[0], values[1], values[2]);
+      if (scanNum >= 1)
+      {
+        urc->type = SARA_R5_URC_EVENT_EDRX;
+        urc->param[0] = act;
+        for (int i = 0; i < 3; i++)
+          urc->param[i + 1] = (i < (scanNum - 1)) ? (int32_t)strtol(values[i], nullptr, 2) : -1;
+        return true;
+      }
+    }
+  }
+  // NOTE: When adding new URC messages, add them to SARA_R5_urc_event_type_t, parseURCEvent and dispatchURCEvent.
+  //       If they need to be coalesced, update queueURCEvent too!
+
+  return false;
+}
+
+// Pass a pre-parsed URC event to the user via the callbacks (if defined)
+bool SARA_R5::dispatchURCEvent(const SARA_R5_urc_event_t *urc)
+{
+  switch (urc->type)
+  {
+  case SARA_R5_URC_EVENT_SOCKET_READ:
+  {
+    int socket = urc->param[0];
+    if (_printDebug == true)
+      _debugPort->println(F("processReadEvent: read socket data"));
+    // From the SARA_R5 AT Commands Manual:
+    // "For the UDP socket type the URC +UUSORD: <socket>,<length> notifies that a UDP packet has been received,
+    //  either when buffer is empty or after a UDP packet has been read and one or more packets are stored in the
+    //  buffer."
+    // So we need to check if this is a TCP socket or a UDP socket:
+    //  If UDP, we call parseSocketReadIndicationUDP.
+    //  Otherwise, we call parseSocketReadIndication.
+    if ((socket >= 0) && (socket < SARA_R5_NUM_SOCKETS) && (_lastSocketProtocol[socket] == SARA_R5_UDP))
+    {
+      if (_printDebug == true)
+        _debugPort->println(F("processReadEvent: received +UUSORD but socket is UDP. Calling parseSocketReadIndicationUDP"));
+      parseSocketReadIndicationUDP(socket, urc->param[1]);
+    }
+    else
+      parseSocketReadIndication(socket, urc->param[1]);
+    return true;
+  }
+  case SARA_R5_URC_EVENT_SOCKET_READ_UDP:
+    if (_printDebug == true)
+      _debugPort->println(F("processReadEvent: UDP receive"));
+    parseSocketReadIndicationUDP(urc->param[0], urc->param[1]);
+    return true;
+  case SARA_R5_URC_EVENT_SOCKET_LISTEN:
+  {
+    IPAddress remoteIP = {urc->remoteIP[0], urc->remoteIP[1], urc->remoteIP[2], urc->remoteIP[3]};
+    IPAddress localIP = {urc->localIP[0], urc->localIP[1], urc->localIP[2], urc->localIP[3]};
+    if (_printDebug == true)
+      _debugPort->println(F("processReadEvent: socket listen"));
+    parseSocketListenIndication(urc->param[2], localIP, urc->param[3], urc->param[0], remoteIP, urc->param[1]);
+    return true;
+  }
+  case SARA_R5_URC_EVENT_SOCKET_CLOSE:
+    if (_printDebug == true)
+      _debugPort->println(F("processReadEvent: socket close"));
+    if ((urc->param[0] >= 0) && (urc->param[0] <= 6))
+    {
+      if (_socketCloseCallback != nullptr)
+      {
+        _socketCloseCallback(urc->param[0]);
+      }
+    }
+    return true;
+  case SARA_R5_URC_EVENT_SIM_STATE:
+    if (_printDebug == true)
+      _debugPort->println(F("processReadEvent: SIM status"));
+    invalidateIdentity(true); // The SIM may have been changed
+    if (_simStateReportCallback != nullptr)
+    {
+      _simStateReportCallback((SARA_R5_sim_states_t)urc->param[0]);
+    }
+    return true;
+  case SARA_R5_URC_EVENT_PDP_ACTION:
+  {
+    IPAddress remoteIP = {urc->remoteIP[0], urc->remoteIP[1], urc->remoteIP[2], urc->remoteIP[3]};
+    if (_printDebug == true)
+      _debugPort->println(F("processReadEvent: packet switched data action"));
+    if (_psdActionRequestCallback != nullptr)
+    {
+      _psdActionRequestCallback(urc->param[0], remoteIP);
+    }
+    return true;
+  }
+  case SARA_R5_URC_EVENT_HTTP_COMMAND:
+    if (_printDebug == true)
+      _debugPort->println(F("processReadEvent: HTTP command result"));
+    if ((urc->param[0] >= 0) && (urc->param[0] < SARA_R5_NUM_HTTP_PROFILES))
+    {
+      fileIndexCompleted(urc->param[0]); // The response file has been written
+      _httpCommandResult[urc->param[0]] = urc->param[2];
+      if ((nullptr != _httpScheduler) && (urc->param[0] < _httpScheduler->numProfiles)
+          && (_httpScheduler->profile[urc->param[0]].staleResults > 0))
+      {
+        _httpScheduler->profile[urc->param[0]].staleResults--; // The late result of a timed-out request. Discard it
+      }
+      else if ((nullptr != _httpScheduler) && (urc->param[0] < _httpScheduler->numProfiles)
+          && (_httpScheduler->profile[urc->param[0]].request != nullptr)
+          && (_httpScheduler->profile[urc->param[0]].request->_command == urc->param[1]))
+      {
+        _httpScheduler->profile[urc->param[0]].request->_result = urc->param[2];
+        _httpScheduler->profile[urc->param[0]].resultReady = true; // Completed by serviceHTTPQueue
+      }
+      if (_httpCommandRequestCallback != nullptr)
+      {
+        _httpCommandRequestCallback(urc->param[0], urc->param[1], urc->param[2]);
+      }
+    }
+    return true;
+  case SARA_R5_URC_EVENT_MQTT_COMMAND:
+    if (_printDebug == true)
+    {
+      _debugPort->println(F("processReadEvent: MQTT command result"));
+    }
+    if ((urc->param[0] == SARA_R5_MQTT_COMMAND_PUBLISH) || (urc->param[0] == SARA_R5_MQTT_COMMAND_PUBLISHBINARY))
+      mqttPipelineResult(urc->param[0], urc->param[1]);
+    if (urc->param[0] == SARA_R5_MQTT_COMMAND_PUBLISHFILE)
+      _mqttPublishFileResult = urc->param[1];
+    if ((urc->param[0] == SARA_R5_MQTT_COMMAND_READ) && (nullptr != _mqttInbound))
+      _mqttInbound->pending = urc->param[1]; // The number of unread messages. Read by serviceMQTTInbound
+    if (_mqttCommandRequestCallback != nullptr)
+    {
+      _mqttCommandRequestCallback(urc->param[0], urc->param[1]);
+    }
+    return true;
+  case SARA_R5_URC_EVENT_MQTTSN_COMMAND:
+    if (_printDebug == true)
+      _debugPort->println(F("processReadEvent: MQTT-SN command result"));
+    if (nullptr != _mqttsn)
+    {
+      bool stale = false;
+      if ((urc->param[0] >= 0) && (urc->param[0] < SARA_R5_MQTTSN_NUM_COMMANDS) && (_mqttsn->staleResults[urc->param[0]] > 0))
+      {
+        if (millis() - _mqttsn->staleSince[urc->param[0]] < SARA_R5_MQTTSN_RESPONSE_TIMEOUT)
+        {
+          _mqttsn->staleResults[urc->param[0]]--; // The late result of a request which timed out. Discard it
+          stale = true;
+        }
+        else
+          _mqttsn->staleResults[urc->param[0]] = 0; // The late results are not coming
+      }
+      if (urc->param[0] == SARA_R5_MQTTSN_COMMAND_READ)
+        _mqttsn->unread = urc->param[1]; // Not a command result
+      else if (stale == false)
+      {
+        if (urc->param[0] == SARA_R5_MQTTSN_COMMAND_CONNECT)
+          _mqttsn->connected = (urc->param[1] == 1);
+        else if (urc->param[0] == SARA_R5_MQTTSN_COMMAND_DISCONNECT)
+          _mqttsn->connected = false;
+        _mqttsn->command = urc->param[0];
+        _mqttsn->result = urc->param[1];
+        _mqttsn->param = (urc->param[0] == SARA_R5_MQTTSN_COMMAND_SUBSCRIBE) ? urc->param[3] : urc->param[2];
+        _mqttsn->resultReady = true;
+      }
+    }
+    if (_mqttsnCommandRequestCallback != nullptr)
+    {
+      _mqttsnCommandRequestCallback(urc->param[0], urc->param[1]);
+    }
+    return true;
+  case SARA_R5_URC_EVENT_FTP_COMMAND:
+    if (urc->param[0] == SARA_R5_FTP_COMMAND_GET_FILE)
+      fileIndexCompleted(SARA_R5_NUM_HTTP_PROFILES);
+    if (_ftpCommandRequestCallback != nullptr)
+    {
+      _ftpCommandRequestCallback(urc->param[0], urc->param[1]);
+      return true;
+    }
+    return false;
+  case SARA_R5_URC_EVENT_REGISTRATION:
+    if (_printDebug == true)
+      _debugPort->println(F("processReadEvent: CREG"));
+    updateRegistrationState(false, urc->param[0], urc->param[1], urc->param[2], urc->param[3]);
+    if (_registrationCallback != nullptr)
+    {
+      _registrationCallback((SARA_R5_registration_status_t)urc->param[0], urc->param[1], urc->param[2], urc->param[3]);
+    }
+    return true;
+  case SARA_R5_URC_EVENT_EPS_REGISTRATION:
+    if (_printDebug == true)
+      _debugPort->println(F("processReadEvent: CEREG"));
+    updateRegistrationState(true, urc->param[0], urc->param[1], urc->param[2], urc->param[3]);
+    if (_epsRegistrationCallback != nullptr)
+    {
+      _epsRegistrationCallback((SARA_R5_registration_status_t)urc->param[0], urc->param[1], urc->param[2], urc->param[3]);
+    }
+    return true;
+  case SARA_R5_URC_EVENT_PSM_STATE:
+    if (_printDebug == true)
+      _debugPort->println(F("processReadEvent: PSM state"));
+    // 0: the module is awake. 1: the module is entering PSM. 2: PSM is blocked (the module stays awake)
+    setPowerState((urc->param[0] == 1) ? SARA_R5_POWER_STATE_PSM : SARA_R5_POWER_STATE_AWAKE);
+    return true;
+  case SARA_R5_URC_EVENT_EDRX:
+    if (_printDebug == true)
+      _debugPort->println(F("processReadEvent: eDRX"));
+    _powerSaving.requestedEDRX = urc->param[1];
+    _powerSaving.networkEDRX = urc->param[2];
+    _powerSaving.pagingTimeWindow = urc->param[3];
+    return true;
+  case SARA_R5_URC_EVENT_GNSS_LOCATION:
+  case SARA_R5_URC_EVENT_PING:
+    return processURCEvent((const char *)&_urcTextBuffer[urc->param[0] * SARA_R5_URC_TEXT_SLOT_SIZE]);
+  default:
+    break;
+  }
+
+  return false;
+}
+
+// This is the original poll function.
+// It is 'blocking' - it does not return when serial data is available until it receives a `\n`.
+// ::bufferedPoll is the new improved version. It processes any data in the backlog and includes a timeout.
+bool SARA_R5::poll(void)
+{
+  SARA_R5_LOCK_TRANSACTION(SARA_R5_PRIORITY_NORMAL); // Also serializes the consumer side of the URC event queue
+
+  if (_pollReentrant == true) // Check for reentry (i.e. poll has been called from inside a callback)
+    return false;
+
+  _pollReentrant = true;
+
+  int avail = 0;
+  char c = 0;
+  bool handled = false;
+
+  if (_rxTaskMode == true) // In RX task mode, rxTask has already queued the URCs
+  {
+#ifdef SARA_R5_RX_TASK_ENABLED
+    discardRxResponse();
+#endif
+    handled = dispatchURCEvents();
+    sampleSignalQuality();
+    serviceHTTPQueue();
+    serviceMQTTPipeline();
+    serviceMQTTInbound();
+    _pollReentrant = false;
+    return handled;
+  }
+
+  memset(_saraRXBuffer, 0, _RXBuffSize); // Clear _saraRXBuffer
+
+  if (hwAvailable() > 0) //hwAvailable can return -1 if the serial port is NULL
+  {
+    while (c != '\n') // Copy characters into _saraRXBuffer. Stop at the first new line
+    {
+      if (hwAvailable() > 0) //hwAvailable can return -1 if the serial port is NULL
+      {
+        c = readChar();
+        _saraRXBuffer[avail++] = c;
+      } else {
+        yield();
+      }
+    }
+
+    // Now search for all supported URC's
+    handled = processURCEvent(_saraRXBuffer);
+    if (handled && (true == _printAtDebug)) {
+      _debugAtPort->write(_saraRXBuffer, avail);
+    }
+    if ((handled == false) && (strlen(_saraRXBuffer) > 2))
+    {
+      if (_printDebug == true)
+      {
+        _debugPort->print(F("poll: "));
+        _debugPort->println(_saraRXBuffer);
+      }
+    }
+    else
+    {
+    }
+  }
+
+  sampleSignalQuality(); // Read +CESQ if the signal sampler is enabled and a sample is due
+  serviceHTTPQueue();
+  serviceMQTTPipeline();
+  serviceMQTTInbound();
+
+  _pollReentrant = false;
+
+  return handled;
+}
+
+void SARA_R5::setSocketListenCallback(void (*socketListenCallback)(int, IPAddress, unsigned int, int, IPAddress, unsigned int))
+{
+  _socketListenCallback = socketListenCallback;
+}
+
+void SARA_R5::setSocketReadCallback(void (*socketReadCallback)(int, String))
+{
+  _socketReadCallback = socketReadCallback;
+}
+
+void SARA_R5::setSocketReadCallbackPlus(void (*socketReadCallbackPlus)(int, const char *, int, IPAddress, int)) // socket, data, length, remoteAddress, remotePort
+{
+  _socketReadCallbackPlus = socketReadCallbackPlus;
+}
+
+void SARA_R5::setSocketCloseCallback(void (*socketCloseCallback)(int))
+{
+  _socketCloseCallback = socketCloseCallback;
+}
+
+void SARA_R5::setGpsReadCallback(void (*gpsRequestCallback)(ClockData time,
+                                                            PositionData gps, SpeedData spd, unsigned long uncertainty))
+{
+  _gpsRequestCallback = gpsRequestCallback;
+}
+
+void SARA_R5::setSIMstateReportCallback(void (*simStateReportCallback)(SARA_R5_sim_states_t state))
+{
+  _simStateReportCallback = simStateReportCallback;
+}
+
+void SARA_R5::setPSDActionCallback(void (*psdActionRequestCallback)(int result, IPAddress ip))
+{
+  _psdActionRequestCallback = psdActionRequestCallback;
+}
+
+void SARA_R5::setPingCallback(void (*pingRequestCallback)(int retry, int p_size, String remote_hostname, IPAddress ip, int ttl, long rtt))
+{
+  _pingRequestCallback = pingRequestCallback;
+}
+
+void SARA_R5::setHTTPCommandCallback(void (*httpCommandRequestCallback)(int profile, int command, int result))
+{
+  _httpCommandRequestCallback = httpCommandRequestCallback;
+}
+
+void SARA_R5::setMQTTCommandCallback(void (*mqttCommandRequestCallback)(int command, int result))
+{
+  _mqttCommandRequestCallback = mqttCommandRequestCallback;
+}
+
+void SARA_R5::setFTPCommandCallback(void (*ftpCommandRequestCallback)(int command, int result))
+{
+    _ftpCommandRequestCallback = ftpCommandRequestCallback;
+}
+
+void SARA_R5::setMQTTSNCommandCallback(void (*mqttsnCommandRequestCallback)(int command, int result))
+{
+  _mqttsnCommandRequestCallback = mqttsnCommandRequestCallback;
+}
+
+SARA_R5_error_t SARA_R5::setRegistrationCallback(void (*registrationCallback)(SARA_R5_registration_status_t status, unsigned int lac, unsigned int ci, int Act))
+{
+  _registrationCallback = registrationCallback;
+
+  char *command = sara_r5_calloc_char(strlen(SARA_R5_REGISTRATION_STATUS) + 3);
+  if (command == nullptr)
+    return SARA_R5_ERROR_OUT_OF_MEMORY;
+  sprintf(command, "%s=%d", SARA_R5_REGISTRATION_STATUS, 2/*enable URC with location*/);
+  SARA_R5_error_t err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR,
+                                nullptr, SARA_R5_STANDARD_RESPONSE_TIMEOUT);
+  if (err == SARA_R5_ERROR_SUCCESS)
+    _registrationURC[0] = true;
+  free(command);
+  return err;
+}
+
+SARA_R5_error_t SARA_R5::setEpsRegistrationCallback(void (*registrationCallback)(SARA_R5_registration_status_t status, unsigned int tac, unsigned int ci, int Act))
+{
+  _epsRegistrationCallback = registrationCallback;
+
+  char *command = sara_r5_calloc_char(strlen(SARA_R5_EPSREGISTRATION_STATUS) + 3);
+  if (command == nullptr)
+    return SARA_R5_ERROR_OUT_OF_MEMORY;
+  sprintf(command, "%s=%d", SARA_R5_EPSREGISTRATION_STATUS, 2/*enable URC with location*/);
+  SARA_R5_error_t err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR,
+                                nullptr, SARA_R5_STANDARD_RESPONSE_TIMEOUT);
+  if (err == SARA_R5_ERROR_SUCCESS)
+    _registrationURC[1] = true;
+  free(command);
+  return err;
+}
+
+// Enable the +CREG and +CEREG URCs so registration can be answered from the registration state.
+// The state is still read from the module if it has not been updated for maxAge milliseconds
+SARA_R5_error_t SARA_R5::setRegistrationTracking(bool enable, unsigned long maxAge)
+{
+  SARA_R5_error_t err = SARA_R5_ERROR_SUCCESS;
+
+  _registrationMaxAge = maxAge;
+
+  for (int i = 0; i < 2; i++)
+  {
+    if (enable == false)
+    {
+      _registrationURC[i] = false; // Stop answering from the state. The URCs stay enabled for the callbacks
+      continue;
+    }
+
+    const char *tag = (i == 1) ? SARA_R5_EPSREGISTRATION_STATUS : SARA_R5_REGISTRATION_STATUS;
+    char *command = sara_r5_calloc_char(strlen(tag) + 3);
+    if (command == nullptr)
+      return SARA_R5_ERROR_OUT_OF_MEMORY;
+    sprintf(command, "%s=%d", tag, 2/*enable URC with location*/);
+    err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR,
+                                  nullptr, SARA_R5_STANDARD_RESPONSE_TIMEOUT);
+    free(command);
+    if (err != SARA_R5_ERROR_SUCCESS)
+      return err;
+    _registrationURC[i] = true;
+    _registrationState[i].valid = false; // Read the full state the first time
+  }
+
+  return err;
+}
+
+const SARA_R5_registration_state_t *SARA_R5::getRegistrationState(bool eps)
+{
+  return &_registrationState[eps ? 1 : 0];
+}
+
+// The time since the registration status last changed (millis). 0 if the status is not known
+unsigned long SARA_R5::getRegistrationTimeInState(bool eps)
+{
+  const SARA_R5_registration_state_t *state = &_registrationState[eps ? 1 : 0];
+  if (state->valid == false)
+    return 0;
+  return millis() - state->lastChange;
+}
+
+// Update the registration state from a URC or the response to +CREG? / +CEREG?.
+// area and ci are 0 if there is no location. Act is -1 if it was not reported: the location may still be valid
+void SARA_R5::updateRegistrationState(bool eps, int status, unsigned int area, unsigned int ci, int Act)
+{
+  SARA_R5_registration_state_t *state = &_registrationState[eps ? 1 : 0];
+  unsigned long now = millis();
+
+  if (state->status != (SARA_R5_registration_status_t)status)
+  {
+    if (state->status != SARA_R5_REGISTRATION_INVALID) // Don't count the first status
+      state->changes++;
+    state->status = (SARA_R5_registration_status_t)status;
+    state->lastChange = now;
+  }
+  state->area = area;
+  state->ci = ci;
+  state->Act = Act;
+  state->lastUpdate = now;
+  state->valid = true;
+}
+
+// Queue any URCs which have arrived and apply the latest +CREG (or +CEREG) to the registration state. Nothing is
+// dispatched and no callbacks are called: the event stays queued and bufferedPoll dispatches it as usual
+void SARA_R5::peekRegistrationEvent(bool eps)
+{
+  SARA_R5_LOCK_TRANSACTION(SARA_R5_PRIORITY_NORMAL);
+
+  if (nullptr == _urcLatest) // Check begin has been called
+    return;
+
+  // In RX task mode, rxTask has already queued the URCs
+  if ((_rxTaskMode == false) && (hwAvailable() > 0))
+  {
+    int avail = 0;
+    unsigned long timeIn = millis();
+    while (((millis() - timeIn) < _rxWindowMillis) && (avail < _RXBuffSize))
+    {
+      if (hwAvailable() > 0) //hwAvailable can return -1 if the serial port is NULL
+      {
+        bufferURCChar(readChar());
+        avail++;
+        timeIn = millis();
+      } else {
+        yield();
+      }
+    }
+  }
+
+  SARA_R5_urc_event_t urc;
+  urc.type = eps ? SARA_R5_URC_EVENT_EPS_REGISTRATION : SARA_R5_URC_EVENT_REGISTRATION;
+  int latest = urcLatestIndex(&urc);
+  if (_urcLatest[latest].pending == false) // Nothing new since the last dispatch
+    return;
+  uint16_t sequence;
+  do
+  {
+    sequence = _urcLatest[latest].sequence;
+    SARA_R5_SPSC_FENCE_ACQUIRE();
+    urc = _urcLatest[latest].event;
+    SARA_R5_SPSC_FENCE_ACQUIRE(); // Read the values before checking the sequence again
+  } while (((sequence & 1) == 1) || (sequence != _urcLatest[latest].sequence));
+  updateRegistrationState(eps, urc.param[0], urc.param[1], urc.param[2], urc.param[3]);
+}
+
+// The module is reset or power cycled (or is about to be). Forget everything which is remembered about it
+void SARA_R5::moduleWasReset(void)
+{
+  invalidateConfigShadow();
+  invalidateIdentity();
+  invalidateRegistrationState();
+  invalidateFileIndex();
+  invalidateHTTPProfiles();
+  invalidateMQTTSNtopics();
+  if (_mqttPublishFileResult < 0)
+    _mqttPublishFileResult = 0; // The publish will not complete
+}
+
+// The module has been reset or power cycled: the URC settings are lost and the state is unknown
+void SARA_R5::invalidateRegistrationState(void)
+{
+  for (int i = 0; i < 2; i++)
+  {
+    _registrationURC[i] = false;
+    _registrationState[i].valid = false;
+  }
+}
+
+size_t SARA_R5::write(uint8_t c)
+{
+  return hwWrite(c);
+}
+
+size_t SARA_R5::write(const char *str)
+{
+  return hwPrint(str);
+}
+
+size_t SARA_R5::write(const char *buffer, size_t size)
+{
+  return hwWriteData(buffer, size);
+}
+
+SARA_R5_error_t SARA_R5::at(void)
+{
+  SARA_R5_error_t err;
+
+  err = sendCommandWithResponse(nullptr, SARA_R5_RESPONSE_OK, nullptr,
+                                SARA_R5_STANDARD_RESPONSE_TIMEOUT);
+
+  return err;
+}
+
+// Wait for the module to start up. Probe with AT on an exponential schedule: 50ms, 100ms, 200ms ... 1s.
+// Any line sent by the module (e.g. a start-up URC) triggers the next probe immediately.
+// timeout is the upper bound. Returns SARA_R5_ERROR_SUCCESS as soon as the module responds
+SARA_R5_error_t SARA_R5::waitForReady(unsigned long timeout)
+{
+  unsigned long startTime = millis();
+  unsigned long interval = SARA_R5_READY_PROBE_INITIAL;
+
+  while ((millis() - startTime) < timeout)
+  {
+    if (sendCommandWithResponse(nullptr, SARA_R5_RESPONSE_OK, nullptr, SARA_R5_READY_PROBE_TIMEOUT) == SARA_R5_ERROR_SUCCESS)
+    {
+      _bootTime = millis() - startTime;
+      if (_printDebug == true)
+      {
+        _debugPort->print(F("waitForReady: module ready after "));
+        _debugPort->print(_bootTime);
+        _debugPort->println(F("ms"));
+      }
+      return SARA_R5_ERROR_SUCCESS;
+    }
+
+    // Wait for the next probe. Stop waiting if the module sends a line
+    unsigned long waitStart = millis();
+    bool lineReceived = false;
+    while ((lineReceived == false) && ((millis() - waitStart) < interval) && ((millis() - startTime) < timeout))
+    {
+      if (hwAvailable() > 0) //hwAvailable can return -1 if the serial port is NULL
+      {
+        char c = readChar();
+        if (_rxTaskMode == false)
+          bufferURCChar(c); // Queue any start-up URCs
+        if (c == '\n')
+          lineReceived = true;
+      }
+      else
+      {
+        yield();
+      }
+    }
+
+    interval *= 2;
+    if (interval > SARA_R5_READY_PROBE_MAX)
+      interval = SARA_R5_READY_PROBE_MAX;
+  }
+
+  if (_printDebug == true)
+    _debugPort->println(F("waitForReady: timeout"));
+  return SARA_R5_ERROR_NO_RESPONSE;
+}
+
+SARA_R5_error_t SARA_R5::enableEcho(bool enable)
+{
+  SARA_R5_error_t err;
+  char *command;
+
+  command = sara_r5_calloc_char(strlen(SARA_R5_COMMAND_ECHO) + 2);
+  if (command == nullptr)
+    return SARA_R5_ERROR_OUT_OF_MEMORY;
+  sprintf(command, "%s%d", SARA_R5_COMMAND_ECHO, enable ? 1 : 0);
+  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK,
+                                nullptr, SARA_R5_STANDARD_RESPONSE_TIMEOUT);
+  free(command);
+  return err;
+}
+
+// The identity getters are served from the identity record - see getIdentity
+String SARA_R5::getManufacturerID(void)
+{
+  const SARA_R5_identity_t *identity = loadIdentity(true, false);
+  return String((identity == nullptr) ? "" : identity->manufacturer);
+}
+
+String SARA_R5::getModelID(void)
+{
+  const SARA_R5_identity_t *identity = loadIdentity(true, false);
+  return String((identity == nullptr) ? "" : identity->model);
+}
+
+String SARA_R5::getFirmwareVersion(void)
+{
+  const SARA_R5_identity_t *identity = loadIdentity(true, false);
+  return String((identity == nullptr) ? "" : identity->firmware);
+}
+
+String SARA_R5::getSerialNo(void)
+{
+  const SARA_R5_identity_t *identity = loadIdentity(true, false);
+  return String((identity == nullptr) ? "" : identity->serialNo);
+}
+
+String SARA_R5::getIMEI(void)
+{
+  const SARA_R5_identity_t *identity = loadIdentity(true, false);
+  return String((identity == nullptr) ? "" : identity->imei);
+}
+
+String SARA_R5::getIMSI(void)
+{
+  const SARA_R5_identity_t *identity = loadIdentity(false, true);
+  return String((identity == nullptr) ? "" : identity->imsi);
+}
+
+String SARA_R5::getCCID(void)
+{
+  const SARA_R5_identity_t *identity = loadIdentity(false, true);
+  return String((identity == nullptr) ? "" : identity->ccid);
+}
+
+String SARA_R5::getSubscriberNo(void)
+{
+  const SARA_R5_identity_t *identity = loadIdentity(false, true);
+  return String((identity == nullptr) ? "" : identity->subscriberNo);
+}
+
+String SARA_R5::getCapabilities(void)
+{
+  const SARA_R5_identity_t *identity = loadIdentity(true, false);
+  return String((identity == nullptr) ? "" : identity->capabilities);
+}
+
+// Return the identity record, reading any part which is not valid from the module first.
+// Returns nullptr if the record could not be allocated. Check moduleValid and simValid for the rest
+const SARA_R5_identity_t *SARA_R5::getIdentity(void)
+{
+  return loadIdentity(true, true);
+}
+
+// Read the parts of the identity record which are requested and not valid.
+// The module part is read with one compound command: AT+CGMI;+CGMM;+CGMR;+CGSN;+GSN;+GCAP
+// The SIM part is read with another: AT+CIMI;+CCID;+CNUM. If that fails, it is not tried again until simFailed is cleared
+// or SARA_R5_IDENTITY_SIM_RETRY has passed
+const SARA_R5_identity_t *SARA_R5::loadIdentity(bool module, bool sim)
+{
+  SARA_R5_LOCK_TRANSACTION(SARA_R5_PRIORITY_NORMAL);
+  char *command;
+  char *response;
+  SARA_R5_error_t err;
+
+  if (nullptr == _identity)
+  {
+    _identity = new SARA_R5_identity_t;
+    if (nullptr == _identity)
+    {
+      if (_printDebug == true)
+        _debugPort->println(F("getIdentity: not enough memory for _identity!"));
+      return nullptr;
+    }
+    memset(_identity, 0, sizeof(SARA_R5_identity_t));
+  }
+
+  bool readModule = module && (_identity->moduleValid == false);
+  bool simRetry = (_identity->simFailed == false) || ((millis() - _identity->simFailedTime) >= SARA_R5_IDENTITY_SIM_RETRY);
+  bool readSim = sim && (_identity->simValid == false) && simRetry;
+  if ((readModule == false) && (readSim == false))
+    return _identity;
+
+  command = sara_r5_calloc_char(64);
+  if (command == nullptr)
+    return _identity;
+  response = sara_r5_calloc_char(SARA_R5_IDENTITY_RESPONSE_LENGTH);
+  if (response == nullptr)
+  {
+    free(command);
+    return _identity;
+  }
+
+  if (readModule)
+  {
+    sprintf(command, "%s;%s;%s;%s;%s;%s", SARA_R5_COMMAND_MANU_ID, SARA_R5_COMMAND_MODEL_ID, SARA_R5_COMMAND_FW_VER_ID,
+            SARA_R5_COMMAND_SERIAL_NO, SARA_R5_COMMAND_IMEI, SARA_R5_COMMAND_REQ_CAP);
+    err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, response,
+                                  SARA_R5_STANDARD_RESPONSE_TIMEOUT, SARA_R5_IDENTITY_RESPONSE_LENGTH);
+    if (err == SARA_R5_ERROR_SUCCESS)
+    {
+      // The first five responses have no prefix: u-blox, SARA-R510M8S, 02.06, 357520070120767, 357520070120767
+      char *fields[5] = {_identity->manufacturer, _identity->model, _identity->firmware, _identity->serialNo, _identity->imei};
+      size_t sizes[5] = {sizeof(_identity->manufacturer), sizeof(_identity->model), sizeof(_identity->firmware),
+                         sizeof(_identity->serialNo), sizeof(_identity->imei)};
+      int field = 0;
+      char *searchPtr = response;
+      while ((*searchPtr != 0) && (field < 5))
+      {
+        while ((*searchPtr == '\r') || (*searchPtr == '\n')) searchPtr++; // skip line endings
+        if (*searchPtr == 0)
+          break;
+        if ((*searchPtr != '+') && (strncmp(searchPtr, "AT", 2) != 0)) // Skip the URCs and the echo
+        {
+          identityCopy(fields[field], sizes[field], searchPtr);
+          field++;
+        }
+        while ((*searchPtr != 0) && (*searchPtr != '\r') && (*searchPtr != '\n')) searchPtr++; // next line
+      }
+      searchPtr = strstr(response, "\r\n+GCAP:"); // E.g. +GCAP: +FCLASS, +CGSM
+      if (searchPtr != nullptr)
+      {
+        searchPtr += strlen("\r\n+GCAP:"); // Move searchPtr to first character - probably a space
+        while (*searchPtr == ' ') searchPtr++; // skip spaces
+        identityCopy(_identity->capabilities, sizeof(_identity->capabilities), searchPtr);
+      }
+      _identity->moduleValid = (field == 5);
+    }
+  }
+
+  if (readSim)
+  {
+    // +CNUM fails on some SIMs. If the full line fails, try again without it
+    for (int attempt = 0; (attempt < 2) && (_identity->simValid == false); attempt++)
+    {
+      if (attempt == 0)
+        sprintf(command, "%s;%s;%s", SARA_R5_COMMAND_IMSI, SARA_R5_COMMAND_CCID, SARA_R5_COMMAND_CNUM);
+      else
+        sprintf(command, "%s;%s", SARA_R5_COMMAND_IMSI, SARA_R5_COMMAND_CCID);
+      memset(response, 0, SARA_R5_IDENTITY_RESPONSE_LENGTH);
+      err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, response,
+                                    SARA_R5_10_SEC_TIMEOUT, SARA_R5_IDENTITY_RESPONSE_LENGTH);
+      if (err != SARA_R5_ERROR_SUCCESS)
+        continue;
+
+      _identity->imsi[0] = 0;
+      _identity->ccid[0] = 0;
+      _identity->subscriberNo[0] = 0;
+      char *searchPtr = response; // The IMSI has no prefix: 222107701772423
+      while (*searchPtr != 0)
+      {
+        while ((*searchPtr == '\r') || (*searchPtr == '\n')) searchPtr++; // skip line endings
+        if ((*searchPtr >= '0') && (*searchPtr <= '9'))
+        {
+          identityCopy(_identity->imsi, sizeof(_identity->imsi), searchPtr);
+          break;
+        }
+        while ((*searchPtr != 0) && (*searchPtr != '\r') && (*searchPtr != '\n')) searchPtr++; // next line
+      }
+      searchPtr = strstr(response, "\r\n+CCID:"); // E.g. +CCID: 8939107900010087330
+      if (searchPtr != nullptr)
+      {
+        searchPtr += strlen("\r\n+CCID:"); // Move searchPtr to first character - probably a space
+        while (*searchPtr == ' ') searchPtr++; // skip spaces
+        identityCopy(_identity->ccid, sizeof(_identity->ccid), searchPtr);
+      }
+      searchPtr = strstr(response, "\r\n+CNUM:"); // E.g. +CNUM: "ABCD . AAA","123456789012",129
+      if (searchPtr != nullptr)
+      {
+        searchPtr += strlen("\r\n+CNUM:"); // Move searchPtr to first character - probably a space
+        while (*searchPtr == ' ') searchPtr++; // skip spaces
+        identityCopy(_identity->subscriberNo, sizeof(_identity->subscriberNo), searchPtr);
+      }
+      _identity->simValid = ((_identity->imsi[0] != 0) && (_identity->ccid[0] != 0));
+    }
+    _identity->simFailed = (_identity->simValid == false);
+    _identity->simFailedTime = millis();
+  }
+
+  free(command);
+  free(response);
+  return _identity;
+}
+
+// Mark the identity record as out of date. It is read again on the next call of getIdentity (or the identity getters)
+void SARA_R5::invalidateIdentity(bool simOnly)
+{
+  if (nullptr == _identity)
+    return;
+  if (simOnly == false)
+    _identity->moduleValid = false;
+  _identity->simValid = false;
+  _identity->simFailed = false; // Try the SIM again
+}
+
+// Copy one line of a response into dest. Stops at the end of the line. dest is always null-terminated
+void SARA_R5::identityCopy(char *dest, size_t destSize, const char *src)
+{
+  size_t i = 0;
+  while ((i < (destSize - 1)) && (src[i] != 0) && (src[i] != '\r') && (src[i] != '\n'))
+  {
+    dest[i] = src[i];
+    i++;
+  }
+  dest[i] = 0;
+}
+
+SARA_R5_error_t SARA_R5::reset(void)
+{
+  moduleWasReset(); // The module is reset
+
+  SARA_R5_error_t err;
+
+  err = functionality(SILENT_RESET_WITH_SIM);
+  if (err == SARA_R5_ERROR_SUCCESS)
+  {
+    // Reset will set the baud rate back to 115200
+    //beginSerial(9600);
+    err = SARA_R5_ERROR_INVALID;
+    while (err != SARA_R5_ERROR_SUCCESS)
+    {
+      beginSerial(SARA_R5_DEFAULT_BAUD_RATE);
+      setBaud(_baud);
+      beginSerial(_baud);
+      err = at();
+    }
+    return init(_baud);
+  }
+  return err;
+}
+
+String SARA_R5::clock(void)
+{
+  SARA_R5_error_t err;
+  char *command;
+  char *response;
+  char *clockBegin;
+  char *clockEnd;
+
+  command = sara_r5_calloc_char(strlen(SARA_R5_COMMAND_CLOCK) + 2);
+  if (command == nullptr)
+    return "";
+  sprintf(command, "%s?", SARA_R5_COMMAND_CLOCK);
+
+  response = sara_r5_calloc_char(minimumResponseAllocation);
+  if (response == nullptr)
+  {
+    free(command);
+    return "";
+  }
+
+  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR,
+                                response, SARA_R5_STANDARD_RESPONSE_TIMEOUT);
+  if (err != SARA_R5_ERROR_SUCCESS)
+  {
+    free(command);
+    free(response);
+    return "";
+  }
+
+  // Response format: \r\n+CCLK: "YY/MM/DD,HH:MM:SS-TZ"\r\n\r\nOK\r\n
+  clockBegin = strchr(response, '\"'); // Find first quote
+  if (clockBegin == nullptr)
+  {
+    free(command);
+    free(response);
+    return "";
+  }
+  clockBegin += 1;                     // Increment pointer to begin at first number
+  clockEnd = strchr(clockBegin, '\"'); // Find last quote
+  if (clockEnd == nullptr)
+  {
+    free(command);
+    free(response);
+    return "";
+  }
+  *(clockEnd) = '\0'; // Set last quote to null char -- end string
+
+  String clock = String(clockBegin); // Extract the clock as a String _before_ freeing response
+
+  free(command);
+  free(response);
+
+  return (clock);
+}
+
+SARA_R5_error_t SARA_R5::clock(uint8_t *y, uint8_t *mo, uint8_t *d,
+                               uint8_t *h, uint8_t *min, uint8_t *s, int8_t *tz)
+{
+  SARA_R5_error_t err;
+  char *command;
+  char *response;
+  char tzPlusMinus;
+  int scanNum = 0;
+
+  int iy, imo, id, ih, imin, is, itz;
+
+  command = sara_r5_calloc_char(strlen(SARA_R5_COMMAND_CLOCK) + 2);
+  if (command == nullptr)
+    return SARA_R5_ERROR_OUT_OF_MEMORY;
+  sprintf(command, "%s?", SARA_R5_COMMAND_CLOCK);
+
+  response = sara_r5_calloc_char(minimumResponseAllocation);
+  if (response == nullptr)
+  {
+    free(command);
+    return SARA_R5_ERROR_OUT_OF_MEMORY;
+  }
+
+  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR,
+                                response, SARA_R5_STANDARD_RESPONSE_TIMEOUT);
+
+  // Response format (if TZ is negative): \r\n+CCLK: "YY/MM/DD,HH:MM:SS-TZ"\r\n\r\nOK\r\n
+  if (err == SARA_R5_ERROR_SUCCESS)
+  {
+    char *searchPtr = strstr(response, "+CCLK:");
+    if (searchPtr != nullptr)
+    {
+      searchPtr += strlen("+CCLK:"); //  Move searchPtr to first char
+      while (*searchPtr == ' ') searchPtr++; // skip spaces
+      scanNum = sscanf(searchPtr, "\"%d/%d/%d,%d:%d:%d%c%d\"\r\n",
+               &iy, &imo, &id, &ih, &imin, &is, &tzPlusMinus, &itz);
+    }
+    if (scanNum == 8)
+    {
+      *y = iy;
+      *mo = imo;
+      *d = id;
+      *h = ih;
+      *min = imin;
+      *s = is;
+      if (tzPlusMinus == '-')
+        *tz = 0 - itz;
+      else
+        *tz = itz;
+    }
+    else
+      err = SARA_R5_ERROR_UNEXPECTED_RESPONSE;
+  }
+
+  free(command);
+  free(response);
+  return err;
+}
+
+SARA_R5_error_t SARA_R5::setClock(uint8_t y, uint8_t mo, uint8_t d,
+                                  uint8_t h, uint8_t min, uint8_t s, int8_t tz)
+{
+  //Convert y,mo,d,h,min,s,tz into a String
+  //Some platforms don't support sprintf correctly (for %02d or %+02d) so we need to build the String manually
+  //Format is "yy/MM/dd,hh:mm:ss+TZ"
+  //TZ can be +/- and is in increments of 15 minutes (not hours)
+
+  String theTime = "";
+
+  theTime.concat(y / 10);
+  theTime.concat(y % 10);
+  theTime.concat('/');
+  theTime.concat(mo / 10);
+  theTime.concat(mo % 10);
+  theTime.concat('/');
+  theTime.concat(d / 10);
+  theTime.concat(d % 10);
+  theTime.concat(',');
+  theTime.concat(h / 10);
+  theTime.concat(h % 10);
+  theTime.concat(':');
+  theTime.concat(min / 10);
+  theTime.concat(min % 10);
+  theTime.concat(':');
+  theTime.concat(s / 10);
+  theTime.concat(s % 10);
+  if (tz < 0)
+  {
+    theTime.concat('-');
+    tz = 0 - tz;
+  }
+  else
+    theTime.concat('+');
+  theTime.concat(tz / 10);
+  theTime.concat(tz % 10);
+
+  return (setClock(theTime));
+}
+
+SARA_R5_error_t SARA_R5::setClock(String theTime)
+{
+  SARA_R5_error_t err;
+  char *command;
+
+  command = sara_r5_calloc_char(strlen(SARA_R5_COMMAND_CLOCK) + theTime.length() + 8);
+  if (command == nullptr)
+    return SARA_R5_ERROR_OUT_OF_MEMORY;
+  sprintf(command, "%s=\"%s\"", SARA_R5_COMMAND_CLOCK, theTime.c_str());
+
+  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR,
+                                nullptr, SARA_R5_STANDARD_RESPONSE_TIMEOUT);
+
+  free(command);
+  return err;
+}
+
+void SARA_R5::autoTimeZoneForBegin(bool tz)
+{
+  _autoTimeZoneForBegin = tz;
+}
+
+void SARA_R5::warmStartForBegin(bool enable, bool keepSockets)
+{
+  _warmStartForBegin = enable;
+  _warmStartKeepSockets = keepSockets;
+}
+
+SARA_R5_error_t SARA_R5::setUtimeMode(SARA_R5_utime_mode_t mode, SARA_R5_utime_sensor_t sensor)
+{
+  SARA_R5_error_t err;
+  char *command;
+
+  command = sara_r5_calloc_char(strlen(SARA_R5_GNSS_REQUEST_TIME) + 16);
+  if (command == nullptr)
+    return SARA_R5_ERROR_OUT_OF_MEMORY;
+  if (mode == SARA_R5_UTIME_MODE_STOP) // stop UTIME does not require a sensor
+    sprintf(command, "%s=%d", SARA_R5_GNSS_REQUEST_TIME, mode);
+  else
+    sprintf(command, "%s=%d,%d", SARA_R5_GNSS_REQUEST_TIME, mode, sensor);
+
+  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR,
+                                nullptr, SARA_R5_10_SEC_TIMEOUT);
+  free(command);
+  return err;
+}
+
+SARA_R5_error_t SARA_R5::getUtimeMode(SARA_R5_utime_mode_t *mode, SARA_R5_utime_sensor_t *sensor)
+{
+  SARA_R5_error_t err;
+  char *command;
+  char *response;
+
+  SARA_R5_utime_mode_t m;
+  SARA_R5_utime_sensor_t s;
+
+  command = sara_r5_calloc_char(strlen(SARA_R5_GNSS_REQUEST_TIME) + 2);
+  if (command == nullptr)
+    return SARA_R5_ERROR_OUT_OF_MEMORY;
+  sprintf(command, "%s?", SARA_R5_GNSS_REQUEST_TIME);
+
+  response = sara_r5_calloc_char(minimumResponseAllocation);
+  if (response == nullptr)
+  {
+    free(command);
+    return SARA_R5_ERROR_OUT_OF_MEMORY;
+  }
+
+  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR,
+                                response, SARA_R5_10_SEC_TIMEOUT);
+
+  // Response format: \r\n+UTIME: <mode>[,<sensor>]\r\n\r\nOK\r\n
+  if (err == SARA_R5_ERROR_SUCCESS)
+  {
+    int mStore, sStore, scanned = 0;
+    char *searchPtr = strstr(response, "+UTIME:");
+    if (searchPtr != nullptr)
+    {
+      searchPtr += strlen("+UTIME:"); // Move searchPtr to first character - probably a space
+      while (*searchPtr == ' ') searchPtr++; // skip spaces
+      scanned = sscanf(searchPtr, "%d,%d\r\n", &mStore, &sStore);
+    }
+    m = (SARA_R5_utime_mode_t)mStore;
+    s = (SARA_R5_utime_sensor_t)sStore;
+    if (scanned == 2)
+    {
+      *mode = m;
+      *sensor = s;
+    }
+    else if (scanned == 1)
+    {
+      *mode = m;
+      *sensor = SARA_R5_UTIME_SENSOR_NONE;
+    }
+    else
+      err = SARA_R5_ERROR_UNEXPECTED_RESPONSE;
+  }
+
+  free(command);
+  free(response);
+  return err;
+}
+
+SARA_R5_error_t SARA_R5::setUtimeIndication(SARA_R5_utime_urc_configuration_t config)
+{
+  SARA_R5_error_t err;
+  char *command;
+
+  command = sara_r5_calloc_char(strlen(SARA_R5_GNSS_TIME_INDICATION) + 16);
+  if (command == nullptr)
+    return SARA_R5_ERROR_OUT_OF_MEMORY;
+  sprintf(command, "%s=%d", SARA_R5_GNSS_TIME_INDICATION, config);
+
+  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR,
+                                nullptr, SARA_R5_STANDARD_RESPONSE_TIMEOUT);
+  free(command);
+  return err;
+}
+
+SARA_R5_error_t SARA_R5::getUtimeIndication(SARA_R5_utime_urc_configuration_t *config)
+{
+  SARA_R5_error_t err;
+  char *command;
+  char *response;
+
+  SARA_R5_utime_urc_configuration_t c;
+
+  command = sara_r5_calloc_char(strlen(SARA_R5_GNSS_TIME_INDICATION) + 2);
+  if (command == nullptr)
+    return SARA_R5_ERROR_OUT_OF_MEMORY;
+  sprintf(command, "%s?", SARA_R5_GNSS_TIME_INDICATION);
+
+  response = sara_r5_calloc_char(minimumResponseAllocation);
+  if (response == nullptr)
+  {
+    free(command);
+    return SARA_R5_ERROR_OUT_OF_MEMORY;
+  }
+
+  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR,
+                                response, SARA_R5_STANDARD_RESPONSE_TIMEOUT);
+
+  // Response format: \r\n+UTIMEIND: <mode>\r\n\r\nOK\r\n
+  if (err == SARA_R5_ERROR_SUCCESS)
+  {
+    int cStore, scanned = 0;
+    char *searchPtr = strstr(response, "+UTIMEIND:");
+    if (searchPtr != nullptr)
+    {
+      searchPtr += strlen("+UTIMEIND:"); //  Move searchPtr to first char
+      while (*searchPtr == ' ') searchPtr++; // skip spaces
+      scanned = sscanf(searchPtr, "%d\r\n", &cStore);
+    }
+    c = (SARA_R5_utime_urc_configuration_t)cStore;
+    if (scanned == 1)
+    {
+      *config = c;
+    }
+    else
+      err = SARA_R5_ERROR_UNEXPECTED_RESPONSE;
+  }
+
+  free(command);
+  free(response);
+  return err;
+}
+
+SARA_R5_error_t SARA_R5::setUtimeConfiguration(int32_t offsetNanoseconds, int32_t offsetSeconds)
+{
+  SARA_R5_error_t err;
+  char *command;
+
+  command = sara_r5_calloc_char(strlen(SARA_R5_GNSS_TIME_CONFIGURATION) + 48);
+  if (command == nullptr)
+    return SARA_R5_ERROR_OUT_OF_MEMORY;
+  sprintf(command, "%s=%d,%d", SARA_R5_GNSS_TIME_CONFIGURATION, (int)offsetNanoseconds, (int)offsetSeconds);
+
+  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR,
+                                nullptr, SARA_R5_STANDARD_RESPONSE_TIMEOUT);
+  free(command);
+  return err;
+}
+
+SARA_R5_error_t SARA_R5::getUtimeConfiguration(int32_t *offsetNanoseconds, int32_t *offsetSeconds)
+{
+  SARA_R5_error_t err;
+  char *command;
+  char *response;
+
+  int ons;
+  int os;
+
+  command = sara_r5_calloc_char(strlen(SARA_R5_GNSS_TIME_CONFIGURATION) + 2);
+  if (command == nullptr)
+    return SARA_R5_ERROR_OUT_OF_MEMORY;
+  sprintf(command, "%s?", SARA_R5_GNSS_TIME_CONFIGURATION);
+
+  response = sara_r5_calloc_char(minimumResponseAllocation);
+  if (response == nullptr)
+  {
+    free(command);
+    return SARA_R5_ERROR_OUT_OF_MEMORY;
+  }
+
+  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR,
+                                response, SARA_R5_STANDARD_RESPONSE_TIMEOUT);
+
+  // Response format: \r\n+UTIMECFG: <offset_nano>,<offset_sec>\r\n\r\nOK\r\n
+  if (err == SARA_R5_ERROR_SUCCESS)
+  {
+    int scanned = 0;
+    char *searchPtr = strstr(response, "+UTIMECFG:");
+    if (searchPtr != nullptr)
+    {
+      searchPtr += strlen("+UTIMECFG:"); //  Move searchPtr to first char
+      while (*searchPtr == ' ') searchPtr++; // skip spaces
+      scanned = sscanf(searchPtr, "%d,%d\r\n", &ons, &os);
+    }
+    if (scanned == 2)
+    {
+      *offsetNanoseconds = ons;
+      *offsetSeconds = os;
+    }
+    else
+      err = SARA_R5_ERROR_UNEXPECTED_RESPONSE;
+  }
+
+  free(command);
+  free(response);
+  return err;
+}
+
+SARA_R5_error_t SARA_R5::autoTimeZone(bool enable)
+{
+  SARA_R5_error_t err;
+  char *command;
+
+  command = sara_r5_calloc_char(strlen(SARA_R5_COMMAND_AUTO_TZ) + 3);
+  if (command == nullptr)
+    return SARA_R5_ERROR_OUT_OF_MEMORY;
+  sprintf(command, "%s=%d", SARA_R5_COMMAND_AUTO_TZ, enable ? 1 : 0);
+
+  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR,
+                                nullptr, SARA_R5_STANDARD_RESPONSE_TIMEOUT);
+  free(command);
+  return err;
+}
+
+int8_t SARA_R5::rssi(void)
+{
+  char *command;
+  char *response;
+  SARA_R5_error_t err;
+  int rssi;
+
+  command = sara_r5_calloc_char(strlen(SARA_R5_SIGNAL_QUALITY) + 1);
+  if (command == nullptr)
+    return SARA_R5_ERROR_OUT_OF_MEMORY;
+  sprintf(command, "%s", SARA_R5_SIGNAL_QUALITY);
+
+  response = sara_r5_calloc_char(minimumResponseAllocation);
+  if (response == nullptr)
+  {
+    free(command);
+    return SARA_R5_ERROR_OUT_OF_MEMORY;
+  }
+
+  err = sendCommandWithResponse(command,
+                                SARA_R5_RESPONSE_OK_OR_ERROR, response, 10000,
+                                minimumResponseAllocation, AT_COMMAND);
+  if (err != SARA_R5_ERROR_SUCCESS)
+  {
+    free(command);
+    free(response);
+    return -1;
+  }
+
+  int scanned = 0;
+  char *searchPtr = strstr(response, "+CSQ:");
+  if (searchPtr != nullptr)
+  {
+    searchPtr += strlen("+CSQ:"); //  Move searchPtr to first char
+    while (*searchPtr == ' ') searchPtr++; // skip spaces
+    scanned = sscanf(searchPtr, "%d,%*d", &rssi);
+  }
+  if (scanned != 1)
+  {
+    rssi = -1;
+  }
+
+  free(command);
+  free(response);
+  return rssi;
+}
+
+SARA_R5_error_t SARA_R5::getExtSignalQuality(signal_quality& signal_quality)
+{
+  char *command;
+  char *response;
+  SARA_R5_error_t err;
+
+  command = sara_r5_calloc_char(strlen(SARA_R5_EXT_SIGNAL_QUALITY) + 1);
+  if (command == nullptr)
+  {
+    return SARA_R5_ERROR_OUT_OF_MEMORY;
+  }
+
+  sprintf(command, "%s", SARA_R5_EXT_SIGNAL_QUALITY);
+
+  response = sara_r5_calloc_char(minimumResponseAllocation);
+  if (response == nullptr)
+  {
+    free(command);
+    return SARA_R5_ERROR_OUT_OF_MEMORY;
+  }
+
+  err = sendCommandWithResponse(command,
+                                SARA_R5_RESPONSE_OK_OR_ERROR, response, 10000,
+                                minimumResponseAllocation, AT_COMMAND);
+  if (err != SARA_R5_ERROR_SUCCESS)
+  {
+    free(command);
+    free(response);
+    return SARA_R5_ERROR_ERROR;
+  }
+
+  int scanned = 0;
+  const char * responseStr = "+CESQ:";
+  char *searchPtr = strstr(response, responseStr);
+  if (searchPtr != nullptr)
+  {
+    searchPtr += strlen(responseStr); //  Move searchPtr to first char
+    while (*searchPtr == ' ') searchPtr++; // skip spaces
+    scanned = sscanf(searchPtr, "%u,%u,%u,%u,%u,%u", &signal_quality.rxlev, &signal_quality.ber,
+                       &signal_quality.rscp, &signal_quality.enc0, &signal_quality.rsrq, &signal_quality.rsrp);
+  }
+
+  err = SARA_R5_ERROR_UNEXPECTED_RESPONSE;
+  if (scanned == 6)
+  {
+    err = SARA_R5_ERROR_SUCCESS;
+  }
+
+  free(command);
+  free(response);
+  return err;
+}
+
+// Background signal quality sampler - see SARA_R5_SIGNAL_HISTORY_SIZE
+// +CESQ is read every period millis by bufferedPoll and poll. The samples are stored in a ring.
+// If adaptive is true, the period is doubled (up to SARA_R5_SIGNAL_MAX_PERIOD_FACTOR * period) while the signal is stable
+// and goes back to period when it changes
+SARA_R5_error_t SARA_R5::setSignalSampler(bool enable, unsigned long period, bool adaptive)
+{
+  if (enable == false)
+  {
+    if (nullptr != _signalHistory)
+      delete[] _signalHistory;
+    _signalHistory = nullptr;
+    return SARA_R5_ERROR_SUCCESS;
+  }
+
+  if (period == 0)
+    return SARA_R5_ERROR_UNEXPECTED_PARAM;
+
+  if (nullptr == _signalHistory)
+  {
+    _signalHistory = new SARA_R5_signal_sample_t[SARA_R5_SIGNAL_HISTORY_SIZE];
+    if (nullptr == _signalHistory)
+    {
+      if (_printDebug == true)
+        _debugPort->println(F("setSignalSampler: not enough memory for _signalHistory!"));
+      return SARA_R5_ERROR_OUT_OF_MEMORY;
+    }
+    _signalHistoryHead = 0;
+    _signalHistoryCount = 0;
+    _signalEwmaValid = 0;
+  }
+
+  _signalSampleBasePeriod = period;
+  _signalSamplePeriod = period;
+  _signalSampleAdaptive = adaptive;
+  _signalLastSample = millis() - period; // Take the first sample on the next poll
+  return SARA_R5_ERROR_SUCCESS;
+}
+
+int SARA_R5::getSignalSampleCount(void)
+{
+  if (nullptr == _signalHistory)
+    return 0;
+  return _signalHistoryCount;
+}
+
+// Copy a sample from the history. index 0 is the newest
+bool SARA_R5::getSignalSample(int index, SARA_R5_signal_sample_t *sample)
+{
+  if ((nullptr == _signalHistory) || (sample == nullptr) || (index < 0) || (index >= _signalHistoryCount))
+    return false;
+  int i = (_signalHistoryHead + SARA_R5_SIGNAL_HISTORY_SIZE - 1 - index) % SARA_R5_SIGNAL_HISTORY_SIZE;
+  *sample = _signalHistory[i];
+  return true;
+}
+
+// Calculate the statistics of one field over the history. The values are in +CESQ units. Unknown values
+// (99 for RXLEV and BER, 255 for RSRQ and RSRP) are ignored. Returns false if there are no known values
+bool SARA_R5::getSignalStats(SARA_R5_signal_field_t field, SARA_R5_signal_stats_t *stats)
+{
+  if ((nullptr == _signalHistory) || (stats == nullptr) || (field < 0) || (field >= SARA_R5_SIGNAL_NUM_FIELDS))
+    return false;
+
+  long sum = 0;
+  stats->count = 0;
+  stats->min = 255;
+  stats->max = 0;
+  for (int i = 0; i < _signalHistoryCount; i++)
+  {
+    uint8_t value = signalSampleField(&_signalHistory[i], field);
+    if (signalSampleUnknown(field, value))
+      continue;
+    if (value < stats->min)
+      stats->min = value;
+    if (value > stats->max)
+      stats->max = value;
+    sum += value;
+    stats->count++;
+  }
+  if (stats->count == 0)
+    return false;
+  stats->mean = (float)sum / stats->count;
+  stats->ewma = _signalEwma[field];
+  return true;
+}
+
+// Take a sample if one is due. Called by bufferedPoll and poll
+void SARA_R5::sampleSignalQuality(void)
+{
+  if ((nullptr == _signalHistory) || (_batchActive == true)) // Don't flush the batch early
+    return;
+  if ((millis() - _signalLastSample) < _signalSamplePeriod)
+    return;
+  _signalLastSample = millis();
+
+  signal_quality quality;
+  if (getExtSignalQuality(quality) != SARA_R5_ERROR_SUCCESS)
+    return;
+
+  SARA_R5_signal_sample_t *sample = &_signalHistory[_signalHistoryHead];
+  sample->time = _signalLastSample;
+  sample->rxlev = (uint8_t)quality.rxlev;
+  sample->ber = (uint8_t)quality.ber;
+  sample->rsrq = (uint8_t)quality.rsrq;
+  sample->rsrp = (uint8_t)quality.rsrp;
+  _signalHistoryHead = (_signalHistoryHead + 1) % SARA_R5_SIGNAL_HISTORY_SIZE;
+
+  bool stable = true;
+  for (int field = 0; field < SARA_R5_SIGNAL_NUM_FIELDS; field++)
+  {
+    uint8_t value = signalSampleField(sample, (SARA_R5_signal_field_t)field);
+    if (signalSampleUnknown((SARA_R5_signal_field_t)field, value))
+      continue;
+    if ((_signalEwmaValid & (1 << field)) == 0) // Is this the first known value?
+    {
+      _signalEwma[field] = value;
+      _signalEwmaValid |= (1 << field);
+      continue;
+    }
+    if ((field == SARA_R5_SIGNAL_RSRP) || (field == SARA_R5_SIGNAL_RXLEV)) // Check stability against the average so far
+    {
+      float delta = (float)value - _signalEwma[field];
+      if ((delta > SARA_R5_SIGNAL_STABLE_DELTA) || (delta < -SARA_R5_SIGNAL_STABLE_DELTA))
+        stable = false;
+    }
+    _signalEwma[field] += SARA_R5_SIGNAL_EWMA_ALPHA * ((float)value - _signalEwma[field]);
+  }
+
+  if (_signalHistoryCount < SARA_R5_SIGNAL_HISTORY_SIZE)
+    _signalHistoryCount++;
+
+  if (_signalSampleAdaptive == true)
+  {
+    if (stable == false)
+      _signalSamplePeriod = _signalSampleBasePeriod;
+    else if (_signalSamplePeriod < (_signalSampleBasePeriod * SARA_R5_SIGNAL_MAX_PERIOD_FACTOR))
+      _signalSamplePeriod *= 2;
+  }
+
+  if (_printDebug == true)
+  {
+    _debugPort->print(F("sampleSignalQuality: RSRP "));
+    _debugPort->print(sample->rsrp);
+    _debugPort->print(F(" next sample in "));
+    _debugPort->println(_signalSamplePeriod);
+  }
+}
+
+uint8_t SARA_R5::signalSampleField(const SARA_R5_signal_sample_t *sample, SARA_R5_signal_field_t field)
+{
+  switch (field)
+  {
+  case SARA_R5_SIGNAL_RXLEV:
+    return sample->rxlev;
+  case SARA_R5_SIGNAL_BER:
+    return sample->ber;
+  case SARA_R5_SIGNAL_RSRQ:
+    return sample->rsrq;
+  case SARA_R5_SIGNAL_RSRP:
+  default:
+    return sample->rsrp;
+  }
+}
+
+bool SARA_R5::signalSampleUnknown(SARA_R5_signal_field_t field, uint8_t value)
+{
+  if ((field == SARA_R5_SIGNAL_RXLEV) || (field == SARA_R5_SIGNAL_BER))
+    return (value == 99);
+  return (value == 255);
+}
+
+SARA_R5_registration_status_t SARA_R5::registration(bool eps)
+{
+  char *command;
+  char *response;
+  SARA_R5_error_t err;
+  int status;
+  int n;
+  unsigned int area = 0, ci = 0;
+  int Act = -1;
+  const SARA_R5_registration_state_t *state = &_registrationState[eps ? 1 : 0];
+
+  // If the URCs are enabled, answer from the registration state
+  if (_registrationURC[eps ? 1 : 0] == true)
+  {
+    peekRegistrationEvent(eps); // Apply the latest +CREG / +CEREG. The other events are left for bufferedPoll
+    if ((state->valid == true) && ((millis() - state->lastUpdate) < _registrationMaxAge))
+      return state->status;
+  }
+
+  const char* tag = eps ? SARA_R5_EPSREGISTRATION_STATUS : SARA_R5_REGISTRATION_STATUS;
+  command = sara_r5_calloc_char(strlen(tag) + 3);
+  if (command == nullptr)
+    return SARA_R5_REGISTRATION_INVALID;
+  sprintf(command, "%s?", tag);
+
+  response = sara_r5_calloc_char(minimumResponseAllocation);
+  if (response == nullptr)
+  {
+    free(command);
+    return SARA_R5_REGISTRATION_INVALID;
+  }
+
+  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR,
+                                response, SARA_R5_STANDARD_RESPONSE_TIMEOUT,
+                                minimumResponseAllocation, AT_COMMAND);
+  if (err != SARA_R5_ERROR_SUCCESS)
+  {
+    free(command);
+    free(response);
+    return SARA_R5_REGISTRATION_INVALID;
+  }
+
+  int scanned = 0;
+  const char *startTag = eps ? SARA_R5_EPSREGISTRATION_STATUS_URC : SARA_R5_REGISTRATION_STATUS_URC;
+  char *searchPtr = strstr(response, startTag);
+  if (searchPtr != nullptr)
+  {
+    searchPtr += eps ? strlen(SARA_R5_EPSREGISTRATION_STATUS_URC) : strlen(SARA_R5_REGISTRATION_STATUS_URC); //  Move searchPtr to first char
+    while (*searchPtr == ' ') searchPtr++; // skip spaces
+    scanned = sscanf(searchPtr, "%d,%d,\"%x\",\"%x\",%d", &n, &status, &area, &ci, &Act);
+  }
+  if (scanned >= 2)
+    updateRegistrationState(eps, status, (scanned >= 4) ? area : 0, (scanned >= 4) ? ci : 0, (scanned >= 5) ? Act : -1);
+  else
+    status = SARA_R5_REGISTRATION_INVALID;
+
+  free(command);
+  free(response);
+  return (SARA_R5_registration_status_t)status;
+}
+
+bool SARA_R5::setNetworkProfile(mobile_network_operator_t mno, bool autoReset, bool urcNotification)
+{
+  mobile_network_operator_t currentMno;
+
+  // Check currently set MNO profile
+  if (getMNOprofile(&currentMno) != SARA_R5_ERROR_SUCCESS)
+  {
+    return false;
+  }
+
+  if (currentMno == mno)
+  {
+    return true;
+  }
+
+  // Disable transmit and receive so we can change operator
+  if (functionality(MINIMUM_FUNCTIONALITY) != SARA_R5_ERROR_SUCCESS)
+  {
+    return false;
+  }
+
+  if (setMNOprofile(mno, autoReset, urcNotification) != SARA_R5_ERROR_SUCCESS)
+  {
+    return false;
+  }
+
+  if (reset() != SARA_R5_ERROR_SUCCESS)
+  {
+    return false;
+  }
+
+  return true;
+}
+
+mobile_network_operator_t SARA_R5::getNetworkProfile(void)
+{
+  mobile_network_operator_t mno;
+  SARA_R5_error_t err;
+
+  err = getMNOprofile(&mno);
+  if (err != SARA_R5_ERROR_SUCCESS)
+  {
+    return MNO_INVALID;
+  }
+  return mno;
+}
+
+SARA_R5_error_t SARA_R5::setAPN(String apn, uint8_t cid, SARA_R5_pdp_type pdpType)
+{
+  SARA_R5_error_t err;
+  char *command;
+  char pdpStr[8];
+
+  memset(pdpStr, 0, 8);
+
+  if (cid >= 8)
+    return SARA_R5_ERROR_UNEXPECTED_PARAM;
+
+  command = sara_r5_calloc_char(strlen(SARA_R5_MESSAGE_PDP_DEF) + strlen(apn.c_str()) + 16);
+  if (command == nullptr)
+    return SARA_R5_ERROR_OUT_OF_MEMORY;
+  switch (pdpType)
+  {
+  case PDP_TYPE_INVALID:
+    free(command);
+    return SARA_R5_ERROR_UNEXPECTED_PARAM;
+    break;
+  case PDP_TYPE_IP:
+    memcpy(pdpStr, "IP", 2);
+    break;
+  case PDP_TYPE_NONIP:
+    memcpy(pdpStr, "NONIP", 5);
+    break;
+  case PDP_TYPE_IPV4V6:
+    memcpy(pdpStr, "IPV4V6", 6);
+    break;
+  case PDP_TYPE_IPV6:
+    memcpy(pdpStr, "IPV6", 4);
+    break;
+  default:
+    free(command);
+    return SARA_R5_ERROR_UNEXPECTED_PARAM;
+    break;
+  }
+  if (apn == nullptr)
+  {
+    if (_printDebug == true)
+      _debugPort->println(F("setAPN: nullptr"));
+    sprintf(command, "%s=%d,\"%s\",\"\"", SARA_R5_MESSAGE_PDP_DEF,
+            cid, pdpStr);
+  }
+  else
+  {
+    if (_printDebug == true)
+    {
+      _debugPort->print(F("setAPN: "));
+      _debugPort->println(apn);
+    }
+    sprintf(command, "%s=%d,\"%s\",\"%s\"", SARA_R5_MESSAGE_PDP_DEF,
+            cid, pdpStr, apn.c_str());
+  }
+
+  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, nullptr,
+                                SARA_R5_STANDARD_RESPONSE_TIMEOUT);
+
+  free(command);
+
+  return err;
+}
+
+// Return the Access Point Name and IP address for the chosen context identifier
+SARA_R5_error_t SARA_R5::getAPN(int cid, String *apn, IPAddress *ip, SARA_R5_pdp_type* pdpType)
+{
+  SARA_R5_error_t err;
+  char *command;
+  char *response;
+
+  if (cid > SARA_R5_NUM_PDP_CONTEXT_IDENTIFIERS)
+    return SARA_R5_ERROR_ERROR;
+
+  command = sara_r5_calloc_char(strlen(SARA_R5_MESSAGE_PDP_DEF) + 3);
+  if (command == nullptr)
+    return SARA_R5_ERROR_OUT_OF_MEMORY;
+  sprintf(command, "%s?", SARA_R5_MESSAGE_PDP_DEF);
+
+  response = sara_r5_calloc_char(1024);
+  if (response == nullptr)
+  {
+    free(command);
+    return SARA_R5_ERROR_OUT_OF_MEMORY;
+  }
+
+  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, response,
+                                SARA_R5_STANDARD_RESPONSE_TIMEOUT, 1024);
+
+  if (err == SARA_R5_ERROR_SUCCESS)
+  {
+    // Example:
+    // +CGDCONT: 0,"IP","payandgo.o2.co.uk","0.0.0.0",0,0,0,0,0,0,0,0,0,0
+    // +CGDCONT: 1,"IP","payandgo.o2.co.uk.mnc010.mcc234.gprs","10.160.182.234",0,0,0,2,0,0,0,0,0,0
+	int rcid = -1;
+    char *searchPtr = response;
+
+    bool keepGoing = true;
+    while (keepGoing == true)
+    {
+      int scanned = 0;
+      // Find the first/next occurrence of +CGDCONT:
+      searchPtr = strstr(searchPtr, "+CGDCONT:");
+      if (searchPtr != nullptr)
+      {
+        char strPdpType[10];
+        char strApn[128];
+        int ipOct[4];
+
+        searchPtr += strlen("+CGDCONT:"); // Point to the cid
+        while (*searchPtr == ' ') searchPtr++; // skip spaces
+        scanned = sscanf(searchPtr, "%d,\"%[^\"]\",\"%[^\"]\",\"%d.%d.%d.%d",
+        &rcid, strPdpType, strApn,
+				&ipOct[0], &ipOct[1], &ipOct[2], &ipOct[3]);
+        if ((scanned == 7) && (rcid == cid)) {
+          if (apn) *apn = strApn;
+          for (int o = 0; ip && (o < 4); o++)
+          {
+            (*ip)[o] = (uint8_t)ipOct[o];
+          }
+          if (pdpType) {
+            *pdpType = (0 == strcmp(strPdpType, "IPV4V6"))  ? PDP_TYPE_IPV4V6 :
+                       (0 == strcmp(strPdpType, "IPV6"))    ? PDP_TYPE_IPV6 :
+                       (0 == strcmp(strPdpType, "IP"))	    ? PDP_TYPE_IP :
+                                                              PDP_TYPE_INVALID;
+          }
+          keepGoing = false;
+        }
+      }
+      else // We don't have a match so let's clear the APN and IP address
+      {
+        if (apn) *apn = "";
+        if (pdpType) *pdpType = PDP_TYPE_INVALID;
+        if (ip) *ip = {0, 0, 0, 0};
+        keepGoing = false;
+      }
+    }
+  }
+  else
+  {
+    err = SARA_R5_ERROR_UNEXPECTED_RESPONSE;
+  }
+
+  free(command);
+  free(response);
+
+  return err;
+}
+
+SARA_R5_error_t SARA_R5::getSimStatus(String* code)
+{
+  SARA_R5_error_t err;
+  char *command;
+  char *response;
+  command = sara_r5_calloc_char(strlen(SARA_R5_COMMAND_SIMPIN) + 2);
+  if (command == nullptr)
+    return SARA_R5_ERROR_OUT_OF_MEMORY;
+  sprintf(command, "%s?", SARA_R5_COMMAND_SIMPIN);
+  response = sara_r5_calloc_char(minimumResponseAllocation);
+  if (response == nullptr)
+  {
+    free(command);
+    return SARA_R5_ERROR_OUT_OF_MEMORY;
+  }
+  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR,
+                                response, SARA_R5_STANDARD_RESPONSE_TIMEOUT);
+
+  if (err == SARA_R5_ERROR_SUCCESS)
+  {
+    int scanned = 0;
+    char c[16];
+    char *searchPtr = strstr(response, "+CPIN:");
+    if (searchPtr != nullptr) {
+      searchPtr += strlen("+CPIN:"); //  Move searchPtr to first char
+      while (*searchPtr == ' ') searchPtr++; // skip spaces
+      scanned = sscanf(searchPtr, "%15s\r\n", c);
+    }
+    if (scanned == 1)
+    {
+      if(code)
+        *code = c;
+    }
+    else
+      err = SARA_R5_ERROR_UNEXPECTED_RESPONSE;
+  }
+
+  free(command);
+  free(response);
+
+  return err;
+}
+
+SARA_R5_error_t SARA_R5::setSimPin(String pin)
+{
+  SARA_R5_error_t err;
+  char *command;
+  command = sara_r5_calloc_char(strlen(SARA_R5_COMMAND_SIMPIN) + 4 + pin.length());
+  if (command == nullptr)
+    return SARA_R5_ERROR_OUT_OF_MEMORY;
+  sprintf(command, "%s=\"%s\"", SARA_R5_COMMAND_SIMPIN, pin.c_str());
+  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR,
+                                nullptr, SARA_R5_STANDARD_RESPONSE_TIMEOUT);
+  if (err == SARA_R5_ERROR_SUCCESS)
+    invalidateIdentity(true); // The SIM is unlocked. It can be read now
+  free(command);
+  return err;
+}
+
+SARA_R5_error_t SARA_R5::setSIMstateReportingMode(int mode)
+{
+  SARA_R5_error_t err;
+  char *command;
+
+  command = sara_r5_calloc_char(strlen(SARA_R5_SIM_STATE) + 4);
+  if (command == nullptr)
+    return SARA_R5_ERROR_OUT_OF_MEMORY;
+  sprintf(command, "%s=%d", SARA_R5_SIM_STATE, mode);
+
+  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR,
+                                nullptr, SARA_R5_STANDARD_RESPONSE_TIMEOUT);
+  free(command);
+  return err;
+}
+
+SARA_R5_error_t SARA_R5::getSIMstateReportingMode(int *mode)
+{
+  SARA_R5_error_t err;
+  char *command;
+  char *response;
+
+  int m;
+
+  command = sara_r5_calloc_char(strlen(SARA_R5_SIM_STATE) + 3);
+  if (command == nullptr)
+    return SARA_R5_ERROR_OUT_OF_MEMORY;
+  sprintf(command, "%s?", SARA_R5_SIM_STATE);
+
+  response = sara_r5_calloc_char(minimumResponseAllocation);
+  if (response == nullptr)
+  {
+    free(command);
+    return SARA_R5_ERROR_OUT_OF_MEMORY;
+  }
+
+  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR,
+                                response, SARA_R5_STANDARD_RESPONSE_TIMEOUT);
+
+  if (err == SARA_R5_ERROR_SUCCESS)
+  {
+    int scanned = 0;
+    char *searchPtr = strstr(response, "+USIMSTAT:");
+    if (searchPtr != nullptr)
+    {
+      searchPtr += strlen("+USIMSTAT:"); //  Move searchPtr to first char
+      while (*searchPtr == ' ') searchPtr++; // skip spaces
+      scanned = sscanf(searchPtr, "%d\r\n", &m);
+    }
+    if (scanned == 1)
+    {
+      *mode = m;
+    }
+    else
+      err = SARA_R5_ERROR_UNEXPECTED_RESPONSE;
+  }
+
+  free(command);
+  free(response);
+  return err;
+}
+
+const char *PPP_L2P[5] = {
+    "",
+    "PPP",
+    "M-HEX",
+    "M-RAW_IP",
+    "M-OPT-PPP",
+};
+
+SARA_R5_error_t SARA_R5::enterPPP(uint8_t cid, char dialing_type_char,
+                                  unsigned long dialNumber, SARA_R5::SARA_R5_l2p_t l2p)
+{
+  SARA_R5_error_t err;
+  char *command;
+
+  if ((dialing_type_char != 0) && (dialing_type_char != 'T') &&
+      (dialing_type_char != 'P'))
+  {
+    return SARA_R5_ERROR_UNEXPECTED_PARAM;
+  }
+
+  command = sara_r5_calloc_char(strlen(SARA_R5_MESSAGE_ENTER_PPP) + 32);
+  if (command == nullptr)
+    return SARA_R5_ERROR_OUT_OF_MEMORY;
+  if (dialing_type_char != 0)
+  {
+    sprintf(command, "%s%c*%lu**%s*%u#", SARA_R5_MESSAGE_ENTER_PPP, dialing_type_char,
+            dialNumber, PPP_L2P[l2p], (unsigned int)cid);
+  }
+  else
+  {
+    sprintf(command, "%s*%lu**%s*%u#", SARA_R5_MESSAGE_ENTER_PPP,
+            dialNumber, PPP_L2P[l2p], (unsigned int)cid);
+  }
+
+  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_CONNECT, nullptr,
+                                SARA_R5_STANDARD_RESPONSE_TIMEOUT);
+
+  free(command);
+  return err;
+}
+
+uint8_t SARA_R5::getOperators(struct operator_stats *opRet, int maxOps)
+{
+  SARA_R5_error_t err;
+  char *command;
+  char *response;
+  uint8_t opsSeen = 0;
+
+  command = sara_r5_calloc_char(strlen(SARA_R5_OPERATOR_SELECTION) + 3);
+  if (command == nullptr)
+    return SARA_R5_ERROR_OUT_OF_MEMORY;
+  sprintf(command, "%s=?", SARA_R5_OPERATOR_SELECTION);
+
+  int responseSize = (maxOps + 1) * 48;
+  response = sara_r5_calloc_char(responseSize);
+  if (response == nullptr)
+  {
+    free(command);
+    return SARA_R5_ERROR_OUT_OF_MEMORY;
+  }
+
+  // AT+COPS maximum response time is 3 minutes (180000 ms)
+  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, response,
+                                SARA_R5_3_MIN_TIMEOUT, responseSize);
+
+  // Sample responses:
+  // +COPS: (3,"Verizon Wireless","VzW","311480",8),,(0,1,2,3,4),(0,1,2)
+  // +COPS: (1,"313 100","313 100","313100",8),(2,"AT&T","AT&T","310410",8),(3,"311 480","311 480","311480",8),,(0,1,2,3,4),(0,1,2)
+
+  if (_printDebug == true)
+  {
+    _debugPort->print(F("getOperators: Response: {"));
+    _debugPort->print(response);
+    _debugPort->println(F("}"));
+  }
+
+  if (err == SARA_R5_ERROR_SUCCESS)
+  {
+    char *opBegin;
+    char *opEnd;
+    int op = 0;
+    int stat;
+    char longOp[26];
+    char shortOp[11];
+    int act;
+    unsigned long numOp;
+
+    opBegin = response;
+
+    for (; op < maxOps; op++)
+    {
+      opBegin = strchr(opBegin, '(');
+      if (opBegin == nullptr)
+        break;
+      opEnd = strchr(opBegin, ')');
+      if (opEnd == nullptr)
+        break;
+
+      int sscanRead = sscanf(opBegin, "(%d,\"%[^\"]\",\"%[^\"]\",\"%lu\",%d)%*s",
+                             &stat, longOp, shortOp, &numOp, &act);
+      if (sscanRead == 5)
+      {
+        opRet[op].stat = stat;
+        opRet[op].longOp = (String)(longOp);
+        opRet[op].shortOp = (String)(shortOp);
+        opRet[op].numOp = numOp;
+        opRet[op].act = act;
+        opsSeen += 1;
+        storeScannedOperator(stat, longOp, shortOp, numOp, act); // Remember it in the operator table too
+      }
+      // TODO: Search for other possible patterns here
+      else
+      {
+        break; // Break out if pattern doesn't match.
+      }
+      opBegin = opEnd + 1; // Move opBegin to beginning of next value
+    }
+  }
+
+  free(command);
+  free(response);
+
+  return opsSeen;
+}
+
+SARA_R5_error_t SARA_R5::registerOperator(struct operator_stats oper)
+{
+  SARA_R5_error_t err;
+  char *command;
+
+  command = sara_r5_calloc_char(strlen(SARA_R5_OPERATOR_SELECTION) + 24);
+  if (command == nullptr)
+    return SARA_R5_ERROR_OUT_OF_MEMORY;
+  sprintf(command, "%s=1,2,\"%lu\"", SARA_R5_OPERATOR_SELECTION, oper.numOp);
+
+  // AT+COPS maximum response time is 3 minutes (180000 ms)
+  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, nullptr,
+                                SARA_R5_3_MIN_TIMEOUT);
+
+  free(command);
+  return err;
+}
+
+// Start a non-blocking operator scan (AT+COPS=?). The response is parsed as it arrives, by bufferedPoll (or rxTask).
+// Each operator is added to the operator table and passed to the callback (if there is one) as soon as it is parsed.
+// The module cannot process any other command while it is scanning - sending anything would abort the scan.
+// So sendCommandWithResponse returns SARA_R5_ERROR_INVALID until the scan is complete. Use abortOperatorScan to stop it.
+SARA_R5_error_t SARA_R5::startOperatorScan(void (*operatorScanCallback)(const SARA_R5_operator_entry_t *entry))
+{
+  SARA_R5_LOCK_TRANSACTION(SARA_R5_PRIORITY_NORMAL);
+  char *command;
+
+  if (isOperatorScanActive())
+    return SARA_R5_ERROR_INVALID;
+
+  if (allocateOperatorScan() == false)
+    return SARA_R5_ERROR_OUT_OF_MEMORY;
+
+  command = sara_r5_calloc_char(strlen(SARA_R5_OPERATOR_SELECTION) + 3);
+  if (command == nullptr)
+    return SARA_R5_ERROR_OUT_OF_MEMORY;
+  sprintf(command, "%s=?", SARA_R5_OPERATOR_SELECTION);
+
+  _operatorScanCallback = operatorScanCallback;
+  _operatorScan->result = SARA_R5_ERROR_INVALID;
+  _operatorScan->tupleLength = -1;
+  _operatorScan->lineLength = 0;
+  _operatorScan->found = 0;
+
+  sendCommand(command, true); // Queues any URCs which are waiting
+  _operatorScan->start = millis();
+  _operatorScan->active = true;
+
+  free(command);
+  return SARA_R5_ERROR_SUCCESS;
+}
+
+bool SARA_R5::isOperatorScanActive(void)
+{
+  return ((nullptr != _operatorScan) && (_operatorScan->active == true));
+}
+
+// SARA_R5_ERROR_INVALID while the scan is active (or if there has not been one). SARA_R5_ERROR_SUCCESS if it completed.
+// SARA_R5_ERROR_ERROR if the module returned an error or the scan was aborted. SARA_R5_ERROR_TIMEOUT if there was no result
+SARA_R5_error_t SARA_R5::getOperatorScanResult(void)
+{
+  if ((nullptr == _operatorScan) || (_operatorScan->active == true))
+    return SARA_R5_ERROR_INVALID;
+  return _operatorScan->result;
+}
+
+// Stop the operator scan. Sending any character to the module aborts AT+COPS=?
+SARA_R5_error_t SARA_R5::abortOperatorScan(void)
+{
+  SARA_R5_LOCK_TRANSACTION(SARA_R5_PRIORITY_NORMAL);
+
+  if (isOperatorScanActive() == false)
+    return SARA_R5_ERROR_SUCCESS;
+
+  hwPrint("\r");
+
+  // Wait for the final result code, so it cannot be mistaken for the response to the next command
+  unsigned long timeIn = millis();
+  while ((_operatorScan->active == true) && ((millis() - timeIn) < SARA_R5_STANDARD_RESPONSE_TIMEOUT))
+  {
+    bufferedPoll();
+    yield();
+  }
+
+  _operatorScan->active = false;
+  _operatorScan->result = SARA_R5_ERROR_ERROR;
+  return SARA_R5_ERROR_SUCCESS;
+}
+
+// The number of operators in the operator table. The table holds the operators seen by startOperatorScan and getOperators
+int SARA_R5::getScannedOperatorCount(void)
+{
+  if (nullptr == _operatorScan)
+    return 0;
+  return _operatorScan->count;
+}
+
+bool SARA_R5::getScannedOperator(int index, SARA_R5_operator_entry_t *entry)
+{
+  if ((nullptr == _operatorScan) || (entry == nullptr) || (index < 0) || (index >= _operatorScan->count))
+    return false;
+  *entry = _operatorScan->table[index];
+  return true;
+}
+
+// Manually register with an operator from the operator table - without scanning again
+SARA_R5_error_t SARA_R5::registerOperator(const SARA_R5_operator_entry_t *entry)
+{
+  SARA_R5_error_t err;
+  char *command;
+
+  if (entry == nullptr)
+    return SARA_R5_ERROR_UNEXPECTED_PARAM;
+
+  command = sara_r5_calloc_char(strlen(SARA_R5_OPERATOR_SELECTION) + 28);
+  if (command == nullptr)
+    return SARA_R5_ERROR_OUT_OF_MEMORY;
+  sprintf(command, "%s=1,2,\"%lu\",%d", SARA_R5_OPERATOR_SELECTION, entry->numOp, entry->act);
+
+  // AT+COPS maximum response time is 3 minutes (180000 ms)
+  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, nullptr,
+                                SARA_R5_3_MIN_TIMEOUT);
+
+  free(command);
+  return err;
+}
+
+bool SARA_R5::allocateOperatorScan(void)
+{
+  if (nullptr != _operatorScan)
+    return true;
+  _operatorScan = new SARA_R5_operator_scan_t;
+  if (nullptr == _operatorScan)
+  {
+    if (_printDebug == true)
+      _debugPort->println(F("allocateOperatorScan: not enough memory for _operatorScan!"));
+    return false;
+  }
+  _operatorScan->count = 0;
+  _operatorScan->active = false;
+  _operatorScan->start = 0;
+  _operatorScan->result = SARA_R5_ERROR_INVALID;
+  _operatorScan->found = 0;
+  _operatorScan->tupleLength = -1;
+  _operatorScan->lineLength = 0;
+  return true;
+}
+
+// Add an operator to the operator table - or update it if it is already there. When the table is full,
+// the entry which was seen longest ago is replaced
+SARA_R5_operator_entry_t *SARA_R5::storeScannedOperator(int stat, const char *longOp, const char *shortOp, unsigned long numOp, int act)
+{
+  if (allocateOperatorScan() == false)
+    return nullptr;
+
+  int index = -1;
+  for (int i = 0; (i < _operatorScan->count) && (index < 0); i++)
+  {
+    if (_operatorScan->table[i].numOp == numOp)
+      index = i;
+  }
+  if ((index < 0) && (_operatorScan->count < SARA_R5_OPERATOR_TABLE_SIZE))
+    index = _operatorScan->count++;
+  if (index < 0)
+  {
+    index = 0;
+    for (int i = 1; i < _operatorScan->count; i++)
+    {
+      if ((long)(_operatorScan->table[i].time - _operatorScan->table[index].time) < 0)
+        index = i;
+    }
+  }
+
+  SARA_R5_operator_entry_t *entry = &_operatorScan->table[index];
+  entry->stat = (uint8_t)stat;
+  entry->act = (uint8_t)act;
+  entry->numOp = numOp;
+  entry->time = millis();
+  strncpy(entry->longOp, longOp, sizeof(entry->longOp) - 1);
+  entry->longOp[sizeof(entry->longOp) - 1] = 0;
+  strncpy(entry->shortOp, shortOp, sizeof(entry->shortOp) - 1);
+  entry->shortOp[sizeof(entry->shortOp) - 1] = 0;
+  return entry;
+}
+
+// Parse the response to AT+COPS=? one character at a time. Called by bufferURCChar while the scan is active.
+// Sample response:
+// +COPS: (1,"313 100","313 100","313100",8),(2,"AT&T","AT&T","310410",8),,(0,1,2,3,4),(0,1,2)
+void SARA_R5::operatorScanChar(char c)
+{
+  SARA_R5_operator_scan_t *scan = _operatorScan;
+
+  if (c == '(')
+  {
+    scan->tupleLength = 0;
+  }
+  else if ((c == ')') && (scan->tupleLength >= 0))
+  {
+    int stat;
+    char longOp[26];
+    char shortOp[11];
+    unsigned long numOp;
+    int act;
+
+    scan->tuple[scan->tupleLength] = '\0';
+    scan->tupleLength = -1;
+    // The supported modes and formats lists at the end do not match
+    if (sscanf(scan->tuple, "%d,\"%25[^\"]\",\"%10[^\"]\",\"%lu\",%d", &stat, longOp, shortOp, &numOp, &act) == 5)
+    {
+      SARA_R5_operator_entry_t *entry = storeScannedOperator(stat, longOp, shortOp, numOp, act);
+      scan->found++;
+      if ((entry != nullptr) && (_operatorScanCallback != nullptr))
+        _operatorScanCallback(entry);
+    }
+  }
+  else if (scan->tupleLength >= 0)
+  {
+    if (scan->tupleLength < (SARA_R5_OPERATOR_TUPLE_LENGTH - 1))
+      scan->tuple[scan->tupleLength++] = c;
+    else
+      scan->tupleLength = -1; // Too long. Discard it
+  }
+
+  // Watch for the final result code
+  if ((c == '\r') || (c == '\n'))
+  {
+    scan->line[scan->lineLength] = '\0';
+    if (strcmp(scan->line, "OK") == 0)
+      scan->result = SARA_R5_ERROR_SUCCESS;
+    else if ((strcmp(scan->line, "ERROR") == 0) || (strncmp(scan->line, "+CME ERROR", 10) == 0)
+             || (strcmp(scan->line, "ABORTED") == 0))
+      scan->result = SARA_R5_ERROR_ERROR;
+    if (scan->result != SARA_R5_ERROR_INVALID)
+    {
+      if (_printDebug == true)
+      {
+        _debugPort->print(F("operatorScanChar: scan complete. Operators: "));
+        _debugPort->println(scan->found);
+      }
+      scan->active = false;
+    }
+    scan->lineLength = 0;
+  }
+  else if (scan->lineLength < (int)(sizeof(scan->line) - 1))
+  {
+    scan->line[scan->lineLength++] = c;
+  }
+}
+
+// Power saving: PSM and eDRX
+
+// Request PSM with the periodic TAU (T3412) and active time (T3324) in seconds. The network may assign different values.
+// Enabling also enables the +UUPSMR URC, so the sleep state can be tracked
+SARA_R5_error_t SARA_R5::setPSM(bool enable, unsigned long periodicTAU, unsigned long activeTime)
+{
+  SARA_R5_error_t err;
+  char *command;
+  char tau[9];
+  char active[9];
+
+  command = sara_r5_calloc_char(strlen(SARA_R5_PSM_SETTINGS) + 32);
+  if (command == nullptr)
+    return SARA_R5_ERROR_OUT_OF_MEMORY;
+
+  if (enable == false)
+  {
+    sprintf(command, "%s=0", SARA_R5_PSM_SETTINGS);
+  }
+  else
+  {
+    psmEncodeTimer(tau, periodicTAU, true);
+    psmEncodeTimer(active, activeTime, false);
+    sprintf(command, "%s=1,,,\"%s\",\"%s\"", SARA_R5_PSM_SETTINGS, tau, active);
+  }
+
+  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, nullptr,
+                                SARA_R5_STANDARD_RESPONSE_TIMEOUT);
+
+  if ((err == SARA_R5_ERROR_SUCCESS) && (enable == true))
+  {
+    sprintf(command, "%s=1", SARA_R5_PSM_REPORT); // Enable +UUPSMR
+    err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, nullptr,
+                                  SARA_R5_STANDARD_RESPONSE_TIMEOUT);
+  }
+
+  free(command);
+  return err;
+}
+
+// Request eDRX. eDRXvalue is the 4-bit cycle code from 3GPP TS 24.008 (e.g. 5 is 81.92 s for LTE Cat M1).
+// Enabling also enables the +CEDRXP URC, which reports the values provided by the network
+SARA_R5_error_t SARA_R5::setEDRX(bool enable, uint8_t eDRXvalue, int act)
+{
+  SARA_R5_error_t err;
+  char *command;
+
+  if (eDRXvalue > 15)
+    return SARA_R5_ERROR_UNEXPECTED_PARAM;
+
+  command = sara_r5_calloc_char(strlen(SARA_R5_EDRX_SETTINGS) + 16);
+  if (command == nullptr)
+    return SARA_R5_ERROR_OUT_OF_MEMORY;
+
+  if (enable == false)
+    sprintf(command, "%s=3", SARA_R5_EDRX_SETTINGS); // Disable eDRX and reset the parameters
+  else
+    sprintf(command, "%s=2,%d,\"%d%d%d%d\"", SARA_R5_EDRX_SETTINGS, act,
+            (eDRXvalue >> 3) & 1, (eDRXvalue >> 2) & 1, (eDRXvalue >> 1) & 1, eDRXvalue & 1);
+
+  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, nullptr,
+                                SARA_R5_STANDARD_RESPONSE_TIMEOUT);
+  if (err == SARA_R5_ERROR_SUCCESS)
+    _powerSaving.requestedEDRX = enable ? eDRXvalue : -1;
+
+  free(command);
+  return err;
+}
+
+// The MCU pin connected to V_INT. V_INT is high while the module is awake and low in PSM deep sleep
+void SARA_R5::setVIntPin(int pin)
+{
+  _vIntPin = pin;
+  if (_vIntPin >= 0)
+    pinMode(_vIntPin, INPUT);
+}
+
+void SARA_R5::setPowerStateCallback(void (*powerStateCallback)(SARA_R5_power_state_t state))
+{
+  _powerStateCallback = powerStateCallback;
+}
+
+SARA_R5_power_state_t SARA_R5::getPowerState(void)
+{
+  updatePowerStateFromVInt();
+  return _powerSaving.state;
+}
+
+// Wake the module from PSM with a pulse on PWR_ON, then wait for it to respond to AT.
+// The time from the pulse to the response is recorded in the wake latency statistics
+SARA_R5_error_t SARA_R5::wakeFromPSM(unsigned long timeout)
+{
+  if (getPowerState() == SARA_R5_POWER_STATE_AWAKE)
+    return SARA_R5_ERROR_SUCCESS;
+
+  if (_powerPin < 0)
+    return SARA_R5_ERROR_INVALID;
+
+  unsigned long wakeStart = millis();
+  powerPinPulse(SARA_R5_POWER_ON_PULSE_PERIOD);
+
+  SARA_R5_error_t err = waitForReady(timeout);
+  if (err != SARA_R5_ERROR_SUCCESS)
+    return err;
+
+  unsigned long latency = millis() - wakeStart;
+  _powerSaving.lastWakeLatency = latency;
+  if ((_powerSaving.wakeCount == 0) || (latency < _powerSaving.minWakeLatency))
+    _powerSaving.minWakeLatency = latency;
+  if (latency > _powerSaving.maxWakeLatency)
+    _powerSaving.maxWakeLatency = latency;
+  _powerSaving.totalWakeLatency += latency;
+  _powerSaving.wakeCount++;
+
+  if (_printDebug == true)
+  {
+    _debugPort->print(F("wakeFromPSM: awake after "));
+    _debugPort->print(latency);
+    _debugPort->println(F("ms"));
+  }
+
+  setPowerState(SARA_R5_POWER_STATE_AWAKE);
+  return SARA_R5_ERROR_SUCCESS;
+}
+
+// Write to a socket - or queue the data if the module is in PSM. The queue is sent by bufferedPoll once the module is awake.
+// If wake is true, the module is woken with wakeFromPSM instead
+SARA_R5_error_t SARA_R5::socketWriteWhenAwake(int socket, const char *str, int len, bool wake)
+{
+  if (len < 0)
+    len = strlen(str);
+
+  if ((getPowerState() == SARA_R5_POWER_STATE_PSM) && (wake == true))
+    wakeFromPSM();
+
+  if ((getPowerState() != SARA_R5_POWER_STATE_PSM) && (_powerSaving.queueLength == 0))
+    return socketWrite(socket, str, len);
+
+  if (nullptr == _powerSaving.queue)
+  {
+    _powerSaving.queue = new char[SARA_R5_PSM_QUEUE_SIZE];
+    if (nullptr == _powerSaving.queue)
+    {
+      if (_printDebug == true)
+        _debugPort->println(F("socketWriteWhenAwake: not enough memory for the queue!"));
+      return SARA_R5_ERROR_OUT_OF_MEMORY;
+    }
+  }
+
+  // Each record is: socket (1 byte), length (2 bytes), data
+  if ((len > 0xFFFF) || ((_powerSaving.queueLength + 3 + len) > SARA_R5_PSM_QUEUE_SIZE))
+    return SARA_R5_ERROR_OUT_OF_MEMORY;
+
+  char *record = &_powerSaving.queue[_powerSaving.queueLength];
+  record[0] = (char)socket;
+  record[1] = (char)(len >> 8);
+  record[2] = (char)(len & 0xFF);
+  memcpy(&record[3], str, len);
+  _powerSaving.queueLength += 3 + len;
+  return SARA_R5_ERROR_SUCCESS;
+}
+
+// Send the queued socket writes. Called by bufferedPoll while the module is awake.
+// A write which the module rejects is dropped. Other failures are tried again on the next poll, up to SARA_R5_PSM_QUEUE_RETRIES times
+void SARA_R5::flushPowerSavingQueue(void)
+{
+  int offset = 0;
+  while (offset < _powerSaving.queueLength)
+  {
+    char *record = &_powerSaving.queue[offset];
+    int len = (((int)(uint8_t)record[1]) << 8) | (uint8_t)record[2];
+    SARA_R5_error_t err = socketWrite((int)(uint8_t)record[0], &record[3], len);
+    if (err != SARA_R5_ERROR_SUCCESS)
+    {
+      // UNEXPECTED_RESPONSE: the module replied with ERROR instead of the @ prompt. The socket is closed or invalid
+      bool rejected = (err == SARA_R5_ERROR_ERROR) || (err == SARA_R5_ERROR_UNEXPECTED_RESPONSE) || (err == SARA_R5_ERROR_UNEXPECTED_PARAM);
+      if ((rejected == false) && (++_powerSaving.queueAttempts < SARA_R5_PSM_QUEUE_RETRIES))
+        break; // Try again on the next poll
+      if (_printDebug == true)
+      {
+        _debugPort->print(F("flushPowerSavingQueue: dropped a write to socket "));
+        _debugPort->print((int)(uint8_t)record[0]);
+        _debugPort->print(F(". err "));
+        _debugPort->println(err);
+      }
+      _powerSaving.queueDropped++;
+    }
+    _powerSaving.queueAttempts = 0;
+    offset += 3 + len;
+  }
+  if (offset > 0)
+  {
+    memmove(_powerSaving.queue, &_powerSaving.queue[offset], _powerSaving.queueLength - offset);
+    _powerSaving.queueLength -= offset;
+  }
+}
+
+void SARA_R5::setPowerState(SARA_R5_power_state_t state)
+{
+  if (state == _powerSaving.state)
+    return;
+  _powerSaving.state = state;
+  _powerSaving.lastChange = millis();
+  _powerSaving.statePending = true; // The callback is called by bufferedPoll
+}
+
+void SARA_R5::updatePowerStateFromVInt(void)
+{
+  if (_vIntPin < 0)
+    return;
+  setPowerState((digitalRead(_vIntPin) == HIGH) ? SARA_R5_POWER_STATE_AWAKE : SARA_R5_POWER_STATE_PSM);
+}
+
+// Encode seconds as a GPRS Timer 3 (T3412, timer3 = true) or GPRS Timer 2 (T3324) binary string.
+// The smallest unit which can hold the value is used. 0 deactivates the timer
+void SARA_R5::psmEncodeTimer(char *timer, unsigned long seconds, bool timer3)
+{
+  // Units (seconds) in increasing order, and their codes
+  const unsigned long timer3Units[7] = {2, 30, 60, 600, 3600, 36000, 1152000};
+  const uint8_t timer3Codes[7] = {3, 4, 5, 0, 1, 2, 6};
+  const unsigned long timer2Units[3] = {2, 60, 360};
+  const uint8_t timer2Codes[3] = {0, 1, 2};
+  const unsigned long *units = timer3 ? timer3Units : timer2Units;
+  const uint8_t *codes = timer3 ? timer3Codes : timer2Codes;
+  int numUnits = timer3 ? 7 : 3;
+
+  uint8_t code = 7; // Deactivated
+  unsigned long value = 0;
+  if (seconds > 0)
+  {
+    for (int i = 0; i < numUnits; i++)
+    {
+      value = (seconds + (units[i] / 2)) / units[i]; // Round to the nearest
+      code = codes[i];
+      if (value <= 31)
+        break;
+    }
+    if (value > 31)
+      value = 31;
+  }
+
+  uint8_t encoded = (code << 5) | (uint8_t)value;
+  for (int bit = 0; bit < 8; bit++)
+    timer[bit] = (encoded & (0x80 >> bit)) ? '1' : '0';
+  timer[8] = '\0';
+}
+
+SARA_R5_error_t SARA_R5::automaticOperatorSelection()
+{
+  SARA_R5_error_t err;
+  char *command;
+
+  command = sara_r5_calloc_char(strlen(SARA_R5_OPERATOR_SELECTION) + 6);
+  if (command == nullptr)
+    return SARA_R5_ERROR_OUT_OF_MEMORY;
+  sprintf(command, "%s=0,0", SARA_R5_OPERATOR_SELECTION);
+
+  // AT+COPS maximum response time is 3 minutes (180000 ms)
+  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, nullptr,
+                                SARA_R5_3_MIN_TIMEOUT);
+
+  free(command);
+  return err;
+}
+
+SARA_R5_error_t SARA_R5::getOperator(String *oper)
+{
+  SARA_R5_error_t err;
+  char *command;
+  char *response;
+  char *searchPtr;
+  char mode;
+
+  command = sara_r5_calloc_char(strlen(SARA_R5_OPERATOR_SELECTION) + 3);
+  if (command == nullptr)
+    return SARA_R5_ERROR_OUT_OF_MEMORY;
+  sprintf(command, "%s?", SARA_R5_OPERATOR_SELECTION);
+
+  response = sara_r5_calloc_char(minimumResponseAllocation);
+  if (response == nullptr)
+  {
+    free(command);
+    return SARA_R5_ERROR_OUT_OF_MEMORY;
+  }
+
+  // AT+COPS maximum response time is 3 minutes (180000 ms)
+  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, response,
+                                SARA_R5_3_MIN_TIMEOUT);
+
+  if (err == SARA_R5_ERROR_SUCCESS)
+  {
+    searchPtr = strstr(response, "+COPS:");
+    if (searchPtr != nullptr)
+    {
+      searchPtr += strlen("+COPS:"); //  Move searchPtr to first char
+      while (*searchPtr == ' ') searchPtr++; // skip spaces
+      mode = *searchPtr;              // Read first char -- should be mode
+      if (mode == '2')                // Check for de-register
+      {
+        err = SARA_R5_ERROR_DEREGISTERED;
+      }
+      // Otherwise if it's default, manual, set-only, or automatic
+      else if ((mode == '0') || (mode == '1') || (mode == '3') || (mode == '4'))
+      {
+        *oper = "";
+        searchPtr = strchr(searchPtr, '\"'); // Move to first quote
+        if (searchPtr == nullptr)
+        {
+          err = SARA_R5_ERROR_DEREGISTERED;
+        }
+        else
+        {
+          while ((*(++searchPtr) != '\"') && (*searchPtr != '\0'))
+          {
+            oper->concat(*(searchPtr));
+          }
+        }
+        if (_printDebug == true)
+        {
+          _debugPort->print(F("getOperator: "));
+          _debugPort->println(*oper);
+        }
+      }
+    }
+  }
+
+  free(response);
+  free(command);
+  return err;
+}
+
+SARA_R5_error_t SARA_R5::deregisterOperator(void)
+{
+  SARA_R5_error_t err;
+  char *command;
+
+  command = sara_r5_calloc_char(strlen(SARA_R5_OPERATOR_SELECTION) + 4);
+  if (command == nullptr)
+    return SARA_R5_ERROR_OUT_OF_MEMORY;
+  sprintf(command, "%s=2", SARA_R5_OPERATOR_SELECTION);
+
+  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, nullptr,
+                                SARA_R5_3_MIN_TIMEOUT);
+
+  free(command);
+  return err;
+}
+
+SARA_R5_error_t SARA_R5::setSMSMessageFormat(SARA_R5_message_format_t textMode)
+{
+  char *command;
+  SARA_R5_error_t err;
+
+  command = sara_r5_calloc_char(strlen(SARA_R5_MESSAGE_FORMAT) + 4);
+  if (command == nullptr)
+    return SARA_R5_ERROR_OUT_OF_MEMORY;
+  sprintf(command, "%s=%d", SARA_R5_MESSAGE_FORMAT,
+          (textMode == SARA_R5_MESSAGE_FORMAT_TEXT) ? 1 : 0);
+
+  err = sendShadowedCommand(command, 0, SARA_R5_STANDARD_RESPONSE_TIMEOUT);
+
+  free(command);
+  return err;
+}
+
+SARA_R5_error_t SARA_R5::sendSMS(String number, String message)
+{
+  SARA_R5_LOCK_TRANSACTION(SARA_R5_PRIORITY_NORMAL);
+
+  char *command;
+  char *messageCStr;
+  char *numberCStr;
+  SARA_R5_error_t err;
+
+  numberCStr = sara_r5_calloc_char(number.length() + 2);
+  if (numberCStr == nullptr)
+    return SARA_R5_ERROR_OUT_OF_MEMORY;
+  number.toCharArray(numberCStr, number.length() + 1);
+
+  command = sara_r5_calloc_char(strlen(SARA_R5_SEND_TEXT) + strlen(numberCStr) + 8);
+  if (command != nullptr)
+  {
+    sprintf(command, "%s=\"%s\"", SARA_R5_SEND_TEXT, numberCStr);
+
+    err = sendCommandWithResponse(command, ">", nullptr,
+                                  SARA_R5_3_MIN_TIMEOUT);
+    free(command);
+    free(numberCStr);
+    if (err != SARA_R5_ERROR_SUCCESS)
+      return err;
+
+    messageCStr = sara_r5_calloc_char(message.length() + 1);
+    if (messageCStr == nullptr)
+    {
+      hwWrite(ASCII_CTRL_Z);
+      return SARA_R5_ERROR_OUT_OF_MEMORY;
+    }
+    message.toCharArray(messageCStr, message.length() + 1);
+    messageCStr[message.length()] = ASCII_CTRL_Z;
+
+    err = sendCommandWithResponse(messageCStr, SARA_R5_RESPONSE_OK_OR_ERROR,
+                                  nullptr, SARA_R5_3_MIN_TIMEOUT, minimumResponseAllocation, NOT_AT_COMMAND);
+
+    free(messageCStr);
+  }
+  else
+  {
+    free(numberCStr);
+    err = SARA_R5_ERROR_OUT_OF_MEMORY;
+  }
+
+  return err;
+}
+
+SARA_R5_error_t SARA_R5::getPreferredMessageStorage(int *used, int *total, String memory)
+{
+  SARA_R5_error_t err;
+  char *command;
+  char *response;
+  int u;
+  int t;
+
+  command = sara_r5_calloc_char(strlen(SARA_R5_PREF_MESSAGE_STORE) + 32);
+  if (command == nullptr)
+    return SARA_R5_ERROR_OUT_OF_MEMORY;
+  sprintf(command, "%s=\"%s\"", SARA_R5_PREF_MESSAGE_STORE, memory.c_str());
+
+  response = sara_r5_calloc_char(minimumResponseAllocation);
+  if (response == nullptr)
+  {
+    free(command);
+    return SARA_R5_ERROR_OUT_OF_MEMORY;
+  }
+
+  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, response,
+                                SARA_R5_3_MIN_TIMEOUT);
+
+  if (err != SARA_R5_ERROR_SUCCESS)
+  {
+    free(command);
+    free(response);
+    return err;
+  }
+
+  int scanned = 0;
+  char *searchPtr = strstr(response, "+CPMS:");
+  if (searchPtr != nullptr)
+  {
+    searchPtr += strlen("+CPMS:"); //  Move searchPtr to first char
+    while (*searchPtr == ' ') searchPtr++; // skip spaces
+    scanned = sscanf(searchPtr, "%d,%d", &u, &t);
+  }
+  if (scanned == 2)
+  {
+    if (_printDebug == true)
+    {
+      _debugPort->print(F("getPreferredMessageStorage: memory1 (read and delete): "));
+      _debugPort->print(memory);
+      _debugPort->print(F(" used: "));
+      _debugPort->print(u);
+      _debugPort->print(F(" total: "));
+      _debugPort->println(t);
+    }
+    *used = u;
+    *total = t;
+  }
+  else
+  {
+    err = SARA_R5_ERROR_INVALID;
+  }
+
+  free(response);
+  free(command);
+  return err;
+}
+
+SARA_R5_error_t SARA_R5::readSMSmessage(int location, String *unread, String *from, String *dateTime, String *message)
+{
+  SARA_R5_error_t err;
+  char *command;
+  char *response;
+
+  command = sara_r5_calloc_char(strlen(SARA_R5_READ_TEXT_MESSAGE) + 5);
+  if (command == nullptr)
+    return SARA_R5_ERROR_OUT_OF_MEMORY;
+  sprintf(command, "%s=%d", SARA_R5_READ_TEXT_MESSAGE, location);
+
+  response = sara_r5_calloc_char(1024);
+  if (response == nullptr)
+  {
+    free(command);
+    return SARA_R5_ERROR_OUT_OF_MEMORY;
+  }
+
+  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, response,
+                                SARA_R5_10_SEC_TIMEOUT, 1024);
+
+  if (err == SARA_R5_ERROR_SUCCESS)
+  {
+    char *searchPtr = response;
+
+    // Find the first occurrence of +CMGR:
+    searchPtr = strstr(searchPtr, "+CMGR:");
+    if (searchPtr != nullptr)
+    {
+      searchPtr += strlen("+CMGR:"); //  Move searchPtr to first char
+      while (*searchPtr == ' ') searchPtr++; // skip spaces
+      int pointer = 0;
+      while ((*(++searchPtr) != '\"') && (*searchPtr != '\0') && (pointer < 12))
+      {
+        unread->concat(*(searchPtr));
+        pointer++;
+      }
+      if ((*searchPtr == '\0') || (pointer == 12))
+      {
+        free(command);
+        free(response);
+        return SARA_R5_ERROR_UNEXPECTED_RESPONSE;
+      }
+      // Search to the next quote
+      searchPtr = strchr(++searchPtr, '\"');
+      pointer = 0;
+      while ((*(++searchPtr) != '\"') && (*searchPtr != '\0') && (pointer < 24))
+      {
+        from->concat(*(searchPtr));
+        pointer++;
+      }
+      if ((*searchPtr == '\0') || (pointer == 24))
+      {
+        free(command);
+        free(response);
+        return SARA_R5_ERROR_UNEXPECTED_RESPONSE;
+      }
+      // Skip two commas
+      searchPtr = strchr(++searchPtr, ',');
+      searchPtr = strchr(++searchPtr, ',');
+      // Search to the next quote
+      searchPtr = strchr(++searchPtr, '\"');
+      pointer = 0;
+      while ((*(++searchPtr) != '\"') && (*searchPtr != '\0') && (pointer < 24))
+      {
+        dateTime->concat(*(searchPtr));
+        pointer++;
+      }
+      if ((*searchPtr == '\0') || (pointer == 24))
+      {
+        free(command);
+        free(response);
+        return SARA_R5_ERROR_UNEXPECTED_RESPONSE;
+      }
+      // Search to the next new line
+      searchPtr = strchr(++searchPtr, '\n');
+      pointer = 0;
+      while ((*(++searchPtr) != '\r') && (*searchPtr != '\n') && (*searchPtr != '\0') && (pointer < 512))
+      {
+        message->concat(*(searchPtr));
+        pointer++;
+      }
+      if ((*searchPtr == '\0') || (pointer == 512))
+      {
+        free(command);
+        free(response);
+        return SARA_R5_ERROR_UNEXPECTED_RESPONSE;
+      }
+    }
+    else
+    {
+      err = SARA_R5_ERROR_UNEXPECTED_RESPONSE;
+    }
+  }
+  else
+  {
+    err = SARA_R5_ERROR_UNEXPECTED_RESPONSE;
+  }
+
+  free(command);
+  free(response);
+
+  return err;
+}
+
+SARA_R5_error_t SARA_R5::deleteSMSmessage(int location, int deleteFlag)
+{
+  char *command;
+  SARA_R5_error_t err;
+
+  command = sara_r5_calloc_char(strlen(SARA_R5_DELETE_MESSAGE) + 12);
+  if (command == nullptr)
+    return SARA_R5_ERROR_OUT_OF_MEMORY;
+  if (deleteFlag == 0)
+    sprintf(command, "%s=%d", SARA_R5_DELETE_MESSAGE, location);
+  else
+    sprintf(command, "%s=%d,%d", SARA_R5_DELETE_MESSAGE, location, deleteFlag);
+
+  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, nullptr, SARA_R5_55_SECS_TIMEOUT);
+
+  free(command);
+  return err;
+}
+
+SARA_R5_error_t SARA_R5::setBaud(unsigned long baud)
+{
+  SARA_R5_error_t err;
+  char *command;
+  int b = 0;
+
+  if (_rxTaskMode == true) // rxTask owns the UART. It cannot follow the change
+    return SARA_R5_ERROR_INVALID;
+
+  // Error check -- ensure supported baud
+  for (; b < NUM_SUPPORTED_BAUD; b++)
+  {
+    if (SARA_R5_SUPPORTED_BAUD[b] == baud)
+    {
+      break;
+    }
+  }
+  if (b >= NUM_SUPPORTED_BAUD)
+  {
+    return SARA_R5_ERROR_UNEXPECTED_PARAM;
+  }
+
+  // Construct command
+  command = sara_r5_calloc_char(strlen(SARA_R5_COMMAND_BAUD) + 7 + 12);
+  if (command == nullptr)
+    return SARA_R5_ERROR_OUT_OF_MEMORY;
+  sprintf(command, "%s=%lu", SARA_R5_COMMAND_BAUD, baud);
+
+  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR,
+                                nullptr, SARA_R5_SET_BAUD_TIMEOUT);
+
+  free(command);
+
+  return err;
+}
+
+SARA_R5_error_t SARA_R5::setFlowControl(SARA_R5_flow_control_t value)
+{
+  SARA_R5_error_t err;
+  char *command;
+
+  command = sara_r5_calloc_char(strlen(SARA_R5_FLOW_CONTROL) + 16);
+  if (command == nullptr)
+    return SARA_R5_ERROR_OUT_OF_MEMORY;
+  sprintf(command, "%s%d", SARA_R5_FLOW_CONTROL, value);
+
+  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR,
+                                nullptr, SARA_R5_STANDARD_RESPONSE_TIMEOUT);
+
+  free(command);
+
+  return err;
+}
+
+SARA_R5_error_t SARA_R5::setGpioMode(SARA_R5_gpio_t gpio,
+                                     SARA_R5_gpio_mode_t mode, int value)
+{
+  SARA_R5_error_t err;
+  char *command;
+
+  // Example command: AT+UGPIOC=16,2
+  // Example command: AT+UGPIOC=23,0,1
+  command = sara_r5_calloc_char(strlen(SARA_R5_COMMAND_GPIO) + 16);
+  if (command == nullptr)
+    return SARA_R5_ERROR_OUT_OF_MEMORY;
+  if (mode == GPIO_OUTPUT)
+    sprintf(command, "%s=%d,%d,%d", SARA_R5_COMMAND_GPIO, gpio, mode, value);
+  else
+    sprintf(command, "%s=%d,%d", SARA_R5_COMMAND_GPIO, gpio, mode);
+
+  if (mode == GPIO_OUTPUT) // Not shadowed. The output can be changed by setGpioOutput (+UGPIOW)
+    err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR,
+                                  nullptr, SARA_R5_10_SEC_TIMEOUT);
+  else
+    err = sendShadowedCommand(command, 1, SARA_R5_10_SEC_TIMEOUT);
+
+  free(command);
+
+  return err;
+}
+
+SARA_R5::SARA_R5_gpio_mode_t SARA_R5::getGpioMode(SARA_R5_gpio_t gpio)
+{
+  SARA_R5_error_t err;
+  char *command;
+  char *response;
+  char gpioChar[4];
+  char *gpioStart;
+  int gpioMode;
+
+  command = sara_r5_calloc_char(strlen(SARA_R5_COMMAND_GPIO) + 2);
+  if (command == nullptr)
+    return GPIO_MODE_INVALID;
+  sprintf(command, "%s?", SARA_R5_COMMAND_GPIO);
+
+  response = sara_r5_calloc_char(minimumResponseAllocation);
+  if (response == nullptr)
+  {
+    free(command);
+    return GPIO_MODE_INVALID;
+  }
+
+  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR,
+                                response, SARA_R5_STANDARD_RESPONSE_TIMEOUT);
+
+  if (err != SARA_R5_ERROR_SUCCESS)
+  {
+    free(command);
+    free(response);
+    return GPIO_MODE_INVALID;
+  }
+
+  sprintf(gpioChar, "%d", gpio);          // Convert GPIO to char array
+  gpioStart = strstr(response, gpioChar); // Find first occurence of GPIO in response
+
+  if (gpioStart == nullptr) {
+    free(command);
+    free(response);
+    return GPIO_MODE_INVALID; // If not found return invalid
+  }
+  scanf(gpioStart, "%*d,%d\r\n", &gpioMode);
+  free(command);
+  free(response);
+
+  return (SARA_R5_gpio_mode_t)gpioMode;
+}
+
+int SARA_R5::socketOpen(SARA_R5_socket_protocol_t protocol, unsigned int localPort)
+{
+  SARA_R5_error_t err;
+  char *command;
+  char *response;
+  int sockId = -1;
+  char *responseStart;
+
+  command = sara_r5_calloc_char(strlen(SARA_R5_CREATE_SOCKET) + 10);
+  if (command == nullptr)
+    return -1;
+  if (localPort == 0)
+    sprintf(command, "%s=%d", SARA_R5_CREATE_SOCKET, (int)protocol);
+  else
+    sprintf(command, "%s=%d,%d", SARA_R5_CREATE_SOCKET, (int)protocol, localPort);
+
+  response = sara_r5_calloc_char(minimumResponseAllocation);
+  if (response == nullptr)
+  {
+    if (_printDebug == true)
+      _debugPort->println(F("socketOpen: Fail: nullptr response"));
+    free(command);
+    return -1;
+  }
+
+  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR,
+                                response, SARA_R5_STANDARD_RESPONSE_TIMEOUT);
+
+  if (err != SARA_R5_ERROR_SUCCESS)
+  {
+    if (_printDebug == true)
+    {
+      _debugPort->print(F("socketOpen: Fail: Error: "));
+      _debugPort->print(err);
+      _debugPort->print(F("  Response: {"));
+      _debugPort->print(response);
+      _debugPort->println(F("}"));
+    }
+    free(command);
+    free(response);
+    return -1;
+  }
+
+  responseStart = strstr(response, "+USOCR:");
+  if (responseStart == nullptr)
+  {
+    if (_printDebug == true)
+    {
+      _debugPort->print(F("socketOpen: Failure: {"));
+      _debugPort->print(response);
+      _debugPort->println(F("}"));
+    }
+    free(command);
+    free(response);
+    return -1;
+  }
+
+  responseStart += strlen("+USOCR:"); //  Move searchPtr to first char
+  while (*responseStart == ' ') responseStart++; // skip spaces
+  sscanf(responseStart, "%d", &sockId);
+  _lastSocketProtocol[sockId] = (int)protocol;
+
+  free(command);
+  free(response);
+
+  return sockId;
+}
+
+SARA_R5_error_t SARA_R5::socketSetSecure(int profile, bool secure, int secprofile)
+{
+  SARA_R5_error_t err;
+  char *command = sara_r5_calloc_char(strlen(SARA_R5_SECURE_SOCKET) + 32);
+  if (command == nullptr)
+    return SARA_R5_ERROR_OUT_OF_MEMORY;
+  if ((secprofile == -1) || !secure) sprintf(command, "%s=%d,%d", SARA_R5_SECURE_SOCKET, profile, secure);
+  else sprintf(command, "%s=%d,%d,%d", SARA_R5_SECURE_SOCKET, profile, secure, secprofile);
+  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, nullptr,
+                                SARA_R5_STANDARD_RESPONSE_TIMEOUT);
+  free(command);
+  return err;
+}
+
+SARA_R5_error_t SARA_R5::socketClose(int socket, unsigned long timeout)
+{
+  SARA_R5_error_t err;
+  char *command;
+  char *response;
+
+  command = sara_r5_calloc_char(strlen(SARA_R5_CLOSE_SOCKET) + 10);
+  if (command == nullptr)
+    return SARA_R5_ERROR_OUT_OF_MEMORY;
+  response = sara_r5_calloc_char(minimumResponseAllocation);
+  if (response == nullptr)
+  {
+    free(command);
+    return SARA_R5_ERROR_OUT_OF_MEMORY;
+  }
+  // if timeout is short, close asynchronously and don't wait for socket closure (we will get the URC later)
+  // this will make sure the AT command parser is not confused during init()
+  const char* format = (SARA_R5_STANDARD_RESPONSE_TIMEOUT == timeout) ? "%s=%d,1" : "%s=%d";
+  sprintf(command, format, SARA_R5_CLOSE_SOCKET, socket);
+
+  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, response, timeout);
+
+  if ((err != SARA_R5_ERROR_SUCCESS) && (_printDebug == true))
+  {
+    _debugPort->print(F("socketClose: Error: "));
+    _debugPort->println(socketGetLastError());
+  }
+
+  free(command);
+  free(response);
+
+  return err;
+}
+
+SARA_R5_error_t SARA_R5::socketConnect(int socket, const char *address,
+                                       unsigned int port)
+{
+  SARA_R5_error_t err;
+  char *command;
+
+  command = sara_r5_calloc_char(strlen(SARA_R5_CONNECT_SOCKET) + strlen(address) + 11);
+  if (command == nullptr)
+    return SARA_R5_ERROR_OUT_OF_MEMORY;
+  sprintf(command, "%s=%d,\"%s\",%d", SARA_R5_CONNECT_SOCKET, socket, address, port);
+
+  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, nullptr, SARA_R5_IP_CONNECT_TIMEOUT);
+
+  free(command);
+
+  return err;
+}
+
+SARA_R5_error_t SARA_R5::socketConnect(int socket, IPAddress address,
+                                       unsigned int port)
+{
+  char *charAddress = sara_r5_calloc_char(16);
+  if (charAddress == nullptr)
+    return SARA_R5_ERROR_OUT_OF_MEMORY;
+  memset(charAddress, 0, 16);
+  sprintf(charAddress, "%d.%d.%d.%d", address[0], address[1], address[2], address[3]);
+
+  return (socketConnect(socket, (const char *)charAddress, port));
+}
+
+SARA_R5_error_t SARA_R5::socketWrite(int socket, const char *str, int len)
+{
+  SARA_R5_LOCK_TRANSACTION(SARA_R5_PRIORITY_NORMAL);
+
+  char *command;
+  char *response;
+  SARA_R5_error_t err;
+
+  command = sara_r5_calloc_char(strlen(SARA_R5_WRITE_SOCKET) + 16);
+  if (command == nullptr)
+    return SARA_R5_ERROR_OUT_OF_MEMORY;
+  response = sara_r5_calloc_char(minimumResponseAllocation);
+  if (response == nullptr)
+  {
+    free(command);
+    return SARA_R5_ERROR_OUT_OF_MEMORY;
+  }
+  int dataLen = len == -1 ? strlen(str) : len;
+  sprintf(command, "%s=%d,%d", SARA_R5_WRITE_SOCKET, socket, dataLen);
+
+  err = sendCommandWithResponse(command, "@", response,
+                                SARA_R5_STANDARD_RESPONSE_TIMEOUT * 5);
+
+  if (err == SARA_R5_ERROR_SUCCESS)
+  {
+    unsigned long writeDelay = millis();
+    while (millis() < (writeDelay + 50))
+      delay(1); //u-blox specification says to wait 50ms after receiving "@" to write data.
+
+    if (len == -1)
+    {
+      if (_printDebug == true)
+      {
+        _debugPort->print(F("socketWrite: writing: "));
+        _debugPort->println(str);
+      }
+      hwPrint(str);
+    }
+    else
+    {
+      if (_printDebug == true)
+      {
+        _debugPort->print(F("socketWrite: writing "));
+        _debugPort->print(len);
+        _debugPort->println(F(" bytes"));
+      }
+      hwWriteData(str, len);
+    }
+
+    err = waitForResponse(SARA_R5_RESPONSE_OK, SARA_R5_RESPONSE_ERROR, SARA_R5_SOCKET_WRITE_TIMEOUT);
+  }
+
+  if (err != SARA_R5_ERROR_SUCCESS)
+  {
+    if (_printDebug == true)
+    {
+      _debugPort->print(F("socketWrite: Error: "));
+      _debugPort->print(err);
+      _debugPort->print(F(" => {"));
+      _debugPort->print(response);
+      _debugPort->println(F("}"));
+    }
+  }
+
+  free(command);
+  free(response);
+  return err;
+}
+
+SARA_R5_error_t SARA_R5::socketWrite(int socket, String str)
+{
+  return socketWrite(socket, str.c_str(), str.length());
+}
+
+SARA_R5_error_t SARA_R5::socketWriteUDP(int socket, const char *address, int port, const char *str, int len)
+{
+  SARA_R5_LOCK_TRANSACTION(SARA_R5_PRIORITY_NORMAL);
+
+  char *command;
+  char *response;
+  SARA_R5_error_t err;
+  int dataLen = len == -1 ? strlen(str) : len;
+
+  command = sara_r5_calloc_char(64);
+  if (command == nullptr)
+    return SARA_R5_ERROR_OUT_OF_MEMORY;
+  response = sara_r5_calloc_char(minimumResponseAllocation);
+  if (response == nullptr)
+  {
+    free(command);
+    return SARA_R5_ERROR_OUT_OF_MEMORY;
+  }
+
+  sprintf(command, "%s=%d,\"%s\",%d,%d", SARA_R5_WRITE_UDP_SOCKET,
+          socket, address, port, dataLen);
+  err = sendCommandWithResponse(command, "@", response, SARA_R5_STANDARD_RESPONSE_TIMEOUT * 5);
+
+  if (err == SARA_R5_ERROR_SUCCESS)
+  {
+    if (len == -1) //If binary data we need to send a length.
+    {
+      hwPrint(str);
+    }
+    else
+    {
+      hwWriteData(str, len);
+    }
+    err = waitForResponse(SARA_R5_RESPONSE_OK, SARA_R5_RESPONSE_ERROR, SARA_R5_SOCKET_WRITE_TIMEOUT);
+  }
+  else
+  {
+    if (_printDebug == true)
+      _debugPort->print(F("socketWriteUDP: Error: "));
+    if (_printDebug == true)
+      _debugPort->println(socketGetLastError());
+  }
+
+  free(command);
+  free(response);
+  return err;
+}
+
+SARA_R5_error_t SARA_R5::socketWriteUDP(int socket, IPAddress address, int port, const char *str, int len)
+{
+  char *charAddress = sara_r5_calloc_char(16);
+  if (charAddress == nullptr)
+    return SARA_R5_ERROR_OUT_OF_MEMORY;
+  memset(charAddress, 0, 16);
+  sprintf(charAddress, "%d.%d.%d.%d", address[0], address[1], address[2], address[3]);
+
+  return (socketWriteUDP(socket, (const char *)charAddress, port, str, len));
+}
+
+SARA_R5_error_t SARA_R5::socketWriteUDP(int socket, String address, int port, String str)
+{
+  return socketWriteUDP(socket, address.c_str(), port, str.c_str(), str.length());
+}
+
+SARA_R5_error_t SARA_R5::socketRead(int socket, int length, char *readDest, int *bytesRead)
+{
+  char *command;
+  char *response;
+  char *strBegin;
+  int readIndexTotal = 0;
+  int readIndexThisRead = 0;
+  SARA_R5_error_t err;
+  int scanNum = 0;
+  int readLength = 0;
+  int socketStore = 0;
+  int bytesLeftToRead = length;
+  int bytesToRead;
+
+  // Set *bytesRead to zero
+  if (bytesRead != nullptr)
+    *bytesRead = 0;
+
+  // Check if length is zero
+  if (length == 0)
+  {
+    if (_printDebug == true)
+      _debugPort->print(F("socketRead: length is 0! Call socketReadAvailable?"));
+    return SARA_R5_ERROR_UNEXPECTED_PARAM;
+  }
+
+  // Allocate memory for the command
+  command = sara_r5_calloc_char(strlen(SARA_R5_READ_SOCKET) + 32);
+  if (command == nullptr)
+    return SARA_R5_ERROR_OUT_OF_MEMORY;
+
+  // Allocate memory for the response
+  // We only need enough to read _saraR5maxSocketRead bytes - not the whole thing
+  int responseLength = _saraR5maxSocketRead + strlen(SARA_R5_READ_SOCKET) + minimumResponseAllocation;
+  response = sara_r5_calloc_char(responseLength);
+  if (response == nullptr)
+  {
+    free(command);
+    return SARA_R5_ERROR_OUT_OF_MEMORY;
+  }
+
+  // If there are more than _saraR5maxSocketRead (1024) bytes to be read,
+  // we need to do multiple reads to get all the data
+
+  while (bytesLeftToRead > 0)
+  {
+    if (bytesLeftToRead > _saraR5maxSocketRead) // Limit a single read to _saraR5maxSocketRead
+      bytesToRead = _saraR5maxSocketRead;
+    else
+      bytesToRead = bytesLeftToRead;
+
+    sprintf(command, "%s=%d,%d", SARA_R5_READ_SOCKET, socket, bytesToRead);
+
+    err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, response,
+                                  SARA_R5_STANDARD_RESPONSE_TIMEOUT, responseLength);
+
+    if (err != SARA_R5_ERROR_SUCCESS)
+    {
+      if (_printDebug == true)
+      {
+        _debugPort->print(F("socketRead: sendCommandWithResponse err "));
+        _debugPort->println(err);
+      }
+      free(command);
+      free(response);
+      return err;
+    }
+
+    // Extract the data
+    char *searchPtr = strstr(response, "+USORD:");
+    if (searchPtr != nullptr)
+    {
+      searchPtr += strlen("+USORD:"); //  Move searchPtr to first char
+      while (*searchPtr == ' ') searchPtr++; // skip spaces
+      scanNum = sscanf(searchPtr, "%d,%d",
+                        &socketStore, &readLength);
+    }
+    if (scanNum != 2)
+    {
+      if (_printDebug == true)
+      {
+        _debugPort->print(F("socketRead: error: scanNum is "));
+        _debugPort->println(scanNum);
+      }
+      free(command);
+      free(response);
+      return SARA_R5_ERROR_UNEXPECTED_RESPONSE;
+    }
+
+    // Check that readLength == bytesToRead
+    if (readLength != bytesToRead)
+    {
+      if (_printDebug == true)
+      {
+        _debugPort->print(F("socketRead: length mismatch! bytesToRead="));
+        _debugPort->print(bytesToRead);
+        _debugPort->print(F(" readLength="));
+        _debugPort->println(readLength);
+      }
+    }
+
+    // Check that readLength > 0
+    if (readLength == 0)
+    {
+      if (_printDebug == true)
+      {
+        _debugPort->println(F("socketRead: zero length!"));
+      }
+      free(command);
+      free(response);
+      return SARA_R5_ERROR_ZERO_READ_LENGTH;
+    }
+
+    // Find the first double-quote:
+    strBegin = strchr(searchPtr, '\"');
+
+    if (strBegin == nullptr)
+    {
+      free(command);
+      free(response);
+      return SARA_R5_ERROR_UNEXPECTED_RESPONSE;
+    }
+
+    // Now copy the data into readDest
+    readIndexThisRead = 1; // Start after the quote
+    while (readIndexThisRead < (readLength + 1))
+    {
+      readDest[readIndexTotal] = strBegin[readIndexThisRead];
+      readIndexTotal++;
+      readIndexThisRead++;
+    }
+
+    if (_printDebug == true)
+      _debugPort->println(F("socketRead: success"));
+
+    // Update *bytesRead
+    if (bytesRead != nullptr)
+      *bytesRead = readIndexTotal;
+
+    // How many bytes are left to read?
+    // This would have been bytesLeftToRead -= bytesToRead
+    // Except the SARA can potentially return less data than requested...
+    // So we need to subtract readLength instead.
+    bytesLeftToRead -= readLength;
+    if (_printDebug == true)
+    {
+      if (bytesLeftToRead > 0)
+      {
+        _debugPort->print(F("socketRead: multiple read. bytesLeftToRead: "));
+        _debugPort->println(bytesLeftToRead);
+      }
+    }
+  } // /while (bytesLeftToRead > 0)
+
+  free(command);
+  free(response);
+
+  return SARA_R5_ERROR_SUCCESS;
+}
+
+SARA_R5_error_t SARA_R5::socketReadAvailable(int socket, int *length)
+{
+  char *command;
+  char *response;
+  SARA_R5_error_t err;
+  int scanNum = 0;
+  int readLength = 0;
+  int socketStore = 0;
+
+  command = sara_r5_calloc_char(strlen(SARA_R5_READ_SOCKET) + 32);
+  if (command == nullptr)
+    return SARA_R5_ERROR_OUT_OF_MEMORY;
+  sprintf(command, "%s=%d,0", SARA_R5_READ_SOCKET, socket);
+
+  response = sara_r5_calloc_char(minimumResponseAllocation);
+  if (response == nullptr)
+  {
+    free(command);
+    return SARA_R5_ERROR_OUT_OF_MEMORY;
+  }
+
+  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, response,
+                                SARA_R5_STANDARD_RESPONSE_TIMEOUT);
+
+  if (err == SARA_R5_ERROR_SUCCESS)
+  {
+    char *searchPtr = strstr(response, "+USORD:");
+    if (searchPtr != nullptr)
+    {
+      searchPtr += strlen("+USORD:"); //  Move searchPtr to first char
+      while (*searchPtr == ' ') searchPtr++; // skip spaces
+      scanNum = sscanf(searchPtr, "%d,%d",
+                        &socketStore, &readLength);
+    }
+    if (scanNum != 2)
+    {
+      if (_printDebug == true)
+      {
+        _debugPort->print(F("socketReadAvailable: error: scanNum is "));
+        _debugPort->println(scanNum);
+      }
+      free(command);
+      free(response);
+      return SARA_R5_ERROR_UNEXPECTED_RESPONSE;
+    }
+
+    *length = readLength;
+  }
+
+  free(command);
+  free(response);
+
+  return err;
+}
+
+SARA_R5_error_t SARA_R5::socketReadUDP(int socket, int length, char *readDest,
+                                      IPAddress *remoteIPAddress, int *remotePort, int *bytesRead)
+{
+  char *command;
+  char *response;
+  char *strBegin;
+  int readIndexTotal = 0;
+  int readIndexThisRead = 0;
+  SARA_R5_error_t err;
+  int scanNum = 0;
+  int remoteIPstore[4] = { 0, 0, 0, 0 };
+  int portStore = 0;
+  int readLength = 0;
+  int socketStore = 0;
+  int bytesLeftToRead = length;
+  int bytesToRead;
+
+  // Set *bytesRead to zero
+  if (bytesRead != nullptr)
+    *bytesRead = 0;
+
+  // Check if length is zero
+  if (length == 0)
+  {
+    if (_printDebug == true)
+      _debugPort->print(F("socketReadUDP: length is 0! Call socketReadAvailableUDP?"));
+    return SARA_R5_ERROR_UNEXPECTED_PARAM;
+  }
+
+  // Allocate memory for the command
+  command = sara_r5_calloc_char(strlen(SARA_R5_READ_UDP_SOCKET) + 32);
+  if (command == nullptr)
+    return SARA_R5_ERROR_OUT_OF_MEMORY;
+
+  // Allocate memory for the response
+  // We only need enough to read _saraR5maxSocketRead bytes - not the whole thing
+  int responseLength = _saraR5maxSocketRead + strlen(SARA_R5_READ_UDP_SOCKET) + minimumResponseAllocation;
+  response = sara_r5_calloc_char(responseLength);
+  if (response == nullptr)
+  {
+    free(command);
+    return SARA_R5_ERROR_OUT_OF_MEMORY;
+  }
+
+  // If there are more than _saraR5maxSocketRead (1024) bytes to be read,
+  // we need to do multiple reads to get all the data
+
+  while (bytesLeftToRead > 0)
+  {
+    if (bytesLeftToRead > _saraR5maxSocketRead) // Limit a single read to _saraR5maxSocketRead
+      bytesToRead = _saraR5maxSocketRead;
+    else
+      bytesToRead = bytesLeftToRead;
+
+    sprintf(command, "%s=%d,%d", SARA_R5_READ_UDP_SOCKET, socket, bytesToRead);
+
+    err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, response,
+                                  SARA_R5_STANDARD_RESPONSE_TIMEOUT, responseLength);
+
+    if (err != SARA_R5_ERROR_SUCCESS)
+    {
+      if (_printDebug == true)
+      {
+        _debugPort->print(F("socketReadUDP: sendCommandWithResponse err "));
+        _debugPort->println(err);
+      }
+      free(command);
+      free(response);
+      return err;
+    }
+
+    // Extract the data
+    char *searchPtr = strstr(response, "+USORF:");
+    if (searchPtr != nullptr)
+    {
+      searchPtr += strlen("+USORF:"); //  Move searchPtr to first char
+      while (*searchPtr == ' ') searchPtr++; // skip spaces
+      scanNum = sscanf(searchPtr, "%d,\"%d.%d.%d.%d\",%d,%d",
+                        &socketStore, &remoteIPstore[0], &remoteIPstore[1], &remoteIPstore[2], &remoteIPstore[3],
+                        &portStore, &readLength);
+    }
+    if (scanNum != 7)
+    {
+      if (_printDebug == true)
+      {
+        _debugPort->print(F("socketReadUDP: error: scanNum is "));
+        _debugPort->println(scanNum);
+      }
+      free(command);
+      free(response);
+      return SARA_R5_ERROR_UNEXPECTED_RESPONSE;
+    }
+
+    // Check that readLength == bytesToRead
+    if (readLength != bytesToRead)
+    {
+      if (_printDebug == true)
+      {
+        _debugPort->print(F("socketReadUDP: length mismatch! bytesToRead="));
+        _debugPort->print(bytesToRead);
+        _debugPort->print(F(" readLength="));
+        _debugPort->println(readLength);
+      }
+    }
+
+    // Check that readLength > 0
+    if (readLength == 0)
+    {
+      if (_printDebug == true)
+      {
+        _debugPort->println(F("socketRead: zero length!"));
+      }
+      free(command);
+      free(response);
+      return SARA_R5_ERROR_ZERO_READ_LENGTH;
+    }
+
+    // Find the third double-quote
+    strBegin = strchr(searchPtr, '\"');
+    strBegin = strchr(strBegin + 1, '\"');
+    strBegin = strchr(strBegin + 1, '\"');
+
+    if (strBegin == nullptr)
+    {
+      free(command);
+      free(response);
+      return SARA_R5_ERROR_UNEXPECTED_RESPONSE;
+    }
+
+    // Now copy the data into readDest
+    readIndexThisRead = 1; // Start after the quote
+    while (readIndexThisRead < (readLength + 1))
+    {
+      readDest[readIndexTotal] = strBegin[readIndexThisRead];
+      readIndexTotal++;
+      readIndexThisRead++;
+    }
+
+    // If remoteIPaddress is not nullptr, copy the remote IP address
+    if (remoteIPAddress != nullptr)
+    {
+      IPAddress tempAddress;
+      for (int i = 0; i <= 3; i++)
+      {
+        tempAddress[i] = (uint8_t)remoteIPstore[i];
+      }
+      *remoteIPAddress = tempAddress;
+    }
+
+    // If remotePort is not nullptr, copy the remote port
+    if (remotePort != nullptr)
+    {
+      *remotePort = portStore;
+    }
+
+    if (_printDebug == true)
+      _debugPort->println(F("socketReadUDP: success"));
+
+    // Update *bytesRead
+    if (bytesRead != nullptr)
+      *bytesRead = readIndexTotal;
+
+    // How many bytes are left to read?
+    // This would have been bytesLeftToRead -= bytesToRead
+    // Except the SARA can potentially return less data than requested...
+    // So we need to subtract readLength instead.
+    bytesLeftToRead -= readLength;
+    if (_printDebug == true)
+    {
+      if (bytesLeftToRead > 0)
+      {
+        _debugPort->print(F("socketReadUDP: multiple read. bytesLeftToRead: "));
+        _debugPort->println(bytesLeftToRead);
+      }
+    }
+  } // /while (bytesLeftToRead > 0)
+
+  free(command);
+  free(response);
+
+  return SARA_R5_ERROR_SUCCESS;
 }
 
-String SARA_R5::getCapabilities(void)
+SARA_R5_error_t SARA_R5::socketReadAvailableUDP(int socket, int *length)
 {
+  char *command;
   char *response;
-  char idResponse[128] = {0x00}; // E.g. +GCAP: +FCLASS, +CGSM
   SARA_R5_error_t err;
+  int scanNum = 0;
+  int readLength = 0;
+  int socketStore = 0;
+
+  command = sara_r5_calloc_char(strlen(SARA_R5_READ_UDP_SOCKET) + 32);
+  if (command == nullptr)
+    return SARA_R5_ERROR_OUT_OF_MEMORY;
+  sprintf(command, "%s=%d,0", SARA_R5_READ_UDP_SOCKET, socket);
 
   response = sara_r5_calloc_char(minimumResponseAllocation);
+  if (response == nullptr)
+  {
+    free(command);
+    return SARA_R5_ERROR_OUT_OF_MEMORY;
+  }
+
+  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, response,
+                                SARA_R5_STANDARD_RESPONSE_TIMEOUT);
 
-  err = sendCommandWithResponse(SARA_R5_COMMAND_REQ_CAP,
-                                SARA_R5_RESPONSE_OK_OR_ERROR, response, SARA_R5_STANDARD_RESPONSE_TIMEOUT);
   if (err == SARA_R5_ERROR_SUCCESS)
   {
-    char *searchPtr = strstr(response, "\r\n+GCAP:");
+    char *searchPtr = strstr(response, "+USORF:");
     if (searchPtr != nullptr)
     {
-      searchPtr += strlen("\r\n+GCAP:"); // Move searchPtr to first character - probably a space
+      searchPtr += strlen("+USORF:"); //  Move searchPtr to first char
       while (*searchPtr == ' ') searchPtr++; // skip spaces
-      if (sscanf(searchPtr, "%127s", idResponse) != 1)
+      scanNum = sscanf(searchPtr, "%d,%d",
+                        &socketStore, &readLength);
+    }
+    if (scanNum != 2)
+    {
+      if (_printDebug == true)
       {
-        idResponse[0] = 0;
+        _debugPort->print(F("socketReadAvailableUDP: error: scanNum is "));
+        _debugPort->println(scanNum);
       }
+      free(command);
+      free(response);
+      return SARA_R5_ERROR_UNEXPECTED_RESPONSE;
     }
+
+    *length = readLength;
   }
+
+  free(command);
   free(response);
-  return String(idResponse);
+
+  return err;
 }
 
-SARA_R5_error_t SARA_R5::reset(void)
+SARA_R5_error_t SARA_R5::socketListen(int socket, unsigned int port)
 {
   SARA_R5_error_t err;
+  char *command;
+
+  command = sara_r5_calloc_char(strlen(SARA_R5_LISTEN_SOCKET) + 9);
+  if (command == nullptr)
+    return SARA_R5_ERROR_OUT_OF_MEMORY;
+  sprintf(command, "%s=%d,%d", SARA_R5_LISTEN_SOCKET, socket, port);
+
+  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, nullptr,
+                                SARA_R5_STANDARD_RESPONSE_TIMEOUT);
+
+  free(command);
+  return err;
+}
+
+SARA_R5_error_t SARA_R5::socketDirectLinkMode(int socket)
+{
+  SARA_R5_error_t err;
+  char *command;
+
+  command = sara_r5_calloc_char(strlen(SARA_R5_SOCKET_DIRECT_LINK) + 8);
+  if (command == nullptr)
+    return SARA_R5_ERROR_OUT_OF_MEMORY;
+  sprintf(command, "%s=%d", SARA_R5_SOCKET_DIRECT_LINK, socket);
+
+  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_CONNECT, nullptr,
+                                SARA_R5_STANDARD_RESPONSE_TIMEOUT);
+
+  free(command);
+  return err;
+}
+
+SARA_R5_error_t SARA_R5::socketDirectLinkTimeTrigger(int socket, unsigned long timerTrigger)
+{
+  // valid range is 0 (trigger disabled), 100-120000
+  if (!((timerTrigger == 0) || ((timerTrigger >= 100) && (timerTrigger <= 120000))))
+    return SARA_R5_ERROR_ERROR;
+
+  SARA_R5_error_t err;
+  char *command;
+
+  command = sara_r5_calloc_char(strlen(SARA_R5_UD_CONFIGURATION) + 16);
+  if (command == nullptr)
+    return SARA_R5_ERROR_OUT_OF_MEMORY;
+  sprintf(command, "%s=5,%d,%ld", SARA_R5_UD_CONFIGURATION, socket, timerTrigger);
+
+  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, nullptr,
+                                SARA_R5_STANDARD_RESPONSE_TIMEOUT);
+
+  free(command);
+  return err;
+}
+
+SARA_R5_error_t SARA_R5::socketDirectLinkDataLengthTrigger(int socket, int dataLengthTrigger)
+{
+  // valid range is 0, 3-1472 for UDP
+  if (!((dataLengthTrigger == 0) || ((dataLengthTrigger >= 3) && (dataLengthTrigger <= 1472))))
+    return SARA_R5_ERROR_ERROR;
+
+  SARA_R5_error_t err;
+  char *command;
+
+  command = sara_r5_calloc_char(strlen(SARA_R5_UD_CONFIGURATION) + 16);
+  if (command == nullptr)
+    return SARA_R5_ERROR_OUT_OF_MEMORY;
+  sprintf(command, "%s=6,%d,%d", SARA_R5_UD_CONFIGURATION, socket, dataLengthTrigger);
+
+  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, nullptr,
+                                SARA_R5_STANDARD_RESPONSE_TIMEOUT);
+
+  free(command);
+  return err;
+}
+
+SARA_R5_error_t SARA_R5::socketDirectLinkCharacterTrigger(int socket, int characterTrigger)
+{
+  // The allowed range is -1, 0-255, the factory-programmed value is -1; -1 means trigger disabled.
+  if (!((characterTrigger >= -1) && (characterTrigger <= 255)))
+    return SARA_R5_ERROR_ERROR;
+
+  SARA_R5_error_t err;
+  char *command;
+
+  command = sara_r5_calloc_char(strlen(SARA_R5_UD_CONFIGURATION) + 16);
+  if (command == nullptr)
+    return SARA_R5_ERROR_OUT_OF_MEMORY;
+  sprintf(command, "%s=7,%d,%d", SARA_R5_UD_CONFIGURATION, socket, characterTrigger);
+
+  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, nullptr,
+                                SARA_R5_STANDARD_RESPONSE_TIMEOUT);
+
+  free(command);
+  return err;
+}
+
+SARA_R5_error_t SARA_R5::socketDirectLinkCongestionTimer(int socket, unsigned long congestionTimer)
+{
+  // valid range is 0, 1000-72000
+  if (!((congestionTimer == 0) || ((congestionTimer >= 1000) && (congestionTimer <= 72000))))
+    return SARA_R5_ERROR_ERROR;
+
+  SARA_R5_error_t err;
+  char *command;
+
+  command = sara_r5_calloc_char(strlen(SARA_R5_UD_CONFIGURATION) + 16);
+  if (command == nullptr)
+    return SARA_R5_ERROR_OUT_OF_MEMORY;
+  sprintf(command, "%s=8,%d,%ld", SARA_R5_UD_CONFIGURATION, socket, congestionTimer);
+
+  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, nullptr,
+                                SARA_R5_STANDARD_RESPONSE_TIMEOUT);
+
+  free(command);
+  return err;
+}
+
+SARA_R5_error_t SARA_R5::querySocketType(int socket, SARA_R5_socket_protocol_t *protocol)
+{
+  char *command;
+  char *response;
+  SARA_R5_error_t err;
+  int scanNum = 0;
+  int socketStore = 0;
+  int paramVal;
+
+  command = sara_r5_calloc_char(strlen(SARA_R5_SOCKET_CONTROL) + 16);
+  if (command == nullptr)
+    return SARA_R5_ERROR_OUT_OF_MEMORY;
+  sprintf(command, "%s=%d,0", SARA_R5_SOCKET_CONTROL, socket);
+
+  response = sara_r5_calloc_char(minimumResponseAllocation);
+  if (response == nullptr)
+  {
+    free(command);
+    return SARA_R5_ERROR_OUT_OF_MEMORY;
+  }
+
+  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, response,
+                                SARA_R5_STANDARD_RESPONSE_TIMEOUT);
 
-  err = functionality(SILENT_RESET_WITH_SIM);
   if (err == SARA_R5_ERROR_SUCCESS)
   {
-    // Reset will set the baud rate back to 115200
-    //beginSerial(9600);
-    err = SARA_R5_ERROR_INVALID;
-    while (err != SARA_R5_ERROR_SUCCESS)
+    char *searchPtr = strstr(response, "+USOCTL:");
+    if (searchPtr != nullptr)
+    {
+      searchPtr += strlen("+USOCTL:"); //  Move searchPtr to first char
+      while (*searchPtr == ' ') searchPtr++; // skip spaces
+      scanNum = sscanf(searchPtr, "%d,0,%d",
+                        &socketStore, &paramVal);
+    }
+    if (scanNum != 2)
+    {
+      if (_printDebug == true)
+      {
+        _debugPort->print(F("querySocketType: error: scanNum is "));
+        _debugPort->println(scanNum);
+      }
+      free(command);
+      free(response);
+      return SARA_R5_ERROR_UNEXPECTED_RESPONSE;
+    }
+
+    *protocol = (SARA_R5_socket_protocol_t)paramVal;
+    _lastSocketProtocol[socketStore] = paramVal;
+  }
+
+  free(command);
+  free(response);
+
+  return err;
+}
+
+SARA_R5_error_t SARA_R5::querySocketLastError(int socket, int *error)
+{
+  char *command;
+  char *response;
+  SARA_R5_error_t err;
+  int scanNum = 0;
+  int socketStore = 0;
+  int paramVal;
+
+  command = sara_r5_calloc_char(strlen(SARA_R5_SOCKET_CONTROL) + 16);
+  if (command == nullptr)
+    return SARA_R5_ERROR_OUT_OF_MEMORY;
+  sprintf(command, "%s=%d,1", SARA_R5_SOCKET_CONTROL, socket);
+
+  response = sara_r5_calloc_char(minimumResponseAllocation);
+  if (response == nullptr)
+  {
+    free(command);
+    return SARA_R5_ERROR_OUT_OF_MEMORY;
+  }
+
+  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, response,
+                                SARA_R5_STANDARD_RESPONSE_TIMEOUT);
+
+  if (err == SARA_R5_ERROR_SUCCESS)
+  {
+    char *searchPtr = strstr(response, "+USOCTL:");
+    if (searchPtr != nullptr)
+    {
+      searchPtr += strlen("+USOCTL:"); //  Move searchPtr to first char
+      while (*searchPtr == ' ') searchPtr++; // skip spaces
+      scanNum = sscanf(searchPtr, "%d,1,%d",
+                        &socketStore, &paramVal);
+    }
+    if (scanNum != 2)
     {
-      beginSerial(SARA_R5_DEFAULT_BAUD_RATE);
-      setBaud(_baud);
-      beginSerial(_baud);
-      err = at();
+      if (_printDebug == true)
+      {
+        _debugPort->print(F("querySocketLastError: error: scanNum is "));
+        _debugPort->println(scanNum);
+      }
+      free(command);
+      free(response);
+      return SARA_R5_ERROR_UNEXPECTED_RESPONSE;
     }
-    return init(_baud);
+
+    *error = paramVal;
   }
+
+  free(command);
+  free(response);
+
   return err;
 }
 
-String SARA_R5::clock(void)
+SARA_R5_error_t SARA_R5::querySocketTotalBytesSent(int socket, uint32_t *total)
 {
-  SARA_R5_error_t err;
   char *command;
   char *response;
-  char *clockBegin;
-  char *clockEnd;
+  SARA_R5_error_t err;
+  int scanNum = 0;
+  int socketStore = 0;
+  long unsigned int paramVal;
 
-  command = sara_r5_calloc_char(strlen(SARA_R5_COMMAND_CLOCK) + 2);
+  command = sara_r5_calloc_char(strlen(SARA_R5_SOCKET_CONTROL) + 16);
   if (command == nullptr)
-    return "";
-  sprintf(command, "%s?", SARA_R5_COMMAND_CLOCK);
+    return SARA_R5_ERROR_OUT_OF_MEMORY;
+  sprintf(command, "%s=%d,2", SARA_R5_SOCKET_CONTROL, socket);
 
   response = sara_r5_calloc_char(minimumResponseAllocation);
   if (response == nullptr)
   {
     free(command);
-    return "";
+    return SARA_R5_ERROR_OUT_OF_MEMORY;
   }
 
-  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR,
-                                response, SARA_R5_STANDARD_RESPONSE_TIMEOUT);
-  if (err != SARA_R5_ERROR_SUCCESS)
-  {
-    free(command);
-    free(response);
-    return "";
-  }
+  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, response,
+                                SARA_R5_STANDARD_RESPONSE_TIMEOUT);
 
-  // Response format: \r\n+CCLK: "YY/MM/DD,HH:MM:SS-TZ"\r\n\r\nOK\r\n
-  clockBegin = strchr(response, '\"'); // Find first quote
-  if (clockBegin == nullptr)
-  {
-    free(command);
-    free(response);
-    return "";
-  }
-  clockBegin += 1;                     // Increment pointer to begin at first number
-  clockEnd = strchr(clockBegin, '\"'); // Find last quote
-  if (clockEnd == nullptr)
+  if (err == SARA_R5_ERROR_SUCCESS)
   {
-    free(command);
-    free(response);
-    return "";
-  }
-  *(clockEnd) = '\0'; // Set last quote to null char -- end string
+    char *searchPtr = strstr(response, "+USOCTL:");
+    if (searchPtr != nullptr)
+    {
+      searchPtr += strlen("+USOCTL:"); //  Move searchPtr to first char
+      while (*searchPtr == ' ') searchPtr++; // skip spaces
+      scanNum = sscanf(searchPtr, "%d,2,%lu",
+                        &socketStore, &paramVal);
+    }
+    if (scanNum != 2)
+    {
+      if (_printDebug == true)
+      {
+        _debugPort->print(F("querySocketTotalBytesSent: error: scanNum is "));
+        _debugPort->println(scanNum);
+      }
+      free(command);
+      free(response);
+      return SARA_R5_ERROR_UNEXPECTED_RESPONSE;
+    }
 
-  String clock = String(clockBegin); // Extract the clock as a String _before_ freeing response
+    *total = (uint32_t)paramVal;
+  }
 
   free(command);
   free(response);
 
-  return (clock);
+  return err;
 }
 
-SARA_R5_error_t SARA_R5::clock(uint8_t *y, uint8_t *mo, uint8_t *d,
-                               uint8_t *h, uint8_t *min, uint8_t *s, int8_t *tz)
+SARA_R5_error_t SARA_R5::querySocketTotalBytesReceived(int socket, uint32_t *total)
 {
-  SARA_R5_error_t err;
   char *command;
   char *response;
-  char tzPlusMinus;
+  SARA_R5_error_t err;
   int scanNum = 0;
+  int socketStore = 0;
+  long unsigned int paramVal;
 
-  int iy, imo, id, ih, imin, is, itz;
-
-  command = sara_r5_calloc_char(strlen(SARA_R5_COMMAND_CLOCK) + 2);
+  command = sara_r5_calloc_char(strlen(SARA_R5_SOCKET_CONTROL) + 16);
   if (command == nullptr)
     return SARA_R5_ERROR_OUT_OF_MEMORY;
-  sprintf(command, "%s?", SARA_R5_COMMAND_CLOCK);
+  sprintf(command, "%s=%d,3", SARA_R5_SOCKET_CONTROL, socket);
 
   response = sara_r5_calloc_char(minimumResponseAllocation);
   if (response == nullptr)
@@ -1238,136 +5500,113 @@ SARA_R5_error_t SARA_R5::clock(uint8_t *y, uint8_t *mo, uint8_t *d,
     return SARA_R5_ERROR_OUT_OF_MEMORY;
   }
 
-  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR,
-                                response, SARA_R5_STANDARD_RESPONSE_TIMEOUT);
+  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, response,
+                                SARA_R5_STANDARD_RESPONSE_TIMEOUT);
 
-  // Response format (if TZ is negative): \r\n+CCLK: "YY/MM/DD,HH:MM:SS-TZ"\r\n\r\nOK\r\n
   if (err == SARA_R5_ERROR_SUCCESS)
   {
-    char *searchPtr = strstr(response, "+CCLK:");
+    char *searchPtr = strstr(response, "+USOCTL:");
     if (searchPtr != nullptr)
     {
-      searchPtr += strlen("+CCLK:"); //  Move searchPtr to first char
+      searchPtr += strlen("+USOCTL:"); //  Move searchPtr to first char
       while (*searchPtr == ' ') searchPtr++; // skip spaces
-      scanNum = sscanf(searchPtr, "\"%d/%d/%d,%d:%d:%d%c%d\"\r\n",
-               &iy, &imo, &id, &ih, &imin, &is, &tzPlusMinus, &itz);
+      scanNum = sscanf(searchPtr, "%d,3,%lu",
+                        &socketStore, &paramVal);
     }
-    if (scanNum == 8)
+    if (scanNum != 2)
     {
-      *y = iy;
-      *mo = imo;
-      *d = id;
-      *h = ih;
-      *min = imin;
-      *s = is;
-      if (tzPlusMinus == '-')
-        *tz = 0 - itz;
-      else
-        *tz = itz;
+      if (_printDebug == true)
+      {
+        _debugPort->print(F("querySocketTotalBytesReceived: error: scanNum is "));
+        _debugPort->println(scanNum);
+      }
+      free(command);
+      free(response);
+      return SARA_R5_ERROR_UNEXPECTED_RESPONSE;
     }
-    else
-      err = SARA_R5_ERROR_UNEXPECTED_RESPONSE;
+
+    *total = (uint32_t)paramVal;
   }
 
   free(command);
   free(response);
-  return err;
-}
-
-SARA_R5_error_t SARA_R5::setClock(uint8_t y, uint8_t mo, uint8_t d,
-                                  uint8_t h, uint8_t min, uint8_t s, int8_t tz)
-{
-  //Convert y,mo,d,h,min,s,tz into a String
-  //Some platforms don't support sprintf correctly (for %02d or %+02d) so we need to build the String manually
-  //Format is "yy/MM/dd,hh:mm:ss+TZ"
-  //TZ can be +/- and is in increments of 15 minutes (not hours)
-
-  String theTime = "";
-
-  theTime.concat(y / 10);
-  theTime.concat(y % 10);
-  theTime.concat('/');
-  theTime.concat(mo / 10);
-  theTime.concat(mo % 10);
-  theTime.concat('/');
-  theTime.concat(d / 10);
-  theTime.concat(d % 10);
-  theTime.concat(',');
-  theTime.concat(h / 10);
-  theTime.concat(h % 10);
-  theTime.concat(':');
-  theTime.concat(min / 10);
-  theTime.concat(min % 10);
-  theTime.concat(':');
-  theTime.concat(s / 10);
-  theTime.concat(s % 10);
-  if (tz < 0)
-  {
-    theTime.concat('-');
-    tz = 0 - tz;
-  }
-  else
-    theTime.concat('+');
-  theTime.concat(tz / 10);
-  theTime.concat(tz % 10);
 
-  return (setClock(theTime));
+  return err;
 }
 
-SARA_R5_error_t SARA_R5::setClock(String theTime)
+SARA_R5_error_t SARA_R5::querySocketRemoteIPAddress(int socket, IPAddress *address, int *port)
 {
-  SARA_R5_error_t err;
   char *command;
+  char *response;
+  SARA_R5_error_t err;
+  int scanNum = 0;
+  int socketStore = 0;
+  int paramVals[5];
 
-  command = sara_r5_calloc_char(strlen(SARA_R5_COMMAND_CLOCK) + theTime.length() + 8);
+  command = sara_r5_calloc_char(strlen(SARA_R5_SOCKET_CONTROL) + 16);
   if (command == nullptr)
     return SARA_R5_ERROR_OUT_OF_MEMORY;
-  sprintf(command, "%s=\"%s\"", SARA_R5_COMMAND_CLOCK, theTime.c_str());
-
-  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR,
-                                nullptr, SARA_R5_STANDARD_RESPONSE_TIMEOUT);
+  sprintf(command, "%s=%d,4", SARA_R5_SOCKET_CONTROL, socket);
 
-  free(command);
-  return err;
-}
+  response = sara_r5_calloc_char(minimumResponseAllocation);
+  if (response == nullptr)
+  {
+    free(command);
+    return SARA_R5_ERROR_OUT_OF_MEMORY;
+  }
 
-void SARA_R5::autoTimeZoneForBegin(bool tz)
-{
-  _autoTimeZoneForBegin = tz;
-}
+  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, response,
+                                SARA_R5_STANDARD_RESPONSE_TIMEOUT);
 
-SARA_R5_error_t SARA_R5::setUtimeMode(SARA_R5_utime_mode_t mode, SARA_R5_utime_sensor_t sensor)
-{
-  SARA_R5_error_t err;
-  char *command;
+  if (err == SARA_R5_ERROR_SUCCESS)
+  {
+    char *searchPtr = strstr(response, "+USOCTL:");
+    if (searchPtr != nullptr)
+    {
+      searchPtr += strlen("+USOCTL:"); //  Move searchPtr to first char
+      while (*searchPtr == ' ') searchPtr++; // skip spaces
+      scanNum = sscanf(searchPtr, "%d,4,\"%d.%d.%d.%d\",%d",
+                        &socketStore,
+                        &paramVals[0], &paramVals[1], &paramVals[2], &paramVals[3],
+                        &paramVals[4]);
+    }
+    if (scanNum != 6)
+    {
+      if (_printDebug == true)
+      {
+        _debugPort->print(F("querySocketRemoteIPAddress: error: scanNum is "));
+        _debugPort->println(scanNum);
+      }
+      free(command);
+      free(response);
+      return SARA_R5_ERROR_UNEXPECTED_RESPONSE;
+    }
 
-  command = sara_r5_calloc_char(strlen(SARA_R5_GNSS_REQUEST_TIME) + 16);
-  if (command == nullptr)
-    return SARA_R5_ERROR_OUT_OF_MEMORY;
-  if (mode == SARA_R5_UTIME_MODE_STOP) // stop UTIME does not require a sensor
-    sprintf(command, "%s=%d", SARA_R5_GNSS_REQUEST_TIME, mode);
-  else
-    sprintf(command, "%s=%d,%d", SARA_R5_GNSS_REQUEST_TIME, mode, sensor);
+    IPAddress tempAddress = { (uint8_t)paramVals[0], (uint8_t)paramVals[1],
+                              (uint8_t)paramVals[2], (uint8_t)paramVals[3] };
+    *address = tempAddress;
+    *port = paramVals[4];
+  }
 
-  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR,
-                                nullptr, SARA_R5_10_SEC_TIMEOUT);
   free(command);
+  free(response);
+
   return err;
 }
 
-SARA_R5_error_t SARA_R5::getUtimeMode(SARA_R5_utime_mode_t *mode, SARA_R5_utime_sensor_t *sensor)
+SARA_R5_error_t SARA_R5::querySocketStatusTCP(int socket, SARA_R5_tcp_socket_status_t *status)
 {
-  SARA_R5_error_t err;
   char *command;
   char *response;
+  SARA_R5_error_t err;
+  int scanNum = 0;
+  int socketStore = 0;
+  int paramVal;
 
-  SARA_R5_utime_mode_t m;
-  SARA_R5_utime_sensor_t s;
-
-  command = sara_r5_calloc_char(strlen(SARA_R5_GNSS_REQUEST_TIME) + 2);
+  command = sara_r5_calloc_char(strlen(SARA_R5_SOCKET_CONTROL) + 16);
   if (command == nullptr)
     return SARA_R5_ERROR_OUT_OF_MEMORY;
-  sprintf(command, "%s?", SARA_R5_GNSS_REQUEST_TIME);
+  sprintf(command, "%s=%d,10", SARA_R5_SOCKET_CONTROL, socket);
 
   response = sara_r5_calloc_char(minimumResponseAllocation);
   if (response == nullptr)
@@ -1376,69 +5615,53 @@ SARA_R5_error_t SARA_R5::getUtimeMode(SARA_R5_utime_mode_t *mode, SARA_R5_utime_
     return SARA_R5_ERROR_OUT_OF_MEMORY;
   }
 
-  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR,
-                                response, SARA_R5_10_SEC_TIMEOUT);
+  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, response,
+                                SARA_R5_STANDARD_RESPONSE_TIMEOUT);
 
-  // Response format: \r\n+UTIME: <mode>[,<sensor>]\r\n\r\nOK\r\n
   if (err == SARA_R5_ERROR_SUCCESS)
   {
-    int mStore, sStore, scanned = 0;
-    char *searchPtr = strstr(response, "+UTIME:");
+    char *searchPtr = strstr(response, "+USOCTL:");
     if (searchPtr != nullptr)
     {
-      searchPtr += strlen("+UTIME:"); // Move searchPtr to first character - probably a space
+      searchPtr += strlen("+USOCTL:"); //  Move searchPtr to first char
       while (*searchPtr == ' ') searchPtr++; // skip spaces
-      scanned = sscanf(searchPtr, "%d,%d\r\n", &mStore, &sStore);
-    }
-    m = (SARA_R5_utime_mode_t)mStore;
-    s = (SARA_R5_utime_sensor_t)sStore;
-    if (scanned == 2)
-    {
-      *mode = m;
-      *sensor = s;
+      scanNum = sscanf(searchPtr, "%d,10,%d",
+                        &socketStore, &paramVal);
     }
-    else if (scanned == 1)
+    if (scanNum != 2)
     {
-      *mode = m;
-      *sensor = SARA_R5_UTIME_SENSOR_NONE;
+      if (_printDebug == true)
+      {
+        _debugPort->print(F("querySocketStatusTCP: error: scanNum is "));
+        _debugPort->println(scanNum);
+      }
+      free(command);
+      free(response);
+      return SARA_R5_ERROR_UNEXPECTED_RESPONSE;
     }
-    else
-      err = SARA_R5_ERROR_UNEXPECTED_RESPONSE;
+
+    *status = (SARA_R5_tcp_socket_status_t)paramVal;
   }
 
   free(command);
   free(response);
-  return err;
-}
-
-SARA_R5_error_t SARA_R5::setUtimeIndication(SARA_R5_utime_urc_configuration_t config)
-{
-  SARA_R5_error_t err;
-  char *command;
-
-  command = sara_r5_calloc_char(strlen(SARA_R5_GNSS_TIME_INDICATION) + 16);
-  if (command == nullptr)
-    return SARA_R5_ERROR_OUT_OF_MEMORY;
-  sprintf(command, "%s=%d", SARA_R5_GNSS_TIME_INDICATION, config);
 
-  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR,
-                                nullptr, SARA_R5_STANDARD_RESPONSE_TIMEOUT);
-  free(command);
   return err;
 }
 
-SARA_R5_error_t SARA_R5::getUtimeIndication(SARA_R5_utime_urc_configuration_t *config)
+SARA_R5_error_t SARA_R5::querySocketOutUnackData(int socket, uint32_t *total)
 {
-  SARA_R5_error_t err;
   char *command;
   char *response;
+  SARA_R5_error_t err;
+  int scanNum = 0;
+  int socketStore = 0;
+  long unsigned int paramVal;
 
-  SARA_R5_utime_urc_configuration_t c;
-
-  command = sara_r5_calloc_char(strlen(SARA_R5_GNSS_TIME_INDICATION) + 2);
+  command = sara_r5_calloc_char(strlen(SARA_R5_SOCKET_CONTROL) + 16);
   if (command == nullptr)
     return SARA_R5_ERROR_OUT_OF_MEMORY;
-  sprintf(command, "%s?", SARA_R5_GNSS_TIME_INDICATION);
+  sprintf(command, "%s=%d,11", SARA_R5_SOCKET_CONTROL, socket);
 
   response = sara_r5_calloc_char(minimumResponseAllocation);
   if (response == nullptr)
@@ -1447,63 +5670,51 @@ SARA_R5_error_t SARA_R5::getUtimeIndication(SARA_R5_utime_urc_configuration_t *c
     return SARA_R5_ERROR_OUT_OF_MEMORY;
   }
 
-  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR,
-                                response, SARA_R5_STANDARD_RESPONSE_TIMEOUT);
+  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, response,
+                                SARA_R5_STANDARD_RESPONSE_TIMEOUT);
 
-  // Response format: \r\n+UTIMEIND: <mode>\r\n\r\nOK\r\n
   if (err == SARA_R5_ERROR_SUCCESS)
   {
-    int cStore, scanned = 0;
-    char *searchPtr = strstr(response, "+UTIMEIND:");
+    char *searchPtr = strstr(response, "+USOCTL:");
     if (searchPtr != nullptr)
     {
-      searchPtr += strlen("+UTIMEIND:"); //  Move searchPtr to first char
+      searchPtr += strlen("+USOCTL:"); //  Move searchPtr to first char
       while (*searchPtr == ' ') searchPtr++; // skip spaces
-      scanned = sscanf(searchPtr, "%d\r\n", &cStore);
+      scanNum = sscanf(searchPtr, "%d,11,%lu",
+                        &socketStore, &paramVal);
     }
-    c = (SARA_R5_utime_urc_configuration_t)cStore;
-    if (scanned == 1)
+    if (scanNum != 2)
     {
-      *config = c;
+      if (_printDebug == true)
+      {
+        _debugPort->print(F("querySocketOutUnackData: error: scanNum is "));
+        _debugPort->println(scanNum);
+      }
+      free(command);
+      free(response);
+      return SARA_R5_ERROR_UNEXPECTED_RESPONSE;
     }
-    else
-      err = SARA_R5_ERROR_UNEXPECTED_RESPONSE;
+
+    *total = (uint32_t)paramVal;
   }
 
   free(command);
   free(response);
-  return err;
-}
-
-SARA_R5_error_t SARA_R5::setUtimeConfiguration(int32_t offsetNanoseconds, int32_t offsetSeconds)
-{
-  SARA_R5_error_t err;
-  char *command;
-
-  command = sara_r5_calloc_char(strlen(SARA_R5_GNSS_TIME_CONFIGURATION) + 48);
-  if (command == nullptr)
-    return SARA_R5_ERROR_OUT_OF_MEMORY;
-  sprintf(command, "%s=%d,%d", SARA_R5_GNSS_TIME_CONFIGURATION, (int)offsetNanoseconds, (int)offsetSeconds);
 
-  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR,
-                                nullptr, SARA_R5_STANDARD_RESPONSE_TIMEOUT);
-  free(command);
   return err;
 }
 
-SARA_R5_error_t SARA_R5::getUtimeConfiguration(int32_t *offsetNanoseconds, int32_t *offsetSeconds)
+//Issues command to get last socket error, then prints to serial. Also updates rx/backlog buffers.
+int SARA_R5::socketGetLastError()
 {
   SARA_R5_error_t err;
   char *command;
   char *response;
+  int errorCode = -1;
 
-  int ons;
-  int os;
-
-  command = sara_r5_calloc_char(strlen(SARA_R5_GNSS_TIME_CONFIGURATION) + 2);
+  command = sara_r5_calloc_char(64);
   if (command == nullptr)
     return SARA_R5_ERROR_OUT_OF_MEMORY;
-  sprintf(command, "%s?", SARA_R5_GNSS_TIME_CONFIGURATION);
 
   response = sara_r5_calloc_char(minimumResponseAllocation);
   if (response == nullptr)
@@ -1512,2425 +5723,2843 @@ SARA_R5_error_t SARA_R5::getUtimeConfiguration(int32_t *offsetNanoseconds, int32
     return SARA_R5_ERROR_OUT_OF_MEMORY;
   }
 
-  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR,
-                                response, SARA_R5_STANDARD_RESPONSE_TIMEOUT);
+  sprintf(command, "%s", SARA_R5_GET_ERROR);
+
+  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, response,
+                                SARA_R5_STANDARD_RESPONSE_TIMEOUT);
 
-  // Response format: \r\n+UTIMECFG: <offset_nano>,<offset_sec>\r\n\r\nOK\r\n
   if (err == SARA_R5_ERROR_SUCCESS)
   {
-    int scanned = 0;
-    char *searchPtr = strstr(response, "+UTIMECFG:");
+    char *searchPtr = strstr(response, "+USOER:");
     if (searchPtr != nullptr)
     {
-      searchPtr += strlen("+UTIMECFG:"); //  Move searchPtr to first char
+      searchPtr += strlen("+USOER:"); //  Move searchPtr to first char
       while (*searchPtr == ' ') searchPtr++; // skip spaces
-      scanned = sscanf(searchPtr, "%d,%d\r\n", &ons, &os);
-    }
-    if (scanned == 2)
-    {
-      *offsetNanoseconds = ons;
-      *offsetSeconds = os;
+      sscanf(searchPtr, "%d", &errorCode);
     }
-    else
-      err = SARA_R5_ERROR_UNEXPECTED_RESPONSE;
   }
 
   free(command);
   free(response);
-  return err;
+
+  return errorCode;
 }
 
-SARA_R5_error_t SARA_R5::autoTimeZone(bool enable)
+IPAddress SARA_R5::lastRemoteIP(void)
 {
-  SARA_R5_error_t err;
-  char *command;
-
-  command = sara_r5_calloc_char(strlen(SARA_R5_COMMAND_AUTO_TZ) + 3);
-  if (command == nullptr)
-    return SARA_R5_ERROR_OUT_OF_MEMORY;
-  sprintf(command, "%s=%d", SARA_R5_COMMAND_AUTO_TZ, enable ? 1 : 0);
-
-  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR,
-                                nullptr, SARA_R5_STANDARD_RESPONSE_TIMEOUT);
-  free(command);
-  return err;
+  return _lastRemoteIP;
 }
 
-int8_t SARA_R5::rssi(void)
+SARA_R5_error_t SARA_R5::resetHTTPprofile(int profile)
 {
-  char *command;
-  char *response;
+  invalidateConfigShadow(); // The profile is reset
+
   SARA_R5_error_t err;
-  int rssi;
+  char *command;
 
-  command = sara_r5_calloc_char(strlen(SARA_R5_SIGNAL_QUALITY) + 1);
-  if (command == nullptr)
-    return SARA_R5_ERROR_OUT_OF_MEMORY;
-  sprintf(command, "%s", SARA_R5_SIGNAL_QUALITY);
+  if (profile >= SARA_R5_NUM_HTTP_PROFILES)
+    return SARA_R5_ERROR_ERROR;
 
-  response = sara_r5_calloc_char(minimumResponseAllocation);
-  if (response == nullptr)
-  {
-    free(command);
+  command = sara_r5_calloc_char(strlen(SARA_R5_HTTP_PROFILE) + 16);
+  if (command == nullptr)
     return SARA_R5_ERROR_OUT_OF_MEMORY;
-  }
-
-  err = sendCommandWithResponse(command,
-                                SARA_R5_RESPONSE_OK_OR_ERROR, response, 10000,
-                                minimumResponseAllocation, AT_COMMAND);
-  if (err != SARA_R5_ERROR_SUCCESS)
-  {
-    free(command);
-    free(response);
-    return -1;
-  }
+  sprintf(command, "%s=%d", SARA_R5_HTTP_PROFILE, profile);
 
-  int scanned = 0;
-  char *searchPtr = strstr(response, "+CSQ:");
-  if (searchPtr != nullptr)
-  {
-    searchPtr += strlen("+CSQ:"); //  Move searchPtr to first char
-    while (*searchPtr == ' ') searchPtr++; // skip spaces
-    scanned = sscanf(searchPtr, "%d,%*d", &rssi);
-  }
-  if (scanned != 1)
-  {
-    rssi = -1;
-  }
+  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, nullptr,
+                                SARA_R5_STANDARD_RESPONSE_TIMEOUT);
 
   free(command);
-  free(response);
-  return rssi;
+  return err;
 }
 
-SARA_R5_error_t SARA_R5::getExtSignalQuality(signal_quality& signal_quality)
+SARA_R5_error_t SARA_R5::setHTTPserverIPaddress(int profile, IPAddress address)
 {
-  char *command;
-  char *response;
   SARA_R5_error_t err;
+  char *command;
 
-  command = sara_r5_calloc_char(strlen(SARA_R5_EXT_SIGNAL_QUALITY) + 1);
-  if (command == nullptr)
-  {
-    return SARA_R5_ERROR_OUT_OF_MEMORY;
-  }
-
-  sprintf(command, "%s", SARA_R5_EXT_SIGNAL_QUALITY);
-
-  response = sara_r5_calloc_char(minimumResponseAllocation);
-  if (response == nullptr)
-  {
-    free(command);
-    return SARA_R5_ERROR_OUT_OF_MEMORY;
-  }
-
-  err = sendCommandWithResponse(command,
-                                SARA_R5_RESPONSE_OK_OR_ERROR, response, 10000,
-                                minimumResponseAllocation, AT_COMMAND);
-  if (err != SARA_R5_ERROR_SUCCESS)
-  {
-    free(command);
-    free(response);
+  if (profile >= SARA_R5_NUM_HTTP_PROFILES)
     return SARA_R5_ERROR_ERROR;
-  }
 
-  int scanned = 0;
-  const char * responseStr = "+CESQ:";
-  char *searchPtr = strstr(response, responseStr);
-  if (searchPtr != nullptr)
-  {
-    searchPtr += strlen(responseStr); //  Move searchPtr to first char
-    while (*searchPtr == ' ') searchPtr++; // skip spaces
-    scanned = sscanf(searchPtr, "%u,%u,%u,%u,%u,%u", &signal_quality.rxlev, &signal_quality.ber,
-                       &signal_quality.rscp, &signal_quality.enc0, &signal_quality.rsrq, &signal_quality.rsrp);
-  }
+  command = sara_r5_calloc_char(strlen(SARA_R5_HTTP_PROFILE) + 64);
+  if (command == nullptr)
+    return SARA_R5_ERROR_OUT_OF_MEMORY;
+  sprintf(command, "%s=%d,%d,\"%d.%d.%d.%d\"", SARA_R5_HTTP_PROFILE, profile, SARA_R5_HTTP_OP_CODE_SERVER_IP,
+          address[0], address[1], address[2], address[3]);
 
-  err = SARA_R5_ERROR_UNEXPECTED_RESPONSE;
-  if (scanned == 6)
-  {
-    err = SARA_R5_ERROR_SUCCESS;
-  }
+  err = sendShadowedCommand(command, 2, SARA_R5_STANDARD_RESPONSE_TIMEOUT);
+
+  // The server IP address and the server name set the same server. The name is no longer what the module holds
+  sprintf(command, "%s=%d,%d,", SARA_R5_HTTP_PROFILE, profile, SARA_R5_HTTP_OP_CODE_SERVER_NAME);
+  forgetShadowedCommand(command);
 
   free(command);
-  free(response);
   return err;
 }
 
-SARA_R5_registration_status_t SARA_R5::registration(bool eps)
+SARA_R5_error_t SARA_R5::setHTTPserverName(int profile, String server)
 {
-  char *command;
-  char *response;
   SARA_R5_error_t err;
-  int status;
-  const char* tag = eps ? SARA_R5_EPSREGISTRATION_STATUS : SARA_R5_REGISTRATION_STATUS;
-  command = sara_r5_calloc_char(strlen(tag) + 3);
-  if (command == nullptr)
-    return SARA_R5_REGISTRATION_INVALID;
-  sprintf(command, "%s?", tag);
+  char *command;
 
-  response = sara_r5_calloc_char(minimumResponseAllocation);
-  if (response == nullptr)
-  {
-    free(command);
-    return SARA_R5_REGISTRATION_INVALID;
-  }
+  if (profile >= SARA_R5_NUM_HTTP_PROFILES)
+    return SARA_R5_ERROR_ERROR;
 
-  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR,
-                                response, SARA_R5_STANDARD_RESPONSE_TIMEOUT,
-                                minimumResponseAllocation, AT_COMMAND);
-  if (err != SARA_R5_ERROR_SUCCESS)
-  {
-    free(command);
-    free(response);
-    return SARA_R5_REGISTRATION_INVALID;
-  }
+  command = sara_r5_calloc_char(strlen(SARA_R5_HTTP_PROFILE) + 12 + server.length());
+  if (command == nullptr)
+    return SARA_R5_ERROR_OUT_OF_MEMORY;
+  sprintf(command, "%s=%d,%d,\"%s\"", SARA_R5_HTTP_PROFILE, profile, SARA_R5_HTTP_OP_CODE_SERVER_NAME,
+          server.c_str());
 
-  int scanned = 0;
-  const char *startTag = eps ? SARA_R5_EPSREGISTRATION_STATUS_URC : SARA_R5_REGISTRATION_STATUS_URC;
-  char *searchPtr = strstr(response, startTag);
-  if (searchPtr != nullptr)
-  {
-    searchPtr += eps ? strlen(SARA_R5_EPSREGISTRATION_STATUS_URC) : strlen(SARA_R5_REGISTRATION_STATUS_URC); //  Move searchPtr to first char
-    while (*searchPtr == ' ') searchPtr++; // skip spaces
-	  scanned = sscanf(searchPtr, "%*d,%d", &status);
-  }
-  if (scanned != 1)
-    status = SARA_R5_REGISTRATION_INVALID;
+  err = sendShadowedCommand(command, 2, SARA_R5_STANDARD_RESPONSE_TIMEOUT);
+
+  // The server name and the server IP address set the same server. The IP address is no longer what the module holds
+  sprintf(command, "%s=%d,%d,", SARA_R5_HTTP_PROFILE, profile, SARA_R5_HTTP_OP_CODE_SERVER_IP);
+  forgetShadowedCommand(command);
 
   free(command);
-  free(response);
-  return (SARA_R5_registration_status_t)status;
+  return err;
 }
 
-bool SARA_R5::setNetworkProfile(mobile_network_operator_t mno, bool autoReset, bool urcNotification)
+SARA_R5_error_t SARA_R5::setHTTPusername(int profile, String username)
 {
-  mobile_network_operator_t currentMno;
-
-  // Check currently set MNO profile
-  if (getMNOprofile(&currentMno) != SARA_R5_ERROR_SUCCESS)
-  {
-    return false;
-  }
-
-  if (currentMno == mno)
-  {
-    return true;
-  }
+  SARA_R5_error_t err;
+  char *command;
 
-  // Disable transmit and receive so we can change operator
-  if (functionality(MINIMUM_FUNCTIONALITY) != SARA_R5_ERROR_SUCCESS)
-  {
-    return false;
-  }
+  if (profile >= SARA_R5_NUM_HTTP_PROFILES)
+    return SARA_R5_ERROR_ERROR;
 
-  if (setMNOprofile(mno, autoReset, urcNotification) != SARA_R5_ERROR_SUCCESS)
-  {
-    return false;
-  }
+  command = sara_r5_calloc_char(strlen(SARA_R5_HTTP_PROFILE) + 12 + username.length());
+  if (command == nullptr)
+    return SARA_R5_ERROR_OUT_OF_MEMORY;
+  sprintf(command, "%s=%d,%d,\"%s\"", SARA_R5_HTTP_PROFILE, profile, SARA_R5_HTTP_OP_CODE_USERNAME,
+          username.c_str());
 
-  if (reset() != SARA_R5_ERROR_SUCCESS)
-  {
-    return false;
-  }
+  err = sendShadowedCommand(command, 2, SARA_R5_STANDARD_RESPONSE_TIMEOUT);
 
-  return true;
+  free(command);
+  return err;
 }
 
-mobile_network_operator_t SARA_R5::getNetworkProfile(void)
+SARA_R5_error_t SARA_R5::setHTTPpassword(int profile, String password)
 {
-  mobile_network_operator_t mno;
   SARA_R5_error_t err;
+  char *command;
 
-  err = getMNOprofile(&mno);
-  if (err != SARA_R5_ERROR_SUCCESS)
-  {
-    return MNO_INVALID;
-  }
-  return mno;
+  if (profile >= SARA_R5_NUM_HTTP_PROFILES)
+    return SARA_R5_ERROR_ERROR;
+
+  command = sara_r5_calloc_char(strlen(SARA_R5_HTTP_PROFILE) + 12 + password.length());
+  if (command == nullptr)
+    return SARA_R5_ERROR_OUT_OF_MEMORY;
+  sprintf(command, "%s=%d,%d,\"%s\"", SARA_R5_HTTP_PROFILE, profile, SARA_R5_HTTP_OP_CODE_PASSWORD,
+          password.c_str());
+
+  err = sendShadowedCommand(command, 2, SARA_R5_STANDARD_RESPONSE_TIMEOUT);
+
+  free(command);
+  return err;
 }
 
-SARA_R5_error_t SARA_R5::setAPN(String apn, uint8_t cid, SARA_R5_pdp_type pdpType)
+SARA_R5_error_t SARA_R5::setHTTPauthentication(int profile, bool authenticate)
 {
   SARA_R5_error_t err;
   char *command;
-  char pdpStr[8];
-
-  memset(pdpStr, 0, 8);
 
-  if (cid >= 8)
-    return SARA_R5_ERROR_UNEXPECTED_PARAM;
+  if (profile >= SARA_R5_NUM_HTTP_PROFILES)
+    return SARA_R5_ERROR_ERROR;
 
-  command = sara_r5_calloc_char(strlen(SARA_R5_MESSAGE_PDP_DEF) + strlen(apn.c_str()) + 16);
+  command = sara_r5_calloc_char(strlen(SARA_R5_HTTP_PROFILE) + 32);
   if (command == nullptr)
     return SARA_R5_ERROR_OUT_OF_MEMORY;
-  switch (pdpType)
-  {
-  case PDP_TYPE_INVALID:
-    free(command);
-    return SARA_R5_ERROR_UNEXPECTED_PARAM;
-    break;
-  case PDP_TYPE_IP:
-    memcpy(pdpStr, "IP", 2);
-    break;
-  case PDP_TYPE_NONIP:
-    memcpy(pdpStr, "NONIP", 5);
-    break;
-  case PDP_TYPE_IPV4V6:
-    memcpy(pdpStr, "IPV4V6", 6);
-    break;
-  case PDP_TYPE_IPV6:
-    memcpy(pdpStr, "IPV6", 4);
-    break;
-  default:
-    free(command);
-    return SARA_R5_ERROR_UNEXPECTED_PARAM;
-    break;
-  }
-  if (apn == nullptr)
-  {
-    if (_printDebug == true)
-      _debugPort->println(F("setAPN: nullptr"));
-    sprintf(command, "%s=%d,\"%s\",\"\"", SARA_R5_MESSAGE_PDP_DEF,
-            cid, pdpStr);
-  }
-  else
-  {
-    if (_printDebug == true)
-    {
-      _debugPort->print(F("setAPN: "));
-      _debugPort->println(apn);
-    }
-    sprintf(command, "%s=%d,\"%s\",\"%s\"", SARA_R5_MESSAGE_PDP_DEF,
-            cid, pdpStr, apn.c_str());
-  }
+  sprintf(command, "%s=%d,%d,%d", SARA_R5_HTTP_PROFILE, profile, SARA_R5_HTTP_OP_CODE_AUTHENTICATION,
+          authenticate);
 
-  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, nullptr,
-                                SARA_R5_STANDARD_RESPONSE_TIMEOUT);
+  err = sendShadowedCommand(command, 2, SARA_R5_STANDARD_RESPONSE_TIMEOUT);
 
   free(command);
-
   return err;
 }
 
-// Return the Access Point Name and IP address for the chosen context identifier
-SARA_R5_error_t SARA_R5::getAPN(int cid, String *apn, IPAddress *ip, SARA_R5_pdp_type* pdpType)
+SARA_R5_error_t SARA_R5::setHTTPserverPort(int profile, int port)
 {
   SARA_R5_error_t err;
   char *command;
-  char *response;
 
-  if (cid > SARA_R5_NUM_PDP_CONTEXT_IDENTIFIERS)
+  if (profile >= SARA_R5_NUM_HTTP_PROFILES)
     return SARA_R5_ERROR_ERROR;
 
-  command = sara_r5_calloc_char(strlen(SARA_R5_MESSAGE_PDP_DEF) + 3);
+  command = sara_r5_calloc_char(strlen(SARA_R5_HTTP_PROFILE) + 32);
   if (command == nullptr)
     return SARA_R5_ERROR_OUT_OF_MEMORY;
-  sprintf(command, "%s?", SARA_R5_MESSAGE_PDP_DEF);
+  sprintf(command, "%s=%d,%d,%d", SARA_R5_HTTP_PROFILE, profile, SARA_R5_HTTP_OP_CODE_SERVER_PORT,
+          port);
 
-  response = sara_r5_calloc_char(1024);
-  if (response == nullptr)
-  {
-    free(command);
-    return SARA_R5_ERROR_OUT_OF_MEMORY;
-  }
+  err = sendShadowedCommand(command, 2, SARA_R5_STANDARD_RESPONSE_TIMEOUT);
 
-  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, response,
-                                SARA_R5_STANDARD_RESPONSE_TIMEOUT, 1024);
+  free(command);
+  return err;
+}
 
-  if (err == SARA_R5_ERROR_SUCCESS)
-  {
-    // Example:
-    // +CGDCONT: 0,"IP","payandgo.o2.co.uk","0.0.0.0",0,0,0,0,0,0,0,0,0,0
-    // +CGDCONT: 1,"IP","payandgo.o2.co.uk.mnc010.mcc234.gprs","10.160.182.234",0,0,0,2,0,0,0,0,0,0
-	int rcid = -1;
-    char *searchPtr = response;
+SARA_R5_error_t SARA_R5::setHTTPcustomHeader(int profile, String header)
+{
+  SARA_R5_error_t err;
+  char *command;
 
-    bool keepGoing = true;
-    while (keepGoing == true)
-    {
-      int scanned = 0;
-      // Find the first/next occurrence of +CGDCONT:
-      searchPtr = strstr(searchPtr, "+CGDCONT:");
-      if (searchPtr != nullptr)
-      {
-        char strPdpType[10];
-        char strApn[128];
-        int ipOct[4];
+  if (profile >= SARA_R5_NUM_HTTP_PROFILES)
+    return SARA_R5_ERROR_ERROR;
 
-        searchPtr += strlen("+CGDCONT:"); // Point to the cid
-        while (*searchPtr == ' ') searchPtr++; // skip spaces
-        scanned = sscanf(searchPtr, "%d,\"%[^\"]\",\"%[^\"]\",\"%d.%d.%d.%d",
-        &rcid, strPdpType, strApn,
-				&ipOct[0], &ipOct[1], &ipOct[2], &ipOct[3]);
-        if ((scanned == 7) && (rcid == cid)) {
-          if (apn) *apn = strApn;
-          for (int o = 0; ip && (o < 4); o++)
-          {
-            (*ip)[o] = (uint8_t)ipOct[o];
-          }
-          if (pdpType) {
-            *pdpType = (0 == strcmp(strPdpType, "IPV4V6"))  ? PDP_TYPE_IPV4V6 :
-                       (0 == strcmp(strPdpType, "IPV6"))    ? PDP_TYPE_IPV6 :
-                       (0 == strcmp(strPdpType, "IP"))	    ? PDP_TYPE_IP :
-                                                              PDP_TYPE_INVALID;
-          }
-          keepGoing = false;
-        }
-      }
-      else // We don't have a match so let's clear the APN and IP address
-      {
-        if (apn) *apn = "";
-        if (pdpType) *pdpType = PDP_TYPE_INVALID;
-        if (ip) *ip = {0, 0, 0, 0};
-        keepGoing = false;
-      }
-    }
-  }
-  else
-  {
-    err = SARA_R5_ERROR_UNEXPECTED_RESPONSE;
-  }
+  command = sara_r5_calloc_char(strlen(SARA_R5_HTTP_PROFILE) + 12 + header.length());
+  if (command == nullptr)
+    return SARA_R5_ERROR_OUT_OF_MEMORY;
+  sprintf(command, "%s=%d,%d,\"%s\"", SARA_R5_HTTP_PROFILE, profile, SARA_R5_HTTP_OP_CODE_ADD_CUSTOM_HEADERS,
+          header.c_str());
 
-  free(command);
-  free(response);
+  err = sendShadowedCommand(command, 2, SARA_R5_STANDARD_RESPONSE_TIMEOUT);
 
+  free(command);
   return err;
 }
 
-SARA_R5_error_t SARA_R5::getSimStatus(String* code)
+SARA_R5_error_t SARA_R5::setHTTPsecure(int profile, bool secure, int secprofile)
 {
   SARA_R5_error_t err;
   char *command;
-  char *response;
-  command = sara_r5_calloc_char(strlen(SARA_R5_COMMAND_SIMPIN) + 2);
+
+  if (profile >= SARA_R5_NUM_HTTP_PROFILES)
+    return SARA_R5_ERROR_ERROR;
+
+  command = sara_r5_calloc_char(strlen(SARA_R5_HTTP_PROFILE) + 32);
   if (command == nullptr)
     return SARA_R5_ERROR_OUT_OF_MEMORY;
-  sprintf(command, "%s?", SARA_R5_COMMAND_SIMPIN);
-  response = sara_r5_calloc_char(minimumResponseAllocation);
-  if (response == nullptr)
-  {
-    free(command);
-    return SARA_R5_ERROR_OUT_OF_MEMORY;
-  }
-  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR,
-                                response, SARA_R5_STANDARD_RESPONSE_TIMEOUT);
+  if ((secprofile == -1) || !secure) 
+      sprintf(command, "%s=%d,%d,%d", SARA_R5_HTTP_PROFILE, profile, SARA_R5_HTTP_OP_CODE_SECURE,
+          secure);
+  else sprintf(command, "%s=%d,%d,%d,%d", SARA_R5_HTTP_PROFILE, profile, SARA_R5_HTTP_OP_CODE_SECURE,
+        secure, secprofile);
 
-  if (err == SARA_R5_ERROR_SUCCESS)
-  {
-    int scanned = 0;
-    char c[16];
-    char *searchPtr = strstr(response, "+CPIN:");
-    if (searchPtr != nullptr) {
-      searchPtr += strlen("+CPIN:"); //  Move searchPtr to first char
-      while (*searchPtr == ' ') searchPtr++; // skip spaces
-      scanned = sscanf(searchPtr, "%15s\r\n", c);
-    }
-    if (scanned == 1)
-    {
-      if(code)
-        *code = c;
-    }
-    else
-      err = SARA_R5_ERROR_UNEXPECTED_RESPONSE;
-  }
+  err = sendShadowedCommand(command, 2, SARA_R5_STANDARD_RESPONSE_TIMEOUT);
 
   free(command);
-  free(response);
-
   return err;
 }
 
-SARA_R5_error_t SARA_R5::setSimPin(String pin)
+SARA_R5_error_t SARA_R5::ping(String remote_host, int retry, int p_size,
+                              unsigned long timeout, int ttl)
 {
   SARA_R5_error_t err;
   char *command;
-  command = sara_r5_calloc_char(strlen(SARA_R5_COMMAND_SIMPIN) + 4 + pin.length());
+
+  command = sara_r5_calloc_char(strlen(SARA_R5_PING_COMMAND) + 48 +
+                                remote_host.length());
   if (command == nullptr)
     return SARA_R5_ERROR_OUT_OF_MEMORY;
-  sprintf(command, "%s=\"%s\"", SARA_R5_COMMAND_SIMPIN, pin.c_str());
-  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR,
-                                nullptr, SARA_R5_STANDARD_RESPONSE_TIMEOUT);
+  sprintf(command, "%s=\"%s\",%d,%d,%ld,%d", SARA_R5_PING_COMMAND,
+          remote_host.c_str(), retry, p_size, timeout, ttl);
+
+  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, nullptr,
+                                SARA_R5_STANDARD_RESPONSE_TIMEOUT);
+
   free(command);
   return err;
 }
 
-SARA_R5_error_t SARA_R5::setSIMstateReportingMode(int mode)
+SARA_R5_error_t SARA_R5::sendHTTPGET(int profile, String path, String responseFilename)
 {
   SARA_R5_error_t err;
   char *command;
 
-  command = sara_r5_calloc_char(strlen(SARA_R5_SIM_STATE) + 4);
+  if ((profile < 0) || (profile >= SARA_R5_NUM_HTTP_PROFILES))
+    return SARA_R5_ERROR_ERROR;
+
+  command = sara_r5_calloc_char(strlen(SARA_R5_HTTP_COMMAND) + 24 +
+                                path.length() + responseFilename.length());
   if (command == nullptr)
     return SARA_R5_ERROR_OUT_OF_MEMORY;
-  sprintf(command, "%s=%d", SARA_R5_SIM_STATE, mode);
+  sprintf(command, "%s=%d,%d,\"%s\",\"%s\"", SARA_R5_HTTP_COMMAND, profile, SARA_R5_HTTP_COMMAND_GET,
+          path.c_str(), responseFilename.c_str());
+
+  _httpCommandResult[profile] = -1; // Until +UUHTTPCR arrives
+  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, nullptr,
+                                SARA_R5_STANDARD_RESPONSE_TIMEOUT);
+  if (err == SARA_R5_ERROR_SUCCESS)
+    fileIndexPending(profile, responseFilename.c_str());
 
-  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR,
-                                nullptr, SARA_R5_STANDARD_RESPONSE_TIMEOUT);
   free(command);
   return err;
 }
 
-SARA_R5_error_t SARA_R5::getSIMstateReportingMode(int *mode)
+SARA_R5_error_t SARA_R5::sendHTTPPOSTdata(int profile, String path, String responseFilename,
+                                          String data, SARA_R5_http_content_types_t httpContentType)
 {
   SARA_R5_error_t err;
   char *command;
-  char *response;
 
-  int m;
+  if ((profile < 0) || (profile >= SARA_R5_NUM_HTTP_PROFILES))
+    return SARA_R5_ERROR_ERROR;
 
-  command = sara_r5_calloc_char(strlen(SARA_R5_SIM_STATE) + 3);
+  command = sara_r5_calloc_char(strlen(SARA_R5_HTTP_COMMAND) + 24 +
+                                path.length() + responseFilename.length() + data.length());
   if (command == nullptr)
     return SARA_R5_ERROR_OUT_OF_MEMORY;
-  sprintf(command, "%s?", SARA_R5_SIM_STATE);
-
-  response = sara_r5_calloc_char(minimumResponseAllocation);
-  if (response == nullptr)
-  {
-    free(command);
-    return SARA_R5_ERROR_OUT_OF_MEMORY;
-  }
-
-  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR,
-                                response, SARA_R5_STANDARD_RESPONSE_TIMEOUT);
+  sprintf(command, "%s=%d,%d,\"%s\",\"%s\",\"%s\",%d", SARA_R5_HTTP_COMMAND, profile, SARA_R5_HTTP_COMMAND_POST_DATA,
+          path.c_str(), responseFilename.c_str(), data.c_str(), httpContentType);
 
+  _httpCommandResult[profile] = -1; // Until +UUHTTPCR arrives
+  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, nullptr,
+                                SARA_R5_STANDARD_RESPONSE_TIMEOUT);
   if (err == SARA_R5_ERROR_SUCCESS)
-  {
-    int scanned = 0;
-    char *searchPtr = strstr(response, "+USIMSTAT:");
-    if (searchPtr != nullptr)
-    {
-      searchPtr += strlen("+USIMSTAT:"); //  Move searchPtr to first char
-      while (*searchPtr == ' ') searchPtr++; // skip spaces
-      scanned = sscanf(searchPtr, "%d\r\n", &m);
-    }
-    if (scanned == 1)
-    {
-      *mode = m;
-    }
-    else
-      err = SARA_R5_ERROR_UNEXPECTED_RESPONSE;
-  }
+    fileIndexPending(profile, responseFilename.c_str());
 
   free(command);
-  free(response);
   return err;
 }
 
-const char *PPP_L2P[5] = {
-    "",
-    "PPP",
-    "M-HEX",
-    "M-RAW_IP",
-    "M-OPT-PPP",
-};
-
-SARA_R5_error_t SARA_R5::enterPPP(uint8_t cid, char dialing_type_char,
-                                  unsigned long dialNumber, SARA_R5::SARA_R5_l2p_t l2p)
+SARA_R5_error_t SARA_R5::sendHTTPPOSTfile(int profile, String path, String responseFilename,
+                                          String requestFile, SARA_R5_http_content_types_t httpContentType)
 {
   SARA_R5_error_t err;
   char *command;
 
-  if ((dialing_type_char != 0) && (dialing_type_char != 'T') &&
-      (dialing_type_char != 'P'))
-  {
-    return SARA_R5_ERROR_UNEXPECTED_PARAM;
-  }
+  if ((profile < 0) || (profile >= SARA_R5_NUM_HTTP_PROFILES))
+    return SARA_R5_ERROR_ERROR;
 
-  command = sara_r5_calloc_char(strlen(SARA_R5_MESSAGE_ENTER_PPP) + 32);
+  command = sara_r5_calloc_char(strlen(SARA_R5_HTTP_COMMAND) + 24 +
+                                path.length() + responseFilename.length() + requestFile.length());
   if (command == nullptr)
     return SARA_R5_ERROR_OUT_OF_MEMORY;
-  if (dialing_type_char != 0)
-  {
-    sprintf(command, "%s%c*%lu**%s*%u#", SARA_R5_MESSAGE_ENTER_PPP, dialing_type_char,
-            dialNumber, PPP_L2P[l2p], (unsigned int)cid);
-  }
-  else
-  {
-    sprintf(command, "%s*%lu**%s*%u#", SARA_R5_MESSAGE_ENTER_PPP,
-            dialNumber, PPP_L2P[l2p], (unsigned int)cid);
-  }
+  sprintf(command, "%s=%d,%d,\"%s\",\"%s\",\"%s\",%d", SARA_R5_HTTP_COMMAND, profile, SARA_R5_HTTP_COMMAND_POST_FILE,
+          path.c_str(), responseFilename.c_str(), requestFile.c_str(), httpContentType);
 
-  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_CONNECT, nullptr,
+  _httpCommandResult[profile] = -1; // Until +UUHTTPCR arrives
+  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, nullptr,
                                 SARA_R5_STANDARD_RESPONSE_TIMEOUT);
+  if (err == SARA_R5_ERROR_SUCCESS)
+    fileIndexPending(profile, responseFilename.c_str());
 
   free(command);
   return err;
 }
 
-uint8_t SARA_R5::getOperators(struct operator_stats *opRet, int maxOps)
+// POST length bytes from memory. Small bodies which are valid inside a quoted AT string are sent inline with
+// +UHTTPC=..,5. Anything else is staged in stagingFile (in a few large +UDWNFILE chunks) and sent with +UHTTPC=..,4.
+// Each profile has its own default staging file. serviceHTTPQueue deletes it once +UUHTTPCR has arrived
+// report (optional) says which path was taken and how long each phase took
+SARA_R5_error_t SARA_R5::sendHTTPPOST(int profile, String path, String responseFilename, const uint8_t *data, size_t length,
+                                      SARA_R5_http_content_types_t httpContentType, SARA_R5_http_post_report_t *report,
+                                      const char *stagingFile)
 {
-  SARA_R5_error_t err;
-  char *command;
-  char *response;
-  uint8_t opsSeen = 0;
+  if ((data == nullptr) && (length > 0))
+    return SARA_R5_ERROR_UNEXPECTED_PARAM;
+  return sendHTTPPOSTbody(profile, path, responseFilename, (const char *)data, nullptr, nullptr, length,
+                          httpContentType, report, stagingFile);
+}
 
-  command = sara_r5_calloc_char(strlen(SARA_R5_OPERATOR_SELECTION) + 3);
-  if (command == nullptr)
-    return SARA_R5_ERROR_OUT_OF_MEMORY;
-  sprintf(command, "%s=?", SARA_R5_OPERATOR_SELECTION);
+// POST length bytes fetched from producer. producer must copy length bytes, starting at offset, into buffer and
+// return the number of bytes copied. It may be asked for the same bytes more than once
+SARA_R5_error_t SARA_R5::sendHTTPPOST(int profile, String path, String responseFilename,
+                                      size_t (*producer)(char *buffer, size_t offset, size_t length, void *context),
+                                      void *context, size_t length, SARA_R5_http_content_types_t httpContentType,
+                                      SARA_R5_http_post_report_t *report, const char *stagingFile)
+{
+  if (producer == nullptr)
+    return SARA_R5_ERROR_UNEXPECTED_PARAM;
+  return sendHTTPPOSTbody(profile, path, responseFilename, nullptr, producer, context, length,
+                          httpContentType, report, stagingFile);
+}
 
-  int responseSize = (maxOps + 1) * 48;
-  response = sara_r5_calloc_char(responseSize);
-  if (response == nullptr)
-  {
-    free(command);
-    return SARA_R5_ERROR_OUT_OF_MEMORY;
-  }
+SARA_R5_error_t SARA_R5::sendHTTPPOSTbody(int profile, const String &path, const String &responseFilename, const char *data,
+                                          size_t (*producer)(char *buffer, size_t offset, size_t length, void *context),
+                                          void *context, size_t length, SARA_R5_http_content_types_t httpContentType,
+                                          SARA_R5_http_post_report_t *report, const char *stagingFile)
+{
+  SARA_R5_LOCK_TRANSACTION(SARA_R5_PRIORITY_LOW);
+  SARA_R5_error_t err = SARA_R5_ERROR_SUCCESS;
+  char *body = nullptr;
+  bool sendInline = false;
+  unsigned long startTime;
+  char staging[SARA_R5_HTTP_POST_STAGING_NAME_LENGTH];
 
-  // AT+COPS maximum response time is 3 minutes (180000 ms)
-  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, response,
-                                SARA_R5_3_MIN_TIMEOUT, responseSize);
+  if ((profile < 0) || (profile >= SARA_R5_NUM_HTTP_PROFILES))
+    return SARA_R5_ERROR_ERROR;
+  if (stagingFile == nullptr)
+    sprintf(staging, SARA_R5_HTTP_POST_STAGING_FILE, profile);
+  else if ((strlen(stagingFile) < 1) || (strlen(stagingFile) >= SARA_R5_HTTP_POST_STAGING_NAME_LENGTH))
+    return SARA_R5_ERROR_UNEXPECTED_PARAM;
+  else
+    strcpy(staging, stagingFile);
 
-  // Sample responses:
-  // +COPS: (3,"Verizon Wireless","VzW","311480",8),,(0,1,2,3,4),(0,1,2)
-  // +COPS: (1,"313 100","313 100","313100",8),(2,"AT&T","AT&T","310410",8),(3,"311 480","311 480","311480",8),,(0,1,2,3,4),(0,1,2)
+  if (report != nullptr)
+  {
+    report->staged = false;
+    report->length = length;
+    report->stageTime = 0;
+    report->commandTime = 0;
+  }
 
-  if (_printDebug == true)
+  // Send the body inline if it is short and can be quoted: printable ASCII without a double quote
+  if (length <= SARA_R5_HTTP_POST_INLINE_MAX)
   {
-    _debugPort->print(F("getOperators: Response: {"));
-    _debugPort->print(response);
-    _debugPort->println(F("}"));
+    body = sara_r5_calloc_char(length + 1);
+    if (body == nullptr)
+      return SARA_R5_ERROR_OUT_OF_MEMORY;
+    if (data != nullptr)
+      memcpy(body, data, length);
+    else if (producer(body, 0, length, context) != length)
+    {
+      free(body);
+      return SARA_R5_ERROR_UNEXPECTED_PARAM; // The producer ran out of data
+    }
+    sendInline = true;
+    for (size_t i = 0; (i < length) && (sendInline == true); i++)
+    {
+      if ((body[i] < ' ') || (body[i] > '~') || (body[i] == '\"'))
+        sendInline = false;
+    }
   }
 
-  if (err == SARA_R5_ERROR_SUCCESS)
+  if (sendInline == true)
   {
-    char *opBegin;
-    char *opEnd;
-    int op = 0;
-    int stat;
-    char longOp[26];
-    char shortOp[11];
-    int act;
-    unsigned long numOp;
+    char *command = sara_r5_calloc_char(strlen(SARA_R5_HTTP_COMMAND) + 32 + path.length() + responseFilename.length() + length);
+    if (command == nullptr)
+    {
+      free(body);
+      return SARA_R5_ERROR_OUT_OF_MEMORY;
+    }
+    int commandLength = sprintf(command, "%s=%d,%d,\"%s\",\"%s\",\"", SARA_R5_HTTP_COMMAND, profile,
+                                SARA_R5_HTTP_COMMAND_POST_DATA, path.c_str(), responseFilename.c_str());
+    memcpy(&command[commandLength], body, length);
+    sprintf(&command[commandLength + length], "\",%d", httpContentType);
 
-    opBegin = response;
+    startTime = millis();
+    _httpCommandResult[profile] = -1; // Until +UUHTTPCR arrives
+    err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, nullptr,
+                                  SARA_R5_STANDARD_RESPONSE_TIMEOUT);
+    if (err == SARA_R5_ERROR_SUCCESS)
+      fileIndexPending(profile, responseFilename.c_str());
+    if (report != nullptr)
+      report->commandTime = millis() - startTime;
 
-    for (; op < maxOps; op++)
+    free(command);
+  }
+  else
+  {
+    // Stage the body. The chunks start at the maximum size: the upload does not need to probe for it
+    SARA_R5_file_upload upload;
+    startTime = millis();
+    err = beginFileUpload(upload, staging, length, false, SARA_R5_HTTP_POST_STAGING_CHUNK);
+    if (err == SARA_R5_ERROR_SUCCESS)
     {
-      opBegin = strchr(opBegin, '(');
-      if (opBegin == nullptr)
-        break;
-      opEnd = strchr(opBegin, ')');
-      if (opEnd == nullptr)
-        break;
-
-      int sscanRead = sscanf(opBegin, "(%d,\"%[^\"]\",\"%[^\"]\",\"%lu\",%d)%*s",
-                             &stat, longOp, shortOp, &numOp, &act);
-      if (sscanRead == 5)
-      {
-        opRet[op].stat = stat;
-        opRet[op].longOp = (String)(longOp);
-        opRet[op].shortOp = (String)(shortOp);
-        opRet[op].numOp = numOp;
-        opRet[op].act = act;
-        opsSeen += 1;
-      }
-      // TODO: Search for other possible patterns here
+      upload._chunkSize = upload._maxChunkSize;
+      if (data != nullptr)
+        err = continueFileUpload(upload, data);
       else
-      {
-        break; // Break out if pattern doesn't match.
-      }
-      opBegin = opEnd + 1; // Move opBegin to beginning of next value
+        err = continueFileUpload(upload, producer, context);
+    }
+    if (report != nullptr)
+    {
+      report->staged = true;
+      report->stageTime = millis() - startTime;
+    }
+
+    if (err == SARA_R5_ERROR_SUCCESS)
+    {
+      startTime = millis();
+      err = sendHTTPPOSTfile(profile, path, responseFilename, String(staging), httpContentType);
+      if (report != nullptr)
+        report->commandTime = millis() - startTime;
+    }
+    if (err == SARA_R5_ERROR_SUCCESS)
+      strcpy(_httpStagingFile[profile], staging); // Deleted by serviceHTTPQueue once +UUHTTPCR has arrived
+    else
+    {
+      _httpStagingFile[profile][0] = 0;
+      deleteFile(String(staging)); // This fails if the file was not created. That's OK
     }
   }
 
-  free(command);
-  free(response);
+  if (_printDebug == true)
+  {
+    _debugPort->print(F("sendHTTPPOST: "));
+    _debugPort->print((unsigned long)length);
+    _debugPort->print((sendInline == true) ? F(" bytes inline. Error: ") : F(" bytes staged. Error: "));
+    _debugPort->println(err);
+  }
 
-  return opsSeen;
+  if (body != nullptr)
+    free(body);
+  return err;
 }
 
-SARA_R5_error_t SARA_R5::registerOperator(struct operator_stats oper)
+// Wait for the +UUHTTPCR result of the last HTTP command sent on profile. result is 1 for success, 0 for failure
+SARA_R5_error_t SARA_R5::waitForHTTPResult(int profile, int *result, unsigned long timeout)
+{
+  if ((profile < 0) || (profile >= SARA_R5_NUM_HTTP_PROFILES))
+    return SARA_R5_ERROR_ERROR;
+
+  unsigned long startTime = millis();
+  while (_httpCommandResult[profile] < 0)
+  {
+    if (insideBufferedPoll() == true) // Called from a callback. bufferedPoll can't deliver the result
+      return SARA_R5_ERROR_INVALID;
+    if (millis() - startTime >= timeout)
+      return SARA_R5_ERROR_TIMEOUT;
+    bufferedPoll();
+    delay(1);
+  }
+
+  if (result != nullptr)
+    *result = _httpCommandResult[profile];
+  return SARA_R5_ERROR_SUCCESS;
+}
+
+// Stream the HTTP response held in responseFilename through parser. The file is read one block at a time.
+// If deleteWhenRead is true, the file is deleted once it has been read to the end
+SARA_R5_error_t SARA_R5::streamHTTPResponse(String responseFilename, SARA_R5_http_parser &parser, bool deleteWhenRead)
 {
+  SARA_R5_LOCK_TRANSACTION(SARA_R5_PRIORITY_LOW);
+  SARA_R5_file_stream stream;
   SARA_R5_error_t err;
-  char *command;
+  int length = 0;
 
-  command = sara_r5_calloc_char(strlen(SARA_R5_OPERATOR_SELECTION) + 24);
-  if (command == nullptr)
+  parser.reset();
+
+  err = openFileStream(stream, responseFilename.c_str());
+  if (err != SARA_R5_ERROR_SUCCESS)
+    return err;
+
+  char *buffer = sara_r5_calloc_char(SARA_R5_FILE_STREAM_CHUNK_SIZE);
+  if (buffer == nullptr)
     return SARA_R5_ERROR_OUT_OF_MEMORY;
-  sprintf(command, "%s=1,2,\"%lu\"", SARA_R5_OPERATOR_SELECTION, oper.numOp);
 
-  // AT+COPS maximum response time is 3 minutes (180000 ms)
-  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, nullptr,
-                                SARA_R5_3_MIN_TIMEOUT);
+  while ((parser.complete() == false) && (parser.failed() == false)
+         && ((length = stream.read(buffer, SARA_R5_FILE_STREAM_CHUNK_SIZE)) > 0))
+    parser.parse(buffer, length);
+  if ((parser.complete() == false) && (parser.failed() == false) && (length < 0))
+    err = stream.getError();
+  free(buffer);
 
-  free(command);
-  return err;
+  if (err != SARA_R5_ERROR_SUCCESS)
+    return err;
+
+  parser.finish(); // The end of the file ends a body which has no length
+
+  if (deleteWhenRead == true)
+    deleteFile(responseFilename);
+
+  if (_printDebug == true)
+  {
+    _debugPort->print(F("streamHTTPResponse: status "));
+    _debugPort->print(parser.getStatusCode());
+    _debugPort->print(F(" body "));
+    _debugPort->println((unsigned long)parser.getBodyLength());
+  }
+
+  return (parser.complete() == true) ? SARA_R5_ERROR_SUCCESS : SARA_R5_ERROR_UNEXPECTED_RESPONSE;
 }
 
-SARA_R5_error_t SARA_R5::automaticOperatorSelection()
+// GET path into responseFilename, wait for the +UUHTTPCR result, then stream the response through parser.
+// Returns SARA_R5_ERROR_ERROR if the module reports that the GET failed - see getHTTPprotocolError
+SARA_R5_error_t SARA_R5::sendHTTPGETstream(int profile, String path, String responseFilename, SARA_R5_http_parser &parser,
+                                           bool deleteWhenRead, unsigned long timeout)
 {
-  SARA_R5_error_t err;
-  char *command;
+  int result = 0;
 
-  command = sara_r5_calloc_char(strlen(SARA_R5_OPERATOR_SELECTION) + 6);
-  if (command == nullptr)
-    return SARA_R5_ERROR_OUT_OF_MEMORY;
-  sprintf(command, "%s=0,0", SARA_R5_OPERATOR_SELECTION);
+  // The transaction lock is not held while waiting for +UUHTTPCR: other threads may use the module meanwhile
+  SARA_R5_error_t err = sendHTTPGET(profile, path, responseFilename);
+  if (err != SARA_R5_ERROR_SUCCESS)
+    return err;
 
-  // AT+COPS maximum response time is 3 minutes (180000 ms)
-  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, nullptr,
-                                SARA_R5_3_MIN_TIMEOUT);
+  err = waitForHTTPResult(profile, &result, timeout);
+  if (err != SARA_R5_ERROR_SUCCESS)
+    return err;
+  if (result != 1)
+    return SARA_R5_ERROR_ERROR;
 
-  free(command);
-  return err;
+  return streamHTTPResponse(responseFilename, parser, deleteWhenRead);
 }
 
-SARA_R5_error_t SARA_R5::getOperator(String *oper)
+void SARA_R5_http_request::setGET(const String &server, const String &path, const String &responseFilename)
 {
-  SARA_R5_error_t err;
-  char *command;
-  char *response;
-  char *searchPtr;
-  char mode;
+  _server = server;
+  _command = SARA_R5_HTTP_COMMAND_GET;
+  _path = path;
+  _responseFilename = responseFilename;
+  _data = "";
+}
 
-  command = sara_r5_calloc_char(strlen(SARA_R5_OPERATOR_SELECTION) + 3);
-  if (command == nullptr)
-    return SARA_R5_ERROR_OUT_OF_MEMORY;
-  sprintf(command, "%s?", SARA_R5_OPERATOR_SELECTION);
+void SARA_R5_http_request::setPOSTdata(const String &server, const String &path, const String &responseFilename,
+                                       const String &data, SARA_R5_http_content_types_t httpContentType)
+{
+  _server = server;
+  _command = SARA_R5_HTTP_COMMAND_POST_DATA;
+  _path = path;
+  _responseFilename = responseFilename;
+  _data = data;
+  _httpContentType = httpContentType;
+}
 
-  response = sara_r5_calloc_char(minimumResponseAllocation);
-  if (response == nullptr)
-  {
-    free(command);
-    return SARA_R5_ERROR_OUT_OF_MEMORY;
-  }
+void SARA_R5_http_request::setPOSTfile(const String &server, const String &path, const String &responseFilename,
+                                       const String &requestFile, SARA_R5_http_content_types_t httpContentType)
+{
+  _server = server;
+  _command = SARA_R5_HTTP_COMMAND_POST_FILE;
+  _path = path;
+  _responseFilename = responseFilename;
+  _data = requestFile;
+  _httpContentType = httpContentType;
+}
 
-  // AT+COPS maximum response time is 3 minutes (180000 ms)
-  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, response,
-                                SARA_R5_3_MIN_TIMEOUT);
+// Enable or disable the HTTP request queue. The queue uses HTTP profiles 0 to (profiles - 1).
+// Disabling fails any requests which are still queued or in flight (without calling their callbacks)
+SARA_R5_error_t SARA_R5::setHTTPQueue(bool enable, int profiles)
+{
+  SARA_R5_LOCK_TRANSACTION(SARA_R5_PRIORITY_LOW);
 
-  if (err == SARA_R5_ERROR_SUCCESS)
+  if (enable == false)
   {
-    searchPtr = strstr(response, "+COPS:");
-    if (searchPtr != nullptr)
+    if (nullptr != _httpScheduler)
     {
-      searchPtr += strlen("+COPS:"); //  Move searchPtr to first char
-      while (*searchPtr == ' ') searchPtr++; // skip spaces
-      mode = *searchPtr;              // Read first char -- should be mode
-      if (mode == '2')                // Check for de-register
+      while (_httpScheduler->queue != nullptr)
       {
-        err = SARA_R5_ERROR_DEREGISTERED;
+        SARA_R5_http_request *request = _httpScheduler->queue;
+        _httpScheduler->queue = request->_next;
+        request->_next = nullptr;
+        request->_state = SARA_R5_HTTP_REQUEST_FAILED;
+        request->_error = SARA_R5_ERROR_INVALID;
       }
-      // Otherwise if it's default, manual, set-only, or automatic
-      else if ((mode == '0') || (mode == '1') || (mode == '3') || (mode == '4'))
+      for (int p = 0; p < _httpScheduler->numProfiles; p++)
       {
-        *oper = "";
-        searchPtr = strchr(searchPtr, '\"'); // Move to first quote
-        if (searchPtr == nullptr)
-        {
-          err = SARA_R5_ERROR_DEREGISTERED;
-        }
-        else
-        {
-          while ((*(++searchPtr) != '\"') && (*searchPtr != '\0'))
-          {
-            oper->concat(*(searchPtr));
-          }
-        }
-        if (_printDebug == true)
+        if (_httpScheduler->profile[p].request != nullptr)
         {
-          _debugPort->print(F("getOperator: "));
-          _debugPort->println(*oper);
+          _httpScheduler->profile[p].request->_state = SARA_R5_HTTP_REQUEST_FAILED;
+          _httpScheduler->profile[p].request->_error = SARA_R5_ERROR_INVALID;
         }
       }
+      delete _httpScheduler;
     }
+    _httpScheduler = nullptr;
+    return SARA_R5_ERROR_SUCCESS;
   }
 
-  free(response);
-  free(command);
-  return err;
+  if ((profiles < 1) || (profiles > SARA_R5_NUM_HTTP_PROFILES))
+    return SARA_R5_ERROR_UNEXPECTED_PARAM;
+
+  if (nullptr == _httpScheduler)
+  {
+    _httpScheduler = new SARA_R5_http_scheduler_t;
+    if (nullptr == _httpScheduler)
+    {
+      if (_printDebug == true)
+        _debugPort->println(F("setHTTPQueue: not enough memory for _httpScheduler!"));
+      return SARA_R5_ERROR_OUT_OF_MEMORY;
+    }
+    memset(_httpScheduler, 0, sizeof(SARA_R5_http_scheduler_t));
+  }
+  else if (profiles < _httpScheduler->numProfiles)
+  {
+    for (int p = profiles; p < _httpScheduler->numProfiles; p++)
+    {
+      if (_httpScheduler->profile[p].request != nullptr)
+        return SARA_R5_ERROR_INVALID; // Busy. Try again once the request has completed
+    }
+  }
+  _httpScheduler->numProfiles = profiles;
+  return SARA_R5_ERROR_SUCCESS;
 }
 
-SARA_R5_error_t SARA_R5::deregisterOperator(void)
+// Add request to the end of the queue. It is started as soon as a profile is free - which may be straight away.
+// The request must not be destroyed or changed until it is done
+SARA_R5_error_t SARA_R5::queueHTTPRequest(SARA_R5_http_request &request)
 {
-  SARA_R5_error_t err;
-  char *command;
+  SARA_R5_LOCK_TRANSACTION(SARA_R5_PRIORITY_LOW);
 
-  command = sara_r5_calloc_char(strlen(SARA_R5_OPERATOR_SELECTION) + 4);
-  if (command == nullptr)
-    return SARA_R5_ERROR_OUT_OF_MEMORY;
-  sprintf(command, "%s=2", SARA_R5_OPERATOR_SELECTION);
+  if (nullptr == _httpScheduler)
+    return SARA_R5_ERROR_INVALID;
+  if ((request._state == SARA_R5_HTTP_REQUEST_QUEUED) || (request._state == SARA_R5_HTTP_REQUEST_IN_FLIGHT)
+      || (request._server.length() < 1) || (request._server.length() >= SARA_R5_HTTP_SERVER_LENGTH))
+    return SARA_R5_ERROR_UNEXPECTED_PARAM;
 
-  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, nullptr,
-                                SARA_R5_3_MIN_TIMEOUT);
+  SARA_R5_http_request **link = &_httpScheduler->failed; // Queued again before its reset failure was reported?
+  while (*link != nullptr)
+  {
+    if (*link == &request)
+    {
+      *link = request._next;
+      break;
+    }
+    link = &(*link)->_next;
+  }
 
-  free(command);
-  return err;
+  request._state = SARA_R5_HTTP_REQUEST_QUEUED;
+  request._profile = -1;
+  request._result = 0;
+  request._error = SARA_R5_ERROR_SUCCESS;
+  request._errorClass = 0;
+  request._errorCode = 0;
+  request._next = nullptr;
+
+  link = &_httpScheduler->queue;
+  while (*link != nullptr)
+    link = &(*link)->_next;
+  *link = &request;
+
+  serviceHTTPQueue();
+  return request._error;
 }
 
-SARA_R5_error_t SARA_R5::setSMSMessageFormat(SARA_R5_message_format_t textMode)
+// Remove a request from the queue. Returns false if it is not queued (a request in flight cannot be cancelled)
+bool SARA_R5::cancelHTTPRequest(SARA_R5_http_request &request)
 {
-  char *command;
-  SARA_R5_error_t err;
+  SARA_R5_LOCK_TRANSACTION(SARA_R5_PRIORITY_LOW);
 
-  command = sara_r5_calloc_char(strlen(SARA_R5_MESSAGE_FORMAT) + 4);
-  if (command == nullptr)
-    return SARA_R5_ERROR_OUT_OF_MEMORY;
-  sprintf(command, "%s=%d", SARA_R5_MESSAGE_FORMAT,
-          (textMode == SARA_R5_MESSAGE_FORMAT_TEXT) ? 1 : 0);
+  if (nullptr == _httpScheduler)
+    return false;
 
-  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, nullptr,
-                                SARA_R5_STANDARD_RESPONSE_TIMEOUT);
+  SARA_R5_http_request **link = &_httpScheduler->queue;
+  while (*link != nullptr)
+  {
+    if (*link == &request)
+    {
+      *link = request._next;
+      request._next = nullptr;
+      request._state = SARA_R5_HTTP_REQUEST_IDLE;
+      return true;
+    }
+    link = &(*link)->_next;
+  }
+  return false;
+}
 
-  free(command);
-  return err;
+int SARA_R5::getHTTPRequestsInFlight(void)
+{
+  int inFlight = 0;
+  if (nullptr == _httpScheduler)
+    return 0;
+  for (int p = 0; p < _httpScheduler->numProfiles; p++)
+  {
+    if (_httpScheduler->profile[p].request != nullptr)
+      inFlight++;
+  }
+  return inFlight;
 }
 
-SARA_R5_error_t SARA_R5::sendSMS(String number, String message)
+// Called by bufferedPoll and poll. Delete the sendHTTPPOST staging files whose +UUHTTPCR has arrived. Complete the requests
+// whose +UUHTTPCR has arrived (reading +UHTTPER for the ones which failed), then start queued requests on the free profiles
+void SARA_R5::serviceHTTPQueue(void)
 {
-  char *command;
-  char *messageCStr;
-  char *numberCStr;
-  SARA_R5_error_t err;
+  SARA_R5_LOCK_TRANSACTION(SARA_R5_PRIORITY_LOW);
 
-  numberCStr = sara_r5_calloc_char(number.length() + 2);
-  if (numberCStr == nullptr)
-    return SARA_R5_ERROR_OUT_OF_MEMORY;
-  number.toCharArray(numberCStr, number.length() + 1);
+  for (int p = 0; p < SARA_R5_NUM_HTTP_PROFILES; p++)
+  {
+    if ((_httpStagingFile[p][0] != 0) && (_httpCommandResult[p] >= 0))
+    {
+      String staging = String(_httpStagingFile[p]);
+      _httpStagingFile[p][0] = 0; // Forget it even if the delete fails: it is not tried again
+      deleteFile(staging);
+    }
+  }
 
-  command = sara_r5_calloc_char(strlen(SARA_R5_SEND_TEXT) + strlen(numberCStr) + 8);
-  if (command != nullptr)
+  if (nullptr == _httpScheduler)
+    return;
+
+  while (_httpScheduler->failed != nullptr) // Failed by a module reset
   {
-    sprintf(command, "%s=\"%s\"", SARA_R5_SEND_TEXT, numberCStr);
+    SARA_R5_http_request *request = _httpScheduler->failed;
+    _httpScheduler->failed = request->_next;
+    request->_next = nullptr;
+    if (request->_callback != nullptr)
+      request->_callback(request, request->_context);
+  }
 
-    err = sendCommandWithResponse(command, ">", nullptr,
-                                  SARA_R5_3_MIN_TIMEOUT);
-    free(command);
-    free(numberCStr);
-    if (err != SARA_R5_ERROR_SUCCESS)
-      return err;
+  for (int p = 0; p < _httpScheduler->numProfiles; p++)
+  {
+    SARA_R5_http_profile_state_t *profile = &_httpScheduler->profile[p];
+    if ((profile->staleResults > 0) && (millis() - profile->staleSince >= SARA_R5_HTTP_REQUEST_TIMEOUT))
+      profile->staleResults = 0; // The late results are not coming. Use the profile again
+    SARA_R5_http_request *request = profile->request;
+    if (request == nullptr)
+      continue;
+    if (profile->resultReady == false)
+    {
+      if (millis() - request->_sentAt < SARA_R5_HTTP_REQUEST_TIMEOUT)
+        continue;
+      request->_error = SARA_R5_ERROR_TIMEOUT;
+      profile->server[0] = 0; // The profile may still be busy. Reset it before it is used again
+      profile->staleResults++; // Its +UUHTTPCR may still arrive. Keep the profile out of use until it does
+      profile->staleSince = millis();
+    }
 
-    messageCStr = sara_r5_calloc_char(message.length() + 1);
-    if (messageCStr == nullptr)
+    profile->request = nullptr;
+    profile->resultReady = false;
+    profile->lastUsed = millis();
+
+    if ((request->_error == SARA_R5_ERROR_SUCCESS) && (request->_result == 1))
+      request->_state = SARA_R5_HTTP_REQUEST_SUCCEEDED;
+    else
     {
-      hwWrite(ASCII_CTRL_Z);
-      return SARA_R5_ERROR_OUT_OF_MEMORY;
+      if (request->_error == SARA_R5_ERROR_SUCCESS)
+      {
+        request->_error = SARA_R5_ERROR_ERROR;
+        getHTTPprotocolError(p, &request->_errorClass, &request->_errorCode);
+      }
+      request->_state = SARA_R5_HTTP_REQUEST_FAILED;
     }
-    message.toCharArray(messageCStr, message.length() + 1);
-    messageCStr[message.length()] = ASCII_CTRL_Z;
 
-    err = sendCommandWithResponse(messageCStr, SARA_R5_RESPONSE_OK_OR_ERROR,
-                                  nullptr, SARA_R5_3_MIN_TIMEOUT, minimumResponseAllocation, NOT_AT_COMMAND);
+    if (_printDebug == true)
+    {
+      _debugPort->print(F("serviceHTTPQueue: profile "));
+      _debugPort->print(p);
+      _debugPort->println((request->_state == SARA_R5_HTTP_REQUEST_SUCCEEDED) ? F(" succeeded") : F(" failed"));
+    }
 
-    free(messageCStr);
+    if (request->_callback != nullptr)
+      request->_callback(request, request->_context);
   }
-  else
+
+  while (_httpScheduler->queue != nullptr)
   {
-    free(numberCStr);
-    err = SARA_R5_ERROR_OUT_OF_MEMORY;
+    int p = chooseHTTPProfile(_httpScheduler->queue);
+    if (p < 0)
+      break; // Every profile is busy
+    SARA_R5_http_request *request = _httpScheduler->queue;
+    _httpScheduler->queue = request->_next;
+    request->_next = nullptr;
+    startHTTPRequest(request, p);
   }
+}
 
-  return err;
+// Choose a free profile for request. A profile which is already configured for the same server is preferred.
+// Otherwise an unconfigured profile, then the one which has been free longest. Returns -1 if every profile is busy
+int SARA_R5::chooseHTTPProfile(const SARA_R5_http_request *request)
+{
+  int choice = -1;
+  int choiceRank = 0;
+
+  for (int p = 0; p < _httpScheduler->numProfiles; p++)
+  {
+    SARA_R5_http_profile_state_t *profile = &_httpScheduler->profile[p];
+    if ((profile->request != nullptr) || (profile->staleResults > 0))
+      continue;
+    if ((strcmp(profile->server, request->_server.c_str()) == 0) && (profile->port == request->_port)
+        && (profile->secure == request->_secure) && (profile->secprofile == request->_secprofile))
+      return p;
+    int rank = (profile->server[0] == 0) ? 2 : 1;
+    if ((rank > choiceRank) || ((rank == choiceRank) && ((long)(profile->lastUsed - _httpScheduler->profile[choice].lastUsed) < 0)))
+    {
+      choice = p;
+      choiceRank = rank;
+    }
+  }
+  return choice;
 }
 
-SARA_R5_error_t SARA_R5::getPreferredMessageStorage(int *used, int *total, String memory)
+// Configure profile p for the request's server - unless it already is - and send the request
+void SARA_R5::startHTTPRequest(SARA_R5_http_request *request, int p)
 {
-  SARA_R5_error_t err;
-  char *command;
-  char *response;
-  int u;
-  int t;
+  SARA_R5_http_profile_state_t *profile = &_httpScheduler->profile[p];
+  SARA_R5_error_t err = SARA_R5_ERROR_SUCCESS;
 
-  command = sara_r5_calloc_char(strlen(SARA_R5_PREF_MESSAGE_STORE) + 32);
-  if (command == nullptr)
-    return SARA_R5_ERROR_OUT_OF_MEMORY;
-  sprintf(command, "%s=\"%s\"", SARA_R5_PREF_MESSAGE_STORE, memory.c_str());
+  if ((strcmp(profile->server, request->_server.c_str()) != 0) || (profile->port != request->_port)
+      || (profile->secure != request->_secure) || (profile->secprofile != request->_secprofile))
+  {
+    profile->server[0] = 0;
+    err = resetHTTPprofile(p);
+    if (err == SARA_R5_ERROR_SUCCESS)
+      err = setHTTPserverName(p, request->_server);
+    if (err == SARA_R5_ERROR_SUCCESS)
+      err = setHTTPserverPort(p, request->_port);
+    if ((err == SARA_R5_ERROR_SUCCESS) && (request->_secure == true))
+      err = setHTTPsecure(p, true, request->_secprofile);
+    if (err == SARA_R5_ERROR_SUCCESS)
+    {
+      strcpy(profile->server, request->_server.c_str());
+      profile->port = request->_port;
+      profile->secure = request->_secure;
+      profile->secprofile = request->_secprofile;
+    }
+  }
+
+  if (err == SARA_R5_ERROR_SUCCESS)
+  {
+    if (request->_command == SARA_R5_HTTP_COMMAND_GET)
+      err = sendHTTPGET(p, request->_path, request->_responseFilename);
+    else if (request->_command == SARA_R5_HTTP_COMMAND_POST_DATA)
+      err = sendHTTPPOSTdata(p, request->_path, request->_responseFilename, request->_data, request->_httpContentType);
+    else
+      err = sendHTTPPOSTfile(p, request->_path, request->_responseFilename, request->_data, request->_httpContentType);
+  }
+
+  request->_profile = p;
+  if (err == SARA_R5_ERROR_SUCCESS)
+  {
+    request->_state = SARA_R5_HTTP_REQUEST_IN_FLIGHT;
+    request->_sentAt = millis();
+    profile->request = request;
+    profile->resultReady = false;
+    return;
+  }
+
+  if (_printDebug == true)
+  {
+    _debugPort->print(F("startHTTPRequest: Error: "));
+    _debugPort->println(err);
+  }
+  request->_state = SARA_R5_HTTP_REQUEST_FAILED;
+  request->_error = err;
+  profile->lastUsed = millis();
+  if (request->_callback != nullptr)
+    request->_callback(request, request->_context);
+}
 
-  response = sara_r5_calloc_char(minimumResponseAllocation);
-  if (response == nullptr)
+// Forget how the profiles are configured. Called when the module is reset.
+// Any command in progress will not complete: the queued and in-flight requests fail now. Their callbacks are called by
+// the next serviceHTTPQueue, so a request queued again from a callback is not sent while the module is restarting
+void SARA_R5::invalidateHTTPProfiles(void)
+{
+  for (int p = 0; p < SARA_R5_NUM_HTTP_PROFILES; p++)
   {
-    free(command);
-    return SARA_R5_ERROR_OUT_OF_MEMORY;
+    if (_httpCommandResult[p] < 0)
+      _httpCommandResult[p] = 0; // Fail waitForHTTPResult
   }
 
-  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, response,
-                                SARA_R5_3_MIN_TIMEOUT);
+  if (nullptr == _httpScheduler)
+    return;
 
-  if (err != SARA_R5_ERROR_SUCCESS)
+  SARA_R5_http_request **failed = &_httpScheduler->failed;
+  while (*failed != nullptr)
+    failed = &(*failed)->_next;
+
+  for (int p = 0; p < SARA_R5_NUM_HTTP_PROFILES; p++)
   {
-    free(command);
-    free(response);
-    return err;
+    SARA_R5_http_profile_state_t *profile = &_httpScheduler->profile[p];
+    profile->server[0] = 0;
+    profile->staleResults = 0; // The module has forgotten the timed-out requests too
+    if (profile->request != nullptr)
+    {
+      *failed = profile->request;
+      failed = &(*failed)->_next;
+      profile->request = nullptr;
+      profile->resultReady = false;
+    }
   }
+  *failed = _httpScheduler->queue; // The queued requests go after the ones which were in flight
+  _httpScheduler->queue = nullptr;
 
-  int scanned = 0;
-  char *searchPtr = strstr(response, "+CPMS:");
-  if (searchPtr != nullptr)
+  for (SARA_R5_http_request *request = _httpScheduler->failed; request != nullptr; request = request->_next)
   {
-    searchPtr += strlen("+CPMS:"); //  Move searchPtr to first char
-    while (*searchPtr == ' ') searchPtr++; // skip spaces
-    scanned = sscanf(searchPtr, "%d,%d", &u, &t);
+    request->_state = SARA_R5_HTTP_REQUEST_FAILED;
+    request->_error = SARA_R5_ERROR_NO_RESPONSE;
   }
-  if (scanned == 2)
+}
+
+// Case-insensitive compare of the first length characters
+static bool sara_r5_http_match(const char *str, const char *match, size_t length)
+{
+  for (size_t i = 0; i < length; i++)
   {
-    if (_printDebug == true)
+    if (tolower((unsigned char)str[i]) != tolower((unsigned char)match[i]))
+      return false;
+  }
+  return true;
+}
+
+void SARA_R5_http_parser::reset(void)
+{
+  _state = SARA_R5_HTTP_PARSER_STATUS_LINE;
+  _lineLength = 0;
+  _statusCode = 0;
+  _contentLength = -1;
+  _remaining = -1;
+  _chunked = false;
+  _bodyLength = 0;
+  _contentType[0] = 0;
+}
+
+// Parse the next length bytes of the response. The body bytes are passed to the body sink as they arrive
+void SARA_R5_http_parser::parse(const char *data, size_t length)
+{
+  size_t i = 0;
+
+  while ((i < length) && (_state != SARA_R5_HTTP_PARSER_DONE) && (_state != SARA_R5_HTTP_PARSER_ERROR))
+  {
+    if ((_state == SARA_R5_HTTP_PARSER_BODY) || (_state == SARA_R5_HTTP_PARSER_CHUNK_DATA))
     {
-      _debugPort->print(F("getPreferredMessageStorage: memory1 (read and delete): "));
-      _debugPort->print(memory);
-      _debugPort->print(F(" used: "));
-      _debugPort->print(u);
-      _debugPort->print(F(" total: "));
-      _debugPort->println(t);
+      size_t run = length - i;
+      if ((_remaining >= 0) && ((size_t)_remaining < run))
+        run = (size_t)_remaining;
+      if ((run > 0) && (_bodySink != nullptr))
+        _bodySink(&data[i], run, _context);
+      _bodyLength += run;
+      i += run;
+      if (_remaining >= 0) // -1 if the body runs to the end of the file
+      {
+        _remaining -= run;
+        if (_remaining == 0)
+          _state = (_state == SARA_R5_HTTP_PARSER_CHUNK_DATA) ? SARA_R5_HTTP_PARSER_CHUNK_END : SARA_R5_HTTP_PARSER_DONE;
+      }
+      continue;
     }
-    *used = u;
-    *total = t;
+
+    char c = data[i++];
+    if (c == '\n')
+    {
+      if ((_lineLength > 0) && (_line[_lineLength - 1] == '\r'))
+        _lineLength--;
+      _line[_lineLength] = 0;
+      parseLine();
+      _lineLength = 0;
+    }
+    else if (_lineLength < (SARA_R5_HTTP_LINE_LENGTH - 1)) // Longer lines are truncated
+      _line[_lineLength++] = c;
   }
-  else
+}
+
+// Call this at the end of the response. A body without a Content-Length runs to the end
+void SARA_R5_http_parser::finish(void)
+{
+  if ((_state == SARA_R5_HTTP_PARSER_BODY) && (_remaining < 0))
+    _state = SARA_R5_HTTP_PARSER_DONE;
+}
+
+void SARA_R5_http_parser::parseLine(void)
+{
+  switch (_state)
   {
-    err = SARA_R5_ERROR_INVALID;
+  case SARA_R5_HTTP_PARSER_STATUS_LINE:
+    if (sscanf(_line, "HTTP/%*d.%*d %d", &_statusCode) == 1)
+      _state = SARA_R5_HTTP_PARSER_HEADER;
+    else
+      _state = SARA_R5_HTTP_PARSER_ERROR;
+    break;
+  case SARA_R5_HTTP_PARSER_HEADER:
+  case SARA_R5_HTTP_PARSER_TRAILER:
+    if (_lineLength == 0) // The end of the headers
+    {
+      if (_state == SARA_R5_HTTP_PARSER_TRAILER)
+        _state = SARA_R5_HTTP_PARSER_DONE;
+      else if (_chunked == true)
+        _state = SARA_R5_HTTP_PARSER_CHUNK_SIZE;
+      else if ((_contentLength == 0) || (_statusCode == 204) || (_statusCode == 304))
+        _state = SARA_R5_HTTP_PARSER_DONE;
+      else
+      {
+        _remaining = _contentLength;
+        _state = SARA_R5_HTTP_PARSER_BODY;
+      }
+    }
+    else
+    {
+      char *value = strchr(_line, ':');
+      if (value == nullptr)
+        break; // Not a header. Ignore it
+      *value++ = 0;
+      while (*value == ' ') value++; // skip spaces
+      if (_state == SARA_R5_HTTP_PARSER_HEADER)
+      {
+        size_t nameLength = strlen(_line);
+        if ((nameLength == 14) && (sara_r5_http_match(_line, "Content-Length", 14)))
+          _contentLength = atol(value);
+        else if ((nameLength == 17) && (sara_r5_http_match(_line, "Transfer-Encoding", 17)))
+        {
+          for (char *ptr = value; strlen(ptr) >= 7; ptr++)
+          {
+            if (sara_r5_http_match(ptr, "chunked", 7))
+              _chunked = true;
+          }
+        }
+        else if ((nameLength == 12) && (sara_r5_http_match(_line, "Content-Type", 12)))
+        {
+          strncpy(_contentType, value, SARA_R5_HTTP_CONTENT_TYPE_LENGTH - 1);
+          _contentType[SARA_R5_HTTP_CONTENT_TYPE_LENGTH - 1] = 0;
+        }
+      }
+      if (_headerCallback != nullptr)
+        _headerCallback(_line, value, _context);
+    }
+    break;
+  case SARA_R5_HTTP_PARSER_CHUNK_SIZE:
+  {
+    char *end;
+    long size = strtol(_line, &end, 16); // Any chunk extension after the size is ignored
+    if ((end == _line) || (size < 0))
+      _state = SARA_R5_HTTP_PARSER_ERROR;
+    else if (size == 0)
+      _state = SARA_R5_HTTP_PARSER_TRAILER;
+    else
+    {
+      _remaining = size;
+      _state = SARA_R5_HTTP_PARSER_CHUNK_DATA;
+    }
+    break;
+  }
+  case SARA_R5_HTTP_PARSER_CHUNK_END:
+    _state = (_lineLength == 0) ? SARA_R5_HTTP_PARSER_CHUNK_SIZE : SARA_R5_HTTP_PARSER_ERROR;
+    break;
+  default:
+    break;
   }
-
-  free(response);
-  free(command);
-  return err;
 }
 
-SARA_R5_error_t SARA_R5::readSMSmessage(int location, String *unread, String *from, String *dateTime, String *message)
+SARA_R5_error_t SARA_R5::getHTTPprotocolError(int profile, int *error_class, int *error_code)
 {
   SARA_R5_error_t err;
   char *command;
   char *response;
 
-  command = sara_r5_calloc_char(strlen(SARA_R5_READ_TEXT_MESSAGE) + 5);
+  int rprofile, eclass, ecode;
+
+  command = sara_r5_calloc_char(strlen(SARA_R5_HTTP_PROTOCOL_ERROR) + 4);
   if (command == nullptr)
     return SARA_R5_ERROR_OUT_OF_MEMORY;
-  sprintf(command, "%s=%d", SARA_R5_READ_TEXT_MESSAGE, location);
+  sprintf(command, "%s=%d", SARA_R5_HTTP_PROTOCOL_ERROR, profile);
 
-  response = sara_r5_calloc_char(1024);
+  response = sara_r5_calloc_char(minimumResponseAllocation);
   if (response == nullptr)
   {
     free(command);
     return SARA_R5_ERROR_OUT_OF_MEMORY;
   }
 
-  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, response,
-                                SARA_R5_10_SEC_TIMEOUT, 1024);
+  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR,
+                                response, SARA_R5_STANDARD_RESPONSE_TIMEOUT);
 
   if (err == SARA_R5_ERROR_SUCCESS)
   {
-    char *searchPtr = response;
-
-    // Find the first occurrence of +CMGR:
-    searchPtr = strstr(searchPtr, "+CMGR:");
+    int scanned = 0;
+    char *searchPtr = strstr(response, "+UHTTPER:");
     if (searchPtr != nullptr)
     {
-      searchPtr += strlen("+CMGR:"); //  Move searchPtr to first char
+      searchPtr += strlen("+UHTTPER:"); //  Move searchPtr to first char
       while (*searchPtr == ' ') searchPtr++; // skip spaces
-      int pointer = 0;
-      while ((*(++searchPtr) != '\"') && (*searchPtr != '\0') && (pointer < 12))
-      {
-        unread->concat(*(searchPtr));
-        pointer++;
-      }
-      if ((*searchPtr == '\0') || (pointer == 12))
-      {
-        free(command);
-        free(response);
-        return SARA_R5_ERROR_UNEXPECTED_RESPONSE;
-      }
-      // Search to the next quote
-      searchPtr = strchr(++searchPtr, '\"');
-      pointer = 0;
-      while ((*(++searchPtr) != '\"') && (*searchPtr != '\0') && (pointer < 24))
-      {
-        from->concat(*(searchPtr));
-        pointer++;
-      }
-      if ((*searchPtr == '\0') || (pointer == 24))
-      {
-        free(command);
-        free(response);
-        return SARA_R5_ERROR_UNEXPECTED_RESPONSE;
-      }
-      // Skip two commas
-      searchPtr = strchr(++searchPtr, ',');
-      searchPtr = strchr(++searchPtr, ',');
-      // Search to the next quote
-      searchPtr = strchr(++searchPtr, '\"');
-      pointer = 0;
-      while ((*(++searchPtr) != '\"') && (*searchPtr != '\0') && (pointer < 24))
-      {
-        dateTime->concat(*(searchPtr));
-        pointer++;
-      }
-      if ((*searchPtr == '\0') || (pointer == 24))
-      {
-        free(command);
-        free(response);
-        return SARA_R5_ERROR_UNEXPECTED_RESPONSE;
-      }
-      // Search to the next new line
-      searchPtr = strchr(++searchPtr, '\n');
-      pointer = 0;
-      while ((*(++searchPtr) != '\r') && (*searchPtr != '\n') && (*searchPtr != '\0') && (pointer < 512))
-      {
-        message->concat(*(searchPtr));
-        pointer++;
-      }
-      if ((*searchPtr == '\0') || (pointer == 512))
-      {
-        free(command);
-        free(response);
-        return SARA_R5_ERROR_UNEXPECTED_RESPONSE;
-      }
+      scanned = sscanf(searchPtr, "%d,%d,%d\r\n",
+                        &rprofile, &eclass, &ecode);
     }
-    else
+    if (scanned == 3)
     {
-      err = SARA_R5_ERROR_UNEXPECTED_RESPONSE;
+      *error_class = eclass;
+      *error_code = ecode;
     }
-  }
-  else
-  {
-    err = SARA_R5_ERROR_UNEXPECTED_RESPONSE;
+    else
+      err = SARA_R5_ERROR_UNEXPECTED_RESPONSE;
   }
 
   free(command);
   free(response);
-
   return err;
 }
 
-SARA_R5_error_t SARA_R5::deleteSMSmessage(int location, int deleteFlag)
+SARA_R5_error_t SARA_R5::nvMQTT(SARA_R5_mqtt_nv_parameter_t parameter)
 {
-  char *command;
-  SARA_R5_error_t err;
-
-  command = sara_r5_calloc_char(strlen(SARA_R5_DELETE_MESSAGE) + 12);
-  if (command == nullptr)
-    return SARA_R5_ERROR_OUT_OF_MEMORY;
-  if (deleteFlag == 0)
-    sprintf(command, "%s=%d", SARA_R5_DELETE_MESSAGE, location);
-  else
-    sprintf(command, "%s=%d,%d", SARA_R5_DELETE_MESSAGE, location, deleteFlag);
-
-  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, nullptr, SARA_R5_55_SECS_TIMEOUT);
+    invalidateConfigShadow(); // The profile may be restored or reset
 
-  free(command);
-  return err;
+    SARA_R5_error_t err;
+    char *command;
+    command = sara_r5_calloc_char(strlen(SARA_R5_MQTT_NVM) + 10);
+    if (command == nullptr)
+      return SARA_R5_ERROR_OUT_OF_MEMORY;
+    sprintf(command, "%s=%d", SARA_R5_MQTT_NVM, parameter);
+    err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, nullptr,
+                                  SARA_R5_STANDARD_RESPONSE_TIMEOUT);
+    free(command);
+    return err;
 }
 
-SARA_R5_error_t SARA_R5::setBaud(unsigned long baud)
+SARA_R5_error_t SARA_R5::setMQTTclientId(const String& clientId)
 {
-  SARA_R5_error_t err;
-  char *command;
-  int b = 0;
+    SARA_R5_error_t err;
+    char *command;
+    command = sara_r5_calloc_char(strlen(SARA_R5_MQTT_PROFILE) + clientId.length() + 10);
+    if (command == nullptr)
+      return SARA_R5_ERROR_OUT_OF_MEMORY;
+    sprintf(command, "%s=%d,\"%s\"", SARA_R5_MQTT_PROFILE, SARA_R5_MQTT_PROFILE_CLIENT_ID, clientId.c_str());
+    err = sendShadowedCommand(command, 1, SARA_R5_STANDARD_RESPONSE_TIMEOUT);
+    free(command);
+    return err;
+}
 
-  // Error check -- ensure supported baud
-  for (; b < NUM_SUPPORTED_BAUD; b++)
-  {
-    if (SARA_R5_SUPPORTED_BAUD[b] == baud)
-    {
-      break;
-    }
-  }
-  if (b >= NUM_SUPPORTED_BAUD)
-  {
-    return SARA_R5_ERROR_UNEXPECTED_PARAM;
-  }
+SARA_R5_error_t SARA_R5::setMQTTserver(const String& serverName, int port)
+{
+    SARA_R5_error_t err;
+    char *command;
+    command = sara_r5_calloc_char(strlen(SARA_R5_MQTT_PROFILE) + serverName.length() + 16);
+    if (command == nullptr)
+      return SARA_R5_ERROR_OUT_OF_MEMORY;
+    sprintf(command, "%s=%d,\"%s\",%d", SARA_R5_MQTT_PROFILE, SARA_R5_MQTT_PROFILE_SERVERNAME, serverName.c_str(), port);
+    err = sendShadowedCommand(command, 1, SARA_R5_STANDARD_RESPONSE_TIMEOUT);
+    free(command);
+    return err;
+}
 
-  // Construct command
-  command = sara_r5_calloc_char(strlen(SARA_R5_COMMAND_BAUD) + 7 + 12);
-  if (command == nullptr)
-    return SARA_R5_ERROR_OUT_OF_MEMORY;
-  sprintf(command, "%s=%lu", SARA_R5_COMMAND_BAUD, baud);
+SARA_R5_error_t SARA_R5::setMQTTcredentials(const String& userName, const String& pwd)
+{
+    SARA_R5_error_t err;
+    char *command;
+    command = sara_r5_calloc_char(strlen(SARA_R5_MQTT_PROFILE) + userName.length() + pwd.length() + 16);
+    if (command == nullptr) {
+        return SARA_R5_ERROR_OUT_OF_MEMORY;
+    }
+    sprintf(command, "%s=%d,\"%s\",\"%s\"", SARA_R5_MQTT_PROFILE, SARA_R5_MQTT_PROFILE_USERNAMEPWD, userName.c_str(), pwd.c_str());
+    err = sendShadowedCommand(command, 1, SARA_R5_STANDARD_RESPONSE_TIMEOUT);
+    free(command);
+    return err;
+}
 
-  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR,
-                                nullptr, SARA_R5_SET_BAUD_TIMEOUT);
+SARA_R5_error_t SARA_R5::setMQTTsecure(bool secure, int secprofile)
+{
+    SARA_R5_error_t err;
+    char *command;
+    command = sara_r5_calloc_char(strlen(SARA_R5_MQTT_PROFILE) + 16);
+    if (command == nullptr)
+      return SARA_R5_ERROR_OUT_OF_MEMORY;
+    if ((secprofile == -1) || !secure) sprintf(command, "%s=%d,%d", SARA_R5_MQTT_PROFILE, SARA_R5_MQTT_PROFILE_SECURE, secure);
+    else sprintf(command, "%s=%d,%d,%d", SARA_R5_MQTT_PROFILE, SARA_R5_MQTT_PROFILE_SECURE, secure, secprofile);
+    err = sendShadowedCommand(command, 1, SARA_R5_STANDARD_RESPONSE_TIMEOUT);
+    free(command);
+    return err;
+}
 
-  free(command);
+SARA_R5_error_t SARA_R5::connectMQTT(void)
+{
+    SARA_R5_error_t err;
+    char *command;
+    command = sara_r5_calloc_char(strlen(SARA_R5_MQTT_COMMAND) + 10);
+    if (command == nullptr)
+      return SARA_R5_ERROR_OUT_OF_MEMORY;
+    sprintf(command, "%s=%d", SARA_R5_MQTT_COMMAND, SARA_R5_MQTT_COMMAND_LOGIN);
+    err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, nullptr,
+                                  SARA_R5_STANDARD_RESPONSE_TIMEOUT);
+    free(command);
+    return err;
+}
 
-  return err;
+SARA_R5_error_t SARA_R5::disconnectMQTT(void)
+{
+    SARA_R5_error_t err;
+    char *command;
+    command = sara_r5_calloc_char(strlen(SARA_R5_MQTT_COMMAND) + 10);
+    if (command == nullptr)
+      return SARA_R5_ERROR_OUT_OF_MEMORY;
+    sprintf(command, "%s=%d", SARA_R5_MQTT_COMMAND, SARA_R5_MQTT_COMMAND_LOGOUT);
+    err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, nullptr,
+                                  SARA_R5_STANDARD_RESPONSE_TIMEOUT);
+    free(command);
+    return err;
 }
 
-SARA_R5_error_t SARA_R5::setFlowControl(SARA_R5_flow_control_t value)
+SARA_R5_error_t SARA_R5::subscribeMQTTtopic(int max_Qos, const String& topic)
 {
   SARA_R5_error_t err;
   char *command;
-
-  command = sara_r5_calloc_char(strlen(SARA_R5_FLOW_CONTROL) + 16);
+  command = sara_r5_calloc_char(strlen(SARA_R5_MQTT_COMMAND) + 16 + topic.length());
   if (command == nullptr)
     return SARA_R5_ERROR_OUT_OF_MEMORY;
-  sprintf(command, "%s%d", SARA_R5_FLOW_CONTROL, value);
-
-  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR,
-                                nullptr, SARA_R5_STANDARD_RESPONSE_TIMEOUT);
-
+  sprintf(command, "%s=%d,%d,\"%s\"", SARA_R5_MQTT_COMMAND, SARA_R5_MQTT_COMMAND_SUBSCRIBE, max_Qos, topic.c_str());
+  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, nullptr,
+                                SARA_R5_STANDARD_RESPONSE_TIMEOUT);
   free(command);
-
   return err;
 }
 
-SARA_R5_error_t SARA_R5::setGpioMode(SARA_R5_gpio_t gpio,
-                                     SARA_R5_gpio_mode_t mode, int value)
+SARA_R5_error_t SARA_R5::unsubscribeMQTTtopic(const String& topic)
 {
   SARA_R5_error_t err;
   char *command;
-
-  // Example command: AT+UGPIOC=16,2
-  // Example command: AT+UGPIOC=23,0,1
-  command = sara_r5_calloc_char(strlen(SARA_R5_COMMAND_GPIO) + 16);
+  command = sara_r5_calloc_char(strlen(SARA_R5_MQTT_COMMAND) + 16 + topic.length());
   if (command == nullptr)
     return SARA_R5_ERROR_OUT_OF_MEMORY;
-  if (mode == GPIO_OUTPUT)
-    sprintf(command, "%s=%d,%d,%d", SARA_R5_COMMAND_GPIO, gpio, mode, value);
-  else
-    sprintf(command, "%s=%d,%d", SARA_R5_COMMAND_GPIO, gpio, mode);
-
-  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR,
-                                nullptr, SARA_R5_10_SEC_TIMEOUT);
-
+  sprintf(command, "%s=%d,\"%s\"", SARA_R5_MQTT_COMMAND, SARA_R5_MQTT_COMMAND_UNSUBSCRIBE, topic.c_str());
+  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, nullptr,
+                                SARA_R5_STANDARD_RESPONSE_TIMEOUT);
   free(command);
-
   return err;
 }
 
-SARA_R5::SARA_R5_gpio_mode_t SARA_R5::getGpioMode(SARA_R5_gpio_t gpio)
+SARA_R5_error_t SARA_R5::readMQTT(int* pQos, String* pTopic, uint8_t *readDest, int readLength, int *bytesRead)
 {
-  SARA_R5_error_t err;
   char *command;
   char *response;
-  char gpioChar[4];
-  char *gpioStart;
-  int gpioMode;
-
-  command = sara_r5_calloc_char(strlen(SARA_R5_COMMAND_GPIO) + 2);
-  if (command == nullptr)
-    return GPIO_MODE_INVALID;
-  sprintf(command, "%s?", SARA_R5_COMMAND_GPIO);
-
-  response = sara_r5_calloc_char(minimumResponseAllocation);
-  if (response == nullptr)
-  {
-    free(command);
-    return GPIO_MODE_INVALID;
-  }
-
-  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR,
-                                response, SARA_R5_STANDARD_RESPONSE_TIMEOUT);
-
-  if (err != SARA_R5_ERROR_SUCCESS)
-  {
-    free(command);
-    free(response);
-    return GPIO_MODE_INVALID;
-  }
-
-  sprintf(gpioChar, "%d", gpio);          // Convert GPIO to char array
-  gpioStart = strstr(response, gpioChar); // Find first occurence of GPIO in response
-
-  if (gpioStart == nullptr) {
-    free(command);
-    free(response);
-    return GPIO_MODE_INVALID; // If not found return invalid
-  }
-  scanf(gpioStart, "%*d,%d\r\n", &gpioMode);
-  free(command);
-  free(response);
-
-  return (SARA_R5_gpio_mode_t)gpioMode;
-}
-
-int SARA_R5::socketOpen(SARA_R5_socket_protocol_t protocol, unsigned int localPort)
-{
   SARA_R5_error_t err;
-  char *command;
-  char *response;
-  int sockId = -1;
-  char *responseStart;
+  int scanNum = 0;
+  int total_length, topic_length, data_length;
 
-  command = sara_r5_calloc_char(strlen(SARA_R5_CREATE_SOCKET) + 10);
+  // Set *bytesRead to zero
+  if (bytesRead != nullptr)
+    *bytesRead = 0;
+
+  // Allocate memory for the command
+  command = sara_r5_calloc_char(strlen(SARA_R5_MQTT_COMMAND) + 10);
   if (command == nullptr)
-    return -1;
-  if (localPort == 0)
-    sprintf(command, "%s=%d", SARA_R5_CREATE_SOCKET, (int)protocol);
-  else
-    sprintf(command, "%s=%d,%d", SARA_R5_CREATE_SOCKET, (int)protocol, localPort);
+    return SARA_R5_ERROR_OUT_OF_MEMORY;
 
-  response = sara_r5_calloc_char(minimumResponseAllocation);
+  // Allocate memory for the response
+  int responseLength = readLength + minimumResponseAllocation;
+  response = sara_r5_calloc_char(responseLength);
   if (response == nullptr)
   {
-    if (_printDebug == true)
-      _debugPort->println(F("socketOpen: Fail: nullptr response"));
     free(command);
-    return -1;
+    return SARA_R5_ERROR_OUT_OF_MEMORY;
   }
 
-  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR,
-                                response, SARA_R5_STANDARD_RESPONSE_TIMEOUT);
+  // Note to self: if the file contents contain "OK\r\n" sendCommandWithResponse will return true too early...
+  // To try and avoid this, look for \"\r\n\r\nOK\r\n there is a extra \r\n beetween " and the the standard \r\nOK\r\n
+  const char mqttReadTerm[] = "\"\r\n\r\nOK\r\n";
+  sprintf(command, "%s=%d,%d", SARA_R5_MQTT_COMMAND, SARA_R5_MQTT_COMMAND_READ, 1);
+  err = sendCommandWithResponse(command, mqttReadTerm, response,
+                                (5 * SARA_R5_STANDARD_RESPONSE_TIMEOUT), responseLength);
 
   if (err != SARA_R5_ERROR_SUCCESS)
   {
     if (_printDebug == true)
     {
-      _debugPort->print(F("socketOpen: Fail: Error: "));
-      _debugPort->print(err);
-      _debugPort->print(F("  Response: {"));
-      _debugPort->print(response);
-      _debugPort->println(F("}"));
+      _debugPort->print(F("readMQTT: sendCommandWithResponse err "));
+      _debugPort->println(err);
     }
     free(command);
     free(response);
-    return -1;
+    return err;
   }
 
-  responseStart = strstr(response, "+USOCR:");
-  if (responseStart == nullptr)
+  // Extract the data
+  char *searchPtr = strstr(response, "+UMQTTC:");
+  int cmd = 0;
+  if (searchPtr != nullptr)
+  {
+    searchPtr += strlen("+UMQTTC:"); //  Move searchPtr to first char
+    while (*searchPtr == ' ') searchPtr++; // skip spaces
+    scanNum = sscanf(searchPtr, "%d,%d,%d,%d,\"%*[^\"]\",%d,\"", &cmd, pQos, &total_length, &topic_length, &data_length);
+  }
+  if ((scanNum != 5) || (cmd != SARA_R5_MQTT_COMMAND_READ))
   {
     if (_printDebug == true)
     {
-      _debugPort->print(F("socketOpen: Failure: {"));
-      _debugPort->print(response);
-      _debugPort->println(F("}"));
+      _debugPort->print(F("readMQTT: error: scanNum is "));
+      _debugPort->println(scanNum);
     }
     free(command);
     free(response);
-    return -1;
+    return SARA_R5_ERROR_UNEXPECTED_RESPONSE;
   }
 
-  responseStart += strlen("+USOCR:"); //  Move searchPtr to first char
-  while (*responseStart == ' ') responseStart++; // skip spaces
-  sscanf(responseStart, "%d", &sockId);
-  _lastSocketProtocol[sockId] = (int)protocol;
-
+  err = SARA_R5_ERROR_SUCCESS;
+  searchPtr = strstr(searchPtr, "\"");
+  if (searchPtr!= nullptr) {
+    if (pTopic) {
+      searchPtr[topic_length + 1] = '\0'; // zero terminate
+      *pTopic = searchPtr + 1;
+      searchPtr[topic_length + 1] = '\"'; // restore
+    }
+    searchPtr = strstr(searchPtr + topic_length + 2, "\"");
+    if (readDest && (searchPtr != nullptr) && (response + responseLength >= searchPtr + data_length + 1) && (searchPtr[data_length + 1] == '"')) {
+      if (data_length > readLength) {
+        data_length = readLength;
+        if (_printDebug == true) {
+          _debugPort->print(F("readMQTT: error: trucate message"));
+        }
+        err = SARA_R5_ERROR_OUT_OF_MEMORY;
+      }
+      memcpy(readDest, searchPtr+1, data_length);
+      *bytesRead = data_length;
+    } else {
+      if (_printDebug == true) {
+        _debugPort->print(F("readMQTT: error: message end "));
+      }
+      err = SARA_R5_ERROR_UNEXPECTED_RESPONSE;
+    }
+  }
   free(command);
   free(response);
 
-  return sockId;
+  return err;
 }
 
-SARA_R5_error_t SARA_R5::socketSetSecure(int profile, bool secure, int secprofile)
+SARA_R5_error_t SARA_R5::mqttPublishTextMsg(const String& topic, const char * const msg, uint8_t qos, bool retain)
 {
+  SARA_R5_LOCK_TRANSACTION(SARA_R5_PRIORITY_NORMAL);
+
+  if (topic.length() < 1 || msg == nullptr)
+  {
+    return SARA_R5_ERROR_INVALID;
+  }
+
   SARA_R5_error_t err;
-  char *command = sara_r5_calloc_char(strlen(SARA_R5_SECURE_SOCKET) + 32);
-  if (command == nullptr)
-    return SARA_R5_ERROR_OUT_OF_MEMORY;
-  if ((secprofile == -1) || !secure) sprintf(command, "%s=%d,%d", SARA_R5_SECURE_SOCKET, profile, secure);
-  else sprintf(command, "%s=%d,%d,%d", SARA_R5_SECURE_SOCKET, profile, secure, secprofile);
-  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, nullptr,
-                                SARA_R5_STANDARD_RESPONSE_TIMEOUT);
-  free(command);
-  return err;
-}
 
-SARA_R5_error_t SARA_R5::socketClose(int socket, unsigned long timeout)
-{
-  SARA_R5_error_t err;
-  char *command;
-  char *response;
+  char sanitized_msg[MAX_MQTT_DIRECT_MSG_LEN + 1];
+  memset(sanitized_msg, 0, sizeof(sanitized_msg));
+
+  // Check the message length and truncate if necessary.
+  size_t msg_len = strnlen(msg, MAX_MQTT_DIRECT_MSG_LEN);
+  if (msg_len > MAX_MQTT_DIRECT_MSG_LEN)
+  {
+    msg_len = MAX_MQTT_DIRECT_MSG_LEN;
+  }
+
+  strncpy(sanitized_msg, msg, msg_len);
+  char * msg_ptr = sanitized_msg;
+  while (*msg_ptr != 0)
+  {
+    if (*msg_ptr == '"')
+    {
+      *msg_ptr = ' ';
+    }
+
+    msg_ptr++;
+  }
 
-  command = sara_r5_calloc_char(strlen(SARA_R5_CLOSE_SOCKET) + 10);
+  char *command = sara_r5_calloc_char(strlen(SARA_R5_MQTT_COMMAND) + 20 + topic.length() + msg_len);
   if (command == nullptr)
-    return SARA_R5_ERROR_OUT_OF_MEMORY;
-  response = sara_r5_calloc_char(minimumResponseAllocation);
-  if (response == nullptr)
   {
-    free(command);
     return SARA_R5_ERROR_OUT_OF_MEMORY;
   }
-  // if timeout is short, close asynchronously and don't wait for socket closure (we will get the URC later)
-  // this will make sure the AT command parser is not confused during init()
-  const char* format = (SARA_R5_STANDARD_RESPONSE_TIMEOUT == timeout) ? "%s=%d,1" : "%s=%d";
-  sprintf(command, format, SARA_R5_CLOSE_SOCKET, socket);
 
-  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, response, timeout);
+  sprintf(command, "%s=%d,%u,%u,0,\"%s\",\"%s\"", SARA_R5_MQTT_COMMAND, SARA_R5_MQTT_COMMAND_PUBLISH, qos, (retain ? 1:0), topic.c_str(), sanitized_msg);
 
-  if ((err != SARA_R5_ERROR_SUCCESS) && (_printDebug == true))
+  sendCommand(command, true);
+  err = waitForResponse(SARA_R5_RESPONSE_MORE, SARA_R5_RESPONSE_ERROR, SARA_R5_STANDARD_RESPONSE_TIMEOUT);
+  if (err == SARA_R5_ERROR_SUCCESS)
   {
-    _debugPort->print(F("socketClose: Error: "));
-    _debugPort->println(socketGetLastError());
+    sendCommand(msg, false);
+    err = waitForResponse(SARA_R5_RESPONSE_OK, SARA_R5_RESPONSE_ERROR, SARA_R5_STANDARD_RESPONSE_TIMEOUT);
   }
 
   free(command);
-  free(response);
-
   return err;
 }
 
-SARA_R5_error_t SARA_R5::socketConnect(int socket, const char *address,
-                                       unsigned int port)
+SARA_R5_error_t SARA_R5::mqttPublishBinaryMsg(const String& topic, const char * const msg, size_t msg_len, uint8_t qos, bool retain)
 {
-  SARA_R5_error_t err;
-  char *command;
+  SARA_R5_LOCK_TRANSACTION(SARA_R5_PRIORITY_NORMAL);
 
-  command = sara_r5_calloc_char(strlen(SARA_R5_CONNECT_SOCKET) + strlen(address) + 11);
+  /*
+   * The modem prints the '>' as the signal to send the binary message content.
+   * at+umqttc=9,0,0,"topic",4
+   *
+   * >"xY"
+   * OK
+   *
+   * +UUMQTTC: 9,1
+   */
+  if (topic.length() < 1|| msg == nullptr || msg_len > MAX_MQTT_DIRECT_MSG_LEN)
+  {
+    return SARA_R5_ERROR_INVALID;
+  }
+
+  SARA_R5_error_t err;
+  char *command = sara_r5_calloc_char(strlen(SARA_R5_MQTT_COMMAND) + 20 + topic.length());
   if (command == nullptr)
-    return SARA_R5_ERROR_OUT_OF_MEMORY;
-  sprintf(command, "%s=%d,\"%s\",%d", SARA_R5_CONNECT_SOCKET, socket, address, port);
+  {
+     return SARA_R5_ERROR_OUT_OF_MEMORY;
+  }
 
-  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, nullptr, SARA_R5_IP_CONNECT_TIMEOUT);
+  sprintf(command, "%s=%d,%u,%u,\"%s\",%u", SARA_R5_MQTT_COMMAND, SARA_R5_MQTT_COMMAND_PUBLISHBINARY, qos, (retain ? 1:0), topic.c_str(), msg_len);
 
-  free(command);
+  sendCommand(command, true);
+  err = waitForResponse(SARA_R5_RESPONSE_MORE, SARA_R5_RESPONSE_ERROR, SARA_R5_STANDARD_RESPONSE_TIMEOUT);
+  if (err == SARA_R5_ERROR_SUCCESS)
+  {
+    sendCommand(msg, false);
+    err = waitForResponse(SARA_R5_RESPONSE_OK, SARA_R5_RESPONSE_ERROR, SARA_R5_STANDARD_RESPONSE_TIMEOUT);
+  }
 
+  free(command);
   return err;
 }
 
-SARA_R5_error_t SARA_R5::socketConnect(int socket, IPAddress address,
-                                       unsigned int port)
+SARA_R5_error_t SARA_R5::mqttPublishFromFile(const String& topic, const String& filename, uint8_t qos, bool retain)
 {
-  char *charAddress = sara_r5_calloc_char(16);
-  if (charAddress == nullptr)
-    return SARA_R5_ERROR_OUT_OF_MEMORY;
-  memset(charAddress, 0, 16);
-  sprintf(charAddress, "%d.%d.%d.%d", address[0], address[1], address[2], address[3]);
+  SARA_R5_LOCK_TRANSACTION(SARA_R5_PRIORITY_LOW);
 
-  return (socketConnect(socket, (const char *)charAddress, port));
-}
+  if (topic.length() < 1|| filename.length() < 1)
+  {
+    return SARA_R5_ERROR_INVALID;
+  }
 
-SARA_R5_error_t SARA_R5::socketWrite(int socket, const char *str, int len)
-{
-  char *command;
-  char *response;
   SARA_R5_error_t err;
-
-  command = sara_r5_calloc_char(strlen(SARA_R5_WRITE_SOCKET) + 16);
+  char *command = sara_r5_calloc_char(strlen(SARA_R5_MQTT_COMMAND) + 20 + topic.length() + filename.length());
   if (command == nullptr)
-    return SARA_R5_ERROR_OUT_OF_MEMORY;
-  response = sara_r5_calloc_char(minimumResponseAllocation);
-  if (response == nullptr)
   {
-    free(command);
     return SARA_R5_ERROR_OUT_OF_MEMORY;
   }
-  int dataLen = len == -1 ? strlen(str) : len;
-  sprintf(command, "%s=%d,%d", SARA_R5_WRITE_SOCKET, socket, dataLen);
-
-  err = sendCommandWithResponse(command, "@", response,
-                                SARA_R5_STANDARD_RESPONSE_TIMEOUT * 5);
 
-  if (err == SARA_R5_ERROR_SUCCESS)
-  {
-    unsigned long writeDelay = millis();
-    while (millis() < (writeDelay + 50))
-      delay(1); //u-blox specification says to wait 50ms after receiving "@" to write data.
+  sprintf(command, "%s=%d,%u,%u,\"%s\",\"%s\"", SARA_R5_MQTT_COMMAND, SARA_R5_MQTT_COMMAND_PUBLISHFILE, qos, (retain ? 1:0), topic.c_str(), filename.c_str());
 
-    if (len == -1)
-    {
-      if (_printDebug == true)
-      {
-        _debugPort->print(F("socketWrite: writing: "));
-        _debugPort->println(str);
-      }
-      hwPrint(str);
-    }
-    else
-    {
-      if (_printDebug == true)
-      {
-        _debugPort->print(F("socketWrite: writing "));
-        _debugPort->print(len);
-        _debugPort->println(F(" bytes"));
-      }
-      hwWriteData(str, len);
-    }
+  _mqttPublishFileResult = -1; // Until +UUMQTTC arrives
+  sendCommand(command, true);
+  err = waitForResponse(SARA_R5_RESPONSE_OK, SARA_R5_RESPONSE_ERROR, SARA_R5_STANDARD_RESPONSE_TIMEOUT);
+  if (err != SARA_R5_ERROR_SUCCESS)
+    _mqttPublishFileResult = 0;
 
-    err = waitForResponse(SARA_R5_RESPONSE_OK, SARA_R5_RESPONSE_ERROR, SARA_R5_SOCKET_WRITE_TIMEOUT);
-  }
+  free(command);
+  return err;
+}
 
-  if (err != SARA_R5_ERROR_SUCCESS)
+// Wait for the +UUMQTTC result of the last mqttPublishFromFile. result is 1 for success, 0 for failure
+SARA_R5_error_t SARA_R5::waitForMQTTPublishFileResult(int *result, unsigned long timeout)
+{
+  unsigned long startTime = millis();
+  while (_mqttPublishFileResult < 0)
   {
-    if (_printDebug == true)
-    {
-      _debugPort->print(F("socketWrite: Error: "));
-      _debugPort->print(err);
-      _debugPort->print(F(" => {"));
-      _debugPort->print(response);
-      _debugPort->println(F("}"));
-    }
+    if (insideBufferedPoll() == true) // Called from a callback. bufferedPoll can't deliver the result
+      return SARA_R5_ERROR_INVALID;
+    if (millis() - startTime >= timeout)
+      return SARA_R5_ERROR_TIMEOUT;
+    bufferedPoll();
+    delay(1);
   }
 
-  free(command);
-  free(response);
-  return err;
+  if (result != nullptr)
+    *result = _mqttPublishFileResult;
+  return SARA_R5_ERROR_SUCCESS;
 }
 
-SARA_R5_error_t SARA_R5::socketWrite(int socket, String str)
+void SARA_R5_mqtt_message::setText(const char *topic, const char *text, uint8_t qos, bool retain)
 {
-  return socketWrite(socket, str.c_str(), str.length());
+  _topic = topic;
+  _payload = text;
+  _length = (text != nullptr) ? strlen(text) : 0;
+  _binary = false;
+  _qos = qos;
+  _retain = retain;
 }
 
-SARA_R5_error_t SARA_R5::socketWriteUDP(int socket, const char *address, int port, const char *str, int len)
+void SARA_R5_mqtt_message::setBinary(const char *topic, const char *data, size_t length, uint8_t qos, bool retain)
 {
-  char *command;
-  char *response;
-  SARA_R5_error_t err;
-  int dataLen = len == -1 ? strlen(str) : len;
+  _topic = topic;
+  _payload = data;
+  _length = length;
+  _binary = true;
+  _qos = qos;
+  _retain = retain;
+}
 
-  command = sara_r5_calloc_char(64);
-  if (command == nullptr)
-    return SARA_R5_ERROR_OUT_OF_MEMORY;
-  response = sara_r5_calloc_char(minimumResponseAllocation);
-  if (response == nullptr)
+// Enable or disable the MQTT publish pipeline. Up to window messages are in flight (sent, but not yet acknowledged) at
+// once. If a message has not been acknowledged after ackTimeout, every unacknowledged message in the window is taken
+// out of it: the QoS 1 messages are sent again (up to retries times) and the QoS 2 messages fail. Their late results
+// are ignored. Do not publish with QoS 1 or 2 outside the pipeline while it is enabled.
+// Disabling fails any messages which are still queued or in flight (without calling their callbacks)
+SARA_R5_error_t SARA_R5::setMQTTPublishPipeline(bool enable, int window, unsigned long ackTimeout, int retries)
+{
+  SARA_R5_LOCK_TRANSACTION(SARA_R5_PRIORITY_LOW);
+
+  if (enable == false)
   {
-    free(command);
-    return SARA_R5_ERROR_OUT_OF_MEMORY;
+    if (nullptr != _mqttPipeline)
+    {
+      SARA_R5_mqtt_message *lists[2] = {_mqttPipeline->queue, _mqttPipeline->inFlight};
+      for (int i = 0; i < 2; i++)
+      {
+        while (lists[i] != nullptr)
+        {
+          SARA_R5_mqtt_message *message = lists[i];
+          lists[i] = message->_next;
+          message->_next = nullptr;
+          message->_state = SARA_R5_MQTT_MESSAGE_FAILED;
+          message->_error = SARA_R5_ERROR_INVALID;
+        }
+      }
+      delete _mqttPipeline;
+    }
+    _mqttPipeline = nullptr;
+    return SARA_R5_ERROR_SUCCESS;
   }
 
-  sprintf(command, "%s=%d,\"%s\",%d,%d", SARA_R5_WRITE_UDP_SOCKET,
-          socket, address, port, dataLen);
-  err = sendCommandWithResponse(command, "@", response, SARA_R5_STANDARD_RESPONSE_TIMEOUT * 5);
+  if ((window < 1) || (retries < 0))
+    return SARA_R5_ERROR_UNEXPECTED_PARAM;
 
-  if (err == SARA_R5_ERROR_SUCCESS)
+  if (nullptr == _mqttPipeline)
   {
-    if (len == -1) //If binary data we need to send a length.
-    {
-      hwPrint(str);
-    }
-    else
+    _mqttPipeline = new SARA_R5_mqtt_pipeline_t;
+    if (nullptr == _mqttPipeline)
     {
-      hwWriteData(str, len);
+      if (_printDebug == true)
+        _debugPort->println(F("setMQTTPublishPipeline: not enough memory for _mqttPipeline!"));
+      return SARA_R5_ERROR_OUT_OF_MEMORY;
     }
-    err = waitForResponse(SARA_R5_RESPONSE_OK, SARA_R5_RESPONSE_ERROR, SARA_R5_SOCKET_WRITE_TIMEOUT);
-  }
-  else
-  {
-    if (_printDebug == true)
-      _debugPort->print(F("socketWriteUDP: Error: "));
-    if (_printDebug == true)
-      _debugPort->println(socketGetLastError());
+    memset(_mqttPipeline, 0, sizeof(SARA_R5_mqtt_pipeline_t));
   }
-
-  free(command);
-  free(response);
-  return err;
+  _mqttPipeline->window = window;
+  _mqttPipeline->ackTimeout = ackTimeout;
+  _mqttPipeline->retries = retries;
+  return SARA_R5_ERROR_SUCCESS;
 }
 
-SARA_R5_error_t SARA_R5::socketWriteUDP(int socket, IPAddress address, int port, const char *str, int len)
+// Add message to the end of the publish queue. It is sent as soon as the window has room - which may be straight away.
+// The message, its topic and its payload must not be destroyed or changed until it is done
+SARA_R5_error_t SARA_R5::queueMQTTPublish(SARA_R5_mqtt_message &message)
 {
-  char *charAddress = sara_r5_calloc_char(16);
-  if (charAddress == nullptr)
-    return SARA_R5_ERROR_OUT_OF_MEMORY;
-  memset(charAddress, 0, 16);
-  sprintf(charAddress, "%d.%d.%d.%d", address[0], address[1], address[2], address[3]);
+  SARA_R5_LOCK_TRANSACTION(SARA_R5_PRIORITY_LOW);
 
-  return (socketWriteUDP(socket, (const char *)charAddress, port, str, len));
+  if (nullptr == _mqttPipeline)
+    return SARA_R5_ERROR_INVALID;
+  if ((message._state == SARA_R5_MQTT_MESSAGE_QUEUED) || (message._state == SARA_R5_MQTT_MESSAGE_IN_FLIGHT)
+      || (message._topic == nullptr) || (message._payload == nullptr) || (message._qos > 2))
+    return SARA_R5_ERROR_UNEXPECTED_PARAM;
+
+  message._state = SARA_R5_MQTT_MESSAGE_QUEUED;
+  message._error = SARA_R5_ERROR_SUCCESS;
+  message._attempts = 0;
+  message._ackLatency = 0;
+  message._acked = false;
+  message._next = nullptr;
+
+  SARA_R5_mqtt_message **link = &_mqttPipeline->queue;
+  while (*link != nullptr)
+    link = &(*link)->_next;
+  *link = &message;
+
+  serviceMQTTPipeline();
+  return SARA_R5_ERROR_SUCCESS;
 }
 
-SARA_R5_error_t SARA_R5::socketWriteUDP(int socket, String address, int port, String str)
+int SARA_R5::getMQTTPublishesInFlight(void)
 {
-  return socketWriteUDP(socket, address.c_str(), port, str.c_str(), str.length());
+  if (nullptr == _mqttPipeline)
+    return 0;
+  return _mqttPipeline->inFlightCount;
 }
 
-SARA_R5_error_t SARA_R5::socketRead(int socket, int length, char *readDest, int *bytesRead)
+// Return the pipeline statistics. The publish rate is the number of delivered messages per second, measured from the
+// first publish to the latest delivery. The ack latencies (QoS 1 and 2 only) are from the publish OK to the +UUMQTTC result
+bool SARA_R5::getMQTTPublishStats(SARA_R5_mqtt_publish_stats_t *stats)
 {
-  char *command;
-  char *response;
-  char *strBegin;
-  int readIndexTotal = 0;
-  int readIndexThisRead = 0;
-  SARA_R5_error_t err;
-  int scanNum = 0;
-  int readLength = 0;
-  int socketStore = 0;
-  int bytesLeftToRead = length;
-  int bytesToRead;
-
-  // Set *bytesRead to zero
-  if (bytesRead != nullptr)
-    *bytesRead = 0;
+  if ((nullptr == _mqttPipeline) || (stats == nullptr))
+    return false;
+  stats->published = _mqttPipeline->published;
+  stats->delivered = _mqttPipeline->delivered;
+  stats->failed = _mqttPipeline->failed;
+  stats->retries = _mqttPipeline->retried;
+  stats->minAckLatency = _mqttPipeline->minAckLatency;
+  stats->maxAckLatency = _mqttPipeline->maxAckLatency;
+  stats->meanAckLatency = (_mqttPipeline->latencyCount > 0) ? (_mqttPipeline->sumAckLatency / _mqttPipeline->latencyCount) : 0;
+  unsigned long elapsed = _mqttPipeline->lastDelivery - _mqttPipeline->firstPublish;
+  stats->publishRate = (elapsed > 0) ? (((float)_mqttPipeline->delivered * 1000.0) / (float)elapsed) : 0.0;
+  return true;
+}
 
-  // Check if length is zero
-  if (length == 0)
+// Called by dispatchURCEvent for a +UUMQTTC publish result. The module reports the results in the order the messages
+// were published, so the result belongs to the oldest message in flight with the same command - unless a late result
+// is still owed for a message which timed out
+void SARA_R5::mqttPipelineResult(int command, int result)
+{
+  if (nullptr == _mqttPipeline)
+    return;
+  int *staleAcks = &_mqttPipeline->staleAcks[(command == SARA_R5_MQTT_COMMAND_PUBLISHBINARY) ? 1 : 0];
+  if (*staleAcks > 0)
   {
+    (*staleAcks)--;
     if (_printDebug == true)
-      _debugPort->print(F("socketRead: length is 0! Call socketReadAvailable?"));
-    return SARA_R5_ERROR_UNEXPECTED_PARAM;
-  }
-
-  // Allocate memory for the command
-  command = sara_r5_calloc_char(strlen(SARA_R5_READ_SOCKET) + 32);
-  if (command == nullptr)
-    return SARA_R5_ERROR_OUT_OF_MEMORY;
-
-  // Allocate memory for the response
-  // We only need enough to read _saraR5maxSocketRead bytes - not the whole thing
-  int responseLength = _saraR5maxSocketRead + strlen(SARA_R5_READ_SOCKET) + minimumResponseAllocation;
-  response = sara_r5_calloc_char(responseLength);
-  if (response == nullptr)
-  {
-    free(command);
-    return SARA_R5_ERROR_OUT_OF_MEMORY;
+      _debugPort->println(F("mqttPipelineResult: late result ignored"));
+    return;
   }
-
-  // If there are more than _saraR5maxSocketRead (1024) bytes to be read,
-  // we need to do multiple reads to get all the data
-
-  while (bytesLeftToRead > 0)
+  for (SARA_R5_mqtt_message *message = _mqttPipeline->inFlight; message != nullptr; message = message->_next)
   {
-    if (bytesLeftToRead > _saraR5maxSocketRead) // Limit a single read to _saraR5maxSocketRead
-      bytesToRead = _saraR5maxSocketRead;
-    else
-      bytesToRead = bytesLeftToRead;
+    if ((message->_acked == false) && (message->_qos > 0)
+        && (command == ((message->_binary == true) ? SARA_R5_MQTT_COMMAND_PUBLISHBINARY : SARA_R5_MQTT_COMMAND_PUBLISH)))
+    {
+      message->_acked = true; // Completed by serviceMQTTPipeline
+      message->_ackLatency = millis() - message->_sentAt;
+      if (result != 1)
+        message->_error = SARA_R5_ERROR_ERROR;
+      return;
+    }
+  }
+}
 
-    sprintf(command, "%s=%d,%d", SARA_R5_READ_SOCKET, socket, bytesToRead);
+// Called by bufferedPoll and poll. Complete the messages which have been acknowledged (or have timed out), then send
+// queued messages while the window has room
+void SARA_R5::serviceMQTTPipeline(void)
+{
+  if (nullptr == _mqttPipeline)
+    return;
 
-    err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, response,
-                                  SARA_R5_STANDARD_RESPONSE_TIMEOUT, responseLength);
+  SARA_R5_LOCK_TRANSACTION(SARA_R5_PRIORITY_LOW);
 
-    if (err != SARA_R5_ERROR_SUCCESS)
-    {
-      if (_printDebug == true)
-      {
-        _debugPort->print(F("socketRead: sendCommandWithResponse err "));
-        _debugPort->println(err);
-      }
-      free(command);
-      free(response);
-      return err;
-    }
+  bool timedOut = false;
+  for (SARA_R5_mqtt_message *message = _mqttPipeline->inFlight; message != nullptr; message = message->_next)
+  {
+    if ((message->_acked == false) && (millis() - message->_sentAt >= _mqttPipeline->ackTimeout))
+      timedOut = true;
+  }
 
-    // Extract the data
-    char *searchPtr = strstr(response, "+USORD:");
-    if (searchPtr != nullptr)
-    {
-      searchPtr += strlen("+USORD:"); //  Move searchPtr to first char
-      while (*searchPtr == ' ') searchPtr++; // skip spaces
-      scanNum = sscanf(searchPtr, "%d,%d",
-                        &socketStore, &readLength);
-    }
-    if (scanNum != 2)
+  SARA_R5_mqtt_message **link = &_mqttPipeline->inFlight;
+  if (timedOut == true)
+  {
+    // The late result would be matched to the next message. Resynchronise: the result of every unacknowledged message
+    // in the window is still owed. Count them so they can be ignored, and hold the queue until they arrive
+    SARA_R5_mqtt_message *retry = nullptr; // Sent again, ahead of the queued messages, in publish order
+    SARA_R5_mqtt_message **retryTail = &retry;
+    if (_printDebug == true)
+      _debugPort->println(F("serviceMQTTPipeline: ack timeout"));
+    _mqttPipeline->staleSince = millis();
+    while (*link != nullptr)
     {
-      if (_printDebug == true)
+      SARA_R5_mqtt_message *message = *link;
+      if (message->_acked == true)
       {
-        _debugPort->print(F("socketRead: error: scanNum is "));
-        _debugPort->println(scanNum);
+        link = &message->_next;
+        continue;
       }
-      free(command);
-      free(response);
-      return SARA_R5_ERROR_UNEXPECTED_RESPONSE;
-    }
-
-    // Check that readLength == bytesToRead
-    if (readLength != bytesToRead)
-    {
-      if (_printDebug == true)
+      _mqttPipeline->staleAcks[(message->_binary == true) ? 1 : 0]++;
+      if ((message->_qos == 1) && (message->_attempts <= _mqttPipeline->retries)) // QoS 2 is never sent twice
       {
-        _debugPort->print(F("socketRead: length mismatch! bytesToRead="));
-        _debugPort->print(bytesToRead);
-        _debugPort->print(F(" readLength="));
-        _debugPort->println(readLength);
+        *link = message->_next; // Remove it from the window
+        message->_next = nullptr;
+        _mqttPipeline->inFlightCount--;
+        _mqttPipeline->retried++;
+        message->_state = SARA_R5_MQTT_MESSAGE_QUEUED;
+        *retryTail = message;
+        retryTail = &message->_next;
+        continue;
       }
+      message->_acked = true; // No result will be matched to it now. Completed below
+      message->_error = SARA_R5_ERROR_TIMEOUT;
+      link = &message->_next;
     }
+    *retryTail = _mqttPipeline->queue;
+    _mqttPipeline->queue = retry;
+    link = &_mqttPipeline->inFlight;
+  }
 
-    // Check that readLength > 0
-    if (readLength == 0)
+  while (*link != nullptr)
+  {
+    SARA_R5_mqtt_message *message = *link;
+    if (message->_acked == false)
     {
-      if (_printDebug == true)
-      {
-        _debugPort->println(F("socketRead: zero length!"));
-      }
-      free(command);
-      free(response);
-      return SARA_R5_ERROR_ZERO_READ_LENGTH;
+      link = &message->_next;
+      continue;
     }
 
-    // Find the first double-quote:
-    strBegin = strchr(searchPtr, '\"');
+    *link = message->_next; // Remove it from the window
+    message->_next = nullptr;
+    _mqttPipeline->inFlightCount--;
 
-    if (strBegin == nullptr)
-    {
-      free(command);
-      free(response);
-      return SARA_R5_ERROR_UNEXPECTED_RESPONSE;
-    }
+    completeMQTTMessage(message);
+    if (nullptr == _mqttPipeline) // The callback disabled the pipeline
+      return;
+    link = &_mqttPipeline->inFlight; // The callback may have queued (and sent) more messages. Start again
+  }
 
-    // Now copy the data into readDest
-    readIndexThisRead = 1; // Start after the quote
-    while (readIndexThisRead < (readLength + 1))
+  if ((_mqttPipeline->staleAcks[0] > 0) || (_mqttPipeline->staleAcks[1] > 0))
+  {
+    if (millis() - _mqttPipeline->staleSince < _mqttPipeline->ackTimeout)
+      return; // Hold the queue until the late results have arrived
+    _mqttPipeline->staleAcks[0] = 0; // They are not coming
+    _mqttPipeline->staleAcks[1] = 0;
+  }
+
+  while ((_mqttPipeline->queue != nullptr) && (_mqttPipeline->inFlightCount < _mqttPipeline->window))
+  {
+    SARA_R5_mqtt_message *message = _mqttPipeline->queue;
+    SARA_R5_error_t err;
+
+    _mqttPipeline->queue = message->_next;
+    message->_next = nullptr;
+    message->_attempts++;
+
+    if (message->_binary == true)
+      err = mqttPublishBinaryMsg(String(message->_topic), message->_payload, message->_length, message->_qos, message->_retain);
+    else
+      err = mqttPublishTextMsg(String(message->_topic), message->_payload, message->_qos, message->_retain);
+
+    if (_mqttPipeline->published == 0)
+      _mqttPipeline->firstPublish = millis();
+
+    if ((err != SARA_R5_ERROR_SUCCESS) || (message->_qos == 0))
     {
-      readDest[readIndexTotal] = strBegin[readIndexThisRead];
-      readIndexTotal++;
-      readIndexThisRead++;
+      // QoS 0 messages are not acknowledged. They are done once the module has accepted them
+      message->_error = err;
+      message->_sentAt = millis();
+      if (err == SARA_R5_ERROR_SUCCESS)
+        _mqttPipeline->published++;
+      completeMQTTMessage(message);
+      if (nullptr == _mqttPipeline)
+        return;
+      continue;
     }
 
-    if (_printDebug == true)
-      _debugPort->println(F("socketRead: success"));
-
-    // Update *bytesRead
-    if (bytesRead != nullptr)
-      *bytesRead = readIndexTotal;
+    _mqttPipeline->published++;
+    message->_state = SARA_R5_MQTT_MESSAGE_IN_FLIGHT;
+    message->_sentAt = millis();
+    message->_acked = false;
+    SARA_R5_mqtt_message **tail = &_mqttPipeline->inFlight; // Keep the window in publish order
+    while (*tail != nullptr)
+      tail = &(*tail)->_next;
+    *tail = message;
+    _mqttPipeline->inFlightCount++;
+  }
+}
 
-    // How many bytes are left to read?
-    // This would have been bytesLeftToRead -= bytesToRead
-    // Except the SARA can potentially return less data than requested...
-    // So we need to subtract readLength instead.
-    bytesLeftToRead -= readLength;
-    if (_printDebug == true)
+void SARA_R5::completeMQTTMessage(SARA_R5_mqtt_message *message)
+{
+  if (message->_error == SARA_R5_ERROR_SUCCESS)
+  {
+    message->_state = SARA_R5_MQTT_MESSAGE_DELIVERED;
+    _mqttPipeline->delivered++;
+    _mqttPipeline->lastDelivery = millis();
+    if (message->_qos > 0)
     {
-      if (bytesLeftToRead > 0)
-      {
-        _debugPort->print(F("socketRead: multiple read. bytesLeftToRead: "));
-        _debugPort->println(bytesLeftToRead);
-      }
+      _mqttPipeline->latencyCount++;
+      _mqttPipeline->sumAckLatency += message->_ackLatency;
+      if ((_mqttPipeline->latencyCount == 1) || (message->_ackLatency < _mqttPipeline->minAckLatency))
+        _mqttPipeline->minAckLatency = message->_ackLatency;
+      if (message->_ackLatency > _mqttPipeline->maxAckLatency)
+        _mqttPipeline->maxAckLatency = message->_ackLatency;
     }
-  } // /while (bytesLeftToRead > 0)
+  }
+  else
+  {
+    message->_state = SARA_R5_MQTT_MESSAGE_FAILED;
+    _mqttPipeline->failed++;
+  }
 
-  free(command);
-  free(response);
+  if (message->_callback != nullptr)
+    message->_callback(message, message->_context);
+}
 
-  return SARA_R5_ERROR_SUCCESS;
+// Return false if filter is not a valid MQTT topic filter. The wildcards must fill a whole level and # must be last
+bool SARA_R5_mqtt_subscription::setFilter(const char *filter,
+                                          void (*handler)(const char *topic, int topicLength, const uint8_t *payload, int payloadLength, int qos, void *context),
+                                          void *context)
+{
+  if ((filter == nullptr) || (*filter == 0) || (handler == nullptr))
+    return false;
+  for (const char *p = filter; *p != 0; p++)
+  {
+    if ((*p == '+') || (*p == '#'))
+    {
+      if ((p != filter) && (*(p - 1) != '/'))
+        return false;
+      if ((*(p + 1) != 0) && ((*p == '#') || (*(p + 1) != '/')))
+        return false;
+    }
+  }
+  _filter = filter;
+  _handler = handler;
+  _context = context;
+  return true;
 }
 
-SARA_R5_error_t SARA_R5::socketReadAvailable(int socket, int *length)
+// Enable or disable the MQTT inbound engine. When the +UUMQTTC unread message count arrives, bufferedPoll (or poll)
+// reads the messages into one reusable buffer of bufferSize bytes, up to maxMessages per call, and passes each to the
+// subscriptions whose filters match its topic. Disabling removes all the subscriptions
+SARA_R5_error_t SARA_R5::setMQTTInbound(bool enable, int bufferSize, int maxMessages)
 {
-  char *command;
-  char *response;
-  SARA_R5_error_t err;
-  int scanNum = 0;
-  int readLength = 0;
-  int socketStore = 0;
+  SARA_R5_LOCK_TRANSACTION(SARA_R5_PRIORITY_LOW);
 
-  command = sara_r5_calloc_char(strlen(SARA_R5_READ_SOCKET) + 32);
-  if (command == nullptr)
-    return SARA_R5_ERROR_OUT_OF_MEMORY;
-  sprintf(command, "%s=%d,0", SARA_R5_READ_SOCKET, socket);
+  if ((nullptr != _mqttInbound) && (_mqttInbound->dispatching == true)) // Called by a handler
+    return SARA_R5_ERROR_INVALID;
 
-  response = sara_r5_calloc_char(minimumResponseAllocation);
-  if (response == nullptr)
+  if (enable == false)
   {
-    free(command);
-    return SARA_R5_ERROR_OUT_OF_MEMORY;
+    if (nullptr != _mqttInbound)
+    {
+      freeMQTTTopicNodes(_mqttInbound->root);
+      while (_mqttInbound->subscriptions != nullptr)
+      {
+        SARA_R5_mqtt_subscription *subscription = _mqttInbound->subscriptions;
+        _mqttInbound->subscriptions = subscription->_next;
+        subscription->_next = nullptr;
+        subscription->_nodeNext = nullptr;
+      }
+      delete[] _mqttInbound->buffer;
+      delete _mqttInbound;
+    }
+    _mqttInbound = nullptr;
+    return SARA_R5_ERROR_SUCCESS;
   }
 
-  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, response,
-                                SARA_R5_STANDARD_RESPONSE_TIMEOUT);
+  if ((bufferSize < 1) || (maxMessages < 1))
+    return SARA_R5_ERROR_UNEXPECTED_PARAM;
 
-  if (err == SARA_R5_ERROR_SUCCESS)
+  if (nullptr == _mqttInbound)
   {
-    char *searchPtr = strstr(response, "+USORD:");
-    if (searchPtr != nullptr)
+    _mqttInbound = new SARA_R5_mqtt_inbound_t;
+    if (nullptr == _mqttInbound)
     {
-      searchPtr += strlen("+USORD:"); //  Move searchPtr to first char
-      while (*searchPtr == ' ') searchPtr++; // skip spaces
-      scanNum = sscanf(searchPtr, "%d,%d",
-                        &socketStore, &readLength);
+      if (_printDebug == true)
+        _debugPort->println(F("setMQTTInbound: not enough memory for _mqttInbound!"));
+      return SARA_R5_ERROR_OUT_OF_MEMORY;
     }
-    if (scanNum != 2)
+    memset(_mqttInbound, 0, sizeof(SARA_R5_mqtt_inbound_t));
+  }
+
+  // The buffer holds the whole +UMQTTC read response: the topic, the payload and the response overhead
+  int size = bufferSize + minimumResponseAllocation;
+  if (size != _mqttInbound->bufferSize)
+  {
+    delete[] _mqttInbound->buffer;
+    _mqttInbound->buffer = new char[size + 1];
+    if (nullptr == _mqttInbound->buffer)
     {
       if (_printDebug == true)
-      {
-        _debugPort->print(F("socketReadAvailable: error: scanNum is "));
-        _debugPort->println(scanNum);
-      }
-      free(command);
-      free(response);
-      return SARA_R5_ERROR_UNEXPECTED_RESPONSE;
+        _debugPort->println(F("setMQTTInbound: not enough memory for buffer!"));
+      _mqttInbound->bufferSize = 0;
+      return SARA_R5_ERROR_OUT_OF_MEMORY;
     }
-
-    *length = readLength;
+    _mqttInbound->bufferSize = size;
   }
-
-  free(command);
-  free(response);
-
-  return err;
+  _mqttInbound->maxMessages = maxMessages;
+  return SARA_R5_ERROR_SUCCESS;
 }
 
-SARA_R5_error_t SARA_R5::socketReadUDP(int socket, int length, char *readDest,
-                                      IPAddress *remoteIPAddress, int *remotePort, int *bytesRead)
+// Add subscription to the dispatch table. This does not subscribe with the broker - call subscribeMQTTtopic too.
+// A message is passed to every subscription which matches its topic
+SARA_R5_error_t SARA_R5::addMQTTSubscriptionHandler(SARA_R5_mqtt_subscription &subscription)
 {
-  char *command;
-  char *response;
-  char *strBegin;
-  int readIndexTotal = 0;
-  int readIndexThisRead = 0;
-  SARA_R5_error_t err;
-  int scanNum = 0;
-  int remoteIPstore[4] = { 0, 0, 0, 0 };
-  int portStore = 0;
-  int readLength = 0;
-  int socketStore = 0;
-  int bytesLeftToRead = length;
-  int bytesToRead;
-
-  // Set *bytesRead to zero
-  if (bytesRead != nullptr)
-    *bytesRead = 0;
+  SARA_R5_LOCK_TRANSACTION(SARA_R5_PRIORITY_LOW);
 
-  // Check if length is zero
-  if (length == 0)
-  {
-    if (_printDebug == true)
-      _debugPort->print(F("socketReadUDP: length is 0! Call socketReadAvailableUDP?"));
+  if ((nullptr == _mqttInbound) || (_mqttInbound->dispatching == true)) // Not enabled, or called by a handler
+    return SARA_R5_ERROR_INVALID;
+  if (subscription._filter == nullptr)
     return SARA_R5_ERROR_UNEXPECTED_PARAM;
+  for (SARA_R5_mqtt_subscription *s = _mqttInbound->subscriptions; s != nullptr; s = s->_next)
+  {
+    if (s == &subscription)
+      return SARA_R5_ERROR_UNEXPECTED_PARAM; // Already added
   }
 
-  // Allocate memory for the command
-  command = sara_r5_calloc_char(strlen(SARA_R5_READ_UDP_SOCKET) + 32);
-  if (command == nullptr)
+  if (compileMQTTSubscription(&subscription) == false)
     return SARA_R5_ERROR_OUT_OF_MEMORY;
+  subscription._next = _mqttInbound->subscriptions;
+  _mqttInbound->subscriptions = &subscription;
+  return SARA_R5_ERROR_SUCCESS;
+}
 
-  // Allocate memory for the response
-  // We only need enough to read _saraR5maxSocketRead bytes - not the whole thing
-  int responseLength = _saraR5maxSocketRead + strlen(SARA_R5_READ_UDP_SOCKET) + minimumResponseAllocation;
-  response = sara_r5_calloc_char(responseLength);
-  if (response == nullptr)
+SARA_R5_error_t SARA_R5::removeMQTTSubscriptionHandler(SARA_R5_mqtt_subscription &subscription)
+{
+  SARA_R5_LOCK_TRANSACTION(SARA_R5_PRIORITY_LOW);
+
+  if ((nullptr == _mqttInbound) || (_mqttInbound->dispatching == true)) // Not enabled, or called by a handler
+    return SARA_R5_ERROR_INVALID;
+
+  SARA_R5_mqtt_subscription **link = &_mqttInbound->subscriptions;
+  while ((*link != nullptr) && (*link != &subscription))
+    link = &(*link)->_next;
+  if (*link == nullptr)
+    return SARA_R5_ERROR_UNEXPECTED_PARAM;
+  *link = subscription._next;
+  subscription._next = nullptr;
+  subscription._nodeNext = nullptr;
+
+  // Rebuild the trie from the remaining subscriptions. The list is newest first, so add them oldest first
+  // to keep the dispatch order
+  freeMQTTTopicNodes(_mqttInbound->root);
+  _mqttInbound->root = nullptr;
+  SARA_R5_error_t err = SARA_R5_ERROR_SUCCESS;
+  SARA_R5_mqtt_subscription *reversed = nullptr;
+  while (_mqttInbound->subscriptions != nullptr)
   {
-    free(command);
-    return SARA_R5_ERROR_OUT_OF_MEMORY;
+    SARA_R5_mqtt_subscription *s = _mqttInbound->subscriptions;
+    _mqttInbound->subscriptions = s->_next;
+    s->_next = reversed;
+    reversed = s;
+  }
+  while (reversed != nullptr)
+  {
+    SARA_R5_mqtt_subscription *s = reversed;
+    reversed = s->_next;
+    s->_nodeNext = nullptr;
+    if (compileMQTTSubscription(s) == false)
+      err = SARA_R5_ERROR_OUT_OF_MEMORY;
+    s->_next = _mqttInbound->subscriptions;
+    _mqttInbound->subscriptions = s;
   }
+  return err;
+}
 
-  // If there are more than _saraR5maxSocketRead (1024) bytes to be read,
-  // we need to do multiple reads to get all the data
+int SARA_R5::getMQTTMessagesPending(void)
+{
+  if (nullptr == _mqttInbound)
+    return 0;
+  return _mqttInbound->pending;
+}
 
-  while (bytesLeftToRead > 0)
-  {
-    if (bytesLeftToRead > _saraR5maxSocketRead) // Limit a single read to _saraR5maxSocketRead
-      bytesToRead = _saraR5maxSocketRead;
-    else
-      bytesToRead = bytesLeftToRead;
+// Return the inbound counters. Any of the pointers can be nullptr
+bool SARA_R5::getMQTTInboundStats(uint32_t *received, uint32_t *unmatched, uint32_t *truncated)
+{
+  if (nullptr == _mqttInbound)
+    return false;
+  if (received != nullptr)
+    *received = _mqttInbound->received;
+  if (unmatched != nullptr)
+    *unmatched = _mqttInbound->unmatched;
+  if (truncated != nullptr)
+    *truncated = _mqttInbound->truncated;
+  return true;
+}
 
-    sprintf(command, "%s=%d,%d", SARA_R5_READ_UDP_SOCKET, socket, bytesToRead);
+// Read the unread messages and dispatch them. Stops after maxMessages (see setMQTTInbound) so one burst cannot
+// hold up bufferedPoll for too long; the rest are read on the next call. Messages which do not fit in the buffer
+// are dropped and counted as truncated. If a read fails, it is tried again on the next call - up to
+// SARA_R5_MQTT_DRAIN_RETRIES times in a row. Then the pending count is dropped until the next +UUMQTTC
+SARA_R5_error_t SARA_R5::drainMQTT(int *messagesRead)
+{
+  SARA_R5_LOCK_TRANSACTION(SARA_R5_PRIORITY_LOW);
 
-    err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, response,
-                                  SARA_R5_STANDARD_RESPONSE_TIMEOUT, responseLength);
+  if (messagesRead != nullptr)
+    *messagesRead = 0;
+  if ((nullptr == _mqttInbound) || (nullptr == _mqttInbound->buffer) || (_mqttInbound->dispatching == true))
+    return SARA_R5_ERROR_INVALID;
+
+  char *command = sara_r5_calloc_char(strlen(SARA_R5_MQTT_COMMAND) + 10);
+  if (command == nullptr)
+    return SARA_R5_ERROR_OUT_OF_MEMORY;
+  sprintf(command, "%s=%d,%d", SARA_R5_MQTT_COMMAND, SARA_R5_MQTT_COMMAND_READ, 1);
+
+  // See readMQTT. The message is followed by \"\r\n\r\nOK\r\n
+  const char mqttReadTerm[] = "\"\r\n\r\nOK\r\n";
+  SARA_R5_error_t err = SARA_R5_ERROR_SUCCESS;
+  int count = 0;
+
+  while ((_mqttInbound->pending > 0) && (count < _mqttInbound->maxMessages))
+  {
+    char *buffer = _mqttInbound->buffer;
+    memset(buffer, 0, _mqttInbound->bufferSize + 1);
 
+    err = sendCommandWithResponse(command, mqttReadTerm, buffer,
+                                  (5 * SARA_R5_STANDARD_RESPONSE_TIMEOUT), _mqttInbound->bufferSize);
     if (err != SARA_R5_ERROR_SUCCESS)
     {
       if (_printDebug == true)
       {
-        _debugPort->print(F("socketReadUDP: sendCommandWithResponse err "));
+        _debugPort->print(F("drainMQTT: sendCommandWithResponse err "));
         _debugPort->println(err);
       }
-      free(command);
-      free(response);
-      return err;
+      if (++_mqttInbound->readFailures >= SARA_R5_MQTT_DRAIN_RETRIES)
+      {
+        _mqttInbound->readFailures = 0;
+        _mqttInbound->pending = 0; // Wait for the next +UUMQTTC unread count
+      }
+      break; // Keep pending. Try again on the next poll
     }
+    _mqttInbound->readFailures = 0;
+    _mqttInbound->pending--; // The module has handed the message over
 
-    // Extract the data
-    char *searchPtr = strstr(response, "+USORF:");
+    // +UMQTTC: 6,<QoS>,<topic_msg_length>,<topic_length>,"<topic>",<msg_length>,"<msg>"
+    int scanNum = 0;
+    int cmd = 0, qos = 0, totalLength = 0, topicLength = 0, dataLength = 0;
+    char *searchPtr = strstr(buffer, "+UMQTTC:");
     if (searchPtr != nullptr)
     {
-      searchPtr += strlen("+USORF:"); //  Move searchPtr to first char
+      searchPtr += strlen("+UMQTTC:"); //  Move searchPtr to first char
       while (*searchPtr == ' ') searchPtr++; // skip spaces
-      scanNum = sscanf(searchPtr, "%d,\"%d.%d.%d.%d\",%d,%d",
-                        &socketStore, &remoteIPstore[0], &remoteIPstore[1], &remoteIPstore[2], &remoteIPstore[3],
-                        &portStore, &readLength);
+      scanNum = sscanf(searchPtr, "%d,%d,%d,%d,\"", &cmd, &qos, &totalLength, &topicLength);
+      searchPtr = strchr(searchPtr, '\"');
     }
-    if (scanNum != 7)
+    if ((scanNum != 4) || (cmd != SARA_R5_MQTT_COMMAND_READ) || (searchPtr == nullptr) || (topicLength < 0))
     {
       if (_printDebug == true)
       {
-        _debugPort->print(F("socketReadUDP: error: scanNum is "));
+        _debugPort->print(F("drainMQTT: error: scanNum is "));
         _debugPort->println(scanNum);
       }
-      free(command);
-      free(response);
-      return SARA_R5_ERROR_UNEXPECTED_RESPONSE;
+      err = SARA_R5_ERROR_UNEXPECTED_RESPONSE;
+      break;
     }
 
-    // Check that readLength == bytesToRead
-    if (readLength != bytesToRead)
+    count++;
+    _mqttInbound->received++;
+    char *topic = searchPtr + 1;
+    char *payload = nullptr;
+    char *end = buffer + _mqttInbound->bufferSize;
+    if ((topic + topicLength + 2 < end) && (topic[topicLength] == '\"')
+        && (sscanf(topic + topicLength + 1, ",%d,\"", &dataLength) == 1) && (dataLength >= 0))
     {
-      if (_printDebug == true)
-      {
-        _debugPort->print(F("socketReadUDP: length mismatch! bytesToRead="));
-        _debugPort->print(bytesToRead);
-        _debugPort->print(F(" readLength="));
-        _debugPort->println(readLength);
-      }
+      payload = strchr(topic + topicLength + 1, '\"');
+      if ((payload != nullptr) && ((payload + 1 + dataLength >= end) || (payload[1 + dataLength] != '\"')))
+        payload = nullptr;
     }
-
-    // Check that readLength > 0
-    if (readLength == 0)
+    if (payload == nullptr)
     {
       if (_printDebug == true)
-      {
-        _debugPort->println(F("socketRead: zero length!"));
-      }
-      free(command);
-      free(response);
-      return SARA_R5_ERROR_ZERO_READ_LENGTH;
+        _debugPort->println(F("drainMQTT: message too long for the buffer. Dropped"));
+      _mqttInbound->truncated++;
+      continue;
     }
 
-    // Find the third double-quote
-    strBegin = strchr(searchPtr, '\"');
-    strBegin = strchr(strBegin + 1, '\"');
-    strBegin = strchr(strBegin + 1, '\"');
+    _mqttInbound->dispatching = true; // The handlers must not free the nodes or reuse the buffer under us
+    if (matchMQTTTopic(_mqttInbound->root, topic, topicLength, 0, (const uint8_t *)(payload + 1), dataLength, qos) == 0)
+      _mqttInbound->unmatched++;
+    _mqttInbound->dispatching = false;
+  }
 
-    if (strBegin == nullptr)
-    {
-      free(command);
-      free(response);
-      return SARA_R5_ERROR_UNEXPECTED_RESPONSE;
-    }
+  free(command);
+  if (messagesRead != nullptr)
+    *messagesRead = count;
+  return err;
+}
 
-    // Now copy the data into readDest
-    readIndexThisRead = 1; // Start after the quote
-    while (readIndexThisRead < (readLength + 1))
-    {
-      readDest[readIndexTotal] = strBegin[readIndexThisRead];
-      readIndexTotal++;
-      readIndexThisRead++;
-    }
+// Called by bufferedPoll and poll
+void SARA_R5::serviceMQTTInbound(void)
+{
+  if ((nullptr == _mqttInbound) || (_mqttInbound->pending <= 0))
+    return;
+  drainMQTT();
+}
 
-    // If remoteIPaddress is not nullptr, copy the remote IP address
-    if (remoteIPAddress != nullptr)
-    {
-      IPAddress tempAddress;
-      for (int i = 0; i <= 3; i++)
-      {
-        tempAddress[i] = (uint8_t)remoteIPstore[i];
-      }
-      *remoteIPAddress = tempAddress;
-    }
+// Add subscription to the trie - one node per filter level. The nodes point into the filter; they do not copy it
+bool SARA_R5::compileMQTTSubscription(SARA_R5_mqtt_subscription *subscription)
+{
+  if (nullptr == _mqttInbound->root)
+  {
+    _mqttInbound->root = new SARA_R5_mqtt_topic_node;
+    if (nullptr == _mqttInbound->root)
+      return false;
+  }
 
-    // If remotePort is not nullptr, copy the remote port
-    if (remotePort != nullptr)
+  SARA_R5_mqtt_topic_node *node = _mqttInbound->root;
+  const char *level = subscription->_filter;
+  while (true)
+  {
+    const char *end = strchr(level, '/');
+    if (end == nullptr)
+      end = level + strlen(level);
+    int length = end - level;
+
+    SARA_R5_mqtt_topic_node **link = &node->_children;
+    while ((*link != nullptr) && (((*link)->_length != length) || (memcmp((*link)->_level, level, length) != 0)))
+      link = &(*link)->_sibling;
+    if (*link == nullptr)
     {
-      *remotePort = portStore;
+      *link = new SARA_R5_mqtt_topic_node;
+      if (*link == nullptr)
+        return false;
+      (*link)->_level = level;
+      (*link)->_length = length;
     }
+    node = *link;
 
-    if (_printDebug == true)
-      _debugPort->println(F("socketReadUDP: success"));
+    if (*end == 0)
+      break;
+    level = end + 1;
+  }
 
-    // Update *bytesRead
-    if (bytesRead != nullptr)
-      *bytesRead = readIndexTotal;
+  SARA_R5_mqtt_subscription **link = &node->_subscriptions;
+  while (*link != nullptr)
+    link = &(*link)->_nodeNext;
+  *link = subscription;
+  subscription->_nodeNext = nullptr;
+  return true;
+}
 
-    // How many bytes are left to read?
-    // This would have been bytesLeftToRead -= bytesToRead
-    // Except the SARA can potentially return less data than requested...
-    // So we need to subtract readLength instead.
-    bytesLeftToRead -= readLength;
-    if (_printDebug == true)
+void SARA_R5::freeMQTTTopicNodes(SARA_R5_mqtt_topic_node *node)
+{
+  while (node != nullptr)
+  {
+    SARA_R5_mqtt_topic_node *sibling = node->_sibling;
+    freeMQTTTopicNodes(node->_children);
+    delete node;
+    node = sibling;
+  }
+}
+
+// Match the topic level starting at position against the children of node. Returns the number of handlers called.
+// Wildcards in the first level do not match topics starting with $ (MQTT 3.1.1 section 4.7.2)
+int SARA_R5::matchMQTTTopic(SARA_R5_mqtt_topic_node *node, const char *topic, int topicLength, int position,
+                            const uint8_t *payload, int payloadLength, int qos)
+{
+  if (node == nullptr)
+    return 0;
+
+  int matches = 0;
+  bool wildcards = !((position == 0) && (topicLength > 0) && (topic[0] == '$'));
+
+  if (position > topicLength) // All the levels have matched
+  {
+    for (SARA_R5_mqtt_subscription *s = node->_subscriptions; s != nullptr; s = s->_nodeNext)
     {
-      if (bytesLeftToRead > 0)
-      {
-        _debugPort->print(F("socketReadUDP: multiple read. bytesLeftToRead: "));
-        _debugPort->println(bytesLeftToRead);
-      }
+      s->_matches++;
+      s->_handler(topic, topicLength, payload, payloadLength, qos, s->_context);
+      matches++;
     }
-  } // /while (bytesLeftToRead > 0)
+    for (SARA_R5_mqtt_topic_node *child = node->_children; child != nullptr; child = child->_sibling)
+    {
+      if ((child->_length == 1) && (child->_level[0] == '#')) // "a/#" matches "a" too
+        matches += matchMQTTTopic(child, topic, topicLength, position, payload, payloadLength, qos);
+    }
+    return matches;
+  }
 
-  free(command);
-  free(response);
+  int end = position;
+  while ((end < topicLength) && (topic[end] != '/'))
+    end++;
 
-  return SARA_R5_ERROR_SUCCESS;
+  for (SARA_R5_mqtt_topic_node *child = node->_children; child != nullptr; child = child->_sibling)
+  {
+    if ((child->_length == 1) && (child->_level[0] == '#'))
+    {
+      if (wildcards)
+        matches += matchMQTTTopic(child, topic, topicLength, topicLength + 1, payload, payloadLength, qos);
+    }
+    else if ((child->_length == 1) && (child->_level[0] == '+'))
+    {
+      if (wildcards)
+        matches += matchMQTTTopic(child, topic, topicLength, end + 1, payload, payloadLength, qos);
+    }
+    else if ((child->_length == end - position) && (memcmp(child->_level, topic + position, end - position) == 0))
+      matches += matchMQTTTopic(child, topic, topicLength, end + 1, payload, payloadLength, qos);
+  }
+  return matches;
 }
 
-SARA_R5_error_t SARA_R5::socketReadAvailableUDP(int socket, int *length)
+SARA_R5_error_t SARA_R5::getMQTTprotocolError(int *error_code, int *error_code2)
 {
-  char *command;
-  char *response;
   SARA_R5_error_t err;
-  int scanNum = 0;
-  int readLength = 0;
-  int socketStore = 0;
+  char *response;
 
-  command = sara_r5_calloc_char(strlen(SARA_R5_READ_UDP_SOCKET) + 32);
-  if (command == nullptr)
-    return SARA_R5_ERROR_OUT_OF_MEMORY;
-  sprintf(command, "%s=%d,0", SARA_R5_READ_UDP_SOCKET, socket);
+  int code, code2;
 
   response = sara_r5_calloc_char(minimumResponseAllocation);
   if (response == nullptr)
   {
-    free(command);
     return SARA_R5_ERROR_OUT_OF_MEMORY;
   }
 
-  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, response,
-                                SARA_R5_STANDARD_RESPONSE_TIMEOUT);
+  err = sendCommandWithResponse(SARA_R5_MQTT_PROTOCOL_ERROR, SARA_R5_RESPONSE_OK_OR_ERROR,
+                                response, SARA_R5_STANDARD_RESPONSE_TIMEOUT);
 
   if (err == SARA_R5_ERROR_SUCCESS)
   {
-    char *searchPtr = strstr(response, "+USORF:");
+    int scanned = 0;
+    char *searchPtr = strstr(response, "+UMQTTER:");
     if (searchPtr != nullptr)
     {
-      searchPtr += strlen("+USORF:"); //  Move searchPtr to first char
+      searchPtr += strlen("+UMQTTER:"); //  Move searchPtr to first char
       while (*searchPtr == ' ') searchPtr++; // skip spaces
-      scanNum = sscanf(searchPtr, "%d,%d",
-                        &socketStore, &readLength);
+      scanned = sscanf(searchPtr, "%d,%d\r\n",
+                        &code, &code2);
     }
-    if (scanNum != 2)
+    if (scanned == 2)
     {
-      if (_printDebug == true)
-      {
-        _debugPort->print(F("socketReadAvailableUDP: error: scanNum is "));
-        _debugPort->println(scanNum);
-      }
-      free(command);
-      free(response);
-      return SARA_R5_ERROR_UNEXPECTED_RESPONSE;
+      *error_code = code;
+      *error_code2 = code2;
     }
-
-    *length = readLength;
+    else
+      err = SARA_R5_ERROR_UNEXPECTED_RESPONSE;
   }
 
-  free(command);
   free(response);
-
   return err;
 }
 
-SARA_R5_error_t SARA_R5::socketListen(int socket, unsigned int port)
+SARA_R5_error_t SARA_R5::setMQTTSNclientId(const String& clientId)
 {
-  SARA_R5_error_t err;
-  char *command;
-
-  command = sara_r5_calloc_char(strlen(SARA_R5_LISTEN_SOCKET) + 9);
-  if (command == nullptr)
-    return SARA_R5_ERROR_OUT_OF_MEMORY;
-  sprintf(command, "%s=%d,%d", SARA_R5_LISTEN_SOCKET, socket, port);
-
-  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, nullptr,
-                                SARA_R5_STANDARD_RESPONSE_TIMEOUT);
+    SARA_R5_error_t err;
+    char *command;
+    command = sara_r5_calloc_char(strlen(SARA_R5_MQTTSN_PROFILE) + clientId.length() + 10);
+    if (command == nullptr)
+      return SARA_R5_ERROR_OUT_OF_MEMORY;
+    sprintf(command, "%s=%d,\"%s\"", SARA_R5_MQTTSN_PROFILE, SARA_R5_MQTTSN_PROFILE_CLIENT_ID, clientId.c_str());
+    err = sendShadowedCommand(command, 1, SARA_R5_STANDARD_RESPONSE_TIMEOUT);
+    free(command);
+    return err;
+}
 
-  free(command);
-  return err;
+SARA_R5_error_t SARA_R5::setMQTTSNserver(const String& serverName, int port)
+{
+    SARA_R5_error_t err;
+    char *command;
+    command = sara_r5_calloc_char(strlen(SARA_R5_MQTTSN_PROFILE) + serverName.length() + 16);
+    if (command == nullptr)
+      return SARA_R5_ERROR_OUT_OF_MEMORY;
+    sprintf(command, "%s=%d,\"%s\",%d", SARA_R5_MQTTSN_PROFILE, SARA_R5_MQTTSN_PROFILE_SERVERNAME, serverName.c_str(), port);
+    err = sendShadowedCommand(command, 1, SARA_R5_STANDARD_RESPONSE_TIMEOUT);
+    free(command);
+    return err;
 }
 
-SARA_R5_error_t SARA_R5::socketDirectLinkMode(int socket)
+// Connect to the MQTT-SN gateway. The result arrives as a +UUMQTTSNC URC - see setMQTTSNCommandCallback.
+// The topic ID cache is cleared: the gateway assigns new IDs for each session
+SARA_R5_error_t SARA_R5::connectMQTTSN(void)
 {
-  SARA_R5_error_t err;
-  char *command;
+    if (nullptr == _mqttsn)
+    {
+      _mqttsn = new SARA_R5_mqttsn_t;
+      if (nullptr == _mqttsn)
+      {
+        if (_printDebug == true)
+          _debugPort->println(F("connectMQTTSN: not enough memory for _mqttsn!"));
+        return SARA_R5_ERROR_OUT_OF_MEMORY;
+      }
+      memset(_mqttsn, 0, sizeof(SARA_R5_mqttsn_t));
+    }
+    invalidateMQTTSNtopics();
+    return sendMQTTSNCommand(SARA_R5_MQTTSN_COMMAND_CONNECT, -1);
+}
 
-  command = sara_r5_calloc_char(strlen(SARA_R5_SOCKET_DIRECT_LINK) + 8);
-  if (command == nullptr)
-    return SARA_R5_ERROR_OUT_OF_MEMORY;
-  sprintf(command, "%s=%d", SARA_R5_SOCKET_DIRECT_LINK, socket);
+SARA_R5_error_t SARA_R5::disconnectMQTTSN(void)
+{
+    invalidateMQTTSNtopics();
+    return sendMQTTSNCommand(SARA_R5_MQTTSN_COMMAND_DISCONNECT, -1);
+}
 
-  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_CONNECT, nullptr,
-                                SARA_R5_STANDARD_RESPONSE_TIMEOUT);
+// Put the client to sleep for duration seconds (a DISCONNECT with a duration). The gateway buffers the messages
+// for the subscribed topics until awakeMQTTSN is called. The topic IDs remain valid
+SARA_R5_error_t SARA_R5::sleepMQTTSN(int duration)
+{
+    if (duration < 1)
+      return SARA_R5_ERROR_UNEXPECTED_PARAM;
+    return sendMQTTSNCommand(SARA_R5_MQTTSN_COMMAND_DISCONNECT, duration);
+}
 
-  free(command);
-  return err;
+// Wake the sleeping client (a PINGREQ with the client ID). The gateway then sends the buffered messages.
+// +UUMQTTSNC: 6 reports how many are waiting. Read them with readMQTTSN
+SARA_R5_error_t SARA_R5::awakeMQTTSN(void)
+{
+    return sendMQTTSNCommand(SARA_R5_MQTTSN_COMMAND_PING, -1);
 }
 
-SARA_R5_error_t SARA_R5::socketDirectLinkTimeTrigger(int socket, unsigned long timerTrigger)
+// Register topic with the gateway and add its topic ID to the cache. Returns straight away if the topic is cached.
+// Blocks until the +UUMQTTSNC register result arrives
+SARA_R5_error_t SARA_R5::registerMQTTSNtopic(const String& topic, uint16_t *topicId)
 {
-  // valid range is 0 (trigger disabled), 100-120000
-  if (!((timerTrigger == 0) || ((timerTrigger >= 100) && (timerTrigger <= 120000))))
-    return SARA_R5_ERROR_ERROR;
+  if ((topic.length() < 1) || (topic.length() >= SARA_R5_MQTTSN_TOPIC_NAME_LENGTH))
+    return SARA_R5_ERROR_INVALID;
+  if (nullptr == _mqttsn)
+    return SARA_R5_ERROR_INVALID; // Call connectMQTTSN first
 
-  SARA_R5_error_t err;
-  char *command;
+  int cached = getMQTTSNtopicId(topic);
+  if (cached > 0)
+  {
+    if (topicId != nullptr)
+      *topicId = (uint16_t)cached;
+    return SARA_R5_ERROR_SUCCESS;
+  }
 
-  command = sara_r5_calloc_char(strlen(SARA_R5_UD_CONFIGURATION) + 16);
+  SARA_R5_error_t err;
+  char *command = sara_r5_calloc_char(strlen(SARA_R5_MQTTSN_COMMAND) + 16 + topic.length());
   if (command == nullptr)
     return SARA_R5_ERROR_OUT_OF_MEMORY;
-  sprintf(command, "%s=5,%d,%ld", SARA_R5_UD_CONFIGURATION, socket, timerTrigger);
+  sprintf(command, "%s=%d,\"%s\"", SARA_R5_MQTTSN_COMMAND, SARA_R5_MQTTSN_COMMAND_REGISTER, topic.c_str());
+  err = sendMQTTSNRequest(command);
+  free(command);
+  if (err != SARA_R5_ERROR_SUCCESS)
+    return err;
 
-  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, nullptr,
-                                SARA_R5_STANDARD_RESPONSE_TIMEOUT);
+  int32_t id = 0;
+  err = waitForMQTTSNResult(SARA_R5_MQTTSN_COMMAND_REGISTER, &id);
+  if (err != SARA_R5_ERROR_SUCCESS)
+    return err;
+  if ((id <= 0) || (id > 0xFFFF))
+    return SARA_R5_ERROR_UNEXPECTED_RESPONSE;
 
-  free(command);
-  return err;
+  {
+    SARA_R5_LOCK_TRANSACTION(SARA_R5_PRIORITY_NORMAL);
+    cacheMQTTSNtopic(topic.c_str(), (uint16_t)id);
+  }
+  if (topicId != nullptr)
+    *topicId = (uint16_t)id;
+  return SARA_R5_ERROR_SUCCESS;
+}
+
+// A short topic name goes inside quotes in the +UMQTTSNC command. It must not contain a quote, a comma or a NULL
+static bool sara_r5_mqttsn_short_name_valid(char c)
+{
+  return ((c != '\"') && (c != ',') && (c != 0));
+}
+
+// Publish msg to topic. The topic is registered first if its ID is not cached, so only the 2-byte topic ID goes over
+// the air. QoS -1 needs no connection, so it cannot register: topic must then be a two character short topic name
+SARA_R5_error_t SARA_R5::publishMQTTSN(const String& topic, const char *msg, int qos, bool retain)
+{
+  if ((topic.length() == 2) && (getMQTTSNtopicId(topic) < 0))
+  {
+    if ((sara_r5_mqttsn_short_name_valid(topic.c_str()[0]) == false) || (sara_r5_mqttsn_short_name_valid(topic.c_str()[1]) == false))
+      return SARA_R5_ERROR_UNEXPECTED_PARAM;
+    uint16_t shortName = ((uint16_t)topic.c_str()[0] << 8) | (uint8_t)topic.c_str()[1];
+    return publishMQTTSN(shortName, msg, qos, retain, SARA_R5_MQTTSN_TOPIC_SHORT);
+  }
+  if (qos < 0)
+    return SARA_R5_ERROR_INVALID;
+
+  uint16_t topicId;
+  SARA_R5_error_t err = registerMQTTSNtopic(topic, &topicId);
+  if (err != SARA_R5_ERROR_SUCCESS)
+    return err;
+  return publishMQTTSN(topicId, msg, qos, retain, SARA_R5_MQTTSN_TOPIC_NORMAL);
 }
 
-SARA_R5_error_t SARA_R5::socketDirectLinkDataLengthTrigger(int socket, int dataLengthTrigger)
+// Publish msg using a topic ID (normal or predefined) or a short topic name (the two characters, high byte first).
+// qos can be -1, 0 or 1. The QoS 1 result arrives as a +UUMQTTSNC URC
+SARA_R5_error_t SARA_R5::publishMQTTSN(uint16_t topicId, const char *msg, int qos, bool retain, SARA_R5_mqttsn_topic_type_t type)
 {
-  // valid range is 0, 3-1472 for UDP
-  if (!((dataLengthTrigger == 0) || ((dataLengthTrigger >= 3) && (dataLengthTrigger <= 1472))))
-    return SARA_R5_ERROR_ERROR;
+  SARA_R5_LOCK_TRANSACTION(SARA_R5_PRIORITY_NORMAL);
 
-  SARA_R5_error_t err;
-  char *command;
+  if ((msg == nullptr) || (qos < -1) || (qos > 1))
+    return SARA_R5_ERROR_INVALID;
+  if ((type == SARA_R5_MQTTSN_TOPIC_SHORT)
+      && ((sara_r5_mqttsn_short_name_valid((char)(topicId >> 8)) == false) || (sara_r5_mqttsn_short_name_valid((char)(topicId & 0xFF)) == false)))
+    return SARA_R5_ERROR_UNEXPECTED_PARAM;
 
-  command = sara_r5_calloc_char(strlen(SARA_R5_UD_CONFIGURATION) + 16);
+  size_t msg_len = strnlen(msg, MAX_MQTT_DIRECT_MSG_LEN);
+  char *command = sara_r5_calloc_char(strlen(SARA_R5_MQTTSN_COMMAND) + 32 + msg_len);
   if (command == nullptr)
     return SARA_R5_ERROR_OUT_OF_MEMORY;
-  sprintf(command, "%s=6,%d,%d", SARA_R5_UD_CONFIGURATION, socket, dataLengthTrigger);
 
-  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, nullptr,
-                                SARA_R5_STANDARD_RESPONSE_TIMEOUT);
+  char topicC[6];
+  if (type == SARA_R5_MQTTSN_TOPIC_SHORT)
+  {
+    topicC[0] = (char)(topicId >> 8);
+    topicC[1] = (char)(topicId & 0xFF);
+    topicC[2] = 0;
+  }
+  else
+    sprintf(topicC, "%u", topicId);
+
+  // QoS -1 is encoded as 3, as in the MQTT-SN flags
+  sprintf(command, "%s=%d,%d,%d,%d,\"%s\",\"", SARA_R5_MQTTSN_COMMAND, SARA_R5_MQTTSN_COMMAND_PUBLISH,
+          (qos < 0) ? 3 : qos, (retain ? 1 : 0), (int)type, topicC);
+  char *msg_ptr = command + strlen(command);
+  for (size_t i = 0; i < msg_len; i++)
+    *msg_ptr++ = (msg[i] == '"') ? ' ' : msg[i]; // As mqttPublishTextMsg
+  *msg_ptr = '"';
 
+  SARA_R5_error_t err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, nullptr,
+                                                SARA_R5_STANDARD_RESPONSE_TIMEOUT);
   free(command);
   return err;
 }
 
-SARA_R5_error_t SARA_R5::socketDirectLinkCharacterTrigger(int socket, int characterTrigger)
+// Subscribe to topic. Blocks until the +UUMQTTSNC subscribe result arrives. For normal topic names the gateway
+// returns the topic ID, which is added to the cache
+SARA_R5_error_t SARA_R5::subscribeMQTTSNtopic(int maxQos, const String& topic, uint16_t *topicId)
 {
-  // The allowed range is -1, 0-255, the factory-programmed value is -1; -1 means trigger disabled.
-  if (!((characterTrigger >= -1) && (characterTrigger <= 255)))
-    return SARA_R5_ERROR_ERROR;
+  if ((topic.length() < 1) || (nullptr == _mqttsn))
+    return SARA_R5_ERROR_INVALID;
 
   SARA_R5_error_t err;
-  char *command;
-
-  command = sara_r5_calloc_char(strlen(SARA_R5_UD_CONFIGURATION) + 16);
+  char *command = sara_r5_calloc_char(strlen(SARA_R5_MQTTSN_COMMAND) + 16 + topic.length());
   if (command == nullptr)
     return SARA_R5_ERROR_OUT_OF_MEMORY;
-  sprintf(command, "%s=7,%d,%d", SARA_R5_UD_CONFIGURATION, socket, characterTrigger);
-
-  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, nullptr,
-                                SARA_R5_STANDARD_RESPONSE_TIMEOUT);
-
+  sprintf(command, "%s=%d,%d,%d,\"%s\"", SARA_R5_MQTTSN_COMMAND, SARA_R5_MQTTSN_COMMAND_SUBSCRIBE, maxQos,
+          (int)SARA_R5_MQTTSN_TOPIC_NORMAL, topic.c_str());
+  err = sendMQTTSNRequest(command);
   free(command);
-  return err;
+  if (err != SARA_R5_ERROR_SUCCESS)
+    return err;
+
+  int32_t id = 0;
+  err = waitForMQTTSNResult(SARA_R5_MQTTSN_COMMAND_SUBSCRIBE, &id);
+  if (err != SARA_R5_ERROR_SUCCESS)
+    return err;
+  if ((id > 0) && (id <= 0xFFFF) && (strchr(topic.c_str(), '+') == nullptr) && (strchr(topic.c_str(), '#') == nullptr)
+      && (topic.length() < SARA_R5_MQTTSN_TOPIC_NAME_LENGTH))
+  {
+    SARA_R5_LOCK_TRANSACTION(SARA_R5_PRIORITY_NORMAL);
+    cacheMQTTSNtopic(topic.c_str(), (uint16_t)id);
+  }
+  if (topicId != nullptr)
+    *topicId = (uint16_t)id;
+  return SARA_R5_ERROR_SUCCESS;
 }
 
-SARA_R5_error_t SARA_R5::socketDirectLinkCongestionTimer(int socket, unsigned long congestionTimer)
+// Unsubscribe from topic and remove its topic ID from the cache. It is registered again if it is published to
+SARA_R5_error_t SARA_R5::unsubscribeMQTTSNtopic(const String& topic)
 {
-  // valid range is 0, 1000-72000
-  if (!((congestionTimer == 0) || ((congestionTimer >= 1000) && (congestionTimer <= 72000))))
-    return SARA_R5_ERROR_ERROR;
-
+  SARA_R5_LOCK_TRANSACTION(SARA_R5_PRIORITY_NORMAL);
   SARA_R5_error_t err;
   char *command;
 
-  command = sara_r5_calloc_char(strlen(SARA_R5_UD_CONFIGURATION) + 16);
+  uncacheMQTTSNtopic(topic.c_str());
+
+  command = sara_r5_calloc_char(strlen(SARA_R5_MQTTSN_COMMAND) + 16 + topic.length());
   if (command == nullptr)
     return SARA_R5_ERROR_OUT_OF_MEMORY;
-  sprintf(command, "%s=8,%d,%ld", SARA_R5_UD_CONFIGURATION, socket, congestionTimer);
-
+  sprintf(command, "%s=%d,%d,\"%s\"", SARA_R5_MQTTSN_COMMAND, SARA_R5_MQTTSN_COMMAND_UNSUBSCRIBE,
+          (int)SARA_R5_MQTTSN_TOPIC_NORMAL, topic.c_str());
   err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, nullptr,
                                 SARA_R5_STANDARD_RESPONSE_TIMEOUT);
-
   free(command);
   return err;
 }
 
-SARA_R5_error_t SARA_R5::querySocketType(int socket, SARA_R5_socket_protocol_t *protocol)
+// Read one message from the module. +UUMQTTSNC: 6,<unread> says how many are waiting - see getMQTTSNmessagesPending.
+// Messages longer than readLength (or than the response buffer) are truncated: SARA_R5_ERROR_OUT_OF_MEMORY is returned
+SARA_R5_error_t SARA_R5::readMQTTSN(int *pQos, String *pTopic, uint8_t *readDest, int readLength, int *bytesRead)
 {
+  SARA_R5_LOCK_TRANSACTION(SARA_R5_PRIORITY_NORMAL);
   char *command;
   char *response;
   SARA_R5_error_t err;
   int scanNum = 0;
-  int socketStore = 0;
-  int paramVal;
+  int cmd = 0, qos = 0, topicType = 0, dataLength = 0;
 
-  command = sara_r5_calloc_char(strlen(SARA_R5_SOCKET_CONTROL) + 16);
+  if (bytesRead != nullptr)
+    *bytesRead = 0;
+  if (nullptr == _mqttsn)
+    return SARA_R5_ERROR_INVALID; // Call connectMQTTSN first
+  if ((readDest == nullptr) || (readLength < 0))
+    return SARA_R5_ERROR_UNEXPECTED_PARAM;
+
+  command = sara_r5_calloc_char(strlen(SARA_R5_MQTTSN_COMMAND) + 10);
   if (command == nullptr)
     return SARA_R5_ERROR_OUT_OF_MEMORY;
-  sprintf(command, "%s=%d,0", SARA_R5_SOCKET_CONTROL, socket);
-
-  response = sara_r5_calloc_char(minimumResponseAllocation);
+  int responseLength = readLength + minimumResponseAllocation;
+  response = sara_r5_calloc_char(responseLength);
   if (response == nullptr)
   {
     free(command);
     return SARA_R5_ERROR_OUT_OF_MEMORY;
   }
 
-  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, response,
-                                SARA_R5_STANDARD_RESPONSE_TIMEOUT);
-
-  if (err == SARA_R5_ERROR_SUCCESS)
+  // As readMQTT: the message is followed by \"\r\n\r\nOK\r\n
+  const char mqttsnReadTerm[] = "\"\r\n\r\nOK\r\n";
+  sprintf(command, "%s=%d", SARA_R5_MQTTSN_COMMAND, SARA_R5_MQTTSN_COMMAND_READ);
+  err = sendCommandWithResponse(command, mqttsnReadTerm, response,
+                                (5 * SARA_R5_STANDARD_RESPONSE_TIMEOUT), responseLength);
+  free(command);
+  if (err != SARA_R5_ERROR_SUCCESS)
   {
-    char *searchPtr = strstr(response, "+USOCTL:");
-    if (searchPtr != nullptr)
-    {
-      searchPtr += strlen("+USOCTL:"); //  Move searchPtr to first char
-      while (*searchPtr == ' ') searchPtr++; // skip spaces
-      scanNum = sscanf(searchPtr, "%d,0,%d",
-                        &socketStore, &paramVal);
-    }
-    if (scanNum != 2)
+    if (_printDebug == true)
     {
-      if (_printDebug == true)
-      {
-        _debugPort->print(F("querySocketType: error: scanNum is "));
-        _debugPort->println(scanNum);
-      }
-      free(command);
-      free(response);
-      return SARA_R5_ERROR_UNEXPECTED_RESPONSE;
+      _debugPort->print(F("readMQTTSN: sendCommandWithResponse err "));
+      _debugPort->println(err);
     }
-
-    *protocol = (SARA_R5_socket_protocol_t)paramVal;
-    _lastSocketProtocol[socketStore] = paramVal;
+    free(response);
+    return err;
   }
 
-  free(command);
-  free(response);
-
-  return err;
-}
-
-SARA_R5_error_t SARA_R5::querySocketLastError(int socket, int *error)
-{
-  char *command;
-  char *response;
-  SARA_R5_error_t err;
-  int scanNum = 0;
-  int socketStore = 0;
-  int paramVal;
-
-  command = sara_r5_calloc_char(strlen(SARA_R5_SOCKET_CONTROL) + 16);
-  if (command == nullptr)
-    return SARA_R5_ERROR_OUT_OF_MEMORY;
-  sprintf(command, "%s=%d,1", SARA_R5_SOCKET_CONTROL, socket);
-
-  response = sara_r5_calloc_char(minimumResponseAllocation);
-  if (response == nullptr)
+  // +UMQTTSNC: 6,<QoS>,<topic_type>,<topic>,<msg_length>,"<msg>". A topic name is quoted. A topic ID is not
+  char *topic = nullptr;
+  char *topicEnd = nullptr;
+  char *searchPtr = strstr(response, "+UMQTTSNC:");
+  if (searchPtr != nullptr)
   {
-    free(command);
-    return SARA_R5_ERROR_OUT_OF_MEMORY;
+    searchPtr += strlen("+UMQTTSNC:"); //  Move searchPtr to first char
+    while (*searchPtr == ' ') searchPtr++; // skip spaces
+    scanNum = sscanf(searchPtr, "%d,%d,%d,", &cmd, &qos, &topicType);
   }
-
-  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, response,
-                                SARA_R5_STANDARD_RESPONSE_TIMEOUT);
-
-  if (err == SARA_R5_ERROR_SUCCESS)
+  if ((scanNum == 3) && (cmd == SARA_R5_MQTTSN_COMMAND_READ))
   {
-    char *searchPtr = strstr(response, "+USOCTL:");
-    if (searchPtr != nullptr)
+    topic = searchPtr;
+    for (int commas = 0; (commas < 3) && (*topic != 0); topic++)
     {
-      searchPtr += strlen("+USOCTL:"); //  Move searchPtr to first char
-      while (*searchPtr == ' ') searchPtr++; // skip spaces
-      scanNum = sscanf(searchPtr, "%d,1,%d",
-                        &socketStore, &paramVal);
+      if (*topic == ',')
+        commas++;
     }
-    if (scanNum != 2)
+    if (*topic == '\"')
     {
-      if (_printDebug == true)
-      {
-        _debugPort->print(F("querySocketLastError: error: scanNum is "));
-        _debugPort->println(scanNum);
-      }
-      free(command);
-      free(response);
-      return SARA_R5_ERROR_UNEXPECTED_RESPONSE;
+      topic++;
+      topicEnd = strchr(topic, '\"');
+      searchPtr = (topicEnd != nullptr) ? topicEnd + 1 : nullptr;
+    }
+    else
+    {
+      topicEnd = strchr(topic, ',');
+      searchPtr = topicEnd;
     }
-
-    *error = paramVal;
   }
-
-  free(command);
-  free(response);
-
-  return err;
-}
-
-SARA_R5_error_t SARA_R5::querySocketTotalBytesSent(int socket, uint32_t *total)
-{
-  char *command;
-  char *response;
-  SARA_R5_error_t err;
-  int scanNum = 0;
-  int socketStore = 0;
-  long unsigned int paramVal;
-
-  command = sara_r5_calloc_char(strlen(SARA_R5_SOCKET_CONTROL) + 16);
-  if (command == nullptr)
-    return SARA_R5_ERROR_OUT_OF_MEMORY;
-  sprintf(command, "%s=%d,2", SARA_R5_SOCKET_CONTROL, socket);
-
-  response = sara_r5_calloc_char(minimumResponseAllocation);
-  if (response == nullptr)
+  if ((searchPtr == nullptr) || (topicEnd == nullptr) || (sscanf(searchPtr, ",%d,\"", &dataLength) != 1) || (dataLength < 0)
+      || ((searchPtr = strchr(searchPtr + 1, '\"')) == nullptr))
   {
-    free(command);
-    return SARA_R5_ERROR_OUT_OF_MEMORY;
+    if (_printDebug == true)
+    {
+      _debugPort->print(F("readMQTTSN: error: scanNum is "));
+      _debugPort->println(scanNum);
+    }
+    free(response);
+    return SARA_R5_ERROR_UNEXPECTED_RESPONSE;
   }
 
-  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, response,
-                                SARA_R5_STANDARD_RESPONSE_TIMEOUT);
-
-  if (err == SARA_R5_ERROR_SUCCESS)
+  if (pQos != nullptr)
+    *pQos = qos;
+  if (pTopic != nullptr)
   {
-    char *searchPtr = strstr(response, "+USOCTL:");
-    if (searchPtr != nullptr)
-    {
-      searchPtr += strlen("+USOCTL:"); //  Move searchPtr to first char
-      while (*searchPtr == ' ') searchPtr++; // skip spaces
-      scanNum = sscanf(searchPtr, "%d,2,%lu",
-                        &socketStore, &paramVal);
-    }
-    if (scanNum != 2)
-    {
-      if (_printDebug == true)
-      {
-        _debugPort->print(F("querySocketTotalBytesSent: error: scanNum is "));
-        _debugPort->println(scanNum);
-      }
-      free(command);
-      free(response);
-      return SARA_R5_ERROR_UNEXPECTED_RESPONSE;
-    }
+    char c = *topicEnd;
+    *topicEnd = 0; // zero terminate
+    *pTopic = topic;
+    *topicEnd = c; // restore
+  }
 
-    *total = (uint32_t)paramVal;
+  char *payload = searchPtr + 1;
+  int available = (response + responseLength - 1) - payload; // The response may have been cut short
+  if ((dataLength > readLength) || (dataLength > available))
+  {
+    dataLength = (readLength < available) ? readLength : available;
+    if (_printDebug == true)
+      _debugPort->println(F("readMQTTSN: error: truncate message"));
+    err = SARA_R5_ERROR_OUT_OF_MEMORY;
   }
+  else if (payload[dataLength] != '\"')
+  {
+    if (_printDebug == true)
+      _debugPort->println(F("readMQTTSN: error: message end"));
+    free(response);
+    return SARA_R5_ERROR_UNEXPECTED_RESPONSE;
+  }
+  memcpy(readDest, payload, dataLength);
+  if (bytesRead != nullptr)
+    *bytesRead = dataLength;
+  if (_mqttsn->unread > 0)
+    _mqttsn->unread--;
 
-  free(command);
   free(response);
-
   return err;
 }
 
-SARA_R5_error_t SARA_R5::querySocketTotalBytesReceived(int socket, uint32_t *total)
+int SARA_R5::getMQTTSNmessagesPending(void)
 {
-  char *command;
-  char *response;
-  SARA_R5_error_t err;
-  int scanNum = 0;
-  int socketStore = 0;
-  long unsigned int paramVal;
-
-  command = sara_r5_calloc_char(strlen(SARA_R5_SOCKET_CONTROL) + 16);
-  if (command == nullptr)
-    return SARA_R5_ERROR_OUT_OF_MEMORY;
-  sprintf(command, "%s=%d,3", SARA_R5_SOCKET_CONTROL, socket);
+  if (nullptr == _mqttsn)
+    return 0;
+  return _mqttsn->unread;
+}
 
-  response = sara_r5_calloc_char(minimumResponseAllocation);
-  if (response == nullptr)
+// Return the cached topic ID for topic, or -1 if it is not cached
+int SARA_R5::getMQTTSNtopicId(const String& topic)
+{
+  if (nullptr == _mqttsn)
+    return -1;
+  for (int i = 0; i < SARA_R5_MQTTSN_TOPIC_CACHE_SIZE; i++)
   {
-    free(command);
-    return SARA_R5_ERROR_OUT_OF_MEMORY;
+    if ((_mqttsn->topics[i].id != 0) && (strcmp(_mqttsn->topics[i].name, topic.c_str()) == 0))
+    {
+      _mqttsn->topics[i].lastUsed = millis();
+      return _mqttsn->topics[i].id;
+    }
   }
+  return -1;
+}
 
-  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, response,
-                                SARA_R5_STANDARD_RESPONSE_TIMEOUT);
+bool SARA_R5::getMQTTSNconnected(void)
+{
+  if (nullptr == _mqttsn)
+    return false;
+  return _mqttsn->connected;
+}
 
-  if (err == SARA_R5_ERROR_SUCCESS)
-  {
-    char *searchPtr = strstr(response, "+USOCTL:");
-    if (searchPtr != nullptr)
-    {
-      searchPtr += strlen("+USOCTL:"); //  Move searchPtr to first char
-      while (*searchPtr == ' ') searchPtr++; // skip spaces
-      scanNum = sscanf(searchPtr, "%d,3,%lu",
-                        &socketStore, &paramVal);
-    }
-    if (scanNum != 2)
+// Add topic to the cache. When the cache is full, the least recently used entry is replaced
+void SARA_R5::cacheMQTTSNtopic(const char *topic, uint16_t topicId)
+{
+  int slot = 0;
+  for (int i = 0; i < SARA_R5_MQTTSN_TOPIC_CACHE_SIZE; i++)
+  {
+    if (_mqttsn->topics[i].id == 0)
     {
-      if (_printDebug == true)
-      {
-        _debugPort->print(F("querySocketTotalBytesReceived: error: scanNum is "));
-        _debugPort->println(scanNum);
-      }
-      free(command);
-      free(response);
-      return SARA_R5_ERROR_UNEXPECTED_RESPONSE;
+      slot = i;
+      break;
     }
-
-    *total = (uint32_t)paramVal;
+    if (_mqttsn->topics[i].lastUsed < _mqttsn->topics[slot].lastUsed)
+      slot = i;
   }
+  strncpy(_mqttsn->topics[slot].name, topic, SARA_R5_MQTTSN_TOPIC_NAME_LENGTH - 1);
+  _mqttsn->topics[slot].name[SARA_R5_MQTTSN_TOPIC_NAME_LENGTH - 1] = 0;
+  _mqttsn->topics[slot].id = topicId;
+  _mqttsn->topics[slot].lastUsed = millis();
+}
 
-  free(command);
-  free(response);
+void SARA_R5::uncacheMQTTSNtopic(const char *topic)
+{
+  if (nullptr == _mqttsn)
+    return;
+  for (int i = 0; i < SARA_R5_MQTTSN_TOPIC_CACHE_SIZE; i++)
+  {
+    if ((_mqttsn->topics[i].id != 0) && (strcmp(_mqttsn->topics[i].name, topic) == 0))
+      _mqttsn->topics[i].id = 0;
+  }
+}
 
-  return err;
+void SARA_R5::invalidateMQTTSNtopics(void)
+{
+  if (nullptr == _mqttsn)
+    return;
+  for (int i = 0; i < SARA_R5_MQTTSN_TOPIC_CACHE_SIZE; i++)
+    _mqttsn->topics[i].id = 0;
+  _mqttsn->connected = false;
 }
 
-SARA_R5_error_t SARA_R5::querySocketRemoteIPAddress(int socket, IPAddress *address, int *port)
+// Send a +UMQTTSNC command with an optional numeric parameter (ignored if negative)
+SARA_R5_error_t SARA_R5::sendMQTTSNCommand(SARA_R5_mqttsn_command_opcode_t opcode, int param)
 {
-  char *command;
-  char *response;
   SARA_R5_error_t err;
-  int scanNum = 0;
-  int socketStore = 0;
-  int paramVals[5];
-
-  command = sara_r5_calloc_char(strlen(SARA_R5_SOCKET_CONTROL) + 16);
+  char *command;
+  command = sara_r5_calloc_char(strlen(SARA_R5_MQTTSN_COMMAND) + 20);
   if (command == nullptr)
     return SARA_R5_ERROR_OUT_OF_MEMORY;
-  sprintf(command, "%s=%d,4", SARA_R5_SOCKET_CONTROL, socket);
-
-  response = sara_r5_calloc_char(minimumResponseAllocation);
-  if (response == nullptr)
-  {
-    free(command);
-    return SARA_R5_ERROR_OUT_OF_MEMORY;
-  }
-
-  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, response,
+  if (param < 0)
+    sprintf(command, "%s=%d", SARA_R5_MQTTSN_COMMAND, opcode);
+  else
+    sprintf(command, "%s=%d,%d", SARA_R5_MQTTSN_COMMAND, opcode, param);
+  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, nullptr,
                                 SARA_R5_STANDARD_RESPONSE_TIMEOUT);
+  free(command);
+  return err;
+}
 
-  if (err == SARA_R5_ERROR_SUCCESS)
+// Send a +UMQTTSNC command whose result is collected with waitForMQTTSNResult. The transaction lock is only held
+// while the command is sent, not while waiting for the result
+SARA_R5_error_t SARA_R5::sendMQTTSNRequest(const char *command)
+{
+  SARA_R5_LOCK_TRANSACTION(SARA_R5_PRIORITY_NORMAL);
+  _mqttsn->resultReady = false;
+  return sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, nullptr,
+                                 SARA_R5_STANDARD_RESPONSE_TIMEOUT);
+}
+
+// Wait for the +UUMQTTSNC result of command. param is set to the command-specific value (the topic ID for register
+// and subscribe). Send the command with sendMQTTSNRequest. Fails straight away if called from a callback:
+// the result could not be delivered
+SARA_R5_error_t SARA_R5::waitForMQTTSNResult(int command, int32_t *param)
+{
+  unsigned long startTime = millis();
+  while ((_mqttsn->resultReady == false) || (_mqttsn->command != command))
   {
-    char *searchPtr = strstr(response, "+USOCTL:");
-    if (searchPtr != nullptr)
-    {
-      searchPtr += strlen("+USOCTL:"); //  Move searchPtr to first char
-      while (*searchPtr == ' ') searchPtr++; // skip spaces
-      scanNum = sscanf(searchPtr, "%d,4,\"%d.%d.%d.%d\",%d",
-                        &socketStore,
-                        &paramVals[0], &paramVals[1], &paramVals[2], &paramVals[3],
-                        &paramVals[4]);
-    }
-    if (scanNum != 6)
+    if (insideBufferedPoll() == true)
+      return SARA_R5_ERROR_INVALID;
+    if (millis() - startTime >= SARA_R5_MQTTSN_RESPONSE_TIMEOUT)
     {
-      if (_printDebug == true)
-      {
-        _debugPort->print(F("querySocketRemoteIPAddress: error: scanNum is "));
-        _debugPort->println(scanNum);
-      }
-      free(command);
-      free(response);
-      return SARA_R5_ERROR_UNEXPECTED_RESPONSE;
+      // The result may still arrive. It must not be taken as the result of the next request
+      SARA_R5_LOCK_TRANSACTION(SARA_R5_PRIORITY_NORMAL);
+      _mqttsn->staleResults[command]++;
+      _mqttsn->staleSince[command] = millis();
+      return SARA_R5_ERROR_TIMEOUT;
     }
-
-    IPAddress tempAddress = { (uint8_t)paramVals[0], (uint8_t)paramVals[1],
-                              (uint8_t)paramVals[2], (uint8_t)paramVals[3] };
-    *address = tempAddress;
-    *port = paramVals[4];
+    bufferedPoll();
+    delay(1);
   }
+  _mqttsn->resultReady = false;
 
-  free(command);
-  free(response);
+  if (param != nullptr)
+    *param = _mqttsn->param;
+  return (_mqttsn->result == 1) ? SARA_R5_ERROR_SUCCESS : SARA_R5_ERROR_ERROR;
+}
 
-  return err;
+SARA_R5_error_t SARA_R5::setFTPserver(const String& serverName)
+{
+  constexpr size_t cmd_len = 145;
+  char command[cmd_len]; // long enough for AT+UFTP=1,<128 bytes>
+
+  snprintf(command, cmd_len - 1, "%s=%d,\"%s\"", SARA_R5_FTP_PROFILE, SARA_R5_FTP_PROFILE_SERVERNAME, serverName.c_str());
+  return sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, nullptr,
+                                 SARA_R5_STANDARD_RESPONSE_TIMEOUT);
 }
 
-SARA_R5_error_t SARA_R5::querySocketStatusTCP(int socket, SARA_R5_tcp_socket_status_t *status)
+SARA_R5_error_t SARA_R5::setFTPtimeouts(const unsigned int timeout, const unsigned int cmd_linger, const unsigned int data_linger)
 {
-  char *command;
-  char *response;
-  SARA_R5_error_t err;
-  int scanNum = 0;
-  int socketStore = 0;
-  int paramVal;
+  constexpr size_t cmd_len = 64;
+  char command[cmd_len]; // long enough for AT+UFTP=1,<128 bytes>
 
-  command = sara_r5_calloc_char(strlen(SARA_R5_SOCKET_CONTROL) + 16);
-  if (command == nullptr)
-    return SARA_R5_ERROR_OUT_OF_MEMORY;
-  sprintf(command, "%s=%d,10", SARA_R5_SOCKET_CONTROL, socket);
+  snprintf(command, cmd_len - 1, "%s=%d,%u,%u,%u", SARA_R5_FTP_PROFILE, SARA_R5_FTP_PROFILE_TIMEOUT, timeout, cmd_linger, data_linger);
+  return sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, nullptr,
+                                 SARA_R5_STANDARD_RESPONSE_TIMEOUT);
+}
 
-  response = sara_r5_calloc_char(minimumResponseAllocation);
-  if (response == nullptr)
-  {
-    free(command);
-    return SARA_R5_ERROR_OUT_OF_MEMORY;
-  }
+SARA_R5_error_t SARA_R5::setFTPcredentials(const String& userName, const String& pwd)
+{
+  SARA_R5_error_t err;
+  constexpr size_t cmd_len = 48;
+  char command[cmd_len]; // long enough for AT+UFTP=n,<30 bytes>
 
-  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, response,
+  snprintf(command, cmd_len - 1, "%s=%d,\"%s\"", SARA_R5_FTP_PROFILE, SARA_R5_FTP_PROFILE_USERNAME, userName.c_str());
+  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, nullptr,
                                 SARA_R5_STANDARD_RESPONSE_TIMEOUT);
-
-  if (err == SARA_R5_ERROR_SUCCESS)
+  if (err != SARA_R5_ERROR_SUCCESS)
   {
-    char *searchPtr = strstr(response, "+USOCTL:");
-    if (searchPtr != nullptr)
-    {
-      searchPtr += strlen("+USOCTL:"); //  Move searchPtr to first char
-      while (*searchPtr == ' ') searchPtr++; // skip spaces
-      scanNum = sscanf(searchPtr, "%d,10,%d",
-                        &socketStore, &paramVal);
-    }
-    if (scanNum != 2)
-    {
-      if (_printDebug == true)
-      {
-        _debugPort->print(F("querySocketStatusTCP: error: scanNum is "));
-        _debugPort->println(scanNum);
-      }
-      free(command);
-      free(response);
-      return SARA_R5_ERROR_UNEXPECTED_RESPONSE;
-    }
-
-    *status = (SARA_R5_tcp_socket_status_t)paramVal;
+    return err;
   }
 
-  free(command);
-  free(response);
+  snprintf(command, cmd_len - 1, "%s=%d,\"%s\"", SARA_R5_FTP_PROFILE, SARA_R5_FTP_PROFILE_PWD, pwd.c_str());
+  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, nullptr,
+                                SARA_R5_STANDARD_RESPONSE_TIMEOUT);
 
   return err;
 }
 
-SARA_R5_error_t SARA_R5::querySocketOutUnackData(int socket, uint32_t *total)
+SARA_R5_error_t SARA_R5::connectFTP(void)
 {
-  char *command;
-  char *response;
-  SARA_R5_error_t err;
-  int scanNum = 0;
-  int socketStore = 0;
-  long unsigned int paramVal;
+  constexpr size_t cmd_len = 16;
+  char command[cmd_len]; // long enough for AT+UFTPC=n
 
-  command = sara_r5_calloc_char(strlen(SARA_R5_SOCKET_CONTROL) + 16);
-  if (command == nullptr)
-    return SARA_R5_ERROR_OUT_OF_MEMORY;
-  sprintf(command, "%s=%d,11", SARA_R5_SOCKET_CONTROL, socket);
+  snprintf(command, cmd_len - 1, "%s=%d", SARA_R5_FTP_COMMAND, SARA_R5_FTP_COMMAND_LOGIN);
+  return sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, nullptr,
+                                 SARA_R5_STANDARD_RESPONSE_TIMEOUT);
+}
 
-  response = sara_r5_calloc_char(minimumResponseAllocation);
-  if (response == nullptr)
+SARA_R5_error_t SARA_R5::disconnectFTP(void)
+{
+  constexpr size_t cmd_len = 16;
+  char command[cmd_len]; // long enough for AT+UFTPC=n
+
+  snprintf(command, cmd_len - 1, "%s=%d", SARA_R5_FTP_COMMAND, SARA_R5_FTP_COMMAND_LOGOUT);
+  return sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, nullptr,
+                                 SARA_R5_STANDARD_RESPONSE_TIMEOUT);
+}
+
+SARA_R5_error_t SARA_R5::ftpGetFile(const String& filename)
+{
+  char * command = sara_r5_calloc_char(strlen(SARA_R5_FTP_COMMAND) + (2 * filename.length()) + 16);
+  if (command == nullptr)
   {
-    free(command);
     return SARA_R5_ERROR_OUT_OF_MEMORY;
   }
 
-  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, response,
-                                SARA_R5_STANDARD_RESPONSE_TIMEOUT);
-
+  sprintf(command, "%s=%d,\"%s\",\"%s\"", SARA_R5_FTP_COMMAND, SARA_R5_FTP_COMMAND_GET_FILE, filename.c_str(), filename.c_str());
+  //memset(response, 0, sizeof(response));
+  //sendCommandWithResponse(command, SARA_R5_RESPONSE_CONNECT, response, 8000 /* ms */, response_len);
+  SARA_R5_error_t err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, nullptr,
+                                                SARA_R5_STANDARD_RESPONSE_TIMEOUT);
   if (err == SARA_R5_ERROR_SUCCESS)
-  {
-    char *searchPtr = strstr(response, "+USOCTL:");
-    if (searchPtr != nullptr)
-    {
-      searchPtr += strlen("+USOCTL:"); //  Move searchPtr to first char
-      while (*searchPtr == ' ') searchPtr++; // skip spaces
-      scanNum = sscanf(searchPtr, "%d,11,%lu",
-                        &socketStore, &paramVal);
-    }
-    if (scanNum != 2)
-    {
-      if (_printDebug == true)
-      {
-        _debugPort->print(F("querySocketOutUnackData: error: scanNum is "));
-        _debugPort->println(scanNum);
-      }
-      free(command);
-      free(response);
-      return SARA_R5_ERROR_UNEXPECTED_RESPONSE;
-    }
-
-    *total = (uint32_t)paramVal;
-  }
+    fileIndexPending(SARA_R5_NUM_HTTP_PROFILES, filename.c_str());
 
   free(command);
-  free(response);
-
   return err;
 }
 
-//Issues command to get last socket error, then prints to serial. Also updates rx/backlog buffers.
-int SARA_R5::socketGetLastError()
+SARA_R5_error_t SARA_R5::getFTPprotocolError(int *error_code, int *error_code2)
 {
   SARA_R5_error_t err;
-  char *command;
   char *response;
-  int errorCode = -1;
 
-  command = sara_r5_calloc_char(64);
-  if (command == nullptr)
-    return SARA_R5_ERROR_OUT_OF_MEMORY;
+  int code, code2;
 
   response = sara_r5_calloc_char(minimumResponseAllocation);
   if (response == nullptr)
   {
-    free(command);
     return SARA_R5_ERROR_OUT_OF_MEMORY;
   }
 
-  sprintf(command, "%s", SARA_R5_GET_ERROR);
-
-  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, response,
-                                SARA_R5_STANDARD_RESPONSE_TIMEOUT);
+  err = sendCommandWithResponse(SARA_R5_FTP_PROTOCOL_ERROR, SARA_R5_RESPONSE_OK_OR_ERROR,
+                                response, SARA_R5_STANDARD_RESPONSE_TIMEOUT);
 
   if (err == SARA_R5_ERROR_SUCCESS)
   {
-    char *searchPtr = strstr(response, "+USOER:");
+    int scanned = 0;
+    char *searchPtr = strstr(response, "+UFTPER:");
     if (searchPtr != nullptr)
     {
-      searchPtr += strlen("+USOER:"); //  Move searchPtr to first char
-      while (*searchPtr == ' ') searchPtr++; // skip spaces
-      sscanf(searchPtr, "%d", &errorCode);
+      searchPtr += strlen("+UFTPER:"); //  Move searchPtr to first char
+      while (*searchPtr == ' ')
+      {
+        searchPtr++; // skip spaces
+      }
+      scanned = sscanf(searchPtr, "%d,%d\r\n", &code, &code2);
+    }
+
+    if (scanned == 2)
+    {
+      *error_code = code;
+      *error_code2 = code2;
+    }
+    else
+    {
+      err = SARA_R5_ERROR_UNEXPECTED_RESPONSE;
     }
   }
 
-  free(command);
   free(response);
-
-  return errorCode;
+  return err;
 }
 
-IPAddress SARA_R5::lastRemoteIP(void)
+SARA_R5_error_t SARA_R5::resetSecurityProfile(int secprofile)
 {
-  return _lastRemoteIP;
-}
+  invalidateConfigShadow(); // The profile is reset
 
-SARA_R5_error_t SARA_R5::resetHTTPprofile(int profile)
-{
   SARA_R5_error_t err;
   char *command;
 
-  if (profile >= SARA_R5_NUM_HTTP_PROFILES)
-    return SARA_R5_ERROR_ERROR;
-
-  command = sara_r5_calloc_char(strlen(SARA_R5_HTTP_PROFILE) + 16);
+  command = sara_r5_calloc_char(strlen(SARA_R5_SEC_PROFILE) + 6);
   if (command == nullptr)
     return SARA_R5_ERROR_OUT_OF_MEMORY;
-  sprintf(command, "%s=%d", SARA_R5_HTTP_PROFILE, profile);
+
+  sprintf(command, "%s=%d", SARA_R5_SEC_PROFILE, secprofile);
 
   err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, nullptr,
                                 SARA_R5_STANDARD_RESPONSE_TIMEOUT);
@@ -3939,124 +8568,164 @@ SARA_R5_error_t SARA_R5::resetHTTPprofile(int profile)
   return err;
 }
 
-SARA_R5_error_t SARA_R5::setHTTPserverIPaddress(int profile, IPAddress address)
+SARA_R5_error_t SARA_R5::configSecurityProfile(int secprofile, SARA_R5_sec_profile_parameter_t parameter, int value)
 {
-  SARA_R5_error_t err;
-  char *command;
-
-  if (profile >= SARA_R5_NUM_HTTP_PROFILES)
-    return SARA_R5_ERROR_ERROR;
-
-  command = sara_r5_calloc_char(strlen(SARA_R5_HTTP_PROFILE) + 64);
-  if (command == nullptr)
-    return SARA_R5_ERROR_OUT_OF_MEMORY;
-  sprintf(command, "%s=%d,%d,\"%d.%d.%d.%d\"", SARA_R5_HTTP_PROFILE, profile, SARA_R5_HTTP_OP_CODE_SERVER_IP,
-          address[0], address[1], address[2], address[3]);
+    SARA_R5_error_t err;
+    char *command;
 
-  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, nullptr,
-                                SARA_R5_STANDARD_RESPONSE_TIMEOUT);
+    command = sara_r5_calloc_char(strlen(SARA_R5_SEC_PROFILE) + 10);
+    if (command == nullptr)
+      return SARA_R5_ERROR_OUT_OF_MEMORY;
+    sprintf(command, "%s=%d,%d,%d", SARA_R5_SEC_PROFILE, secprofile,parameter,value);
+    err = sendShadowedCommand(command, 2, SARA_R5_STANDARD_RESPONSE_TIMEOUT);
+    free(command);
+    return err;
+}
 
-  free(command);
-  return err;
+SARA_R5_error_t SARA_R5::configSecurityProfileString(int secprofile, SARA_R5_sec_profile_parameter_t parameter, String value)
+{
+    SARA_R5_error_t err;
+    char *command;
+    command = sara_r5_calloc_char(strlen(SARA_R5_SEC_PROFILE) + value.length() + 10);
+    if (command == nullptr)
+      return SARA_R5_ERROR_OUT_OF_MEMORY;
+    sprintf(command, "%s=%d,%d,\"%s\"", SARA_R5_SEC_PROFILE, secprofile,parameter,value.c_str());
+    err = sendShadowedCommand(command, 2, SARA_R5_STANDARD_RESPONSE_TIMEOUT);
+    free(command);
+    return err;
 }
 
-SARA_R5_error_t SARA_R5::setHTTPserverName(int profile, String server)
+SARA_R5_error_t SARA_R5::setSecurityManager(SARA_R5_sec_manager_opcode_t opcode, SARA_R5_sec_manager_parameter_t parameter, String name, String data)
 {
-  SARA_R5_error_t err;
-  char *command;
+  SARA_R5_LOCK_TRANSACTION(SARA_R5_PRIORITY_NORMAL);
 
-  if (profile >= SARA_R5_NUM_HTTP_PROFILES)
-    return SARA_R5_ERROR_ERROR;
+  char *command;
+  char *response;
+  SARA_R5_error_t err;
 
-  command = sara_r5_calloc_char(strlen(SARA_R5_HTTP_PROFILE) + 12 + server.length());
+  command = sara_r5_calloc_char(strlen(SARA_R5_SEC_MANAGER) + name.length() + 20);
   if (command == nullptr)
     return SARA_R5_ERROR_OUT_OF_MEMORY;
-  sprintf(command, "%s=%d,%d,\"%s\"", SARA_R5_HTTP_PROFILE, profile, SARA_R5_HTTP_OP_CODE_SERVER_NAME,
-          server.c_str());
+  response = sara_r5_calloc_char(minimumResponseAllocation);
+  if (response == nullptr)
+  {
+    free(command);
+    return SARA_R5_ERROR_OUT_OF_MEMORY;
+  }
+  int dataLen = data.length();
+  sprintf(command, "%s=%d,%d,\"%s\",%d", SARA_R5_SEC_MANAGER, opcode, parameter, name.c_str(), dataLen);
 
-  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, nullptr,
-                                SARA_R5_STANDARD_RESPONSE_TIMEOUT);
+  err = sendCommandWithResponse(command, ">", response, SARA_R5_STANDARD_RESPONSE_TIMEOUT);
+  if (err == SARA_R5_ERROR_SUCCESS)
+  {
+    if (_printDebug == true)
+    {
+      _debugPort->print(F("dataDownload: writing "));
+      _debugPort->print(dataLen);
+      _debugPort->println(F(" bytes"));
+    }
+    hwWriteData(data.c_str(), dataLen);
+    err = waitForResponse(SARA_R5_RESPONSE_OK, SARA_R5_RESPONSE_ERROR, SARA_R5_SECURITY_RESPONSE_TIMEOUT);
+  }
+
+
+  if (err != SARA_R5_ERROR_SUCCESS)
+  {
+    if (_printDebug == true)
+    {
+      _debugPort->print(F("dataDownload: Error: "));
+      _debugPort->print(err);
+      _debugPort->print(F(" => {"));
+      _debugPort->print(response);
+      _debugPort->println(F("}"));
+    }
+  }
 
   free(command);
+  free(response);
   return err;
 }
 
-SARA_R5_error_t SARA_R5::setHTTPusername(int profile, String username)
+SARA_R5_error_t SARA_R5::setPDPconfiguration(int profile, SARA_R5_pdp_configuration_parameter_t parameter, int value)
 {
   SARA_R5_error_t err;
   char *command;
 
-  if (profile >= SARA_R5_NUM_HTTP_PROFILES)
+  if (profile >= SARA_R5_NUM_PSD_PROFILES)
     return SARA_R5_ERROR_ERROR;
 
-  command = sara_r5_calloc_char(strlen(SARA_R5_HTTP_PROFILE) + 12 + username.length());
+  command = sara_r5_calloc_char(strlen(SARA_R5_MESSAGE_PDP_CONFIG) + 24);
   if (command == nullptr)
     return SARA_R5_ERROR_OUT_OF_MEMORY;
-  sprintf(command, "%s=%d,%d,\"%s\"", SARA_R5_HTTP_PROFILE, profile, SARA_R5_HTTP_OP_CODE_USERNAME,
-          username.c_str());
+  sprintf(command, "%s=%d,%d,%d", SARA_R5_MESSAGE_PDP_CONFIG, profile, parameter,
+          value);
 
-  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, nullptr,
-                                SARA_R5_STANDARD_RESPONSE_TIMEOUT);
+  err = sendShadowedCommand(command, 2, SARA_R5_STANDARD_RESPONSE_TIMEOUT);
 
   free(command);
   return err;
 }
 
-SARA_R5_error_t SARA_R5::setHTTPpassword(int profile, String password)
+SARA_R5_error_t SARA_R5::setPDPconfiguration(int profile, SARA_R5_pdp_configuration_parameter_t parameter, SARA_R5_pdp_protocol_type_t value)
+{
+  return (setPDPconfiguration(profile, parameter, (int)value));
+}
+
+SARA_R5_error_t SARA_R5::setPDPconfiguration(int profile, SARA_R5_pdp_configuration_parameter_t parameter, String value)
 {
   SARA_R5_error_t err;
   char *command;
 
-  if (profile >= SARA_R5_NUM_HTTP_PROFILES)
+  if (profile >= SARA_R5_NUM_PSD_PROFILES)
     return SARA_R5_ERROR_ERROR;
 
-  command = sara_r5_calloc_char(strlen(SARA_R5_HTTP_PROFILE) + 12 + password.length());
+  command = sara_r5_calloc_char(strlen(SARA_R5_MESSAGE_PDP_CONFIG) + 64);
   if (command == nullptr)
     return SARA_R5_ERROR_OUT_OF_MEMORY;
-  sprintf(command, "%s=%d,%d,\"%s\"", SARA_R5_HTTP_PROFILE, profile, SARA_R5_HTTP_OP_CODE_PASSWORD,
-          password.c_str());
+  sprintf(command, "%s=%d,%d,\"%s\"", SARA_R5_MESSAGE_PDP_CONFIG, profile, parameter,
+          value.c_str());
 
-  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, nullptr,
-                                SARA_R5_STANDARD_RESPONSE_TIMEOUT);
+  err = sendShadowedCommand(command, 2, SARA_R5_STANDARD_RESPONSE_TIMEOUT);
 
   free(command);
   return err;
 }
 
-SARA_R5_error_t SARA_R5::setHTTPauthentication(int profile, bool authenticate)
+SARA_R5_error_t SARA_R5::setPDPconfiguration(int profile, SARA_R5_pdp_configuration_parameter_t parameter, IPAddress value)
 {
   SARA_R5_error_t err;
   char *command;
 
-  if (profile >= SARA_R5_NUM_HTTP_PROFILES)
+  if (profile >= SARA_R5_NUM_PSD_PROFILES)
     return SARA_R5_ERROR_ERROR;
 
-  command = sara_r5_calloc_char(strlen(SARA_R5_HTTP_PROFILE) + 32);
+  command = sara_r5_calloc_char(strlen(SARA_R5_MESSAGE_PDP_CONFIG) + 64);
   if (command == nullptr)
     return SARA_R5_ERROR_OUT_OF_MEMORY;
-  sprintf(command, "%s=%d,%d,%d", SARA_R5_HTTP_PROFILE, profile, SARA_R5_HTTP_OP_CODE_AUTHENTICATION,
-          authenticate);
+  sprintf(command, "%s=%d,%d,\"%d.%d.%d.%d\"", SARA_R5_MESSAGE_PDP_CONFIG, profile, parameter,
+          value[0], value[1], value[2], value[3]);
 
-  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, nullptr,
-                                SARA_R5_STANDARD_RESPONSE_TIMEOUT);
+  err = sendShadowedCommand(command, 2, SARA_R5_STANDARD_RESPONSE_TIMEOUT);
 
   free(command);
   return err;
 }
 
-SARA_R5_error_t SARA_R5::setHTTPserverPort(int profile, int port)
+SARA_R5_error_t SARA_R5::performPDPaction(int profile, SARA_R5_pdp_actions_t action)
 {
+  if ((action == SARA_R5_PSD_ACTION_RESET) || (action == SARA_R5_PSD_ACTION_LOAD))
+    invalidateConfigShadow(); // The profile is reset or loaded from NVM
+
   SARA_R5_error_t err;
   char *command;
 
-  if (profile >= SARA_R5_NUM_HTTP_PROFILES)
+  if (profile >= SARA_R5_NUM_PSD_PROFILES)
     return SARA_R5_ERROR_ERROR;
 
-  command = sara_r5_calloc_char(strlen(SARA_R5_HTTP_PROFILE) + 32);
+  command = sara_r5_calloc_char(strlen(SARA_R5_MESSAGE_PDP_ACTION) + 32);
   if (command == nullptr)
     return SARA_R5_ERROR_OUT_OF_MEMORY;
-  sprintf(command, "%s=%d,%d,%d", SARA_R5_HTTP_PROFILE, profile, SARA_R5_HTTP_OP_CODE_SERVER_PORT,
-          port);
+  sprintf(command, "%s=%d,%d", SARA_R5_MESSAGE_PDP_ACTION, profile, action);
 
   err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, nullptr,
                                 SARA_R5_STANDARD_RESPONSE_TIMEOUT);
@@ -4065,19 +8734,21 @@ SARA_R5_error_t SARA_R5::setHTTPserverPort(int profile, int port)
   return err;
 }
 
-SARA_R5_error_t SARA_R5::setHTTPcustomHeader(int profile, String header)
+SARA_R5_error_t SARA_R5::activatePDPcontext(bool status, int cid)
 {
   SARA_R5_error_t err;
   char *command;
 
-  if (profile >= SARA_R5_NUM_HTTP_PROFILES)
+  if (cid >= SARA_R5_NUM_PDP_CONTEXT_IDENTIFIERS)
     return SARA_R5_ERROR_ERROR;
 
-  command = sara_r5_calloc_char(strlen(SARA_R5_HTTP_PROFILE) + 12 + header.length());
+  command = sara_r5_calloc_char(strlen(SARA_R5_MESSAGE_PDP_CONTEXT_ACTIVATE) + 32);
   if (command == nullptr)
     return SARA_R5_ERROR_OUT_OF_MEMORY;
-  sprintf(command, "%s=%d,%d,\"%s\"", SARA_R5_HTTP_PROFILE, profile, SARA_R5_HTTP_OP_CODE_ADD_CUSTOM_HEADERS,
-          header.c_str());
+  if (cid == -1)
+    sprintf(command, "%s=%d", SARA_R5_MESSAGE_PDP_CONTEXT_ACTIVATE, status);
+  else
+    sprintf(command, "%s=%d,%d", SARA_R5_MESSAGE_PDP_CONTEXT_ACTIVATE, status, cid);
 
   err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, nullptr,
                                 SARA_R5_STANDARD_RESPONSE_TIMEOUT);
@@ -4086,130 +8757,236 @@ SARA_R5_error_t SARA_R5::setHTTPcustomHeader(int profile, String header)
   return err;
 }
 
-SARA_R5_error_t SARA_R5::setHTTPsecure(int profile, bool secure, int secprofile)
+SARA_R5_error_t SARA_R5::getNetworkAssignedIPAddress(int profile, IPAddress *address)
 {
-  SARA_R5_error_t err;
   char *command;
+  char *response;
+  SARA_R5_error_t err;
+  int scanNum = 0;
+  int profileStore = 0;
+  int paramTag = 0; // 0: IP address: dynamic IP address assigned during PDP context activation
+  int paramVals[4];
 
-  if (profile >= SARA_R5_NUM_HTTP_PROFILES)
-    return SARA_R5_ERROR_ERROR;
-
-  command = sara_r5_calloc_char(strlen(SARA_R5_HTTP_PROFILE) + 32);
+  command = sara_r5_calloc_char(strlen(SARA_R5_NETWORK_ASSIGNED_DATA) + 16);
   if (command == nullptr)
     return SARA_R5_ERROR_OUT_OF_MEMORY;
-  if ((secprofile == -1) || !secure) 
-      sprintf(command, "%s=%d,%d,%d", SARA_R5_HTTP_PROFILE, profile, SARA_R5_HTTP_OP_CODE_SECURE,
-          secure);
-  else sprintf(command, "%s=%d,%d,%d,%d", SARA_R5_HTTP_PROFILE, profile, SARA_R5_HTTP_OP_CODE_SECURE,
-        secure, secprofile);
+  sprintf(command, "%s=%d,%d", SARA_R5_NETWORK_ASSIGNED_DATA, profile, paramTag);
 
-  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, nullptr,
+  response = sara_r5_calloc_char(minimumResponseAllocation);
+  if (response == nullptr)
+  {
+    free(command);
+    return SARA_R5_ERROR_OUT_OF_MEMORY;
+  }
+
+  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, response,
                                 SARA_R5_STANDARD_RESPONSE_TIMEOUT);
 
+  if (err == SARA_R5_ERROR_SUCCESS)
+  {
+    char *searchPtr = strstr(response, "+UPSND:");
+    if (searchPtr != nullptr)
+    {
+      searchPtr += strlen("+UPSND:"); //  Move searchPtr to first char
+      while (*searchPtr == ' ') searchPtr++; // skip spaces
+      scanNum = sscanf(searchPtr, "%d,%d,\"%d.%d.%d.%d\"",
+                        &profileStore, &paramTag,
+                        &paramVals[0], &paramVals[1], &paramVals[2], &paramVals[3]);
+    }
+    if (scanNum != 6)
+    {
+      if (_printDebug == true)
+      {
+        _debugPort->print(F("getNetworkAssignedIPAddress: error: scanNum is "));
+        _debugPort->println(scanNum);
+      }
+      free(command);
+      free(response);
+      return SARA_R5_ERROR_UNEXPECTED_RESPONSE;
+    }
+
+    IPAddress tempAddress = { (uint8_t)paramVals[0], (uint8_t)paramVals[1],
+                              (uint8_t)paramVals[2], (uint8_t)paramVals[3] };
+    *address = tempAddress;
+  }
+
   free(command);
+  free(response);
+
   return err;
 }
 
-SARA_R5_error_t SARA_R5::ping(String remote_host, int retry, int p_size,
-                              unsigned long timeout, int ttl)
+bool SARA_R5::isGPSon(void)
 {
   SARA_R5_error_t err;
   char *command;
+  char *response;
+  bool on = false;
 
-  command = sara_r5_calloc_char(strlen(SARA_R5_PING_COMMAND) + 48 +
-                                remote_host.length());
+  command = sara_r5_calloc_char(strlen(SARA_R5_GNSS_POWER) + 2);
   if (command == nullptr)
     return SARA_R5_ERROR_OUT_OF_MEMORY;
-  sprintf(command, "%s=\"%s\",%d,%d,%ld,%d", SARA_R5_PING_COMMAND,
-          remote_host.c_str(), retry, p_size, timeout, ttl);
+  sprintf(command, "%s?", SARA_R5_GNSS_POWER);
 
-  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, nullptr,
-                                SARA_R5_STANDARD_RESPONSE_TIMEOUT);
+  response = sara_r5_calloc_char(minimumResponseAllocation);
+  if (response == nullptr)
+  {
+    free(command);
+    return SARA_R5_ERROR_OUT_OF_MEMORY;
+  }
+
+  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, response,
+                                SARA_R5_10_SEC_TIMEOUT);
+
+  if (err == SARA_R5_ERROR_SUCCESS)
+  {
+    // Example response: "+UGPS: 0" for off "+UGPS: 1,0,1" for on
+    // Search for a ':' followed by a '1' or ' 1'
+    char *pch1 = strchr(response, ':');
+    if (pch1 != nullptr)
+    {
+      char *pch2 = strchr(response, '1');
+      if ((pch2 != nullptr) && ((pch2 == pch1 + 1) || (pch2 == pch1 + 2)))
+        on = true;
+    }
+  }
 
   free(command);
-  return err;
+  free(response);
+
+  return on;
 }
 
-SARA_R5_error_t SARA_R5::sendHTTPGET(int profile, String path, String responseFilename)
+SARA_R5_error_t SARA_R5::gpsPower(bool enable, gnss_system_t gnss_sys, gnss_aiding_mode_t gnss_aiding)
 {
   SARA_R5_error_t err;
   char *command;
+  bool gpsState;
 
-  if (profile >= SARA_R5_NUM_HTTP_PROFILES)
-    return SARA_R5_ERROR_ERROR;
+  // Don't turn GPS on/off if it's already on/off
+  gpsState = isGPSon();
+  if ((enable && gpsState) || (!enable && !gpsState))
+  {
+    return SARA_R5_ERROR_SUCCESS;
+  }
 
-  command = sara_r5_calloc_char(strlen(SARA_R5_HTTP_COMMAND) + 24 +
-                                path.length() + responseFilename.length());
+  // GPS power management
+  command = sara_r5_calloc_char(strlen(SARA_R5_GNSS_POWER) + 32); // gnss_sys could be up to three digits
   if (command == nullptr)
     return SARA_R5_ERROR_OUT_OF_MEMORY;
-  sprintf(command, "%s=%d,%d,\"%s\",\"%s\"", SARA_R5_HTTP_COMMAND, profile, SARA_R5_HTTP_COMMAND_GET,
-          path.c_str(), responseFilename.c_str());
+  if (enable)
+  {
+    sprintf(command, "%s=1,%d,%d", SARA_R5_GNSS_POWER, gnss_aiding, gnss_sys);
+  }
+  else
+  {
+    sprintf(command, "%s=0", SARA_R5_GNSS_POWER);
+  }
 
-  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, nullptr,
-                                SARA_R5_STANDARD_RESPONSE_TIMEOUT);
+  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, nullptr, 10000);
 
   free(command);
   return err;
 }
 
-SARA_R5_error_t SARA_R5::sendHTTPPOSTdata(int profile, String path, String responseFilename,
-                                          String data, SARA_R5_http_content_types_t httpContentType)
+/*
+SARA_R5_error_t SARA_R5::gpsEnableClock(bool enable)
 {
-  SARA_R5_error_t err;
-  char *command;
+    // AT+UGZDA=<0,1>
+    SARA_R5_error_t err = SARA_R5_ERROR_SUCCESS;
+    return err;
+}
 
-  if (profile >= SARA_R5_NUM_HTTP_PROFILES)
-    return SARA_R5_ERROR_ERROR;
+SARA_R5_error_t SARA_R5::gpsGetClock(struct ClockData *clock)
+{
+    // AT+UGZDA?
+    SARA_R5_error_t err = SARA_R5_ERROR_SUCCESS;
+    return err;
+}
 
-  command = sara_r5_calloc_char(strlen(SARA_R5_HTTP_COMMAND) + 24 +
-                                path.length() + responseFilename.length() + data.length());
-  if (command == nullptr)
-    return SARA_R5_ERROR_OUT_OF_MEMORY;
-  sprintf(command, "%s=%d,%d,\"%s\",\"%s\",\"%s\",%d", SARA_R5_HTTP_COMMAND, profile, SARA_R5_HTTP_COMMAND_POST_DATA,
-          path.c_str(), responseFilename.c_str(), data.c_str(), httpContentType);
+SARA_R5_error_t SARA_R5::gpsEnableFix(bool enable)
+{
+    // AT+UGGGA=<0,1>
+    SARA_R5_error_t err = SARA_R5_ERROR_SUCCESS;
+    return err;
+}
 
-  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, nullptr,
-                                SARA_R5_STANDARD_RESPONSE_TIMEOUT);
+SARA_R5_error_t SARA_R5::gpsGetFix(struct PositionData *pos)
+{
+    // AT+UGGGA?
+    SARA_R5_error_t err = SARA_R5_ERROR_SUCCESS;
+    return err;
+}
 
-  free(command);
-  return err;
+SARA_R5_error_t SARA_R5::gpsEnablePos(bool enable)
+{
+    // AT+UGGLL=<0,1>
+    SARA_R5_error_t err = SARA_R5_ERROR_SUCCESS;
+    return err;
 }
 
-SARA_R5_error_t SARA_R5::sendHTTPPOSTfile(int profile, String path, String responseFilename,
-                                          String requestFile, SARA_R5_http_content_types_t httpContentType)
+SARA_R5_error_t SARA_R5::gpsGetPos(struct PositionData *pos)
+{
+    // AT+UGGLL?
+    SARA_R5_error_t err = SARA_R5_ERROR_SUCCESS;
+    return err;
+}
+
+SARA_R5_error_t SARA_R5::gpsEnableSat(bool enable)
+{
+    // AT+UGGSV=<0,1>
+    SARA_R5_error_t err = SARA_R5_ERROR_SUCCESS;
+    return err;
+}
+
+SARA_R5_error_t SARA_R5::gpsGetSat(uint8_t *sats)
+{
+    // AT+UGGSV?
+    SARA_R5_error_t err = SARA_R5_ERROR_SUCCESS;
+    return err;
+}
+*/
+
+SARA_R5_error_t SARA_R5::gpsEnableRmc(bool enable)
 {
+  // AT+UGRMC=<0,1>
   SARA_R5_error_t err;
   char *command;
 
-  if (profile >= SARA_R5_NUM_HTTP_PROFILES)
-    return SARA_R5_ERROR_ERROR;
+  // ** Don't call gpsPower here. It causes problems for +UTIME and the PPS signal **
+  // ** Call isGPSon and gpsPower externally if required **
+  // if (!isGPSon())
+  // {
+  //     err = gpsPower(true);
+  //     if (err != SARA_R5_ERROR_SUCCESS)
+  //     {
+  //         return err;
+  //     }
+  // }
 
-  command = sara_r5_calloc_char(strlen(SARA_R5_HTTP_COMMAND) + 24 +
-                                path.length() + responseFilename.length() + requestFile.length());
+  command = sara_r5_calloc_char(strlen(SARA_R5_GNSS_GPRMC) + 3);
   if (command == nullptr)
     return SARA_R5_ERROR_OUT_OF_MEMORY;
-  sprintf(command, "%s=%d,%d,\"%s\",\"%s\",\"%s\",%d", SARA_R5_HTTP_COMMAND, profile, SARA_R5_HTTP_COMMAND_POST_FILE,
-          path.c_str(), responseFilename.c_str(), requestFile.c_str(), httpContentType);
+  sprintf(command, "%s=%d", SARA_R5_GNSS_GPRMC, enable ? 1 : 0);
 
-  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, nullptr,
-                                SARA_R5_STANDARD_RESPONSE_TIMEOUT);
+  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, nullptr, SARA_R5_10_SEC_TIMEOUT);
 
   free(command);
   return err;
 }
 
-SARA_R5_error_t SARA_R5::getHTTPprotocolError(int profile, int *error_class, int *error_code)
+SARA_R5_error_t SARA_R5::gpsGetRmc(struct PositionData *pos, struct SpeedData *spd,
+                                   struct ClockData *clk, bool *valid)
 {
   SARA_R5_error_t err;
   char *command;
   char *response;
+  char *rmcBegin;
 
-  int rprofile, eclass, ecode;
-
-  command = sara_r5_calloc_char(strlen(SARA_R5_HTTP_PROTOCOL_ERROR) + 4);
+  command = sara_r5_calloc_char(strlen(SARA_R5_GNSS_GPRMC) + 2);
   if (command == nullptr)
     return SARA_R5_ERROR_OUT_OF_MEMORY;
-  sprintf(command, "%s=%d", SARA_R5_HTTP_PROTOCOL_ERROR, profile);
+  sprintf(command, "%s?", SARA_R5_GNSS_GPRMC);
 
   response = sara_r5_calloc_char(minimumResponseAllocation);
   if (response == nullptr)
@@ -4218,27 +8995,19 @@ SARA_R5_error_t SARA_R5::getHTTPprotocolError(int profile, int *error_class, int
     return SARA_R5_ERROR_OUT_OF_MEMORY;
   }
 
-  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR,
-                                response, SARA_R5_STANDARD_RESPONSE_TIMEOUT);
-
+  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, response, SARA_R5_10_SEC_TIMEOUT);
   if (err == SARA_R5_ERROR_SUCCESS)
   {
-    int scanned = 0;
-    char *searchPtr = strstr(response, "+UHTTPER:");
-    if (searchPtr != nullptr)
+    // Fast-forward response string to $GPRMC starter
+    rmcBegin = strstr(response, "$GPRMC");
+    if (rmcBegin == nullptr)
     {
-      searchPtr += strlen("+UHTTPER:"); //  Move searchPtr to first char
-      while (*searchPtr == ' ') searchPtr++; // skip spaces
-      scanned = sscanf(searchPtr, "%d,%d,%d\r\n",
-                        &rprofile, &eclass, &ecode);
+      err = SARA_R5_ERROR_UNEXPECTED_RESPONSE;
     }
-    if (scanned == 3)
+    else
     {
-      *error_class = eclass;
-      *error_code = ecode;
+      *valid = parseGPRMCString(rmcBegin, pos, clk, spd);
     }
-    else
-      err = SARA_R5_ERROR_UNEXPECTED_RESPONSE;
   }
 
   free(command);
@@ -4246,172 +9015,189 @@ SARA_R5_error_t SARA_R5::getHTTPprotocolError(int profile, int *error_class, int
   return err;
 }
 
-SARA_R5_error_t SARA_R5::nvMQTT(SARA_R5_mqtt_nv_parameter_t parameter)
+/*
+SARA_R5_error_t SARA_R5::gpsEnableSpeed(bool enable)
 {
-    SARA_R5_error_t err;
-    char *command;
-    command = sara_r5_calloc_char(strlen(SARA_R5_MQTT_NVM) + 10);
-    if (command == nullptr)
-      return SARA_R5_ERROR_OUT_OF_MEMORY;
-    sprintf(command, "%s=%d", SARA_R5_MQTT_NVM, parameter);
-    err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, nullptr,
-                                  SARA_R5_STANDARD_RESPONSE_TIMEOUT);
-    free(command);
+    // AT+UGVTG=<0,1>
+    SARA_R5_error_t err = SARA_R5_ERROR_SUCCESS;
     return err;
 }
 
-SARA_R5_error_t SARA_R5::setMQTTclientId(const String& clientId)
+SARA_R5_error_t SARA_R5::gpsGetSpeed(struct SpeedData *speed)
 {
-    SARA_R5_error_t err;
-    char *command;
-    command = sara_r5_calloc_char(strlen(SARA_R5_MQTT_PROFILE) + clientId.length() + 10);
-    if (command == nullptr)
-      return SARA_R5_ERROR_OUT_OF_MEMORY;
-    sprintf(command, "%s=%d,\"%s\"", SARA_R5_MQTT_PROFILE, SARA_R5_MQTT_PROFILE_CLIENT_ID, clientId.c_str());
-    err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, nullptr,
-                                  SARA_R5_STANDARD_RESPONSE_TIMEOUT);
-    free(command);
+    // AT+UGVTG?
+    SARA_R5_error_t err = SARA_R5_ERROR_SUCCESS;
     return err;
 }
+*/
 
-SARA_R5_error_t SARA_R5::setMQTTserver(const String& serverName, int port)
+SARA_R5_error_t SARA_R5::gpsRequest(unsigned int timeout, uint32_t accuracy,
+                                    bool detailed, unsigned int sensor)
 {
-    SARA_R5_error_t err;
-    char *command;
-    command = sara_r5_calloc_char(strlen(SARA_R5_MQTT_PROFILE) + serverName.length() + 16);
-    if (command == nullptr)
-      return SARA_R5_ERROR_OUT_OF_MEMORY;
-    sprintf(command, "%s=%d,\"%s\",%d", SARA_R5_MQTT_PROFILE, SARA_R5_MQTT_PROFILE_SERVERNAME, serverName.c_str(), port);
-    err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, nullptr,
-                                  SARA_R5_STANDARD_RESPONSE_TIMEOUT);
-    free(command);
-    return err;
-}
+  // AT+ULOC=2,<useCellLocate>,<detailed>,<timeout>,<accuracy>
+  SARA_R5_error_t err;
+  char *command;
 
-SARA_R5_error_t SARA_R5::setMQTTcredentials(const String& userName, const String& pwd)
-{
-    SARA_R5_error_t err;
-    char *command;
-    command = sara_r5_calloc_char(strlen(SARA_R5_MQTT_PROFILE) + userName.length() + pwd.length() + 16);
-    if (command == nullptr) {
-        return SARA_R5_ERROR_OUT_OF_MEMORY;
-    }
-    sprintf(command, "%s=%d,\"%s\",\"%s\"", SARA_R5_MQTT_PROFILE, SARA_R5_MQTT_PROFILE_USERNAMEPWD, userName.c_str(), pwd.c_str());
-    err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, nullptr,
-                                  SARA_R5_STANDARD_RESPONSE_TIMEOUT);
-    free(command);
-    return err;
-}
+  // This function will only work if the GPS module is initially turned off.
+  if (isGPSon())
+  {
+    gpsPower(false);
+  }
 
-SARA_R5_error_t SARA_R5::setMQTTsecure(bool secure, int secprofile)
-{
-    SARA_R5_error_t err;
-    char *command;
-    command = sara_r5_calloc_char(strlen(SARA_R5_MQTT_PROFILE) + 16);
-    if (command == nullptr)
-      return SARA_R5_ERROR_OUT_OF_MEMORY;
-    if ((secprofile == -1) || !secure) sprintf(command, "%s=%d,%d", SARA_R5_MQTT_PROFILE, SARA_R5_MQTT_PROFILE_SECURE, secure);
-    else sprintf(command, "%s=%d,%d,%d", SARA_R5_MQTT_PROFILE, SARA_R5_MQTT_PROFILE_SECURE, secure, secprofile);
-    err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, nullptr,
-                                  SARA_R5_STANDARD_RESPONSE_TIMEOUT);
-    free(command);
-    return err;
-}
+  if (timeout > 999)
+    timeout = 999;
+  if (accuracy > 999999)
+    accuracy = 999999;
 
-SARA_R5_error_t SARA_R5::connectMQTT(void)
-{
-    SARA_R5_error_t err;
-    char *command;
-    command = sara_r5_calloc_char(strlen(SARA_R5_MQTT_COMMAND) + 10);
-    if (command == nullptr)
-      return SARA_R5_ERROR_OUT_OF_MEMORY;
-    sprintf(command, "%s=%d", SARA_R5_MQTT_COMMAND, SARA_R5_MQTT_COMMAND_LOGIN);
-    err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, nullptr,
-                                  SARA_R5_STANDARD_RESPONSE_TIMEOUT);
-    free(command);
-    return err;
-}
+  command = sara_r5_calloc_char(strlen(SARA_R5_GNSS_REQUEST_LOCATION) + 24);
+  if (command == nullptr)
+    return SARA_R5_ERROR_OUT_OF_MEMORY;
+  sprintf(command, "%s=2,%d,%d,%d,%d", SARA_R5_GNSS_REQUEST_LOCATION,
+          sensor, detailed ? 1 : 0, timeout, (int)accuracy);
 
-SARA_R5_error_t SARA_R5::disconnectMQTT(void)
-{
-    SARA_R5_error_t err;
-    char *command;
-    command = sara_r5_calloc_char(strlen(SARA_R5_MQTT_COMMAND) + 10);
-    if (command == nullptr)
-      return SARA_R5_ERROR_OUT_OF_MEMORY;
-    sprintf(command, "%s=%d", SARA_R5_MQTT_COMMAND, SARA_R5_MQTT_COMMAND_LOGOUT);
-    err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, nullptr,
-                                  SARA_R5_STANDARD_RESPONSE_TIMEOUT);
-    free(command);
-    return err;
+  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, nullptr, SARA_R5_10_SEC_TIMEOUT);
+
+  free(command);
+  return err;
 }
 
-SARA_R5_error_t SARA_R5::subscribeMQTTtopic(int max_Qos, const String& topic)
+SARA_R5_error_t SARA_R5::gpsAidingServerConf(const char *primaryServer, const char *secondaryServer, const char *authToken,
+                                             unsigned int days, unsigned int period, unsigned int resolution,
+                                             unsigned int gnssTypes, unsigned int mode, unsigned int dataType)
 {
   SARA_R5_error_t err;
   char *command;
-  command = sara_r5_calloc_char(strlen(SARA_R5_MQTT_COMMAND) + 16 + topic.length());
+
+  command = sara_r5_calloc_char(strlen(SARA_R5_AIDING_SERVER_CONFIGURATION) + 256);
   if (command == nullptr)
     return SARA_R5_ERROR_OUT_OF_MEMORY;
-  sprintf(command, "%s=%d,%d,\"%s\"", SARA_R5_MQTT_COMMAND, SARA_R5_MQTT_COMMAND_SUBSCRIBE, max_Qos, topic.c_str());
+
+  sprintf(command, "%s=\"%s\",\"%s\",\"%s\",%d,%d,%d,%d,%d,%d", SARA_R5_AIDING_SERVER_CONFIGURATION,
+          primaryServer, secondaryServer, authToken,
+          days, period, resolution, gnssTypes, mode, dataType);
+
   err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, nullptr,
                                 SARA_R5_STANDARD_RESPONSE_TIMEOUT);
+
   free(command);
   return err;
 }
 
-SARA_R5_error_t SARA_R5::unsubscribeMQTTtopic(const String& topic)
+
+// OK for text files. But will fail with binary files (containing \0) on some platforms.
+SARA_R5_error_t SARA_R5::appendFileContents(String filename, const char *str, int len)
 {
-  SARA_R5_error_t err;
+  SARA_R5_LOCK_TRANSACTION(SARA_R5_PRIORITY_LOW);
+
   char *command;
-  command = sara_r5_calloc_char(strlen(SARA_R5_MQTT_COMMAND) + 16 + topic.length());
+  char *response;
+  SARA_R5_error_t err;
+
+  command = sara_r5_calloc_char(strlen(SARA_R5_FILE_SYSTEM_DOWNLOAD_FILE) + filename.length() + 10);
   if (command == nullptr)
     return SARA_R5_ERROR_OUT_OF_MEMORY;
-  sprintf(command, "%s=%d,\"%s\"", SARA_R5_MQTT_COMMAND, SARA_R5_MQTT_COMMAND_UNSUBSCRIBE, topic.c_str());
-  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, nullptr,
-                                SARA_R5_STANDARD_RESPONSE_TIMEOUT);
+  response = sara_r5_calloc_char(minimumResponseAllocation);
+  if (response == nullptr)
+  {
+    free(command);
+    return SARA_R5_ERROR_OUT_OF_MEMORY;
+  }
+  int dataLen = len == -1 ? strlen(str) : len;
+  sprintf(command, "%s=\"%s\",%d", SARA_R5_FILE_SYSTEM_DOWNLOAD_FILE, filename.c_str(), dataLen);
+
+  err = sendCommandWithResponse(command, ">", response,
+                                SARA_R5_STANDARD_RESPONSE_TIMEOUT*2);
+
+  unsigned long writeDelay = millis();
+  while (millis() < (writeDelay + 50))
+    delay(1); //uBlox specification says to wait 50ms after receiving "@" to write data.
+
+  if (err == SARA_R5_ERROR_SUCCESS)
+  {
+    if (_printDebug == true)
+    {
+      _debugPort->print(F("fileDownload: writing "));
+      _debugPort->print(dataLen);
+      _debugPort->println(F(" bytes"));
+    }
+    hwWriteData(str, dataLen);
+
+    err = waitForResponse(SARA_R5_RESPONSE_OK, SARA_R5_RESPONSE_ERROR, SARA_R5_STANDARD_RESPONSE_TIMEOUT*5);
+    fileIndexWritten(filename.c_str(), (err == SARA_R5_ERROR_SUCCESS) ? dataLen : -1); // Part of the data may have been written
+  }
+  if (err != SARA_R5_ERROR_SUCCESS)
+  {
+    if (_printDebug == true)
+    {
+      _debugPort->print(F("fileDownload: Error: "));
+      _debugPort->print(err);
+      _debugPort->print(F(" => {"));
+      _debugPort->print(response);
+      _debugPort->println(F("}"));
+    }
+  }
+
   free(command);
+  free(response);
   return err;
 }
 
-SARA_R5_error_t SARA_R5::readMQTT(int* pQos, String* pTopic, uint8_t *readDest, int readLength, int *bytesRead)
+SARA_R5_error_t SARA_R5::appendFileContents(String filename, String str)
+{
+    return appendFileContents(filename, str.c_str(), str.length());
+}
+
+
+// OK for text files. But will fail with binary files (containing \0) on some platforms.
+SARA_R5_error_t SARA_R5::getFileContents(String filename, String *contents)
 {
+  SARA_R5_error_t err;
   char *command;
   char *response;
-  SARA_R5_error_t err;
-  int scanNum = 0;
-  int total_length, topic_length, data_length;
 
-  // Set *bytesRead to zero
-  if (bytesRead != nullptr)
-    *bytesRead = 0;
+  // Start by getting the file size so we know in advance how much data to expect
+  int fileSize = 0;
+  err = getFileSize(filename, &fileSize);
+  if (err != SARA_R5_SUCCESS)
+  {
+    if (_printDebug == true)
+    {
+      _debugPort->print(F("getFileContents: getFileSize returned err "));
+      _debugPort->println(err);
+    }
+    return err;
+  }
 
-  // Allocate memory for the command
-  command = sara_r5_calloc_char(strlen(SARA_R5_MQTT_COMMAND) + 10);
+  command = sara_r5_calloc_char(strlen(SARA_R5_FILE_SYSTEM_READ_FILE) + filename.length() + 8);
   if (command == nullptr)
     return SARA_R5_ERROR_OUT_OF_MEMORY;
+  sprintf(command, "%s=\"%s\"", SARA_R5_FILE_SYSTEM_READ_FILE, filename.c_str());
 
-  // Allocate memory for the response
-  int responseLength = readLength + minimumResponseAllocation;
-  response = sara_r5_calloc_char(responseLength);
+  response = sara_r5_calloc_char(fileSize + minimumResponseAllocation);
   if (response == nullptr)
   {
+    if (_printDebug == true)
+    {
+      _debugPort->print(F("getFileContents: response alloc failed: "));
+      _debugPort->println(fileSize + minimumResponseAllocation);
+    }
     free(command);
     return SARA_R5_ERROR_OUT_OF_MEMORY;
   }
 
+  // A large file will be passed through the URC line buffer - but only the URCs (if any) will be kept
   // Note to self: if the file contents contain "OK\r\n" sendCommandWithResponse will return true too early...
-  // To try and avoid this, look for \"\r\n\r\nOK\r\n there is a extra \r\n beetween " and the the standard \r\nOK\r\n
-  const char mqttReadTerm[] = "\"\r\n\r\nOK\r\n";
-  sprintf(command, "%s=%d,%d", SARA_R5_MQTT_COMMAND, SARA_R5_MQTT_COMMAND_READ, 1);
-  err = sendCommandWithResponse(command, mqttReadTerm, response,
-                                (5 * SARA_R5_STANDARD_RESPONSE_TIMEOUT), responseLength);
+  // To try and avoid this, look for \"\r\nOK\r\n
+  const char fileReadTerm[] = "\r\nOK\r\n"; //LARA-R6 returns "\"\r\n\r\nOK\r\n" while SARA-R5 return "\"\r\nOK\r\n";
+  err = sendCommandWithResponse(command, fileReadTerm,
+                                response, (5 * SARA_R5_STANDARD_RESPONSE_TIMEOUT),
+                                (fileSize + minimumResponseAllocation));
 
   if (err != SARA_R5_ERROR_SUCCESS)
   {
     if (_printDebug == true)
     {
-      _debugPort->print(F("readMQTT: sendCommandWithResponse err "));
+      _debugPort->print(F("getFileContents: sendCommandWithResponse returned err "));
       _debugPort->println(err);
     }
     free(command);
@@ -4419,611 +9205,1156 @@ SARA_R5_error_t SARA_R5::readMQTT(int* pQos, String* pTopic, uint8_t *readDest,
     return err;
   }
 
-  // Extract the data
-  char *searchPtr = strstr(response, "+UMQTTC:");
-  int cmd = 0;
+  // Response format: \r\n+URDFILE: "filename",36,"these bytes are the data of the file"\r\n\r\nOK\r\n
+  int scanned = 0;
+  int readFileSize = 0;
+  char *searchPtr = strstr(response, "+URDFILE:");
   if (searchPtr != nullptr)
   {
-    searchPtr += strlen("+UMQTTC:"); //  Move searchPtr to first char
-    while (*searchPtr == ' ') searchPtr++; // skip spaces
-    scanNum = sscanf(searchPtr, "%d,%d,%d,%d,\"%*[^\"]\",%d,\"", &cmd, pQos, &total_length, &topic_length, &data_length);
-  }
-  if ((scanNum != 5) || (cmd != SARA_R5_MQTT_COMMAND_READ))
-  {
-    if (_printDebug == true)
+    searchPtr = strchr(searchPtr, '\"'); // Find the first quote
+    searchPtr = strchr(++searchPtr, '\"'); // Find the second quote
+
+    scanned = sscanf(searchPtr, "\",%d,", &readFileSize); // Get the file size (again)
+    if (scanned == 1)
     {
-      _debugPort->print(F("readMQTT: error: scanNum is "));
-      _debugPort->println(scanNum);
-    }
-    free(command);
-    free(response);
-    return SARA_R5_ERROR_UNEXPECTED_RESPONSE;
-  }
+      searchPtr = strchr(++searchPtr, '\"'); // Find the third quote
 
-  err = SARA_R5_ERROR_SUCCESS;
-  searchPtr = strstr(searchPtr, "\"");
-  if (searchPtr!= nullptr) {
-    if (pTopic) {
-      searchPtr[topic_length + 1] = '\0'; // zero terminate
-      *pTopic = searchPtr + 1;
-      searchPtr[topic_length + 1] = '\"'; // restore
-    }
-    searchPtr = strstr(searchPtr + topic_length + 2, "\"");
-    if (readDest && (searchPtr != nullptr) && (response + responseLength >= searchPtr + data_length + 1) && (searchPtr[data_length + 1] == '"')) {
-      if (data_length > readLength) {
-        data_length = readLength;
-        if (_printDebug == true) {
-          _debugPort->print(F("readMQTT: error: trucate message"));
+      if (searchPtr == nullptr)
+      {
+        if (_printDebug == true)
+        {
+          _debugPort->println(F("getFileContents: third quote not found!"));
         }
-        err = SARA_R5_ERROR_OUT_OF_MEMORY;
+        free(command);
+        free(response);
+        return SARA_R5_ERROR_UNEXPECTED_RESPONSE;
       }
-      memcpy(readDest, searchPtr+1, data_length);
-      *bytesRead = data_length;
-    } else {
-      if (_printDebug == true) {
-        _debugPort->print(F("readMQTT: error: message end "));
+
+      int bytesRead = 0;
+
+      while (bytesRead < readFileSize)
+      {
+        searchPtr++; // Increment searchPtr then copy file char into contents
+      // Important Note: some implementations of concat, like the one on ESP32, are binary-compatible.
+      // But some, like SAMD, are not. They use strlen or strcpy internally - which don't like \0's.
+      // The only true binary-compatible solution is to use getFileContents(String filename, char *contents)...
+        contents->concat(*(searchPtr)); // Append file char to contents
+        bytesRead++;
+      }
+      if (_printDebug == true)
+      {
+        _debugPort->print(F("getFileContents: total bytes read: "));
+        _debugPort->println(bytesRead);
+      }
+      err = SARA_R5_ERROR_SUCCESS;
+    }
+    else
+    {
+      if (_printDebug == true)
+      {
+        _debugPort->print(F("getFileContents: sscanf failed! scanned is "));
+        _debugPort->println(scanned);
       }
       err = SARA_R5_ERROR_UNEXPECTED_RESPONSE;
     }
   }
+  else
+  {
+    if (_printDebug == true)
+      _debugPort->println(F("getFileContents: strstr failed!"));
+    err = SARA_R5_ERROR_UNEXPECTED_RESPONSE;
+  }
+
   free(command);
   free(response);
-
   return err;
 }
 
-SARA_R5_error_t SARA_R5::mqttPublishTextMsg(const String& topic, const char * const msg, uint8_t qos, bool retain)
+// OK for binary files. Make sure contents can hold the entire file. Get the size first with getFileSize.
+SARA_R5_error_t SARA_R5::getFileContents(String filename, char *contents)
 {
-  if (topic.length() < 1 || msg == nullptr)
+  SARA_R5_error_t err;
+  char *command;
+  char *response;
+
+  // Start by getting the file size so we know in advance how much data to expect
+  int fileSize = 0;
+  err = getFileSize(filename, &fileSize);
+  if (err != SARA_R5_SUCCESS)
   {
-    return SARA_R5_ERROR_INVALID;
+    if (_printDebug == true)
+    {
+      _debugPort->print(F("getFileContents: getFileSize returned err "));
+      _debugPort->println(err);
+    }
+    return err;
   }
 
-  SARA_R5_error_t err;
-
-  char sanitized_msg[MAX_MQTT_DIRECT_MSG_LEN + 1];
-  memset(sanitized_msg, 0, sizeof(sanitized_msg));
+  command = sara_r5_calloc_char(strlen(SARA_R5_FILE_SYSTEM_READ_FILE) + filename.length() + 8);
+  if (command == nullptr)
+    return SARA_R5_ERROR_OUT_OF_MEMORY;
+  sprintf(command, "%s=\"%s\"", SARA_R5_FILE_SYSTEM_READ_FILE, filename.c_str());
 
-  // Check the message length and truncate if necessary.
-  size_t msg_len = strnlen(msg, MAX_MQTT_DIRECT_MSG_LEN);
-  if (msg_len > MAX_MQTT_DIRECT_MSG_LEN)
+  response = sara_r5_calloc_char(fileSize + minimumResponseAllocation);
+  if (response == nullptr)
   {
-    msg_len = MAX_MQTT_DIRECT_MSG_LEN;
+    if (_printDebug == true)
+    {
+      _debugPort->print(F("getFileContents: response alloc failed: "));
+      _debugPort->println(fileSize + minimumResponseAllocation);
+    }
+    free(command);
+    return SARA_R5_ERROR_OUT_OF_MEMORY;
   }
 
-  strncpy(sanitized_msg, msg, msg_len);
-  char * msg_ptr = sanitized_msg;
-  while (*msg_ptr != 0)
+  // A large file will be passed through the URC line buffer - but only the URCs (if any) will be kept
+  // Note to self: if the file contents contain "OK\r\n" sendCommandWithResponse will return true too early...
+  // To try and avoid this, look for \"\r\nOK\r\n
+  const char fileReadTerm[] = "\"\r\nOK\r\n";
+  err = sendCommandWithResponse(command, fileReadTerm,
+                                response, (5 * SARA_R5_STANDARD_RESPONSE_TIMEOUT),
+                                (fileSize + minimumResponseAllocation));
+
+  if (err != SARA_R5_ERROR_SUCCESS)
   {
-    if (*msg_ptr == '"')
+    if (_printDebug == true)
     {
-      *msg_ptr = ' ';
+      _debugPort->print(F("getFileContents: sendCommandWithResponse returned err "));
+      _debugPort->println(err);
     }
-
-    msg_ptr++;
+    free(command);
+    free(response);
+    return err;
   }
 
-  char *command = sara_r5_calloc_char(strlen(SARA_R5_MQTT_COMMAND) + 20 + topic.length() + msg_len);
-  if (command == nullptr)
+  // Response format: \r\n+URDFILE: "filename",36,"these bytes are the data of the file"\r\n\r\nOK\r\n
+  int scanned = 0;
+  int readFileSize = 0;
+  char *searchPtr = strstr(response, "+URDFILE:");
+  if (searchPtr != nullptr)
   {
-    return SARA_R5_ERROR_OUT_OF_MEMORY;
-  }
+    searchPtr = strchr(searchPtr, '\"'); // Find the first quote
+    searchPtr = strchr(++searchPtr, '\"'); // Find the second quote
 
-  sprintf(command, "%s=%d,%u,%u,0,\"%s\",\"%s\"", SARA_R5_MQTT_COMMAND, SARA_R5_MQTT_COMMAND_PUBLISH, qos, (retain ? 1:0), topic.c_str(), sanitized_msg);
+    scanned = sscanf(searchPtr, "\",%d,", &readFileSize); // Get the file size (again)
+    if (scanned == 1)
+    {
+      searchPtr = strchr(++searchPtr, '\"'); // Find the third quote
 
-  sendCommand(command, true);
-  err = waitForResponse(SARA_R5_RESPONSE_MORE, SARA_R5_RESPONSE_ERROR, SARA_R5_STANDARD_RESPONSE_TIMEOUT);
-  if (err == SARA_R5_ERROR_SUCCESS)
+      if (searchPtr == nullptr)
+      {
+        if (_printDebug == true)
+        {
+          _debugPort->println(F("getFileContents: third quote not found!"));
+        }
+        free(command);
+        free(response);
+        return SARA_R5_ERROR_UNEXPECTED_RESPONSE;
+      }
+
+      int bytesRead = 0;
+
+      while (bytesRead < readFileSize)
+      {
+        searchPtr++; // Increment searchPtr then copy file char into contents
+        contents[bytesRead] = *searchPtr; // Append file char to contents
+        bytesRead++;
+      }
+      if (_printDebug == true)
+      {
+        _debugPort->print(F("getFileContents: total bytes read: "));
+        _debugPort->println(bytesRead);
+      }
+      err = SARA_R5_ERROR_SUCCESS;
+    }
+    else
+    {
+      if (_printDebug == true)
+      {
+        _debugPort->print(F("getFileContents: sscanf failed! scanned is "));
+        _debugPort->println(scanned);
+      }
+      err = SARA_R5_ERROR_UNEXPECTED_RESPONSE;
+    }
+  }
+  else
   {
-    sendCommand(msg, false);
-    err = waitForResponse(SARA_R5_RESPONSE_OK, SARA_R5_RESPONSE_ERROR, SARA_R5_STANDARD_RESPONSE_TIMEOUT);
+    if (_printDebug == true)
+      _debugPort->println(F("getFileContents: strstr failed!"));
+    err = SARA_R5_ERROR_UNEXPECTED_RESPONSE;
   }
 
   free(command);
+  free(response);
   return err;
 }
 
-SARA_R5_error_t SARA_R5::mqttPublishBinaryMsg(const String& topic, const char * const msg, size_t msg_len, uint8_t qos, bool retain)
+SARA_R5_error_t SARA_R5::getFileBlock(const String& filename, char* buffer, size_t offset, size_t requestedLength, size_t& bytesRead)
 {
-  /*
-   * The modem prints the '>' as the signal to send the binary message content.
-   * at+umqttc=9,0,0,"topic",4
-   *
-   * >"xY"
-   * OK
-   *
-   * +UUMQTTC: 9,1
-   */
-  if (topic.length() < 1|| msg == nullptr || msg_len > MAX_MQTT_DIRECT_MSG_LEN)
+  bytesRead = 0;
+  if (filename.length() < 1 || buffer == nullptr || requestedLength < 1)
   {
-    return SARA_R5_ERROR_INVALID;
+      return SARA_R5_ERROR_UNEXPECTED_PARAM;
   }
 
-  SARA_R5_error_t err;
-  char *command = sara_r5_calloc_char(strlen(SARA_R5_MQTT_COMMAND) + 20 + topic.length());
-  if (command == nullptr)
-  {
-     return SARA_R5_ERROR_OUT_OF_MEMORY;
-  }
+  return readFileBlock(filename.c_str(), buffer, offset, requestedLength, &bytesRead);
+}
 
-  sprintf(command, "%s=%d,%u,%u,\"%s\",%u", SARA_R5_MQTT_COMMAND, SARA_R5_MQTT_COMMAND_PUBLISHBINARY, qos, (retain ? 1:0), topic.c_str(), msg_len);
+// Read a block of a file with +URDBLOCK, straight from the UART into buffer. Works with hardware and software serial.
+// The length reported by the module is checked against the requested length, and the file name is checked too.
+// Returns as soon as the final OK has been received, so the next block can be requested immediately.
+// Response format: \r\n+URDBLOCK: "filename",64000,"these bytes are the data of the file block"\r\n\r\nOK\r\n
+SARA_R5_error_t SARA_R5::readFileBlock(const char *filename, char *buffer, size_t offset, size_t length, size_t *bytesRead)
+{
+  SARA_R5_LOCK_TRANSACTION(SARA_R5_PRIORITY_LOW);
 
-  sendCommand(command, true);
-  err = waitForResponse(SARA_R5_RESPONSE_MORE, SARA_R5_RESPONSE_ERROR, SARA_R5_STANDARD_RESPONSE_TIMEOUT);
-  if (err == SARA_R5_ERROR_SUCCESS)
-  {
-    sendCommand(msg, false);
-    err = waitForResponse(SARA_R5_RESPONSE_OK, SARA_R5_RESPONSE_ERROR, SARA_R5_STANDARD_RESPONSE_TIMEOUT);
-  }
+  SARA_R5_error_t err = SARA_R5_ERROR_SUCCESS;
+  char *command;
+  char *header;
+  int headerLength = 0;
+  int quoteCount = 0;
+  size_t dataLength = 0;
+  size_t remaining = 0; // The data still owed by the module if we give up early
+  unsigned long timeIn;
 
-  free(command);
-  return err;
-}
+  *bytesRead = 0;
 
-SARA_R5_error_t SARA_R5::mqttPublishFromFile(const String& topic, const String& filename, uint8_t qos, bool retain)
-{
-  if (topic.length() < 1|| filename.length() < 1)
+  // readFileBlock reads the UART directly, which would race with rxTask
+  if (_rxTaskMode == true)
   {
+    if (_printDebug == true)
+      _debugPort->println(F("readFileBlock: not supported in RX task mode"));
     return SARA_R5_ERROR_INVALID;
   }
 
-  SARA_R5_error_t err;
-  char *command = sara_r5_calloc_char(strlen(SARA_R5_MQTT_COMMAND) + 20 + topic.length() + filename.length());
+  command = sara_r5_calloc_char(strlen(SARA_R5_FILE_SYSTEM_READ_BLOCK) + strlen(filename) + 28);
   if (command == nullptr)
+    return SARA_R5_ERROR_OUT_OF_MEMORY;
+  sprintf(command, "%s=\"%s\",%lu,%lu", SARA_R5_FILE_SYSTEM_READ_BLOCK, filename, (unsigned long)offset, (unsigned long)length);
+
+  header = sara_r5_calloc_char(minimumResponseAllocation);
+  if (header == nullptr)
   {
+    free(command);
     return SARA_R5_ERROR_OUT_OF_MEMORY;
   }
 
-  sprintf(command, "%s=%d,%u,%u,\"%s\",\"%s\"", SARA_R5_MQTT_COMMAND, SARA_R5_MQTT_COMMAND_PUBLISHFILE, qos, (retain ? 1:0), topic.c_str(), filename.c_str());
-
   sendCommand(command, true);
-  err = waitForResponse(SARA_R5_RESPONSE_OK, SARA_R5_RESPONSE_ERROR, SARA_R5_STANDARD_RESPONSE_TIMEOUT);
-
-  free(command);
-  return err;
-}
 
-SARA_R5_error_t SARA_R5::getMQTTprotocolError(int *error_code, int *error_code2)
-{
-  SARA_R5_error_t err;
-  char *response;
-
-  int code, code2;
-
-  response = sara_r5_calloc_char(minimumResponseAllocation);
-  if (response == nullptr)
+  // Wait for the +URDBLOCK: header. Hand any other lines (URCs) to the URC parser
+  const int tagLength = strlen(SARA_R5_FILE_SYSTEM_READ_BLOCK);
+  timeIn = millis();
+  while (quoteCount < 3)
   {
-    return SARA_R5_ERROR_OUT_OF_MEMORY;
+    if ((millis() - timeIn) > (5 * SARA_R5_STANDARD_RESPONSE_TIMEOUT))
+    {
+      err = SARA_R5_ERROR_NO_RESPONSE;
+      break;
+    }
+    if (hwAvailable() <= 0) //hwAvailable can return -1 if the serial port is NULL
+    {
+      yield();
+      continue;
+    }
+    char c = readChar();
+    if (headerLength < (minimumResponseAllocation - 1))
+      header[headerLength++] = c;
+    header[headerLength] = 0;
+    if (strncmp(header, SARA_R5_FILE_SYSTEM_READ_BLOCK, (headerLength < tagLength) ? headerLength : tagLength) == 0)
+    {
+      if (c == '\"') // The data starts after the third quote
+        quoteCount++;
+    }
+    else if (c == '\n') // Another line
+    {
+      if (strstr(header, "ERROR") != nullptr)
+      {
+        err = SARA_R5_ERROR_ERROR;
+        break;
+      }
+      for (int i = 0; i < headerLength; i++)
+        bufferURCChar(header[i]);
+      headerLength = 0;
+    }
   }
 
-  err = sendCommandWithResponse(SARA_R5_MQTT_PROTOCOL_ERROR, SARA_R5_RESPONSE_OK_OR_ERROR,
-                                response, SARA_R5_STANDARD_RESPONSE_TIMEOUT);
+  if (err == SARA_R5_ERROR_SUCCESS)
+  {
+    // Check the file name and the length. E.g. +URDBLOCK: "filename",64000,"
+    char *namePtr = strchr(header, '\"');
+    char *nameEnd = (namePtr == nullptr) ? nullptr : strchr(namePtr + 1, '\"');
+    if ((nameEnd != nullptr) && (*(nameEnd + 1) == ','))
+      dataLength = strtoul(nameEnd + 2, nullptr, 10);
+    remaining = dataLength;
+    if ((nameEnd == nullptr) || ((size_t)(nameEnd - namePtr - 1) != strlen(filename))
+        || (strncmp(namePtr + 1, filename, strlen(filename)) != 0) || (*(nameEnd + 1) != ','))
+      err = SARA_R5_ERROR_UNEXPECTED_RESPONSE;
+    else if (dataLength > length) // The module must not send more than we asked for. It sends less at the end of the file
+      err = SARA_R5_ERROR_UNEXPECTED_RESPONSE;
+    if ((err != SARA_R5_ERROR_SUCCESS) && (_printDebug == true))
+    {
+      _debugPort->print(F("readFileBlock: unexpected header: "));
+      _debugPort->println(header);
+    }
+  }
 
   if (err == SARA_R5_ERROR_SUCCESS)
   {
-    int scanned = 0;
-    char *searchPtr = strstr(response, "+UMQTTER:");
-    if (searchPtr != nullptr)
+    // Read the data straight into buffer. Allow for the transmission time
+    unsigned long dataTimeout = SARA_R5_STANDARD_RESPONSE_TIMEOUT + (((unsigned long)dataLength * 10000) / _baud);
+    timeIn = millis();
+    while ((*bytesRead < dataLength) && ((millis() - timeIn) < dataTimeout))
     {
-      searchPtr += strlen("+UMQTTER:"); //  Move searchPtr to first char
-      while (*searchPtr == ' ') searchPtr++; // skip spaces
-      scanned = sscanf(searchPtr, "%d,%d\r\n",
-                        &code, &code2);
+      if (hwAvailable() > 0) //hwAvailable can return -1 if the serial port is NULL
+        buffer[(*bytesRead)++] = readChar();
+      else
+        yield();
     }
-    if (scanned == 2)
+    remaining = dataLength - *bytesRead;
+    if (*bytesRead < dataLength)
+      err = SARA_R5_ERROR_TIMEOUT;
+  }
+
+  if (err == SARA_R5_ERROR_SUCCESS)
+  {
+    // The data is followed by "\r\n\r\nOK\r\n. Stop as soon as the OK has been seen
+    const char trailer[] = "\"\r\n\r\nOK\r\n";
+    size_t matched = 0;
+    timeIn = millis();
+    while ((matched < strlen(trailer)) && ((millis() - timeIn) < SARA_R5_STANDARD_RESPONSE_TIMEOUT))
     {
-      *error_code = code;
-      *error_code2 = code2;
+      if (hwAvailable() > 0) //hwAvailable can return -1 if the serial port is NULL
+      {
+        char c = readChar();
+        if (c == trailer[matched])
+          matched++;
+        else
+          matched = (c == trailer[0]) ? 1 : 0;
+      }
+      else
+        yield();
     }
-    else
+    if (matched < strlen(trailer))
       err = SARA_R5_ERROR_UNEXPECTED_RESPONSE;
   }
 
-  free(response);
+  if ((err != SARA_R5_ERROR_SUCCESS) && (err != SARA_R5_ERROR_ERROR))
+  {
+    // Discard the rest of the response - the data still owed, then the final OK - so the next command does not
+    // take it as its response. The data is skipped by length: it can contain OK too
+    const char finalOK[] = "\r\nOK\r\n";
+    size_t matched = 0;
+    unsigned long drainTimeout = SARA_R5_STANDARD_RESPONSE_TIMEOUT + (((unsigned long)remaining * 10000) / _baud);
+    timeIn = millis();
+    while ((matched < strlen(finalOK)) && ((millis() - timeIn) < drainTimeout))
+    {
+      if (hwAvailable() > 0) //hwAvailable can return -1 if the serial port is NULL
+      {
+        char c = readChar();
+        if (remaining > 0)
+          remaining--;
+        else if (c == finalOK[matched])
+          matched++;
+        else
+          matched = (c == finalOK[0]) ? 1 : 0;
+      }
+      else
+        yield();
+    }
+  }
+
+  if ((err != SARA_R5_ERROR_SUCCESS) && (_printDebug == true))
+  {
+    _debugPort->print(F("readFileBlock: error: "));
+    _debugPort->println(err);
+  }
+
+  free(command);
+  free(header);
   return err;
 }
 
-SARA_R5_error_t SARA_R5::setFTPserver(const String& serverName)
+// Open a file stream. The file size is read from the module. See SARA_R5_file_stream
+SARA_R5_error_t SARA_R5::openFileStream(SARA_R5_file_stream &stream, const char *filename, size_t chunkSize)
 {
-  constexpr size_t cmd_len = 145;
-  char command[cmd_len]; // long enough for AT+UFTP=1,<128 bytes>
+  int size = 0;
 
-  snprintf(command, cmd_len - 1, "%s=%d,\"%s\"", SARA_R5_FTP_PROFILE, SARA_R5_FTP_PROFILE_SERVERNAME, serverName.c_str());
-  return sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, nullptr,
-                                 SARA_R5_STANDARD_RESPONSE_TIMEOUT);
-}
+  if ((filename == nullptr) || (strlen(filename) < 1) || (strlen(filename) >= SARA_R5_FILE_STREAM_NAME_LENGTH) || (chunkSize < 1))
+    return SARA_R5_ERROR_UNEXPECTED_PARAM;
 
-SARA_R5_error_t SARA_R5::setFTPtimeouts(const unsigned int timeout, const unsigned int cmd_linger, const unsigned int data_linger)
-{
-  constexpr size_t cmd_len = 64;
-  char command[cmd_len]; // long enough for AT+UFTP=1,<128 bytes>
+  SARA_R5_error_t err = getFileSize(String(filename), &size);
+  if (err != SARA_R5_ERROR_SUCCESS)
+    return err;
 
-  snprintf(command, cmd_len - 1, "%s=%d,%u,%u,%u", SARA_R5_FTP_PROFILE, SARA_R5_FTP_PROFILE_TIMEOUT, timeout, cmd_linger, data_linger);
-  return sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, nullptr,
-                                 SARA_R5_STANDARD_RESPONSE_TIMEOUT);
+  stream._sara = this;
+  strcpy(stream._filename, filename);
+  stream._chunkSize = chunkSize;
+  stream._size = (size_t)size;
+  stream._position = 0;
+  stream._error = SARA_R5_ERROR_SUCCESS;
+  return SARA_R5_ERROR_SUCCESS;
 }
 
-SARA_R5_error_t SARA_R5::setFTPcredentials(const String& userName, const String& pwd)
+// Read up to length bytes from the current position into buffer. The block requests are no longer than the chunk size.
+// Returns the number of bytes read. 0 at the end of the file. -1 if there was an error - see getError
+int SARA_R5_file_stream::read(char *buffer, size_t length)
 {
-  SARA_R5_error_t err;
-  constexpr size_t cmd_len = 48;
-  char command[cmd_len]; // long enough for AT+UFTP=n,<30 bytes>
-
-  snprintf(command, cmd_len - 1, "%s=%d,\"%s\"", SARA_R5_FTP_PROFILE, SARA_R5_FTP_PROFILE_USERNAME, userName.c_str());
-  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, nullptr,
-                                SARA_R5_STANDARD_RESPONSE_TIMEOUT);
-  if (err != SARA_R5_ERROR_SUCCESS)
+  if ((_sara == nullptr) || (buffer == nullptr) || (_error != SARA_R5_ERROR_SUCCESS))
+    return -1;
+
+  size_t total = 0;
+  while ((total < length) && (_position < _size))
   {
-    return err;
-  }
+    size_t request = length - total;
+    if (request > _chunkSize)
+      request = _chunkSize;
+    if (request > (_size - _position))
+      request = _size - _position;
 
-  snprintf(command, cmd_len - 1, "%s=%d,\"%s\"", SARA_R5_FTP_PROFILE, SARA_R5_FTP_PROFILE_PWD, pwd.c_str());
-  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, nullptr,
-                                SARA_R5_STANDARD_RESPONSE_TIMEOUT);
+    size_t bytesRead = 0;
+    _error = _sara->readFileBlock(_filename, &buffer[total], _position, request, &bytesRead);
+    if ((_error == SARA_R5_ERROR_SUCCESS) && (bytesRead != request)) // The file is shorter than the size reported by the module
+      _error = SARA_R5_ERROR_UNEXPECTED_RESPONSE;
+    if (_error != SARA_R5_ERROR_SUCCESS)
+      return -1;
 
-  return err;
+    total += bytesRead;
+    _position += bytesRead;
+  }
+
+  return (int)total;
 }
 
-SARA_R5_error_t SARA_R5::connectFTP(void)
+// Read the rest of the file, one chunk at a time, and pass each chunk to the callback.
+// buffer must hold at least the chunk size. Each block is requested as soon as the callback returns
+SARA_R5_error_t SARA_R5_file_stream::readAll(char *buffer, size_t bufferSize,
+                                             void (*callback)(const char *data, size_t length, size_t offset, void *context),
+                                             void *context)
 {
-  constexpr size_t cmd_len = 16;
-  char command[cmd_len]; // long enough for AT+UFTPC=n
+  if ((buffer == nullptr) || (bufferSize < 1) || (callback == nullptr))
+    return SARA_R5_ERROR_UNEXPECTED_PARAM;
 
-  snprintf(command, cmd_len - 1, "%s=%d", SARA_R5_FTP_COMMAND, SARA_R5_FTP_COMMAND_LOGIN);
-  return sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, nullptr,
-                                 SARA_R5_STANDARD_RESPONSE_TIMEOUT);
+  size_t chunk = (bufferSize < _chunkSize) ? bufferSize : _chunkSize;
+  while (_position < _size)
+  {
+    size_t offset = _position;
+    int bytesRead = read(buffer, chunk);
+    if (bytesRead < 0)
+      return _error;
+    callback(buffer, (size_t)bytesRead, offset, context);
+  }
+  return SARA_R5_ERROR_SUCCESS;
 }
 
-SARA_R5_error_t SARA_R5::disconnectFTP(void)
+bool SARA_R5_file_stream::seek(size_t position)
 {
-  constexpr size_t cmd_len = 16;
-  char command[cmd_len]; // long enough for AT+UFTPC=n
-
-  snprintf(command, cmd_len - 1, "%s=%d", SARA_R5_FTP_COMMAND, SARA_R5_FTP_COMMAND_LOGOUT);
-  return sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, nullptr,
-                                 SARA_R5_STANDARD_RESPONSE_TIMEOUT);
+  if (position > _size)
+    return false;
+  _position = position;
+  _error = SARA_R5_ERROR_SUCCESS;
+  return true;
 }
 
-SARA_R5_error_t SARA_R5::ftpGetFile(const String& filename)
+// Start - or resume - uploading size bytes to filename in the module file system. See SARA_R5_file_upload.
+// If resume is true and the file already exists, the upload continues from the end of the file. The CRC of the bytes
+// which are already in the module is read back, unless upload has just been used to send them.
+// If resume is false - or the file is longer than size - the file is deleted and the upload starts from zero
+SARA_R5_error_t SARA_R5::beginFileUpload(SARA_R5_file_upload &upload, const char *filename, size_t size, bool resume, size_t maxChunkSize)
 {
-  char * command = sara_r5_calloc_char(strlen(SARA_R5_FTP_COMMAND) + (2 * filename.length()) + 16);
-  if (command == nullptr)
+  SARA_R5_LOCK_TRANSACTION(SARA_R5_PRIORITY_LOW);
+  int existingSize = 0;
+
+  if ((filename == nullptr) || (strlen(filename) < 1) || (strlen(filename) >= SARA_R5_FILE_STREAM_NAME_LENGTH)
+      || (maxChunkSize < SARA_R5_UPLOAD_MIN_CHUNK_SIZE))
+    return SARA_R5_ERROR_UNEXPECTED_PARAM;
+
+  if ((resume == false) || (getFileSize(String(filename), &existingSize) != SARA_R5_ERROR_SUCCESS)) // The file may not exist
+    existingSize = 0;
+
+  if ((size_t)existingSize > size)
+    existingSize = 0;
+  if (existingSize == 0)
+    deleteFile(String(filename)); // This fails if the file does not exist. That's OK
+
+  bool sameUpload = (strcmp(upload._filename, filename) == 0) && (upload._size == size) && (upload._offset == (size_t)existingSize);
+
+  strcpy(upload._filename, filename);
+  upload._size = size;
+  upload._maxChunkSize = maxChunkSize;
+  if (upload._chunkSize > maxChunkSize)
+    upload._chunkSize = maxChunkSize;
+  upload._error = SARA_R5_ERROR_SUCCESS;
+
+  if (sameUpload == false)
   {
-    return SARA_R5_ERROR_OUT_OF_MEMORY;
+    upload._offset = 0;
+    upload._crc = 0xFFFFFFFF;
+    upload._chunkSize = (SARA_R5_UPLOAD_CHUNK_SIZE < maxChunkSize) ? SARA_R5_UPLOAD_CHUNK_SIZE : maxChunkSize;
+    upload._bytesTimed = 0;
+    upload._timeTaken = 0;
+
+    if (existingSize > 0) // Read the existing data back to calculate its CRC
+    {
+      size_t bufferSize = (SARA_R5_FILE_STREAM_CHUNK_SIZE < maxChunkSize) ? SARA_R5_FILE_STREAM_CHUNK_SIZE : maxChunkSize;
+      char *buffer = sara_r5_calloc_char(bufferSize);
+      if (buffer == nullptr)
+        return SARA_R5_ERROR_OUT_OF_MEMORY;
+      while (upload._offset < (size_t)existingSize)
+      {
+        size_t request = (size_t)existingSize - upload._offset;
+        if (request > bufferSize)
+          request = bufferSize;
+        size_t bytesRead = 0;
+        SARA_R5_error_t err = readFileBlock(filename, buffer, upload._offset, request, &bytesRead);
+        if ((err == SARA_R5_ERROR_SUCCESS) && (bytesRead != request))
+          err = SARA_R5_ERROR_UNEXPECTED_RESPONSE;
+        if (err != SARA_R5_ERROR_SUCCESS)
+        {
+          free(buffer);
+          upload._error = err;
+          return err;
+        }
+        upload._crc = crc32Update(upload._crc, buffer, bytesRead);
+        upload._offset += bytesRead;
+      }
+      free(buffer);
+    }
   }
 
-  sprintf(command, "%s=%d,\"%s\",\"%s\"", SARA_R5_FTP_COMMAND, SARA_R5_FTP_COMMAND_GET_FILE, filename.c_str(), filename.c_str());
-  //memset(response, 0, sizeof(response));
-  //sendCommandWithResponse(command, SARA_R5_RESPONSE_CONNECT, response, 8000 /* ms */, response_len);
-  SARA_R5_error_t err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, nullptr,
-                                                SARA_R5_STANDARD_RESPONSE_TIMEOUT);
+  if (_printDebug == true)
+  {
+    _debugPort->print(F("beginFileUpload: starting at "));
+    _debugPort->println((unsigned long)upload._offset);
+  }
 
-  free(command);
-  return err;
+  return SARA_R5_ERROR_SUCCESS;
 }
 
-SARA_R5_error_t SARA_R5::getFTPprotocolError(int *error_code, int *error_code2)
+// Upload the rest of the file. source is called to fetch the data for each chunk: it must copy length bytes, starting at
+// offset, into buffer and return the number of bytes copied. The chunk size doubles after each chunk (up to the
+// maximum) and halves after an error. A chunk which fails is retried SARA_R5_UPLOAD_RETRIES times. If it still fails,
+// the error is returned and the upload can be resumed later with beginFileUpload and continueFileUpload
+SARA_R5_error_t SARA_R5::continueFileUpload(SARA_R5_file_upload &upload,
+                                            size_t (*source)(char *buffer, size_t offset, size_t length, void *context),
+                                            void *context, void (*progress)(size_t offset, size_t size, void *context))
 {
-  SARA_R5_error_t err;
-  char *response;
+  SARA_R5_LOCK_TRANSACTION(SARA_R5_PRIORITY_LOW);
+  SARA_R5_error_t err = SARA_R5_ERROR_SUCCESS;
+  int retries = 0;
 
-  int code, code2;
+  if ((source == nullptr) || (upload._filename[0] == 0))
+    return SARA_R5_ERROR_UNEXPECTED_PARAM;
 
-  response = sara_r5_calloc_char(minimumResponseAllocation);
-  if (response == nullptr)
-  {
+  char *buffer = sara_r5_calloc_char(upload._maxChunkSize);
+  if (buffer == nullptr)
     return SARA_R5_ERROR_OUT_OF_MEMORY;
-  }
-
-  err = sendCommandWithResponse(SARA_R5_FTP_PROTOCOL_ERROR, SARA_R5_RESPONSE_OK_OR_ERROR,
-                                response, SARA_R5_STANDARD_RESPONSE_TIMEOUT);
 
-  if (err == SARA_R5_ERROR_SUCCESS)
+  while (upload._offset < upload._size)
   {
-    int scanned = 0;
-    char *searchPtr = strstr(response, "+UFTPER:");
-    if (searchPtr != nullptr)
+    size_t length = upload._size - upload._offset;
+    if (length > upload._chunkSize)
+      length = upload._chunkSize;
+    if (source(buffer, upload._offset, length, context) != length)
     {
-      searchPtr += strlen("+UFTPER:"); //  Move searchPtr to first char
-      while (*searchPtr == ' ')
+      err = SARA_R5_ERROR_UNEXPECTED_PARAM; // The source ran out of data
+      break;
+    }
+
+    unsigned long startTime = millis();
+    err = appendFileContents(String(upload._filename), buffer, (int)length);
+
+    if (err != SARA_R5_ERROR_SUCCESS)
+    {
+      // Find out if the chunk made it into the file before giving up on it
+      int fileSize = 0;
+      if (getFileSize(String(upload._filename), &fileSize) != SARA_R5_ERROR_SUCCESS)
+        fileSize = -1;
+      if ((fileSize >= 0) && ((size_t)fileSize == (upload._offset + length)))
+        err = SARA_R5_ERROR_SUCCESS;
+      else if ((fileSize >= 0) && ((size_t)fileSize != upload._offset)) // Partially written. It cannot be resumed from here
       {
-        searchPtr++; // skip spaces
+        upload._error = SARA_R5_ERROR_UNEXPECTED_RESPONSE;
+        free(buffer);
+        return upload._error;
       }
-      scanned = sscanf(searchPtr, "%d,%d\r\n", &code, &code2);
     }
 
-    if (scanned == 2)
+    if (err != SARA_R5_ERROR_SUCCESS)
     {
-      *error_code = code;
-      *error_code2 = code2;
+      if (upload._chunkSize > SARA_R5_UPLOAD_MIN_CHUNK_SIZE)
+        upload._chunkSize /= 2;
+      if (retries++ >= SARA_R5_UPLOAD_RETRIES)
+        break;
+      continue;
     }
-    else
+
+    upload._timeTaken += millis() - startTime;
+    upload._bytesTimed += length;
+    upload._crc = crc32Update(upload._crc, buffer, length);
+    upload._offset += length;
+    retries = 0;
+    if (upload._chunkSize < upload._maxChunkSize)
     {
-      err = SARA_R5_ERROR_UNEXPECTED_RESPONSE;
+      upload._chunkSize *= 2;
+      if (upload._chunkSize > upload._maxChunkSize)
+        upload._chunkSize = upload._maxChunkSize;
     }
+
+    if (progress != nullptr)
+      progress(upload._offset, upload._size, context);
   }
 
-  free(response);
+  upload._error = err;
+  free(buffer);
   return err;
 }
 
-SARA_R5_error_t SARA_R5::resetSecurityProfile(int secprofile)
+static size_t sara_r5_upload_memory_source(char *buffer, size_t offset, size_t length, void *context)
 {
-  SARA_R5_error_t err;
-  char *command;
-
-  command = sara_r5_calloc_char(strlen(SARA_R5_SEC_PROFILE) + 6);
-  if (command == nullptr)
-    return SARA_R5_ERROR_OUT_OF_MEMORY;
-
-  sprintf(command, "%s=%d", SARA_R5_SEC_PROFILE, secprofile);
-
-  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, nullptr,
-                                SARA_R5_STANDARD_RESPONSE_TIMEOUT);
+  memcpy(buffer, ((const char *)context) + offset, length);
+  return length;
+}
 
-  free(command);
-  return err;
+// Upload the rest of the file from memory. data holds the whole file
+SARA_R5_error_t SARA_R5::continueFileUpload(SARA_R5_file_upload &upload, const char *data,
+                                            void (*progress)(size_t offset, size_t size, void *context))
+{
+  if (data == nullptr)
+    return SARA_R5_ERROR_UNEXPECTED_PARAM;
+  return continueFileUpload(upload, sara_r5_upload_memory_source, (void *)data, progress);
 }
 
-SARA_R5_error_t SARA_R5::configSecurityProfile(int secprofile, SARA_R5_sec_profile_parameter_t parameter, int value)
+// Average upload speed in bytes per second - measured over the successful +UDWNFILE commands
+unsigned long SARA_R5_file_upload::getThroughput(void)
 {
-    SARA_R5_error_t err;
-    char *command;
+  if (_timeTaken == 0)
+    return 0;
+  return (unsigned long)(((unsigned long long)_bytesTimed * 1000) / _timeTaken);
+}
 
-    command = sara_r5_calloc_char(strlen(SARA_R5_SEC_PROFILE) + 10);
-    if (command == nullptr)
-      return SARA_R5_ERROR_OUT_OF_MEMORY;
-    sprintf(command, "%s=%d,%d,%d", SARA_R5_SEC_PROFILE, secprofile,parameter,value);
-    err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, nullptr,
-                                  SARA_R5_STANDARD_RESPONSE_TIMEOUT);
-    free(command);
-    return err;
+// CRC-32 (IEEE 802.3). Start with 0xFFFFFFFF. Invert the result
+uint32_t SARA_R5::crc32Update(uint32_t crc, const char *data, size_t length)
+{
+  for (size_t i = 0; i < length; i++)
+  {
+    crc ^= (uint8_t)data[i];
+    for (int bit = 0; bit < 8; bit++)
+      crc = (crc & 1) ? ((crc >> 1) ^ 0xEDB88320UL) : (crc >> 1);
+  }
+  return crc;
 }
 
-SARA_R5_error_t SARA_R5::configSecurityProfileString(int secprofile, SARA_R5_sec_profile_parameter_t parameter, String value)
+// Open - or create - the store-and-forward journal called name. The segment files are name.0 to name.<segments - 1>.
+// Any existing segments are found from the sequence numbers in their first records, so the journal survives a restart.
+// The read position is not persisted: flushing starts again from the first record of the oldest segment (at-least-once)
+SARA_R5_error_t SARA_R5::openJournal(SARA_R5_journal &journal, const char *name, size_t segmentSize, int segments)
 {
-    SARA_R5_error_t err;
-    char *command;
-    command = sara_r5_calloc_char(strlen(SARA_R5_SEC_PROFILE) + value.length() + 10);
-    if (command == nullptr)
-      return SARA_R5_ERROR_OUT_OF_MEMORY;
-    sprintf(command, "%s=%d,%d,\"%s\"", SARA_R5_SEC_PROFILE, secprofile,parameter,value.c_str());
-    err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, nullptr,
-                                  SARA_R5_STANDARD_RESPONSE_TIMEOUT);
-    free(command);
-    return err;
+  SARA_R5_LOCK_TRANSACTION(SARA_R5_PRIORITY_LOW);
+  char filename[SARA_R5_JOURNAL_NAME_LENGTH];
+  bool found = false;
+
+  if ((name == nullptr) || (strlen(name) < 1) || (strlen(name) > (SARA_R5_JOURNAL_NAME_LENGTH - 5))
+      || (segments < 2) || (segments > SARA_R5_JOURNAL_MAX_SEGMENTS)
+      || (segmentSize < ((2 * SARA_R5_JOURNAL_OVERHEAD) + 4 + SARA_R5_JOURNAL_MAX_RECORD)))
+    return SARA_R5_ERROR_UNEXPECTED_PARAM;
+
+  strcpy(journal._name, name);
+  journal._segmentSize = segmentSize;
+  journal._segments = segments;
+  journal._headSeq = 0;
+  journal._tailSeq = 0;
+  journal._headSize = 0;
+  journal._tailOffset = 0;
+  journal._droppedSegments = 0;
+  journal._corruptRecords = 0;
+
+  for (int i = 0; i < segments; i++)
+  {
+    int size = 0;
+    uint32_t seq = 0;
+    journalSegmentName(journal, i, filename);
+    if (getFileSize(String(filename), &size) != SARA_R5_ERROR_SUCCESS)
+      continue; // The segment does not exist
+    if ((journalReadSegmentHeader(filename, &seq) != SARA_R5_ERROR_SUCCESS) || ((seq % segments) != (uint32_t)i))
+    {
+      deleteFile(String(filename)); // The segment header is incomplete - or the number of segments has changed
+      continue;
+    }
+    if ((found == false) || ((int32_t)(seq - journal._tailSeq) < 0))
+      journal._tailSeq = seq;
+    if ((found == false) || ((int32_t)(seq - journal._headSeq) > 0))
+    {
+      journal._headSeq = seq;
+      journal._headSize = size;
+    }
+    found = true;
+  }
+
+  if (_printDebug == true)
+  {
+    _debugPort->print(F("openJournal: "));
+    _debugPort->print(found ? (unsigned long)(journal._headSeq - journal._tailSeq + 1) : 0UL);
+    _debugPort->println(F(" segments"));
+  }
+
+  return SARA_R5_ERROR_SUCCESS;
 }
 
-SARA_R5_error_t SARA_R5::setSecurityManager(SARA_R5_sec_manager_opcode_t opcode, SARA_R5_sec_manager_parameter_t parameter, String name, String data)
+// Append one record to the journal. The record is framed and written with a single +UDWNFILE.
+// If the head segment is full, a new segment is started. If every segment is in use, the oldest is dropped
+SARA_R5_error_t SARA_R5::journalAppend(SARA_R5_journal &journal, const char *data, size_t length)
 {
-  char *command;
-  char *response;
+  SARA_R5_LOCK_TRANSACTION(SARA_R5_PRIORITY_LOW);
+  char filename[SARA_R5_JOURNAL_NAME_LENGTH];
   SARA_R5_error_t err;
 
-  command = sara_r5_calloc_char(strlen(SARA_R5_SEC_MANAGER) + name.length() + 20);
-  if (command == nullptr)
-    return SARA_R5_ERROR_OUT_OF_MEMORY;
-  response = sara_r5_calloc_char(minimumResponseAllocation);
-  if (response == nullptr)
-  {
-    free(command);
+  if ((journal.isOpen() == false) || (data == nullptr) || (length < 1) || (length > SARA_R5_JOURNAL_MAX_RECORD))
+    return SARA_R5_ERROR_UNEXPECTED_PARAM;
+
+  if ((journal._headSize > 0) && ((journal._headSize + length + SARA_R5_JOURNAL_OVERHEAD) > journal._segmentSize))
+    journalRotate(journal);
+
+  char *frame = sara_r5_calloc_char(length + (2 * SARA_R5_JOURNAL_OVERHEAD) + 4);
+  if (frame == nullptr)
     return SARA_R5_ERROR_OUT_OF_MEMORY;
-  }
-  int dataLen = data.length();
-  sprintf(command, "%s=%d,%d,\"%s\",%d", SARA_R5_SEC_MANAGER, opcode, parameter, name.c_str(), dataLen);
 
-  err = sendCommandWithResponse(command, ">", response, SARA_R5_STANDARD_RESPONSE_TIMEOUT);
-  if (err == SARA_R5_ERROR_SUCCESS)
+  size_t frameLength = 0;
+  if (journal._headSize == 0) // Start the segment with its sequence number
   {
-    if (_printDebug == true)
-    {
-      _debugPort->print(F("dataDownload: writing "));
-      _debugPort->print(dataLen);
-      _debugPort->println(F(" bytes"));
-    }
-    hwWriteData(data.c_str(), dataLen);
-    err = waitForResponse(SARA_R5_RESPONSE_OK, SARA_R5_RESPONSE_ERROR, SARA_R5_SECURITY_RESPONSE_TIMEOUT);
+    char seq[4];
+    for (int i = 0; i < 4; i++)
+      seq[i] = (char)((journal._headSeq >> (8 * i)) & 0xFF);
+    frameLength = journalFrame(frame, SARA_R5_JOURNAL_SEGMENT_MAGIC, seq, 4);
   }
+  frameLength += journalFrame(&frame[frameLength], SARA_R5_JOURNAL_RECORD_MAGIC, data, length);
 
+  journalSegmentName(journal, journal._headSeq, filename);
+  err = appendFileContents(String(filename), frame, (int)frameLength);
 
-  if (err != SARA_R5_ERROR_SUCCESS)
+  if (err == SARA_R5_ERROR_SUCCESS)
+    journal._headSize += frameLength;
+  else
   {
+    int size = 0;
+    bool nothingWritten = ((getFileSize(String(filename), &size) == SARA_R5_ERROR_SUCCESS) && ((size_t)size == journal._headSize));
+    if ((nothingWritten == false) && (journal._headSize == 0))
+      deleteFile(String(filename)); // The segment header may be incomplete
+    else if (nothingWritten == false)
+      journalRotate(journal); // The segment may end with part of a frame. Start a new one for the next record
+
     if (_printDebug == true)
     {
-      _debugPort->print(F("dataDownload: Error: "));
-      _debugPort->print(err);
-      _debugPort->print(F(" => {"));
-      _debugPort->print(response);
-      _debugPort->println(F("}"));
+      _debugPort->print(F("journalAppend: Error: "));
+      _debugPort->println(err);
     }
   }
 
-  free(command);
-  free(response);
+  free(frame);
   return err;
 }
 
-SARA_R5_error_t SARA_R5::setPDPconfiguration(int profile, SARA_R5_pdp_configuration_parameter_t parameter, int value)
+// Flush the journal. The records are read back in batches of up to maxBytes and the sink is passed each batch.
+// Once the sink returns SARA_R5_ERROR_SUCCESS, the records are removed from the journal. Flushing stops at the first
+// error. The records which were not delivered are kept. maxBatches limits the number of batches (0 for no limit)
+SARA_R5_error_t SARA_R5::journalFlush(SARA_R5_journal &journal, SARA_R5_error_t (*sink)(const char *data, size_t length, void *context),
+                                      void *context, size_t maxBytes, int maxBatches)
 {
-  SARA_R5_error_t err;
-  char *command;
+  SARA_R5_journal_cursor_t cursor;
+  SARA_R5_error_t err = SARA_R5_ERROR_SUCCESS;
+  bool more = true;
+  int batches = 0;
 
-  if (profile >= SARA_R5_NUM_PSD_PROFILES)
-    return SARA_R5_ERROR_ERROR;
+  if ((journal.isOpen() == false) || (sink == nullptr) || (maxBytes < (SARA_R5_JOURNAL_MAX_RECORD + SARA_R5_JOURNAL_BATCH_OVERHEAD)))
+    return SARA_R5_ERROR_UNEXPECTED_PARAM;
 
-  command = sara_r5_calloc_char(strlen(SARA_R5_MESSAGE_PDP_CONFIG) + 24);
-  if (command == nullptr)
+  char *batch = sara_r5_calloc_char(maxBytes);
+  if (batch == nullptr)
     return SARA_R5_ERROR_OUT_OF_MEMORY;
-  sprintf(command, "%s=%d,%d,%d", SARA_R5_MESSAGE_PDP_CONFIG, profile, parameter,
-          value);
+  cursor.buffer = sara_r5_calloc_char(SARA_R5_JOURNAL_READ_SIZE);
+  if (cursor.buffer == nullptr)
+  {
+    free(batch);
+    return SARA_R5_ERROR_OUT_OF_MEMORY;
+  }
+  cursor.seq = journal._tailSeq;
+  cursor.offset = journal._tailOffset;
+  cursor.segmentEnd = -1;
+  cursor.bufferSeq = journal._tailSeq;
+  cursor.bufferOffset = 0;
+  cursor.bufferLength = 0;
 
-  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, nullptr,
-                                SARA_R5_STANDARD_RESPONSE_TIMEOUT);
+  while ((more == true) && ((maxBatches == 0) || (batches < maxBatches)))
+  {
+    size_t batchLength = 0;
+    int records = 0;
 
-  free(command);
+    while (true) // The lock is only held while the batch is read. The sink may wait for a URC
+    {
+      SARA_R5_LOCK_TRANSACTION(SARA_R5_PRIORITY_LOW);
+      uint32_t seq = cursor.seq; // Remember where this record starts, in case it does not fit
+      size_t offset = cursor.offset;
+      long segmentEnd = cursor.segmentEnd;
+      const char *data;
+      size_t length;
+
+      err = journalNextRecord(journal, &cursor, &data, &length);
+      if (err == SARA_R5_ERROR_ZERO_READ_LENGTH) // No more records
+      {
+        err = SARA_R5_ERROR_SUCCESS;
+        more = false;
+        break;
+      }
+      if (err != SARA_R5_ERROR_SUCCESS)
+        break;
+      if ((batchLength + SARA_R5_JOURNAL_BATCH_OVERHEAD + length) > maxBytes) // The record goes in the next batch
+      {
+        cursor.seq = seq;
+        cursor.offset = offset;
+        cursor.segmentEnd = segmentEnd;
+        break;
+      }
+      batch[batchLength++] = (char)(length & 0xFF); // Each record is preceded by its length, LSB first
+      batch[batchLength++] = (char)((length >> 8) & 0xFF);
+      memcpy(&batch[batchLength], data, length);
+      batchLength += length;
+      records++;
+    }
+
+    if ((err == SARA_R5_ERROR_SUCCESS) && (batchLength > 0))
+    {
+      err = sink(batch, batchLength, context);
+      batches++;
+      if (_printDebug == true)
+      {
+        _debugPort->print(F("journalFlush: "));
+        _debugPort->print(records);
+        _debugPort->print(F(" records, "));
+        _debugPort->print(batchLength);
+        _debugPort->print(F(" bytes. Result: "));
+        _debugPort->println(err);
+      }
+    }
+    if (err != SARA_R5_ERROR_SUCCESS)
+      break;
+    {
+      SARA_R5_LOCK_TRANSACTION(SARA_R5_PRIORITY_LOW);
+      journalCommit(journal, &cursor);
+    }
+  }
+
+  free(cursor.buffer);
+  free(batch);
   return err;
 }
 
-SARA_R5_error_t SARA_R5::setPDPconfiguration(int profile, SARA_R5_pdp_configuration_parameter_t parameter, SARA_R5_pdp_protocol_type_t value)
+typedef struct
 {
-  return (setPDPconfiguration(profile, parameter, (int)value));
-}
+  SARA_R5 *sara;
+  int socket;
+  const String *topic;
+  uint8_t qos;
+  bool retain;
+  int profile;
+  const String *path;
+  const String *responseFilename;
+  SARA_R5_http_content_types_t httpContentType;
+  char staging[SARA_R5_JOURNAL_NAME_LENGTH + 4]; // name.out
+} sara_r5_journal_flush_t;
 
-SARA_R5_error_t SARA_R5::setPDPconfiguration(int profile, SARA_R5_pdp_configuration_parameter_t parameter, String value)
+static SARA_R5_error_t sara_r5_journal_socket_sink(const char *data, size_t length, void *context)
 {
-  SARA_R5_error_t err;
-  char *command;
-
-  if (profile >= SARA_R5_NUM_PSD_PROFILES)
-    return SARA_R5_ERROR_ERROR;
-
-  command = sara_r5_calloc_char(strlen(SARA_R5_MESSAGE_PDP_CONFIG) + 64);
-  if (command == nullptr)
-    return SARA_R5_ERROR_OUT_OF_MEMORY;
-  sprintf(command, "%s=%d,%d,\"%s\"", SARA_R5_MESSAGE_PDP_CONFIG, profile, parameter,
-          value.c_str());
+  sara_r5_journal_flush_t *flush = (sara_r5_journal_flush_t *)context;
+  return flush->sara->socketWrite(flush->socket, data, (int)length);
+}
 
-  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, nullptr,
-                                SARA_R5_STANDARD_RESPONSE_TIMEOUT);
+// Write the batch to the staging file
+static SARA_R5_error_t sara_r5_journal_stage(sara_r5_journal_flush_t *flush, const char *data, size_t length)
+{
+  flush->sara->deleteFile(String(flush->staging)); // This fails if the file does not exist. That's OK
+  return flush->sara->appendFileContents(String(flush->staging), data, (int)length);
+}
 
-  free(command);
+static SARA_R5_error_t sara_r5_journal_mqtt_sink(const char *data, size_t length, void *context)
+{
+  sara_r5_journal_flush_t *flush = (sara_r5_journal_flush_t *)context;
+  SARA_R5_error_t err = sara_r5_journal_stage(flush, data, length);
+  if (err == SARA_R5_ERROR_SUCCESS)
+    err = flush->sara->mqttPublishFromFile(*flush->topic, String(flush->staging), flush->qos, flush->retain);
+  if (err == SARA_R5_ERROR_SUCCESS)
+  {
+    int result = 0;
+    err = flush->sara->waitForMQTTPublishFileResult(&result);
+    if ((err == SARA_R5_ERROR_SUCCESS) && (result != 1))
+      err = SARA_R5_ERROR_ERROR;
+  }
   return err;
 }
 
-SARA_R5_error_t SARA_R5::setPDPconfiguration(int profile, SARA_R5_pdp_configuration_parameter_t parameter, IPAddress value)
+static SARA_R5_error_t sara_r5_journal_http_sink(const char *data, size_t length, void *context)
 {
-  SARA_R5_error_t err;
-  char *command;
-
-  if (profile >= SARA_R5_NUM_PSD_PROFILES)
-    return SARA_R5_ERROR_ERROR;
-
-  command = sara_r5_calloc_char(strlen(SARA_R5_MESSAGE_PDP_CONFIG) + 64);
-  if (command == nullptr)
-    return SARA_R5_ERROR_OUT_OF_MEMORY;
-  sprintf(command, "%s=%d,%d,\"%d.%d.%d.%d\"", SARA_R5_MESSAGE_PDP_CONFIG, profile, parameter,
-          value[0], value[1], value[2], value[3]);
-
-  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, nullptr,
-                                SARA_R5_STANDARD_RESPONSE_TIMEOUT);
-
-  free(command);
+  sara_r5_journal_flush_t *flush = (sara_r5_journal_flush_t *)context;
+  SARA_R5_error_t err = sara_r5_journal_stage(flush, data, length);
+  if (err == SARA_R5_ERROR_SUCCESS)
+    err = flush->sara->sendHTTPPOSTfile(flush->profile, *flush->path, *flush->responseFilename,
+                                        String(flush->staging), flush->httpContentType);
+  if (err == SARA_R5_ERROR_SUCCESS)
+  {
+    int result = 0;
+    err = flush->sara->waitForHTTPResult(flush->profile, &result);
+    if ((err == SARA_R5_ERROR_SUCCESS) && (result != 1))
+      err = SARA_R5_ERROR_ERROR;
+  }
   return err;
 }
 
-SARA_R5_error_t SARA_R5::performPDPaction(int profile, SARA_R5_pdp_actions_t action)
+// Flush the whole journal through an open socket
+SARA_R5_error_t SARA_R5::journalFlushSocket(SARA_R5_journal &journal, int socket, size_t maxBytes)
 {
-  SARA_R5_error_t err;
-  char *command;
+  sara_r5_journal_flush_t flush;
+  flush.sara = this;
+  flush.socket = socket;
+  return journalFlush(journal, sara_r5_journal_socket_sink, &flush, maxBytes);
+}
 
-  if (profile >= SARA_R5_NUM_PSD_PROFILES)
-    return SARA_R5_ERROR_ERROR;
+// Publish one batch from the journal and wait for its +UUMQTTC result
+SARA_R5_error_t SARA_R5::journalFlushMQTT(SARA_R5_journal &journal, const String& topic, uint8_t qos, bool retain, size_t maxBytes)
+{
+  sara_r5_journal_flush_t flush;
+  if (journal.isOpen() == false)
+    return SARA_R5_ERROR_UNEXPECTED_PARAM;
+  flush.sara = this;
+  flush.topic = &topic;
+  flush.qos = qos;
+  flush.retain = retain;
+  snprintf(flush.staging, sizeof(flush.staging), "%s.out", journal._name);
+  return journalFlush(journal, sara_r5_journal_mqtt_sink, &flush, maxBytes, 1);
+}
 
-  command = sara_r5_calloc_char(strlen(SARA_R5_MESSAGE_PDP_ACTION) + 32);
-  if (command == nullptr)
-    return SARA_R5_ERROR_OUT_OF_MEMORY;
-  sprintf(command, "%s=%d,%d", SARA_R5_MESSAGE_PDP_ACTION, profile, action);
+// POST one batch from the journal and wait for its +UUHTTPCR result
+SARA_R5_error_t SARA_R5::journalFlushHTTP(SARA_R5_journal &journal, int profile, String path, String responseFilename,
+                                          SARA_R5_http_content_types_t httpContentType, size_t maxBytes)
+{
+  sara_r5_journal_flush_t flush;
+  if (journal.isOpen() == false)
+    return SARA_R5_ERROR_UNEXPECTED_PARAM;
+  flush.sara = this;
+  flush.profile = profile;
+  flush.path = &path;
+  flush.responseFilename = &responseFilename;
+  flush.httpContentType = httpContentType;
+  snprintf(flush.staging, sizeof(flush.staging), "%s.out", journal._name);
+  return journalFlush(journal, sara_r5_journal_http_sink, &flush, maxBytes, 1);
+}
 
-  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, nullptr,
-                                SARA_R5_STANDARD_RESPONSE_TIMEOUT);
+void SARA_R5::journalSegmentName(const SARA_R5_journal &journal, uint32_t seq, char *filename)
+{
+  sprintf(filename, "%s.%u", journal._name, (unsigned int)(seq % journal._segments));
+}
 
-  free(command);
-  return err;
+// Write one frame to dest: magic, length (2 bytes), data, CRC-32 of the data (4 bytes). Returns the frame length
+size_t SARA_R5::journalFrame(char *dest, uint8_t magic, const char *data, size_t length)
+{
+  uint32_t crc = ~crc32Update(0xFFFFFFFF, data, length);
+  dest[0] = (char)magic;
+  dest[1] = (char)(length & 0xFF);
+  dest[2] = (char)((length >> 8) & 0xFF);
+  memcpy(&dest[3], data, length);
+  for (int i = 0; i < 4; i++)
+    dest[3 + length + i] = (char)((crc >> (8 * i)) & 0xFF);
+  return length + SARA_R5_JOURNAL_OVERHEAD;
 }
 
-SARA_R5_error_t SARA_R5::activatePDPcontext(bool status, int cid)
+static uint32_t sara_r5_journal_get32(const char *src)
 {
-  SARA_R5_error_t err;
-  char *command;
+  uint32_t val = 0;
+  for (int i = 3; i >= 0; i--)
+    val = (val << 8) | (uint8_t)src[i];
+  return val;
+}
 
-  if (cid >= SARA_R5_NUM_PDP_CONTEXT_IDENTIFIERS)
-    return SARA_R5_ERROR_ERROR;
+SARA_R5_error_t SARA_R5::journalReadSegmentHeader(const char *filename, uint32_t *seq)
+{
+  char header[SARA_R5_JOURNAL_OVERHEAD + 4];
+  size_t bytesRead = 0;
 
-  command = sara_r5_calloc_char(strlen(SARA_R5_MESSAGE_PDP_CONTEXT_ACTIVATE) + 32);
-  if (command == nullptr)
-    return SARA_R5_ERROR_OUT_OF_MEMORY;
-  if (cid == -1)
-    sprintf(command, "%s=%d", SARA_R5_MESSAGE_PDP_CONTEXT_ACTIVATE, status);
-  else
-    sprintf(command, "%s=%d,%d", SARA_R5_MESSAGE_PDP_CONTEXT_ACTIVATE, status, cid);
+  SARA_R5_error_t err = readFileBlock(filename, header, 0, sizeof(header), &bytesRead);
+  if (err != SARA_R5_ERROR_SUCCESS)
+    return err;
+  if ((bytesRead != sizeof(header)) || ((uint8_t)header[0] != SARA_R5_JOURNAL_SEGMENT_MAGIC) || (header[1] != 4) || (header[2] != 0))
+    return SARA_R5_ERROR_UNEXPECTED_RESPONSE;
+  if ((~crc32Update(0xFFFFFFFF, &header[3], 4)) != sara_r5_journal_get32(&header[7]))
+    return SARA_R5_ERROR_UNEXPECTED_RESPONSE;
+  *seq = sara_r5_journal_get32(&header[3]);
+  return SARA_R5_ERROR_SUCCESS;
+}
 
-  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, nullptr,
-                                SARA_R5_STANDARD_RESPONSE_TIMEOUT);
+// Start a new head segment. If every segment is in use, the oldest is dropped
+void SARA_R5::journalRotate(SARA_R5_journal &journal)
+{
+  char filename[SARA_R5_JOURNAL_NAME_LENGTH];
 
-  free(command);
-  return err;
+  journal._headSeq++;
+  journal._headSize = 0;
+  if ((journal._headSeq - journal._tailSeq) >= (uint32_t)journal._segments)
+  {
+    journal._tailSeq++;
+    journal._tailOffset = 0;
+    journal._droppedSegments++;
+    if (_printDebug == true)
+      _debugPort->println(F("journalRotate: journal is full. Dropping the oldest segment"));
+  }
+  journalSegmentName(journal, journal._headSeq, filename);
+  deleteFile(String(filename)); // The oldest segment - or an old one. This fails if the file does not exist. That's OK
 }
 
-SARA_R5_error_t SARA_R5::getNetworkAssignedIPAddress(int profile, IPAddress *address)
+// Read the next valid record at the cursor. data points into the cursor buffer. A frame which is cut short or fails
+// its CRC is counted as corrupt and the rest of its segment is skipped. Returns SARA_R5_ERROR_ZERO_READ_LENGTH when
+// there are no more records
+SARA_R5_error_t SARA_R5::journalNextRecord(SARA_R5_journal &journal, SARA_R5_journal_cursor_t *cursor, const char **data, size_t *length)
 {
-  char *command;
-  char *response;
+  char filename[SARA_R5_JOURNAL_NAME_LENGTH];
   SARA_R5_error_t err;
-  int scanNum = 0;
-  int profileStore = 0;
-  int paramTag = 0; // 0: IP address: dynamic IP address assigned during PDP context activation
-  int paramVals[4];
-
-  command = sara_r5_calloc_char(strlen(SARA_R5_NETWORK_ASSIGNED_DATA) + 16);
-  if (command == nullptr)
-    return SARA_R5_ERROR_OUT_OF_MEMORY;
-  sprintf(command, "%s=%d,%d", SARA_R5_NETWORK_ASSIGNED_DATA, profile, paramTag);
 
-  response = sara_r5_calloc_char(minimumResponseAllocation);
-  if (response == nullptr)
+  while (true)
   {
-    free(command);
-    return SARA_R5_ERROR_OUT_OF_MEMORY;
-  }
+    journalSegmentName(journal, cursor->seq, filename);
+    if (cursor->seq == journal._headSeq)
+      cursor->segmentEnd = journal._headSize;
+    else if (cursor->segmentEnd < 0)
+    {
+      int size = 0;
+      if (getFileSize(String(filename), &size) != SARA_R5_ERROR_SUCCESS)
+        size = 0; // The segment has been deleted
+      cursor->segmentEnd = size;
+    }
 
-  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, response,
-                                SARA_R5_STANDARD_RESPONSE_TIMEOUT);
+    if ((cursor->offset + SARA_R5_JOURNAL_OVERHEAD) > (size_t)cursor->segmentEnd) // The end of this segment
+    {
+      if (cursor->seq == journal._headSeq)
+        return SARA_R5_ERROR_ZERO_READ_LENGTH;
+      cursor->seq++;
+      cursor->offset = 0;
+      cursor->segmentEnd = -1;
+      continue;
+    }
 
-  if (err == SARA_R5_ERROR_SUCCESS)
-  {
-    char *searchPtr = strstr(response, "+UPSND:");
-    if (searchPtr != nullptr)
+    // Find the frame header, then the whole frame, in the buffer. Read a new block if it is not there
+    const char *frame = nullptr;
+    size_t frameLength = SARA_R5_JOURNAL_OVERHEAD;
+    bool valid = true;
+    for (int pass = 0; (pass < 2) && (valid == true); pass++)
     {
-      searchPtr += strlen("+UPSND:"); //  Move searchPtr to first char
-      while (*searchPtr == ' ') searchPtr++; // skip spaces
-      scanNum = sscanf(searchPtr, "%d,%d,\"%d.%d.%d.%d\"",
-                        &profileStore, &paramTag,
-                        &paramVals[0], &paramVals[1], &paramVals[2], &paramVals[3]);
+      if ((cursor->bufferSeq != cursor->seq) || (cursor->offset < cursor->bufferOffset)
+          || ((cursor->offset + frameLength) > (cursor->bufferOffset + cursor->bufferLength)))
+      {
+        size_t request = (size_t)cursor->segmentEnd - cursor->offset;
+        if (request > SARA_R5_JOURNAL_READ_SIZE)
+          request = SARA_R5_JOURNAL_READ_SIZE;
+        cursor->bufferLength = 0;
+        err = readFileBlock(filename, cursor->buffer, cursor->offset, request, &cursor->bufferLength);
+        if (err != SARA_R5_ERROR_SUCCESS)
+          return err;
+        cursor->bufferSeq = cursor->seq;
+        cursor->bufferOffset = cursor->offset;
+      }
+      if ((cursor->offset + frameLength) > (cursor->bufferOffset + cursor->bufferLength))
+      {
+        valid = false; // The segment is shorter than it should be
+        break;
+      }
+      frame = &cursor->buffer[cursor->offset - cursor->bufferOffset];
+      if (pass == 0)
+      {
+        size_t dataLength = (uint8_t)frame[1] | ((size_t)(uint8_t)frame[2] << 8);
+        frameLength = dataLength + SARA_R5_JOURNAL_OVERHEAD;
+        if ((((uint8_t)frame[0] != SARA_R5_JOURNAL_RECORD_MAGIC) && ((uint8_t)frame[0] != SARA_R5_JOURNAL_SEGMENT_MAGIC))
+            || (dataLength > SARA_R5_JOURNAL_MAX_RECORD) || ((cursor->offset + frameLength) > (size_t)cursor->segmentEnd))
+          valid = false;
+      }
     }
-    if (scanNum != 6)
+
+    if (valid == true)
     {
+      size_t dataLength = frameLength - SARA_R5_JOURNAL_OVERHEAD;
+      valid = ((~crc32Update(0xFFFFFFFF, &frame[3], dataLength)) == sara_r5_journal_get32(&frame[3 + dataLength]));
+    }
+
+    if (valid == false)
+    {
+      journal._corruptRecords++;
       if (_printDebug == true)
       {
-        _debugPort->print(F("getNetworkAssignedIPAddress: error: scanNum is "));
-        _debugPort->println(scanNum);
+        _debugPort->print(F("journalNextRecord: corrupt record in "));
+        _debugPort->println(filename);
       }
-      free(command);
-      free(response);
-      return SARA_R5_ERROR_UNEXPECTED_RESPONSE;
+      cursor->offset = cursor->segmentEnd; // Skip the rest of the segment
+      continue;
     }
 
-    IPAddress tempAddress = { (uint8_t)paramVals[0], (uint8_t)paramVals[1],
-                              (uint8_t)paramVals[2], (uint8_t)paramVals[3] };
-    *address = tempAddress;
+    cursor->offset += frameLength;
+    if ((uint8_t)frame[0] == SARA_R5_JOURNAL_SEGMENT_MAGIC)
+      continue;
+    *data = &frame[3];
+    *length = frameLength - SARA_R5_JOURNAL_OVERHEAD;
+    return SARA_R5_ERROR_SUCCESS;
   }
+}
 
-  free(command);
-  free(response);
+// Remove the records before the cursor from the journal. Segments which have been read completely are deleted
+void SARA_R5::journalCommit(SARA_R5_journal &journal, const SARA_R5_journal_cursor_t *cursor)
+{
+  char filename[SARA_R5_JOURNAL_NAME_LENGTH];
 
-  return err;
+  if ((int32_t)(cursor->seq - journal._tailSeq) < 0) // The segment has been dropped
+    return;
+
+  while (journal._tailSeq != cursor->seq)
+  {
+    journalSegmentName(journal, journal._tailSeq, filename);
+    deleteFile(String(filename));
+    journal._tailSeq++;
+  }
+  journal._tailOffset = cursor->offset;
+
+  if ((journal._tailSeq == journal._headSeq) && (journal._headSize > 0) && (journal._tailOffset >= journal._headSize))
+  {
+    // Everything has been delivered. Delete the head segment too and start again with a new one
+    journalSegmentName(journal, journal._headSeq, filename);
+    deleteFile(String(filename));
+    journal._headSeq++;
+    journal._tailSeq = journal._headSeq;
+    journal._headSize = 0;
+    journal._tailOffset = 0;
+  }
 }
 
-bool SARA_R5::isGPSon(void)
+SARA_R5_error_t SARA_R5::getFileSize(String filename, int *size)
 {
+  SARA_R5_LOCK_TRANSACTION(SARA_R5_PRIORITY_LOW);
   SARA_R5_error_t err;
   char *command;
   char *response;
-  bool on = false;
 
-  command = sara_r5_calloc_char(strlen(SARA_R5_GNSS_POWER) + 2);
+  if ((nullptr != _fileIndex) && (loadFileIndex() == SARA_R5_ERROR_SUCCESS))
+  {
+    SARA_R5_file_index_entry_t *entry = fileIndexFind(filename.c_str());
+    if ((entry != nullptr) && (entry->size >= 0))
+    {
+      *size = entry->size;
+      return SARA_R5_ERROR_SUCCESS;
+    }
+    if ((entry == nullptr) && (_fileIndex->complete == true))
+    {
+      if (_printDebug == true)
+        _debugPort->println(F("getFileSize: file does not exist"));
+      return SARA_R5_ERROR_ERROR; // The module would return ERROR
+    }
+  }
+
+  command = sara_r5_calloc_char(strlen(SARA_R5_FILE_SYSTEM_LIST_FILES) + filename.length() + 8);
   if (command == nullptr)
     return SARA_R5_ERROR_OUT_OF_MEMORY;
-  sprintf(command, "%s?", SARA_R5_GNSS_POWER);
+  sprintf(command, "%s=2,\"%s\"", SARA_R5_FILE_SYSTEM_LIST_FILES, filename.c_str());
 
   response = sara_r5_calloc_char(minimumResponseAllocation);
   if (response == nullptr)
@@ -5032,682 +10363,822 @@ bool SARA_R5::isGPSon(void)
     return SARA_R5_ERROR_OUT_OF_MEMORY;
   }
 
-  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, response,
-                                SARA_R5_10_SEC_TIMEOUT);
+  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, response, SARA_R5_STANDARD_RESPONSE_TIMEOUT);
+  if (err != SARA_R5_ERROR_SUCCESS)
+  {
+    if (_printDebug == true)
+    {
+      _debugPort->print(F("getFileSize: Fail: Error: "));
+      _debugPort->print(err);
+      _debugPort->print(F("  Response: {"));
+      _debugPort->print(response);
+      _debugPort->println(F("}"));
+    }
+    free(command);
+    free(response);
+    return err;
+  }
 
-  if (err == SARA_R5_ERROR_SUCCESS)
+  char *responseStart = strstr(response, "+ULSTFILE:");
+  if (responseStart == nullptr)
   {
-    // Example response: "+UGPS: 0" for off "+UGPS: 1,0,1" for on
-    // Search for a ':' followed by a '1' or ' 1'
-    char *pch1 = strchr(response, ':');
-    if (pch1 != nullptr)
+    if (_printDebug == true)
     {
-      char *pch2 = strchr(response, '1');
-      if ((pch2 != nullptr) && ((pch2 == pch1 + 1) || (pch2 == pch1 + 2)))
-        on = true;
+      _debugPort->print(F("getFileSize: Failure: {"));
+      _debugPort->print(response);
+      _debugPort->println(F("}"));
     }
+    free(command);
+    free(response);
+    return SARA_R5_ERROR_UNEXPECTED_RESPONSE;
   }
 
+  int fileSize;
+  responseStart += strlen("+ULSTFILE:"); //  Move searchPtr to first char
+  while (*responseStart == ' ') responseStart++; // skip spaces
+  sscanf(responseStart, "%d", &fileSize);
+  *size = fileSize;
+
+  SARA_R5_file_index_entry_t *entry = fileIndexFind(filename.c_str());
+  if (entry == nullptr)
+    entry = fileIndexAdd(filename.c_str());
+  if (entry != nullptr)
+    entry->size = fileSize;
+
   free(command);
   free(response);
-
-  return on;
+  return err;
 }
 
-SARA_R5_error_t SARA_R5::gpsPower(bool enable, gnss_system_t gnss_sys, gnss_aiding_mode_t gnss_aiding)
+SARA_R5_error_t SARA_R5::deleteFile(String filename)
 {
+  SARA_R5_LOCK_TRANSACTION(SARA_R5_PRIORITY_LOW);
   SARA_R5_error_t err;
   char *command;
-  bool gpsState;
-
-  // Don't turn GPS on/off if it's already on/off
-  gpsState = isGPSon();
-  if ((enable && gpsState) || (!enable && !gpsState))
-  {
-    return SARA_R5_ERROR_SUCCESS;
-  }
 
-  // GPS power management
-  command = sara_r5_calloc_char(strlen(SARA_R5_GNSS_POWER) + 32); // gnss_sys could be up to three digits
+  command = sara_r5_calloc_char(strlen(SARA_R5_FILE_SYSTEM_DELETE_FILE) + filename.length() + 8);
   if (command == nullptr)
     return SARA_R5_ERROR_OUT_OF_MEMORY;
-  if (enable)
+  sprintf(command, "%s=\"%s\"", SARA_R5_FILE_SYSTEM_DELETE_FILE, filename.c_str());
+
+  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, nullptr, SARA_R5_STANDARD_RESPONSE_TIMEOUT);
+
+  if (err != SARA_R5_ERROR_SUCCESS)
   {
-    sprintf(command, "%s=1,%d,%d", SARA_R5_GNSS_POWER, gnss_aiding, gnss_sys);
+    if (_printDebug == true)
+    {
+      _debugPort->print(F("deleteFile: Fail: Error: "));
+      _debugPort->println(err);
+    }
   }
   else
-  {
-    sprintf(command, "%s=0", SARA_R5_GNSS_POWER);
-  }
-
-  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, nullptr, 10000);
+    fileIndexRemove(filename.c_str());
 
   free(command);
   return err;
 }
 
-/*
-SARA_R5_error_t SARA_R5::gpsEnableClock(bool enable)
+// Enable or disable the file system index. Enabling allocates the index. It is read from the module on first use
+SARA_R5_error_t SARA_R5::setFileIndex(bool enable)
 {
-    // AT+UGZDA=<0,1>
-    SARA_R5_error_t err = SARA_R5_ERROR_SUCCESS;
-    return err;
-}
+  SARA_R5_LOCK_TRANSACTION(SARA_R5_PRIORITY_LOW);
 
-SARA_R5_error_t SARA_R5::gpsGetClock(struct ClockData *clock)
-{
-    // AT+UGZDA?
-    SARA_R5_error_t err = SARA_R5_ERROR_SUCCESS;
-    return err;
-}
+  if (enable == false)
+  {
+    if (nullptr != _fileIndex)
+      delete _fileIndex;
+    _fileIndex = nullptr;
+    return SARA_R5_ERROR_SUCCESS;
+  }
 
-SARA_R5_error_t SARA_R5::gpsEnableFix(bool enable)
-{
-    // AT+UGGGA=<0,1>
-    SARA_R5_error_t err = SARA_R5_ERROR_SUCCESS;
-    return err;
+  if (nullptr == _fileIndex)
+  {
+    _fileIndex = new SARA_R5_file_index_t;
+    if (nullptr == _fileIndex)
+    {
+      if (_printDebug == true)
+        _debugPort->println(F("setFileIndex: not enough memory for _fileIndex!"));
+      return SARA_R5_ERROR_OUT_OF_MEMORY;
+    }
+    memset(_fileIndex, 0, sizeof(SARA_R5_file_index_t));
+    _fileIndex->freeSpace = -1;
+  }
+  return SARA_R5_ERROR_SUCCESS;
 }
 
-SARA_R5_error_t SARA_R5::gpsGetFix(struct PositionData *pos)
+// Mark the index as out of date. The file list and free space are read again on next use
+void SARA_R5::invalidateFileIndex(void)
 {
-    // AT+UGGGA?
-    SARA_R5_error_t err = SARA_R5_ERROR_SUCCESS;
-    return err;
+  if (nullptr == _fileIndex)
+    return;
+  _fileIndex->valid = false;
+  _fileIndex->count = 0;
+  _fileIndex->freeSpace = -1;
 }
 
-SARA_R5_error_t SARA_R5::gpsEnablePos(bool enable)
+// Return the number of files in the module file system. Returns -1 if the index is not enabled or cannot be read
+int SARA_R5::getFileCount(void)
 {
-    // AT+UGGLL=<0,1>
-    SARA_R5_error_t err = SARA_R5_ERROR_SUCCESS;
-    return err;
-}
+  SARA_R5_LOCK_TRANSACTION(SARA_R5_PRIORITY_LOW);
 
-SARA_R5_error_t SARA_R5::gpsGetPos(struct PositionData *pos)
-{
-    // AT+UGGLL?
-    SARA_R5_error_t err = SARA_R5_ERROR_SUCCESS;
-    return err;
+  if (loadFileIndex() != SARA_R5_ERROR_SUCCESS)
+    return -1;
+  return _fileIndex->count;
 }
 
-SARA_R5_error_t SARA_R5::gpsEnableSat(bool enable)
+SARA_R5_error_t SARA_R5::getFileName(int index, String *filename)
 {
-    // AT+UGGSV=<0,1>
-    SARA_R5_error_t err = SARA_R5_ERROR_SUCCESS;
-    return err;
-}
+  SARA_R5_LOCK_TRANSACTION(SARA_R5_PRIORITY_LOW);
 
-SARA_R5_error_t SARA_R5::gpsGetSat(uint8_t *sats)
-{
-    // AT+UGGSV?
-    SARA_R5_error_t err = SARA_R5_ERROR_SUCCESS;
+  SARA_R5_error_t err = loadFileIndex();
+  if (err != SARA_R5_ERROR_SUCCESS)
     return err;
+  if ((index < 0) || (index >= _fileIndex->count))
+    return SARA_R5_ERROR_UNEXPECTED_PARAM;
+  *filename = String(_fileIndex->files[index].name);
+  return SARA_R5_ERROR_SUCCESS;
 }
-*/
 
-SARA_R5_error_t SARA_R5::gpsEnableRmc(bool enable)
+// Return the free space in the module file system (bytes). Read with +ULSTFILE=1 unless the index already holds it.
+// The index updates its copy as files are written and deleted, so it is an estimate until the index is next read
+SARA_R5_error_t SARA_R5::getFreeSpace(long *freeSpace)
 {
-  // AT+UGRMC=<0,1>
+  SARA_R5_LOCK_TRANSACTION(SARA_R5_PRIORITY_LOW);
   SARA_R5_error_t err;
   char *command;
+  char *response;
 
-  // ** Don't call gpsPower here. It causes problems for +UTIME and the PPS signal **
-  // ** Call isGPSon and gpsPower externally if required **
-  // if (!isGPSon())
-  // {
-  //     err = gpsPower(true);
-  //     if (err != SARA_R5_ERROR_SUCCESS)
-  //     {
-  //         return err;
-  //     }
-  // }
+  if ((nullptr != _fileIndex) && (_fileIndex->valid == true) && (_fileIndex->freeSpace >= 0))
+  {
+    *freeSpace = _fileIndex->freeSpace;
+    return SARA_R5_ERROR_SUCCESS;
+  }
 
-  command = sara_r5_calloc_char(strlen(SARA_R5_GNSS_GPRMC) + 3);
+  command = sara_r5_calloc_char(strlen(SARA_R5_FILE_SYSTEM_LIST_FILES) + 8);
   if (command == nullptr)
     return SARA_R5_ERROR_OUT_OF_MEMORY;
-  sprintf(command, "%s=%d", SARA_R5_GNSS_GPRMC, enable ? 1 : 0);
+  sprintf(command, "%s=1", SARA_R5_FILE_SYSTEM_LIST_FILES);
 
-  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, nullptr, SARA_R5_10_SEC_TIMEOUT);
+  response = sara_r5_calloc_char(minimumResponseAllocation);
+  if (response == nullptr)
+  {
+    free(command);
+    return SARA_R5_ERROR_OUT_OF_MEMORY;
+  }
+
+  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, response, SARA_R5_STANDARD_RESPONSE_TIMEOUT);
+
+  if (err == SARA_R5_ERROR_SUCCESS)
+  {
+    long space = -1;
+    char *searchPtr = strstr(response, "+ULSTFILE:");
+    if (searchPtr != nullptr)
+    {
+      searchPtr += strlen("+ULSTFILE:"); //  Move searchPtr to first char
+      while (*searchPtr == ' ') searchPtr++; // skip spaces
+      if (sscanf(searchPtr, "%ld", &space) != 1)
+        space = -1;
+    }
+    if (space >= 0)
+    {
+      *freeSpace = space;
+      if ((nullptr != _fileIndex) && (_fileIndex->valid == true))
+        _fileIndex->freeSpace = space;
+    }
+    else
+      err = SARA_R5_ERROR_UNEXPECTED_RESPONSE;
+  }
+
+  if (err != SARA_R5_ERROR_SUCCESS)
+  {
+    if (_printDebug == true)
+    {
+      _debugPort->print(F("getFreeSpace: Fail: Error: "));
+      _debugPort->print(err);
+      _debugPort->print(F("  Response: {"));
+      _debugPort->print(response);
+      _debugPort->println(F("}"));
+    }
+  }
 
   free(command);
+  free(response);
   return err;
 }
 
-SARA_R5_error_t SARA_R5::gpsGetRmc(struct PositionData *pos, struct SpeedData *spd,
-                                   struct ClockData *clk, bool *valid)
+// Read the file list (+ULSTFILE=0) into the index, if it is not already valid. The sizes are read when they are needed
+SARA_R5_error_t SARA_R5::loadFileIndex(void)
 {
+  SARA_R5_LOCK_TRANSACTION(SARA_R5_PRIORITY_LOW);
   SARA_R5_error_t err;
   char *command;
   char *response;
-  char *rmcBegin;
 
-  command = sara_r5_calloc_char(strlen(SARA_R5_GNSS_GPRMC) + 2);
+  if (nullptr == _fileIndex)
+    return SARA_R5_ERROR_INVALID;
+  if (_fileIndex->valid == true)
+    return SARA_R5_ERROR_SUCCESS;
+
+  command = sara_r5_calloc_char(strlen(SARA_R5_FILE_SYSTEM_LIST_FILES) + 8);
   if (command == nullptr)
     return SARA_R5_ERROR_OUT_OF_MEMORY;
-  sprintf(command, "%s?", SARA_R5_GNSS_GPRMC);
+  sprintf(command, "%s=0", SARA_R5_FILE_SYSTEM_LIST_FILES);
 
-  response = sara_r5_calloc_char(minimumResponseAllocation);
+  response = sara_r5_calloc_char(SARA_R5_FILE_INDEX_RESPONSE_LENGTH);
   if (response == nullptr)
   {
     free(command);
     return SARA_R5_ERROR_OUT_OF_MEMORY;
   }
 
-  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, response, SARA_R5_10_SEC_TIMEOUT);
-  if (err == SARA_R5_ERROR_SUCCESS)
+  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, response,
+                                SARA_R5_STANDARD_RESPONSE_TIMEOUT, SARA_R5_FILE_INDEX_RESPONSE_LENGTH - 1);
+  if (err != SARA_R5_ERROR_SUCCESS)
   {
-    // Fast-forward response string to $GPRMC starter
-    rmcBegin = strstr(response, "$GPRMC");
-    if (rmcBegin == nullptr)
+    if (_printDebug == true)
     {
-      err = SARA_R5_ERROR_UNEXPECTED_RESPONSE;
+      _debugPort->print(F("loadFileIndex: Fail: Error: "));
+      _debugPort->println(err);
     }
-    else
+    free(command);
+    free(response);
+    return err;
+  }
+
+  _fileIndex->count = 0;
+  _fileIndex->complete = (strstr(response, SARA_R5_RESPONSE_OK) != nullptr); // The response is truncated if the OK is missing
+
+  char *searchPtr = strstr(response, "+ULSTFILE:");
+  if (searchPtr != nullptr) // The file system may be empty
+  {
+    searchPtr += strlen("+ULSTFILE:"); //  Move searchPtr to first char
+    while ((*searchPtr != 0) && (*searchPtr != '\r') && (*searchPtr != '\n'))
     {
-      *valid = parseGPRMCString(rmcBegin, pos, clk, spd);
+      if (*searchPtr != '\"')
+      {
+        searchPtr++; // Skip the spaces and commas
+        continue;
+      }
+      char *nameEnd = strchr(searchPtr + 1, '\"');
+      if (nameEnd == nullptr)
+      {
+        _fileIndex->complete = false;
+        break;
+      }
+      size_t nameLen = nameEnd - (searchPtr + 1);
+      if ((nameLen < SARA_R5_FILE_STREAM_NAME_LENGTH) && (_fileIndex->count < SARA_R5_FILE_INDEX_SIZE))
+      {
+        SARA_R5_file_index_entry_t *entry = &_fileIndex->files[_fileIndex->count++];
+        memcpy(entry->name, searchPtr + 1, nameLen);
+        entry->name[nameLen] = 0;
+        entry->size = -1;
+      }
+      else
+        _fileIndex->complete = false; // This file cannot be indexed
+      searchPtr = nameEnd + 1;
     }
   }
 
+  _fileIndex->valid = true;
+
+  if (_printDebug == true)
+  {
+    _debugPort->print(F("loadFileIndex: "));
+    _debugPort->print(_fileIndex->count);
+    _debugPort->println((_fileIndex->complete == true) ? F(" files") : F(" files (incomplete)"));
+  }
+
   free(command);
   free(response);
-  return err;
+  return SARA_R5_ERROR_SUCCESS;
 }
 
-/*
-SARA_R5_error_t SARA_R5::gpsEnableSpeed(bool enable)
+SARA_R5_file_index_entry_t *SARA_R5::fileIndexFind(const char *filename)
 {
-    // AT+UGVTG=<0,1>
-    SARA_R5_error_t err = SARA_R5_ERROR_SUCCESS;
-    return err;
+  if ((nullptr == _fileIndex) || (_fileIndex->valid == false))
+    return nullptr;
+  for (int i = 0; i < _fileIndex->count; i++)
+  {
+    if (strcmp(_fileIndex->files[i].name, filename) == 0)
+      return &_fileIndex->files[i];
+  }
+  return nullptr;
 }
 
-SARA_R5_error_t SARA_R5::gpsGetSpeed(struct SpeedData *speed)
+// Add filename to the index with an unknown size. Returns nullptr if there is no room
+SARA_R5_file_index_entry_t *SARA_R5::fileIndexAdd(const char *filename)
 {
-    // AT+UGVTG?
-    SARA_R5_error_t err = SARA_R5_ERROR_SUCCESS;
-    return err;
+  if ((nullptr == _fileIndex) || (_fileIndex->valid == false))
+    return nullptr;
+  if ((strlen(filename) >= SARA_R5_FILE_STREAM_NAME_LENGTH) || (_fileIndex->count >= SARA_R5_FILE_INDEX_SIZE))
+  {
+    _fileIndex->complete = false;
+    return nullptr;
+  }
+  SARA_R5_file_index_entry_t *entry = &_fileIndex->files[_fileIndex->count++];
+  strcpy(entry->name, filename);
+  entry->size = -1;
+  return entry;
 }
-*/
 
-SARA_R5_error_t SARA_R5::gpsRequest(unsigned int timeout, uint32_t accuracy,
-                                    bool detailed, unsigned int sensor)
+// Record that bytesAdded bytes have been appended to filename. bytesAdded is -1 if the new size is not known
+// (the file has been overwritten, or a write failed part way through). Its size is then read again when it is needed
+void SARA_R5::fileIndexWritten(const char *filename, int bytesAdded)
 {
-  // AT+ULOC=2,<useCellLocate>,<detailed>,<timeout>,<accuracy>
-  SARA_R5_error_t err;
-  char *command;
+  if ((nullptr == _fileIndex) || (_fileIndex->valid == false))
+    return;
 
-  // This function will only work if the GPS module is initially turned off.
-  if (isGPSon())
+  SARA_R5_file_index_entry_t *entry = fileIndexFind(filename);
+  if (entry == nullptr)
   {
-    gpsPower(false);
+    bool newFile = _fileIndex->complete; // If the index is complete, a file which is not in it did not exist
+    entry = fileIndexAdd(filename);
+    if ((entry != nullptr) && (newFile == true))
+      entry->size = 0;
+  }
+  if (entry != nullptr)
+  {
+    if ((bytesAdded >= 0) && (entry->size >= 0))
+      entry->size += bytesAdded;
+    else
+      entry->size = -1;
   }
 
-  if (timeout > 999)
-    timeout = 999;
-  if (accuracy > 999999)
-    accuracy = 999999;
+  if ((bytesAdded >= 0) && (_fileIndex->freeSpace >= 0))
+  {
+    _fileIndex->freeSpace -= bytesAdded;
+    if (_fileIndex->freeSpace < 0)
+      _fileIndex->freeSpace = 0;
+  }
+  else
+    _fileIndex->freeSpace = -1;
+}
 
-  command = sara_r5_calloc_char(strlen(SARA_R5_GNSS_REQUEST_LOCATION) + 24);
-  if (command == nullptr)
-    return SARA_R5_ERROR_OUT_OF_MEMORY;
-  sprintf(command, "%s=2,%d,%d,%d,%d", SARA_R5_GNSS_REQUEST_LOCATION,
-          sensor, detailed ? 1 : 0, timeout, (int)accuracy);
+void SARA_R5::fileIndexRemove(const char *filename)
+{
+  if ((nullptr == _fileIndex) || (_fileIndex->valid == false))
+    return;
 
-  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, nullptr, SARA_R5_10_SEC_TIMEOUT);
+  SARA_R5_file_index_entry_t *entry = fileIndexFind(filename);
+  if ((entry != nullptr) && (entry->size >= 0) && (_fileIndex->freeSpace >= 0))
+    _fileIndex->freeSpace += entry->size;
+  else
+    _fileIndex->freeSpace = -1;
 
-  free(command);
-  return err;
+  if (entry != nullptr)
+  {
+    _fileIndex->count--;
+    if (entry != &_fileIndex->files[_fileIndex->count])
+      memcpy(entry, &_fileIndex->files[_fileIndex->count], sizeof(SARA_R5_file_index_entry_t)); // Move the last entry into the gap
+  }
 }
 
-SARA_R5_error_t SARA_R5::gpsAidingServerConf(const char *primaryServer, const char *secondaryServer, const char *authToken,
-                                             unsigned int days, unsigned int period, unsigned int resolution,
-                                             unsigned int gnssTypes, unsigned int mode, unsigned int dataType)
+// The module will write filename in the background (HTTP response or FTP download). slot is the HTTP profile, or
+// SARA_R5_NUM_HTTP_PROFILES for FTP. The file size is marked as unknown now and again when the URC arrives
+void SARA_R5::fileIndexPending(int slot, const char *filename)
+{
+  if ((nullptr == _fileIndex) || (slot < 0) || (slot > SARA_R5_NUM_HTTP_PROFILES))
+    return;
+  fileIndexWritten(filename, -1);
+  if (strlen(filename) < SARA_R5_FILE_STREAM_NAME_LENGTH)
+    strcpy(_fileIndex->pendingFile[slot], filename);
+  else
+    invalidateFileIndex(); // The file cannot be tracked
+}
+
+void SARA_R5::fileIndexCompleted(int slot)
+{
+  if ((nullptr == _fileIndex) || (slot < 0) || (slot > SARA_R5_NUM_HTTP_PROFILES))
+    return;
+  if (_fileIndex->pendingFile[slot][0] == 0)
+    return;
+  fileIndexWritten(_fileIndex->pendingFile[slot], -1);
+  _fileIndex->pendingFile[slot][0] = 0;
+}
+
+SARA_R5_error_t SARA_R5::modulePowerOff(void)
 {
+  moduleWasReset(); // The module is power cycled
+
   SARA_R5_error_t err;
   char *command;
 
-  command = sara_r5_calloc_char(strlen(SARA_R5_AIDING_SERVER_CONFIGURATION) + 256);
+  command = sara_r5_calloc_char(strlen(SARA_R5_COMMAND_POWER_OFF) + 6);
   if (command == nullptr)
     return SARA_R5_ERROR_OUT_OF_MEMORY;
 
-  sprintf(command, "%s=\"%s\",\"%s\",\"%s\",%d,%d,%d,%d,%d,%d", SARA_R5_AIDING_SERVER_CONFIGURATION,
-          primaryServer, secondaryServer, authToken,
-          days, period, resolution, gnssTypes, mode, dataType);
+  sprintf(command, "%s", SARA_R5_COMMAND_POWER_OFF);
 
   err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, nullptr,
-                                SARA_R5_STANDARD_RESPONSE_TIMEOUT);
+                                SARA_R5_POWER_OFF_TIMEOUT);
 
   free(command);
   return err;
 }
 
-
-// OK for text files. But will fail with binary files (containing \0) on some platforms.
-SARA_R5_error_t SARA_R5::appendFileContents(String filename, const char *str, int len)
+void SARA_R5::modulePowerOn(void)
 {
-  char *command;
-  char *response;
-  SARA_R5_error_t err;
-
-  command = sara_r5_calloc_char(strlen(SARA_R5_FILE_SYSTEM_DOWNLOAD_FILE) + filename.length() + 10);
-  if (command == nullptr)
-    return SARA_R5_ERROR_OUT_OF_MEMORY;
-  response = sara_r5_calloc_char(minimumResponseAllocation);
-  if (response == nullptr)
-  {
-    free(command);
-    return SARA_R5_ERROR_OUT_OF_MEMORY;
-  }
-  int dataLen = len == -1 ? strlen(str) : len;
-  sprintf(command, "%s=\"%s\",%d", SARA_R5_FILE_SYSTEM_DOWNLOAD_FILE, filename.c_str(), dataLen);
-
-  err = sendCommandWithResponse(command, ">", response,
-                                SARA_R5_STANDARD_RESPONSE_TIMEOUT*2);
-
-  unsigned long writeDelay = millis();
-  while (millis() < (writeDelay + 50))
-    delay(1); //uBlox specification says to wait 50ms after receiving "@" to write data.
-
-  if (err == SARA_R5_ERROR_SUCCESS)
+  if (_powerPin >= 0)
   {
-    if (_printDebug == true)
-    {
-      _debugPort->print(F("fileDownload: writing "));
-      _debugPort->print(dataLen);
-      _debugPort->println(F(" bytes"));
-    }
-    hwWriteData(str, dataLen);
-
-    err = waitForResponse(SARA_R5_RESPONSE_OK, SARA_R5_RESPONSE_ERROR, SARA_R5_STANDARD_RESPONSE_TIMEOUT*5);
+    powerOn();
   }
-  if (err != SARA_R5_ERROR_SUCCESS)
+  else
   {
     if (_printDebug == true)
-    {
-      _debugPort->print(F("fileDownload: Error: "));
-      _debugPort->print(err);
-      _debugPort->print(F(" => {"));
-      _debugPort->print(response);
-      _debugPort->println(F("}"));
-    }
+      _debugPort->println(F("modulePowerOn: not supported. _powerPin not defined."));
   }
-
-  free(command);
-  free(response);
-  return err;
-}
-
-SARA_R5_error_t SARA_R5::appendFileContents(String filename, String str)
-{
-    return appendFileContents(filename, str.c_str(), str.length());
 }
 
+/////////////
+// Private //
+/////////////
 
-// OK for text files. But will fail with binary files (containing \0) on some platforms.
-SARA_R5_error_t SARA_R5::getFileContents(String filename, String *contents)
+// Initialize a module which is already running: query its settings and only apply the differences
+SARA_R5_error_t SARA_R5::warmStart(unsigned long baud)
 {
   SARA_R5_error_t err;
   char *command;
   char *response;
+  int gpio1Mode = -1;
+  int gpio6Mode = -1;
+  int messageFormat = -1;
+  int autoTZ = -1;
+
+  if (_printDebug == true)
+    _debugPort->println(F("warmStart: Attempting warm start."));
 
-  // Start by getting the file size so we know in advance how much data to expect
-  int fileSize = 0;
-  err = getFileSize(filename, &fileSize);
-  if (err != SARA_R5_SUCCESS)
-  {
-    if (_printDebug == true)
-    {
-      _debugPort->print(F("getFileContents: getFileSize returned err "));
-      _debugPort->println(err);
-    }
+  beginSerial(baud);
+
+  err = enableEcho(false); // This also checks the module is running at this baud rate
+  if (err != SARA_R5_ERROR_SUCCESS)
     return err;
-  }
 
-  command = sara_r5_calloc_char(strlen(SARA_R5_FILE_SYSTEM_READ_FILE) + filename.length() + 8);
+  _baud = baud;
+
+  // Query the settings which init would apply - with one compound command
+  command = sara_r5_calloc_char(strlen(SARA_R5_COMMAND_GPIO) + strlen(SARA_R5_MESSAGE_FORMAT) + strlen(SARA_R5_COMMAND_AUTO_TZ) + 8);
   if (command == nullptr)
     return SARA_R5_ERROR_OUT_OF_MEMORY;
-  sprintf(command, "%s=\"%s\"", SARA_R5_FILE_SYSTEM_READ_FILE, filename.c_str());
+  sprintf(command, "%s?;%s?;%s?", SARA_R5_COMMAND_GPIO, SARA_R5_MESSAGE_FORMAT, SARA_R5_COMMAND_AUTO_TZ);
 
-  response = sara_r5_calloc_char(fileSize + minimumResponseAllocation);
+  response = sara_r5_calloc_char(minimumResponseAllocation * 2);
   if (response == nullptr)
   {
-    if (_printDebug == true)
-    {
-      _debugPort->print(F("getFileContents: response alloc failed: "));
-      _debugPort->println(fileSize + minimumResponseAllocation);
-    }
     free(command);
     return SARA_R5_ERROR_OUT_OF_MEMORY;
   }
 
-  // A large file will completely fill the backlog buffer - but it will be pruned afterwards
-  // Note to self: if the file contents contain "OK\r\n" sendCommandWithResponse will return true too early...
-  // To try and avoid this, look for \"\r\nOK\r\n
-  const char fileReadTerm[] = "\r\nOK\r\n"; //LARA-R6 returns "\"\r\n\r\nOK\r\n" while SARA-R5 return "\"\r\nOK\r\n";
-  err = sendCommandWithResponse(command, fileReadTerm,
-                                response, (5 * SARA_R5_STANDARD_RESPONSE_TIMEOUT),
-                                (fileSize + minimumResponseAllocation));
+  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, response,
+                                SARA_R5_STANDARD_RESPONSE_TIMEOUT, minimumResponseAllocation * 2);
 
-  if (err != SARA_R5_ERROR_SUCCESS)
+  if (err == SARA_R5_ERROR_SUCCESS)
   {
-    if (_printDebug == true)
+    // +UGPIOC:\r\n<gpio_id>,<gpio_mode>\r\n...
+    char *searchPtr = strstr(response, "+UGPIOC:");
+    char *endPtr = strstr(response, "+CMGF:");
+    if ((searchPtr != nullptr) && (endPtr != nullptr))
     {
-      _debugPort->print(F("getFileContents: sendCommandWithResponse returned err "));
-      _debugPort->println(err);
+      searchPtr = strchr(searchPtr, '\n');
+      while ((searchPtr != nullptr) && (searchPtr < endPtr))
+      {
+        int gpio, mode;
+        searchPtr++; // Skip the \n
+        if (sscanf(searchPtr, "%d,%d", &gpio, &mode) == 2)
+        {
+          if (gpio == GPIO1)
+            gpio1Mode = mode;
+          else if (gpio == GPIO6)
+            gpio6Mode = mode;
+        }
+        searchPtr = strchr(searchPtr, '\n');
+      }
+    }
+    searchPtr = strstr(response, "+CMGF:");
+    if (searchPtr != nullptr)
+    {
+      searchPtr += strlen("+CMGF:"); //  Move searchPtr to first char
+      while (*searchPtr == ' ') searchPtr++; // skip spaces
+      sscanf(searchPtr, "%d", &messageFormat);
+    }
+    searchPtr = strstr(response, "+CTZU:");
+    if (searchPtr != nullptr)
+    {
+      searchPtr += strlen("+CTZU:"); //  Move searchPtr to first char
+      while (*searchPtr == ' ') searchPtr++; // skip spaces
+      sscanf(searchPtr, "%d", &autoTZ);
     }
-    free(command);
-    free(response);
-    return err;
   }
 
-  // Response format: \r\n+URDFILE: "filename",36,"these bytes are the data of the file"\r\n\r\nOK\r\n
-  int scanned = 0;
-  int readFileSize = 0;
-  char *searchPtr = strstr(response, "+URDFILE:");
-  if (searchPtr != nullptr)
-  {
-    searchPtr = strchr(searchPtr, '\"'); // Find the first quote
-    searchPtr = strchr(++searchPtr, '\"'); // Find the second quote
+  free(command);
+  free(response);
 
-    scanned = sscanf(searchPtr, "\",%d,", &readFileSize); // Get the file size (again)
-    if (scanned == 1)
-    {
-      searchPtr = strchr(++searchPtr, '\"'); // Find the third quote
+  if (err != SARA_R5_ERROR_SUCCESS)
+    return err;
 
-      if (searchPtr == nullptr)
+  if (_printDebug == true)
+    _debugPort->println(F("warmStart: Module responded successfully. Applying the differences."));
+
+  // Apply the differences. -1 (not found) always causes the setting to be applied
+  if (gpio1Mode != NETWORK_STATUS)
+    setGpioMode(GPIO1, NETWORK_STATUS);
+  if (gpio6Mode != TIME_PULSE_OUTPUT)
+    setGpioMode(GPIO6, TIME_PULSE_OUTPUT);
+  if (messageFormat != SARA_R5_MESSAGE_FORMAT_TEXT)
+    setSMSMessageFormat(SARA_R5_MESSAGE_FORMAT_TEXT);
+  if (autoTZ != (_autoTimeZoneForBegin ? 1 : 0))
+    autoTimeZone(_autoTimeZoneForBegin);
+
+  for (int i = 0; i < SARA_R5_NUM_SOCKETS; i++)
+  {
+    if (_warmStartKeepSockets == true)
+    {
+      // Adopt the open sockets. querySocketType updates _lastSocketProtocol. It returns an error if the socket is not open
+      SARA_R5_socket_protocol_t protocol;
+      if (querySocketType(i, &protocol) == SARA_R5_ERROR_SUCCESS)
       {
-        if (_printDebug == true)
+        SARA_R5_tcp_socket_status_t status = SARA_R5_TCP_SOCKET_STATUS_INACTIVE;
+        if ((protocol == SARA_R5_TCP) && (querySocketStatusTCP(i, &status) == SARA_R5_ERROR_SUCCESS)
+            && (status == SARA_R5_TCP_SOCKET_STATUS_INACTIVE))
         {
-          _debugPort->println(F("getFileContents: third quote not found!"));
+          socketClose(i, SARA_R5_STANDARD_RESPONSE_TIMEOUT); // The connection has gone. Free the socket
+        }
+        else if (_printDebug == true)
+        {
+          _debugPort->print(F("warmStart: keeping socket "));
+          _debugPort->println(i);
         }
-        free(command);
-        free(response);
-        return SARA_R5_ERROR_UNEXPECTED_RESPONSE;
-      }
-
-      int bytesRead = 0;
-
-      while (bytesRead < readFileSize)
-      {
-        searchPtr++; // Increment searchPtr then copy file char into contents
-      // Important Note: some implementations of concat, like the one on ESP32, are binary-compatible.
-      // But some, like SAMD, are not. They use strlen or strcpy internally - which don't like \0's.
-      // The only true binary-compatible solution is to use getFileContents(String filename, char *contents)...
-        contents->concat(*(searchPtr)); // Append file char to contents
-        bytesRead++;
-      }
-      if (_printDebug == true)
-      {
-        _debugPort->print(F("getFileContents: total bytes read: "));
-        _debugPort->println(bytesRead);
       }
-      err = SARA_R5_ERROR_SUCCESS;
     }
     else
     {
-      if (_printDebug == true)
-      {
-        _debugPort->print(F("getFileContents: sscanf failed! scanned is "));
-        _debugPort->println(scanned);
-      }
-      err = SARA_R5_ERROR_UNEXPECTED_RESPONSE;
+      socketClose(i, SARA_R5_STANDARD_RESPONSE_TIMEOUT);
     }
   }
-  else
-  {
-    if (_printDebug == true)
-      _debugPort->println(F("getFileContents: strstr failed!"));
-    err = SARA_R5_ERROR_UNEXPECTED_RESPONSE;
-  }
 
-  free(command);
-  free(response);
-  return err;
+  return SARA_R5_ERROR_SUCCESS;
 }
 
-// OK for binary files. Make sure contents can hold the entire file. Get the size first with getFileSize.
-SARA_R5_error_t SARA_R5::getFileContents(String filename, char *contents)
+SARA_R5_error_t SARA_R5::init(unsigned long baud,
+                              SARA_R5::SARA_R5_init_type_t initType)
 {
-  SARA_R5_error_t err;
-  char *command;
-  char *response;
-
-  // Start by getting the file size so we know in advance how much data to expect
-  int fileSize = 0;
-  err = getFileSize(filename, &fileSize);
-  if (err != SARA_R5_SUCCESS)
-  {
-    if (_printDebug == true)
-    {
-      _debugPort->print(F("getFileContents: getFileSize returned err "));
-      _debugPort->println(err);
-    }
-    return err;
-  }
+  moduleWasReset(); // We do not know what the module holds
 
-  command = sara_r5_calloc_char(strlen(SARA_R5_FILE_SYSTEM_READ_FILE) + filename.length() + 8);
-  if (command == nullptr)
-    return SARA_R5_ERROR_OUT_OF_MEMORY;
-  sprintf(command, "%s=\"%s\"", SARA_R5_FILE_SYSTEM_READ_FILE, filename.c_str());
+  int retries = _maxInitTries;
+  SARA_R5_error_t err = SARA_R5_ERROR_SUCCESS;
 
-  response = sara_r5_calloc_char(fileSize + minimumResponseAllocation);
-  if (response == nullptr)
+  if ((_warmStartForBegin == true) && (initType == SARA_R5_INIT_STANDARD))
   {
+    if (warmStart(baud) == SARA_R5_ERROR_SUCCESS)
+      return SARA_R5_ERROR_SUCCESS;
     if (_printDebug == true)
-    {
-      _debugPort->print(F("getFileContents: response alloc failed: "));
-      _debugPort->println(fileSize + minimumResponseAllocation);
-    }
-    free(command);
-    return SARA_R5_ERROR_OUT_OF_MEMORY;
+      _debugPort->println(F("init: warm start failed. Doing a full init."));
   }
 
-  // A large file will completely fill the backlog buffer - but it will be pruned afterwards
-  // Note to self: if the file contents contain "OK\r\n" sendCommandWithResponse will return true too early...
-  // To try and avoid this, look for \"\r\nOK\r\n
-  const char fileReadTerm[] = "\"\r\nOK\r\n";
-  err = sendCommandWithResponse(command, fileReadTerm,
-                                response, (5 * SARA_R5_STANDARD_RESPONSE_TIMEOUT),
-                                (fileSize + minimumResponseAllocation));
+  beginSerial(baud);
 
-  if (err != SARA_R5_ERROR_SUCCESS)
+  do
   {
     if (_printDebug == true)
-    {
-      _debugPort->print(F("getFileContents: sendCommandWithResponse returned err "));
-      _debugPort->println(err);
-    }
-    free(command);
-    free(response);
-    return err;
-  }
-
-  // Response format: \r\n+URDFILE: "filename",36,"these bytes are the data of the file"\r\n\r\nOK\r\n
-  int scanned = 0;
-  int readFileSize = 0;
-  char *searchPtr = strstr(response, "+URDFILE:");
-  if (searchPtr != nullptr)
-  {
-    searchPtr = strchr(searchPtr, '\"'); // Find the first quote
-    searchPtr = strchr(++searchPtr, '\"'); // Find the second quote
+      _debugPort->println(F("init: Begin module init."));
 
-    scanned = sscanf(searchPtr, "\",%d,", &readFileSize); // Get the file size (again)
-    if (scanned == 1)
+    if (initType == SARA_R5_INIT_AUTOBAUD)
     {
-      searchPtr = strchr(++searchPtr, '\"'); // Find the third quote
-
-      if (searchPtr == nullptr)
-      {
-        if (_printDebug == true)
-        {
-          _debugPort->println(F("getFileContents: third quote not found!"));
-        }
-        free(command);
-        free(response);
-        return SARA_R5_ERROR_UNEXPECTED_RESPONSE;
-      }
+      if (_printDebug == true)
+        _debugPort->println(F("init: Attempting autobaud connection to module."));
 
-      int bytesRead = 0;
+      err = autobaud(baud);
 
-      while (bytesRead < readFileSize)
-      {
-        searchPtr++; // Increment searchPtr then copy file char into contents
-        contents[bytesRead] = *searchPtr; // Append file char to contents
-        bytesRead++;
+      if (err != SARA_R5_ERROR_SUCCESS) {
+        initType = SARA_R5_INIT_RESET;
       }
+    }
+    else if (initType == SARA_R5_INIT_RESET)
+    {
       if (_printDebug == true)
+        _debugPort->println(F("init: Power cycling module."));
+
+      powerOff();
+      delay(SARA_R5_POWER_OFF_PULSE_PERIOD);
+      powerOn();
+      beginSerial(baud);
+
+      err = waitForReady(); // Returns as soon as the module responds to AT
+      if (err != SARA_R5_ERROR_SUCCESS)
       {
-        _debugPort->print(F("getFileContents: total bytes read: "));
-        _debugPort->println(bytesRead);
+         initType = SARA_R5_INIT_AUTOBAUD;
       }
-      err = SARA_R5_ERROR_SUCCESS;
     }
-    else
+    if (err == SARA_R5_ERROR_SUCCESS)
     {
-      if (_printDebug == true)
+      err = enableEcho(false); // = disableEcho
+      if (err != SARA_R5_ERROR_SUCCESS)
       {
-        _debugPort->print(F("getFileContents: sscanf failed! scanned is "));
-        _debugPort->println(scanned);
+        if (_printDebug == true)
+          _debugPort->println(F("init: Module failed echo test."));
+        initType =  SARA_R5_INIT_AUTOBAUD;
       }
-      err = SARA_R5_ERROR_UNEXPECTED_RESPONSE;
     }
   }
-  else
-  {
+  while ((retries --) && (err != SARA_R5_ERROR_SUCCESS));
+
+  // we tried but seems failed
+  if (err != SARA_R5_ERROR_SUCCESS) {
     if (_printDebug == true)
-      _debugPort->println(F("getFileContents: strstr failed!"));
-    err = SARA_R5_ERROR_UNEXPECTED_RESPONSE;
+      _debugPort->println(F("init: Module failed to init. Exiting."));
+    return (SARA_R5_ERROR_NO_RESPONSE);
   }
 
-  free(command);
-  free(response);
-  return err;
+  if (_printDebug == true)
+    _debugPort->println(F("init: Module responded successfully."));
+
+  _baud = baud;
+  setGpioMode(GPIO1, NETWORK_STATUS);
+  //setGpioMode(GPIO2, GNSS_SUPPLY_ENABLE);
+  setGpioMode(GPIO6, TIME_PULSE_OUTPUT);
+  setSMSMessageFormat(SARA_R5_MESSAGE_FORMAT_TEXT);
+  autoTimeZone(_autoTimeZoneForBegin);
+  for (int i = 0; i < SARA_R5_NUM_SOCKETS; i++)
+  {
+    socketClose(i, SARA_R5_STANDARD_RESPONSE_TIMEOUT);
+  }
+
+  return SARA_R5_ERROR_SUCCESS;
 }
 
-SARA_R5_error_t SARA_R5::getFileBlock(const String& filename, char* buffer, size_t offset, size_t requestedLength, size_t& bytesRead)
+void SARA_R5::invertPowerPin(bool invert)
 {
-  SARA_R5_error_t err;
-  char *command;
-  char *response;
+  _invertPowerPin = invert;
+}
 
-  bytesRead = 0;
-  if (filename.length() < 1 || buffer == nullptr || requestedLength < 1)
-  {
-      return SARA_R5_ERROR_UNEXPECTED_PARAM;
-  }
+// Do a graceful power off. Hold the PWR_ON pin low for SARA_R5_POWER_OFF_PULSE_PERIOD
+// Note: +CPWROFF () is preferred to this.
+void SARA_R5::powerOff(void)
+{
+  moduleWasReset(); // The module is power cycled
 
-  // trying to get a byte at a time does not seem to be reliable so this method must use
-  // a real UART.
-  if (_hardSerial == nullptr)
+  if (_powerPin >= 0)
   {
+    if (_invertPowerPin) // Set the pin state before making it an output
+      digitalWrite(_powerPin, HIGH);
+    else
+      digitalWrite(_powerPin, LOW);
+    pinMode(_powerPin, OUTPUT);
+    if (_invertPowerPin) // Set the pin state
+      digitalWrite(_powerPin, HIGH);
+    else
+      digitalWrite(_powerPin, LOW);
+    delay(SARA_R5_POWER_OFF_PULSE_PERIOD);
+    pinMode(_powerPin, INPUT); // Return to high-impedance, rely on (e.g.) SARA module internal pull-up
     if (_printDebug == true)
-    {
-      _debugPort->println(F("getFileBlock: only works with a hardware UART"));
-    }
-    return SARA_R5_ERROR_INVALID;
+      _debugPort->println(F("powerOff: complete"));
   }
+}
 
-  command = sara_r5_calloc_char(strlen(SARA_R5_FILE_SYSTEM_READ_BLOCK) + filename.length() + 28);
-  if (command == nullptr)
-  {
-    return SARA_R5_ERROR_OUT_OF_MEMORY;
-  }
-  sprintf(command, "%s=\"%s\",%lu,%lu", SARA_R5_FILE_SYSTEM_READ_BLOCK, filename.c_str(), (unsigned long) offset, (unsigned long) requestedLength);
+void SARA_R5::powerOn(void)
+{
+  moduleWasReset(); // The module is power cycled
 
-  response = sara_r5_calloc_char(minimumResponseAllocation);
-  if (response == nullptr)
+  if (_powerPin >= 0)
   {
+    powerPinPulse(SARA_R5_POWER_ON_PULSE_PERIOD);
+    //delay(2000);               // Do this in init. Wait before sending AT commands to module. 100 is too short.
     if (_printDebug == true)
-    {
-      _debugPort->print(F("getFileBlock: response alloc failed: "));
-      _debugPort->println(minimumResponseAllocation);
-    }
-    free(command);
-    return SARA_R5_ERROR_OUT_OF_MEMORY;
+      _debugPort->println(F("powerOn: complete"));
   }
+}
 
-  // Send command and wait for some response
-  // Response format: \r\n+URDBLOCK: "filename",64000,"these bytes are the data of the file block"\r\n\r\nOK\r\n
-  sendCommand(command, true);
-  err = waitForResponse(SARA_R5_FILE_SYSTEM_READ_BLOCK, SARA_R5_RESPONSE_ERROR, 5 * SARA_R5_STANDARD_RESPONSE_TIMEOUT);
-  if (err != SARA_R5_ERROR_SUCCESS)
+// Pull PWR_ON low for period millis. Used to power the module on and to wake it from PSM
+void SARA_R5::powerPinPulse(unsigned long period)
+{
+  if (_powerPin < 0)
+    return;
+  if (_invertPowerPin) // Set the pin state before making it an output
+    digitalWrite(_powerPin, HIGH);
+  else
+    digitalWrite(_powerPin, LOW);
+  pinMode(_powerPin, OUTPUT);
+  if (_invertPowerPin) // Set the pin state
+    digitalWrite(_powerPin, HIGH);
+  else
+    digitalWrite(_powerPin, LOW);
+  delay(period);
+  pinMode(_powerPin, INPUT); // Return to high-impedance, rely on (e.g.) SARA module internal pull-up
+}
+
+//This does an abrupt emergency hardware shutdown of the SARA-R5 series modules.
+//It only works if you have access to both the RESET_N and PWR_ON pins.
+//You cannot use this function on the SparkFun Asset Tracker and RESET_N is tied to the MicroMod processor !RESET!...
+void SARA_R5::hwReset(void)
+{
+  moduleWasReset(); // The module is reset
+
+  if ((_resetPin >= 0) && (_powerPin >= 0))
   {
-    if (_printDebug == true)
+    digitalWrite(_resetPin, HIGH); // Start by making sure the RESET_N pin is high
+    pinMode(_resetPin, OUTPUT);
+    digitalWrite(_resetPin, HIGH);
+
+    if (_invertPowerPin) // Now pull PWR_ON low - invert as necessary (on the Asset Tracker)
     {
-      _debugPort->print(F("getFileBlock: waitForResponse returned err "));
-      _debugPort->println(err);
+      digitalWrite(_powerPin, HIGH); // Inverted - Asset Tracker
+      pinMode(_powerPin, OUTPUT);
+      digitalWrite(_powerPin, HIGH);
     }
-    free(command);
-    free(response);
-    return err;
-  }
-
-  // Skip the filename in quotes and get the data length index
-  int ich;
-  char ch;
-  int quoteCount = 0;
-  size_t lengthIndex = 0;
-  while (quoteCount < 3 && bytesRead < minimumResponseAllocation)
-  {
-    ich = _hardSerial->read();
-    if (ich < 0)
+    else
     {
-      continue;
+      digitalWrite(_powerPin, LOW); // Not inverted
+      pinMode(_powerPin, OUTPUT);
+      digitalWrite(_powerPin, LOW);
     }
-    ch = (char)(ich & 0xFF);
-    response[bytesRead++] = ch;
-    if (ch == '"')
+
+    delay(SARA_R5_RESET_PULSE_PERIOD); // Wait 23 seconds... (Yes, really!)
+
+    digitalWrite(_resetPin, LOW); // Now pull RESET_N low
+
+    delay(100); // Wait a little... (The data sheet doesn't say how long for)
+
+    if (_invertPowerPin) // Now pull PWR_ON high - invert as necessary (on the Asset Tracker)
     {
-      quoteCount++;
+      digitalWrite(_powerPin, LOW); // Inverted - Asset Tracker
     }
-    else if (ch == ',' && lengthIndex == 0 && quoteCount == 2)
+    else
     {
-      lengthIndex = bytesRead;
+      digitalWrite(_powerPin, HIGH); // Not inverted
     }
-  }
-  response[bytesRead] = 0; // Make response a null-terminated string
-  response[bytesRead - 2] = 0; // Terminate response string right after block length
-  size_t data_length = strtoul(&response[lengthIndex], nullptr, 10);
 
-  // Read file block data directly into supplied buffer
-  bytesRead = 0;
-  size_t bytesRemaining = data_length;
-  while (bytesRead < data_length)
-  {
-    // This method seems more reliable than reading a byte at a time.
-    size_t rc = _hardSerial->readBytes(&buffer[bytesRead], bytesRemaining);
-    bytesRead += rc;
-    bytesRemaining -= rc;
+    delay(1500); // Wait 1.5 seconds
+
+    digitalWrite(_resetPin, HIGH); // Now pull RESET_N high again
+
+    pinMode(_resetPin, INPUT); // Return to high-impedance, rely on SARA module internal pull-up
+    pinMode(_powerPin, INPUT); // Return to high-impedance, rely on SARA module internal pull-up
   }
+}
 
-  // Read rest of response until \r\nOK\r\n
-  err = waitForResponse(SARA_R5_RESPONSE_OK, SARA_R5_RESPONSE_ERROR, SARA_R5_STANDARD_RESPONSE_TIMEOUT);
-  if (err != SARA_R5_ERROR_SUCCESS)
+SARA_R5_error_t SARA_R5::functionality(SARA_R5_functionality_t function)
+{
+  if ((function == FAST_SAFE_POWER_OFF) || ((int)function == 15) || (function == SILENT_RESET_WITH_SIM)) // 15 is SILENT_RESET_WITHOUT_SIM
+    moduleWasReset();
+  else
   {
-    if (_printDebug == true)
-    {
-      _debugPort->print(F("getFileBlock: waitForResponse returned err "));
-      _debugPort->println(err);
-    }
-    free(command);
-    free(response);
-    return err;
+    invalidateConfigShadow(); // The module settings may change
+    invalidateIdentity(true); // The SIM may be switched off or on
   }
 
+  SARA_R5_error_t err;
+  char *command;
+
+  command = sara_r5_calloc_char(strlen(SARA_R5_COMMAND_FUNC) + 16);
+  if (command == nullptr)
+    return SARA_R5_ERROR_OUT_OF_MEMORY;
+  sprintf(command, "%s=%d", SARA_R5_COMMAND_FUNC, function);
+
+  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR,
+                                nullptr, SARA_R5_3_MIN_TIMEOUT);
+
   free(command);
-  free(response);
+
   return err;
 }
 
-SARA_R5_error_t SARA_R5::getFileSize(String filename, int *size)
+SARA_R5_error_t SARA_R5::setMNOprofile(mobile_network_operator_t mno, bool autoReset, bool urcNotification)
+{
+  moduleWasReset(); // The module may reboot
+
+  SARA_R5_error_t err;
+  char *command;
+
+  command = sara_r5_calloc_char(strlen(SARA_R5_COMMAND_MNO) + 9);
+  if (command == nullptr)
+    return SARA_R5_ERROR_OUT_OF_MEMORY;
+  if (mno == MNO_SIM_ICCID) // Only add autoReset and urcNotification if mno is MNO_SIM_ICCID
+    sprintf(command, "%s=%d,%d,%d", SARA_R5_COMMAND_MNO, (uint8_t)mno, (uint8_t)autoReset, (uint8_t)urcNotification);
+  else
+    sprintf(command, "%s=%d", SARA_R5_COMMAND_MNO, (uint8_t)mno);
+
+  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR,
+                                nullptr, SARA_R5_STANDARD_RESPONSE_TIMEOUT);
+
+  free(command);
+
+  return err;
+}
+
+SARA_R5_error_t SARA_R5::getMNOprofile(mobile_network_operator_t *mno)
 {
   SARA_R5_error_t err;
   char *command;
   char *response;
+  mobile_network_operator_t o;
+  int d;
+  int r;
+  int u;
+  int oStore;
 
-  command = sara_r5_calloc_char(strlen(SARA_R5_FILE_SYSTEM_LIST_FILES) + filename.length() + 8);
+  command = sara_r5_calloc_char(strlen(SARA_R5_COMMAND_MNO) + 2);
   if (command == nullptr)
     return SARA_R5_ERROR_OUT_OF_MEMORY;
-  sprintf(command, "%s=2,\"%s\"", SARA_R5_FILE_SYSTEM_LIST_FILES, filename.c_str());
+  sprintf(command, "%s?", SARA_R5_COMMAND_MNO);
 
   response = sara_r5_calloc_char(minimumResponseAllocation);
   if (response == nullptr)
@@ -5716,609 +11187,748 @@ SARA_R5_error_t SARA_R5::getFileSize(String filename, int *size)
     return SARA_R5_ERROR_OUT_OF_MEMORY;
   }
 
-  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, response, SARA_R5_STANDARD_RESPONSE_TIMEOUT);
+  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR,
+                                response, SARA_R5_STANDARD_RESPONSE_TIMEOUT);
   if (err != SARA_R5_ERROR_SUCCESS)
   {
-    if (_printDebug == true)
-    {
-      _debugPort->print(F("getFileSize: Fail: Error: "));
-      _debugPort->print(err);
-      _debugPort->print(F("  Response: {"));
-      _debugPort->print(response);
-      _debugPort->println(F("}"));
-    }
     free(command);
     free(response);
     return err;
   }
 
-  char *responseStart = strstr(response, "+ULSTFILE:");
-  if (responseStart == nullptr)
+  int scanned = 0;
+  char *searchPtr = strstr(response, "+UMNOPROF:");
+  if (searchPtr != nullptr)
+  {
+    searchPtr += strlen("+UMNOPROF:"); //  Move searchPtr to first char
+    while (*searchPtr == ' ') searchPtr++; // skip spaces
+    scanned = sscanf(searchPtr, "%d,%d,%d,%d", &oStore, &d, &r, &u);
+  }
+  o = (mobile_network_operator_t)oStore;
+
+  if (scanned >= 1)
   {
     if (_printDebug == true)
     {
-      _debugPort->print(F("getFileSize: Failure: {"));
-      _debugPort->print(response);
-      _debugPort->println(F("}"));
+      _debugPort->print(F("getMNOprofile: MNO is: "));
+      _debugPort->println(o);
     }
-    free(command);
-    free(response);
-    return SARA_R5_ERROR_UNEXPECTED_RESPONSE;
+    *mno = o;
+  }
+  else
+  {
+    err = SARA_R5_ERROR_INVALID;
   }
-
-  int fileSize;
-  responseStart += strlen("+ULSTFILE:"); //  Move searchPtr to first char
-  while (*responseStart == ' ') responseStart++; // skip spaces
-  sscanf(responseStart, "%d", &fileSize);
-  *size = fileSize;
 
   free(command);
   free(response);
+
   return err;
 }
 
-SARA_R5_error_t SARA_R5::deleteFile(String filename)
+SARA_R5_error_t SARA_R5::waitForResponse(const char *expectedResponse, const char *expectedError, uint16_t timeout)
 {
-  SARA_R5_error_t err;
-  char *command;
+  SARA_R5_LOCK_TRANSACTION(SARA_R5_PRIORITY_NORMAL);
 
-  command = sara_r5_calloc_char(strlen(SARA_R5_FILE_SYSTEM_DELETE_FILE) + filename.length() + 8);
-  if (command == nullptr)
-    return SARA_R5_ERROR_OUT_OF_MEMORY;
-  sprintf(command, "%s=\"%s\"", SARA_R5_FILE_SYSTEM_DELETE_FILE, filename.c_str());
+  if (isOperatorScanActive()) // The command was not sent
+    return SARA_R5_ERROR_INVALID;
+
+  unsigned long timeIn;
+  bool found = false;
+  bool error = false;
+  int responseIndex = 0, errorIndex = 0;
+  // bool printedSomething = false;
+
+  timeIn = millis();
+
+  int responseLen = (int)strlen(expectedResponse);
+  int errorLen = (int)strlen(expectedError);
+
+  while ((!found) && ((timeIn + timeout) > millis()))
+  {
+    if (hwAvailable() > 0) //hwAvailable can return -1 if the serial port is nullptr
+    {
+      char c = readChar();
+      // if (_printDebug == true)
+      // {
+      //   if (printedSomething == false)
+      //     _debugPort->print(F("waitForResponse: "));
+      //   _debugPort->write(c);
+      //   printedSomething = true;
+      // }
+      if ((responseIndex < responseLen) && (c == expectedResponse[responseIndex]))
+      {
+        if (++responseIndex == responseLen)
+        {
+          found = true;
+        }
+      }
+      else
+      {
+        responseIndex = ((responseIndex < responseLen) && (c == expectedResponse[0])) ? 1 : 0;
+      }
+      if ((errorIndex < errorLen) && (c == expectedError[errorIndex]))
+      {
+        if (++errorIndex == errorLen)
+        {
+          error = true;
+          found = true;
+        }
+      }
+      else
+      {
+        errorIndex = ((errorIndex < errorLen) && (c == expectedError[0])) ? 1 : 0;
+      }
+      //Any URCs that come in while waiting for the response are converted into events and queued.
+      //They are dispatched later within bufferedPoll(). Everything else is discarded.
+      //In RX task mode, rxTask has already queued them.
+      if (_rxTaskMode == false)
+        bufferURCChar(c);
+    } else {
+      yield();
+    }
+  }
 
-  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, nullptr, SARA_R5_STANDARD_RESPONSE_TIMEOUT);
+  // if (_printDebug == true)
+  //   if (printedSomething)
+  //     _debugPort->println();
 
-  if (err != SARA_R5_ERROR_SUCCESS)
+  if (rxResponseLost())
   {
     if (_printDebug == true)
-    {
-      _debugPort->print(F("deleteFile: Fail: Error: "));
-      _debugPort->println(err);
+      _debugPort->println(F("waitForResponse: the response ring overflowed. The response is incomplete"));
+    return SARA_R5_ERROR_UNEXPECTED_RESPONSE;
+  }
+
+  if (found == true)
+  {
+    if (true == _printAtDebug) {
+      _debugAtPort->print((error == true) ? expectedError : expectedResponse);
     }
+
+    return (error == true) ? SARA_R5_ERROR_ERROR : SARA_R5_ERROR_SUCCESS;
   }
 
-  free(command);
-  return err;
+  return SARA_R5_ERROR_NO_RESPONSE;
 }
 
-SARA_R5_error_t SARA_R5::modulePowerOff(void)
+SARA_R5_error_t SARA_R5::sendCommandWithResponse(
+    const char *command, const char *expectedResponse, char *responseDest,
+    unsigned long commandTimeout, int destSize, bool at)
 {
-  SARA_R5_error_t err;
-  char *command;
-
-  command = sara_r5_calloc_char(strlen(SARA_R5_COMMAND_POWER_OFF) + 6);
-  if (command == nullptr)
-    return SARA_R5_ERROR_OUT_OF_MEMORY;
-
-  sprintf(command, "%s", SARA_R5_COMMAND_POWER_OFF);
+  SARA_R5_LOCK_TRANSACTION(SARA_R5_PRIORITY_NORMAL);
 
-  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, nullptr,
-                                SARA_R5_POWER_OFF_TIMEOUT);
-
-  free(command);
-  return err;
-}
+  bool found = false;
+  bool error = false;
+  int responseIndex = 0;
+  int errorIndex = 0;
+  int destIndex = 0;
+  unsigned int charsRead = 0;
+  int responseLen = 0;
+  int errorLen = 0;
+  const char* expectedError= nullptr;
+  bool printResponse = false; // Change to true to print the full response
+  bool printedSomething = false;
 
-void SARA_R5::modulePowerOn(void)
-{
-  if (_powerPin >= 0)
+  if (_printDebug == true)
   {
-    powerOn();
+    _debugPort->print(F("sendCommandWithResponse: Command: "));
+    _debugPort->println(String(command));
   }
-  else
+
+  if (isOperatorScanActive()) // Any command would abort the scan
   {
     if (_printDebug == true)
-      _debugPort->println(F("modulePowerOn: not supported. _powerPin not defined."));
+      _debugPort->println(F("sendCommandWithResponse: operator scan in progress"));
+    return SARA_R5_ERROR_INVALID;
   }
-}
 
-/////////////
-// Private //
-/////////////
+  int latencyIndex = -1;
+  unsigned long defaultTimeout = commandTimeout;
+  int latencyErrorIndex = 0; // Matches SARA_R5_RESPONSE_ERROR even when the caller is waiting for another response
+  unsigned long latencyError = 0; // When the ERROR arrived. 0 if it has not
 
-SARA_R5_error_t SARA_R5::init(unsigned long baud,
-                              SARA_R5::SARA_R5_init_type_t initType)
-{
-  int retries = _maxInitTries;
-  SARA_R5_error_t err = SARA_R5_ERROR_SUCCESS;
+  if ((_commandLatency != nullptr) && (at == true) && (_batchSending == false)) // Only single AT commands are tracked
+  {
+    latencyIndex = commandLatencyIndex(command, true);
+    commandTimeout = adaptiveTimeout(latencyIndex, commandTimeout);
+  }
 
-  beginSerial(baud);
+  sendCommand(command, at); //Sending command needs to queue any URCs that arrive first.
+  unsigned long timeIn = millis();
+  if (SARA_R5_RESPONSE_OK_OR_ERROR == expectedResponse) {
+    expectedResponse = SARA_R5_RESPONSE_OK;
+    expectedError = SARA_R5_RESPONSE_ERROR;
+    responseLen = sizeof(SARA_R5_RESPONSE_OK)-1;
+    errorLen = sizeof(SARA_R5_RESPONSE_ERROR)-1;
+  } else {
+    responseLen = (int)strlen(expectedResponse);
+  }
 
-  do
+  while ((!found) && ((timeIn + commandTimeout) > millis()))
   {
-    if (_printDebug == true)
-      _debugPort->println(F("init: Begin module init."));
-
-    if (initType == SARA_R5_INIT_AUTOBAUD)
+    if (hwAvailable() > 0) //hwAvailable can return -1 if the serial port is nullptr
     {
-      if (_printDebug == true)
-        _debugPort->println(F("init: Attempting autobaud connection to module."));
-
-      err = autobaud(baud);
-
-      if (err != SARA_R5_ERROR_SUCCESS) {
-        initType = SARA_R5_INIT_RESET;
+      char c = readChar();
+      if ((printResponse = true) && (_printDebug == true))
+      {
+        if (printedSomething == false)
+        {
+          _debugPort->print(F("sendCommandWithResponse: Response: "));
+          printedSomething = true;
+        }
+        _debugPort->write(c);
       }
-    }
-    else if (initType == SARA_R5_INIT_RESET)
-    {
-      if (_printDebug == true)
-        _debugPort->println(F("init: Power cycling module."));
-
-      powerOff();
-      delay(SARA_R5_POWER_OFF_PULSE_PERIOD);
-      powerOn();
-      beginSerial(baud);
-      delay(2000);
-
-      err = at();
-      if (err != SARA_R5_ERROR_SUCCESS)
+      if (responseDest != nullptr)
       {
-         initType = SARA_R5_INIT_AUTOBAUD;
+        if (destIndex < destSize) // Only add this char to response if there is room for it
+          responseDest[destIndex] = c;
+        destIndex++;
+        if (destIndex == destSize)
+        {
+          if (_printDebug == true)
+          {
+            if ((printResponse = true) && (printedSomething))
+              _debugPort->println();
+            _debugPort->print(F("sendCommandWithResponse: Panic! responseDest is full!"));
+            if ((printResponse = true) && (printedSomething))
+              _debugPort->print(F("sendCommandWithResponse: Ignored response: "));
+          }
+        }
       }
-    }
-    if (err == SARA_R5_ERROR_SUCCESS)
-    {
-      err = enableEcho(false); // = disableEcho
-      if (err != SARA_R5_ERROR_SUCCESS)
+      charsRead++;
+      if ((errorIndex < errorLen) && (c == expectedError[errorIndex]))
       {
-        if (_printDebug == true)
-          _debugPort->println(F("init: Module failed echo test."));
-        initType =  SARA_R5_INIT_AUTOBAUD;
+        if (++errorIndex == errorLen)
+        {
+          error = true;
+          found = true;
+        }
       }
+      else
+      {
+        errorIndex = ((errorIndex < errorLen) && (c == expectedError[0])) ? 1 : 0;
+      }
+      if ((responseIndex < responseLen) && (c == expectedResponse[responseIndex]))
+      {
+        if (++responseIndex == responseLen)
+        {
+          found = true;
+        }
+      }
+      else
+      {
+        responseIndex = ((responseIndex < responseLen) && (c == expectedResponse[0])) ? 1 : 0;
+      }
+      if ((latencyIndex >= 0) && (latencyError == 0))
+      {
+        if (c == SARA_R5_RESPONSE_ERROR[latencyErrorIndex])
+        {
+          if (++latencyErrorIndex == (int)(sizeof(SARA_R5_RESPONSE_ERROR) - 1))
+            latencyError = millis() - timeIn + 1; // + 1 so an immediate ERROR is not 0
+        }
+        else
+          latencyErrorIndex = (c == SARA_R5_RESPONSE_ERROR[0]) ? 1 : 0;
+      }
+      //Any URCs that come in while waiting for the response are converted into events and queued.
+      //They are dispatched later within bufferedPoll(). Everything else is discarded.
+      //In RX task mode, rxTask has already queued them.
+      if (_rxTaskMode == false)
+        bufferURCChar(c);
+    } else {
+      yield();
     }
   }
-  while ((retries --) && (err != SARA_R5_ERROR_SUCCESS));
-
-  // we tried but seems failed
-  if (err != SARA_R5_ERROR_SUCCESS) {
-    if (_printDebug == true)
-      _debugPort->println(F("init: Module failed to init. Exiting."));
-    return (SARA_R5_ERROR_NO_RESPONSE);
-  }
 
   if (_printDebug == true)
-    _debugPort->println(F("init: Module responded successfully."));
+    if ((printResponse = true) && (printedSomething))
+      _debugPort->println();
 
-  _baud = baud;
-  setGpioMode(GPIO1, NETWORK_STATUS);
-  //setGpioMode(GPIO2, GNSS_SUPPLY_ENABLE);
-  setGpioMode(GPIO6, TIME_PULSE_OUTPUT);
-  setSMSMessageFormat(SARA_R5_MESSAGE_FORMAT_TEXT);
-  autoTimeZone(_autoTimeZoneForBegin);
-  for (int i = 0; i < SARA_R5_NUM_SOCKETS; i++)
+  // A prompt ERROR is a response too. It must not stretch the timeout as if the module had not replied
+  if (latencyIndex >= 0)
   {
-    socketClose(i, SARA_R5_STANDARD_RESPONSE_TIMEOUT);
+    if ((found == false) && (latencyError > 0))
+      updateCommandLatency(latencyIndex, true, latencyError - 1, commandTimeout, defaultTimeout);
+    else
+      updateCommandLatency(latencyIndex, found, millis() - timeIn, commandTimeout, defaultTimeout);
   }
 
-  return SARA_R5_ERROR_SUCCESS;
+  if (rxResponseLost())
+  {
+    if (_printDebug == true)
+      _debugPort->println(F("sendCommandWithResponse: the response ring overflowed. The response is incomplete"));
+    return SARA_R5_ERROR_UNEXPECTED_RESPONSE;
+  }
+
+  if (found)
+  {
+    if ((true == _printAtDebug) && ((nullptr != responseDest) || (nullptr != expectedResponse))) {
+      _debugAtPort->print((nullptr != responseDest) ? responseDest : expectedResponse);
+    }
+    return error ? SARA_R5_ERROR_ERROR : SARA_R5_ERROR_SUCCESS;
+  }
+  else if (charsRead == 0)
+  {
+    return SARA_R5_ERROR_NO_RESPONSE;
+  }
+  else
+  {
+    if ((true == _printAtDebug) && (nullptr != responseDest)) {
+      _debugAtPort->print(responseDest);
+    }
+    return SARA_R5_ERROR_UNEXPECTED_RESPONSE;
+  }
 }
 
-void SARA_R5::invertPowerPin(bool invert)
+// Send a custom command with an expected (potentially partial) response, store entire response
+SARA_R5_error_t SARA_R5::sendCustomCommandWithResponse(const char *command, const char *expectedResponse,
+                                                       char *responseDest, unsigned long commandTimeout, bool at)
 {
-  _invertPowerPin = invert;
+  // Assume the user has allocated enough storage for any response. Set destSize to 32766.
+  return sendCommandWithResponse(command, expectedResponse, responseDest, commandTimeout, 32766, at);
 }
 
-// Do a graceful power off. Hold the PWR_ON pin low for SARA_R5_POWER_OFF_PULSE_PERIOD
-// Note: +CPWROFF () is preferred to this.
-void SARA_R5::powerOff(void)
+SARA_R5_error_t SARA_R5::setConfigShadow(bool enable)
 {
-  if (_powerPin >= 0)
+  if (enable == false)
   {
-    if (_invertPowerPin) // Set the pin state before making it an output
-      digitalWrite(_powerPin, HIGH);
-    else
-      digitalWrite(_powerPin, LOW);
-    pinMode(_powerPin, OUTPUT);
-    if (_invertPowerPin) // Set the pin state
-      digitalWrite(_powerPin, HIGH);
-    else
-      digitalWrite(_powerPin, LOW);
-    delay(SARA_R5_POWER_OFF_PULSE_PERIOD);
-    pinMode(_powerPin, INPUT); // Return to high-impedance, rely on (e.g.) SARA module internal pull-up
-    if (_printDebug == true)
-      _debugPort->println(F("powerOff: complete"));
+    if (nullptr != _configShadow)
+      delete[] _configShadow;
+    _configShadow = nullptr;
+    return SARA_R5_ERROR_SUCCESS;
+  }
+
+  if (nullptr == _configShadow)
+  {
+    _configShadow = new SARA_R5_config_shadow_t[SARA_R5_CONFIG_SHADOW_SIZE];
+    if (nullptr == _configShadow)
+    {
+      if (_printDebug == true)
+        _debugPort->println(F("setConfigShadow: not enough memory for _configShadow!"));
+      return SARA_R5_ERROR_OUT_OF_MEMORY;
+    }
+    invalidateConfigShadow();
   }
+  return SARA_R5_ERROR_SUCCESS;
 }
 
-void SARA_R5::powerOn(void)
+void SARA_R5::invalidateConfigShadow(void)
 {
-  if (_powerPin >= 0)
+  if (nullptr == _configShadow)
+    return;
+  memset(_configShadow, 0, SARA_R5_CONFIG_SHADOW_SIZE * sizeof(SARA_R5_config_shadow_t));
+  _configShadowNext = 0;
+}
+
+// Forget the shadowed value of the setting selected by selector - the command up to and including the ',' (or '=')
+// before the value, e.g. "+UHTTP=0,1,". Used when another command changes the same setting on the module
+void SARA_R5::forgetShadowedCommand(const char *selector)
+{
+  if (nullptr == _configShadow)
+    return;
+  uint32_t key = configShadowHash(selector, strlen(selector));
+  for (int i = 0; i < SARA_R5_CONFIG_SHADOW_SIZE; i++)
   {
-    if (_invertPowerPin) // Set the pin state before making it an output
-      digitalWrite(_powerPin, HIGH);
-    else
-      digitalWrite(_powerPin, LOW);
-    pinMode(_powerPin, OUTPUT);
-    if (_invertPowerPin) // Set the pin state
-      digitalWrite(_powerPin, HIGH);
-    else
-      digitalWrite(_powerPin, LOW);
-    delay(SARA_R5_POWER_ON_PULSE_PERIOD);
-    pinMode(_powerPin, INPUT); // Return to high-impedance, rely on (e.g.) SARA module internal pull-up
-    //delay(2000);               // Do this in init. Wait before sending AT commands to module. 100 is too short.
-    if (_printDebug == true)
-      _debugPort->println(F("powerOn: complete"));
+    if (_configShadow[i].key == key)
+      _configShadow[i].key = 0;
   }
 }
 
-//This does an abrupt emergency hardware shutdown of the SARA-R5 series modules.
-//It only works if you have access to both the RESET_N and PWR_ON pins.
-//You cannot use this function on the SparkFun Asset Tracker and RESET_N is tied to the MicroMod processor !RESET!...
-void SARA_R5::hwReset(void)
+// 32-bit FNV-1a hash. Never returns zero - that marks an unused shadow entry
+uint32_t SARA_R5::configShadowHash(const char *str, size_t len)
 {
-  if ((_resetPin >= 0) && (_powerPin >= 0))
+  uint32_t hash = 2166136261UL;
+  for (size_t i = 0; i < len; i++)
   {
-    digitalWrite(_resetPin, HIGH); // Start by making sure the RESET_N pin is high
-    pinMode(_resetPin, OUTPUT);
-    digitalWrite(_resetPin, HIGH);
+    hash ^= (uint8_t)str[i];
+    hash *= 16777619UL;
+  }
+  return (hash == 0) ? 1 : hash;
+}
 
-    if (_invertPowerPin) // Now pull PWR_ON low - invert as necessary (on the Asset Tracker)
+// Send a set command - unless the module already holds the value.
+// selectors is the number of parameters after the '=' which select what is being set (profile, op code, etc.).
+// The rest of the command is the value.
+SARA_R5_error_t SARA_R5::sendShadowedCommand(const char *command, int selectors, unsigned long commandTimeout)
+{
+  SARA_R5_error_t err;
+  const char *value = nullptr;
+  int index = -1;
+  uint32_t key = 0;
+  uint32_t hash = 0;
+
+  if (nullptr != _configShadow)
+  {
+    value = strchr(command, '=');
+    for (int i = 0; (i < selectors) && (value != nullptr); i++)
+      value = strchr(value + 1, ',');
+  }
+
+  if (value != nullptr)
+  {
+    value++; // Skip the '=' or ','
+    key = configShadowHash(command, value - command);
+    hash = configShadowHash(value, strlen(value));
+
+    for (int i = 0; i < SARA_R5_CONFIG_SHADOW_SIZE; i++)
     {
-      digitalWrite(_powerPin, HIGH); // Inverted - Asset Tracker
-      pinMode(_powerPin, OUTPUT);
-      digitalWrite(_powerPin, HIGH);
+      if (_configShadow[i].key == key)
+      {
+        index = i;
+        break;
+      }
     }
-    else
+
+    if ((index >= 0) && (_configShadow[index].value == hash))
     {
-      digitalWrite(_powerPin, LOW); // Not inverted
-      pinMode(_powerPin, OUTPUT);
-      digitalWrite(_powerPin, LOW);
+      if (_printDebug == true)
+      {
+        _debugPort->print(F("sendShadowedCommand: skipping: "));
+        _debugPort->println(command);
+      }
+      _configShadowHits++;
+      return SARA_R5_ERROR_SUCCESS;
     }
+  }
 
-    delay(SARA_R5_RESET_PULSE_PERIOD); // Wait 23 seconds... (Yes, really!)
-
-    digitalWrite(_resetPin, LOW); // Now pull RESET_N low
-
-    delay(100); // Wait a little... (The data sheet doesn't say how long for)
+  bool batched = _batchActive; // A batched command has not been sent yet. Its result is only known after endBatch
+  err = sendBatchableCommand(command, commandTimeout);
+  batched = batched && _batchActive && (_batch->length > 0);
 
-    if (_invertPowerPin) // Now pull PWR_ON high - invert as necessary (on the Asset Tracker)
+  if (value != nullptr)
+  {
+    if ((err == SARA_R5_ERROR_SUCCESS) && (batched == false))
     {
-      digitalWrite(_powerPin, LOW); // Inverted - Asset Tracker
+      if (index < 0) // Replace the oldest entry
+      {
+        index = _configShadowNext;
+        _configShadowNext = (_configShadowNext + 1) % SARA_R5_CONFIG_SHADOW_SIZE;
+      }
+      _configShadow[index].key = key;
+      _configShadow[index].value = hash;
     }
-    else
+    else if (index >= 0) // We no longer know what the module holds
     {
-      digitalWrite(_powerPin, HIGH); // Not inverted
+      _configShadow[index].key = 0;
     }
+  }
 
-    delay(1500); // Wait 1.5 seconds
+  return err;
+}
 
-    digitalWrite(_resetPin, HIGH); // Now pull RESET_N high again
+SARA_R5_error_t SARA_R5::beginBatch(void)
+{
+  if (_batchActive == true) // Already batching. Send the previous commands first
+    sendBatch();
 
-    pinMode(_resetPin, INPUT); // Return to high-impedance, rely on SARA module internal pull-up
-    pinMode(_powerPin, INPUT); // Return to high-impedance, rely on SARA module internal pull-up
+  if (nullptr == _batch)
+  {
+    _batch = new SARA_R5_batch_t;
+    if (nullptr == _batch)
+    {
+      if (_printDebug == true)
+        _debugPort->println(F("beginBatch: not enough memory for _batch!"));
+      return SARA_R5_ERROR_OUT_OF_MEMORY;
+    }
   }
+
+  memset(_batch, 0, sizeof(SARA_R5_batch_t));
+  _batchActive = true;
+  return SARA_R5_ERROR_SUCCESS;
 }
 
-SARA_R5_error_t SARA_R5::functionality(SARA_R5_functionality_t function)
+SARA_R5_error_t SARA_R5::endBatch(void)
 {
-  SARA_R5_error_t err;
-  char *command;
-
-  command = sara_r5_calloc_char(strlen(SARA_R5_COMMAND_FUNC) + 16);
-  if (command == nullptr)
-    return SARA_R5_ERROR_OUT_OF_MEMORY;
-  sprintf(command, "%s=%d", SARA_R5_COMMAND_FUNC, function);
+  SARA_R5_error_t err = SARA_R5_ERROR_SUCCESS;
 
-  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR,
-                                nullptr, SARA_R5_3_MIN_TIMEOUT);
+  if (_batchActive == false)
+    return SARA_R5_ERROR_INVALID;
 
-  free(command);
+  sendBatch();
+  _batchActive = false;
 
+  for (int i = 0; i < _batch->commands; i++)
+  {
+    if (_batch->result[i] != SARA_R5_ERROR_SUCCESS)
+    {
+      err = _batch->result[i];
+      break;
+    }
+  }
   return err;
 }
 
-SARA_R5_error_t SARA_R5::setMNOprofile(mobile_network_operator_t mno, bool autoReset, bool urcNotification)
+int SARA_R5::getBatchCommandCount(void)
 {
-  SARA_R5_error_t err;
-  char *command;
+  if (nullptr == _batch)
+    return 0;
+  return _batch->commands;
+}
 
-  command = sara_r5_calloc_char(strlen(SARA_R5_COMMAND_MNO) + 9);
-  if (command == nullptr)
-    return SARA_R5_ERROR_OUT_OF_MEMORY;
-  if (mno == MNO_SIM_ICCID) // Only add autoReset and urcNotification if mno is MNO_SIM_ICCID
-    sprintf(command, "%s=%d,%d,%d", SARA_R5_COMMAND_MNO, (uint8_t)mno, (uint8_t)autoReset, (uint8_t)urcNotification);
-  else
-    sprintf(command, "%s=%d", SARA_R5_COMMAND_MNO, (uint8_t)mno);
+SARA_R5_error_t SARA_R5::getBatchResult(int index)
+{
+  if ((nullptr == _batch) || (index < 0) || (index >= _batch->commands))
+    return SARA_R5_ERROR_INVALID;
+  return _batch->result[index];
+}
 
-  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR,
-                                nullptr, SARA_R5_STANDARD_RESPONSE_TIMEOUT);
+// Add command to the batch. Returns false if it cannot be batched - it is then sent as normal
+bool SARA_R5::addBatchCommand(const char *command, unsigned long commandTimeout)
+{
+  int len = strlen(command);
 
-  free(command);
+  if ((_batch->commands >= SARA_R5_BATCH_MAX_COMMANDS)
+      || ((len + (int)strlen(SARA_R5_COMMAND_AT) + 1) > SARA_R5_BATCH_LINE_LENGTH))
+    return false;
 
-  return err;
+  // Send the commands so far if this one will not fit. Leave room for the "AT", the ';' and the NULL
+  if ((_batch->length > 0) && ((_batch->length + len + (int)strlen(SARA_R5_COMMAND_AT) + 2) > SARA_R5_BATCH_LINE_LENGTH))
+    sendBatch();
+
+  if (_batch->length > 0)
+    _batch->line[_batch->length++] = ';';
+  _batch->start[_batch->commands] = _batch->length;
+  memcpy(&_batch->line[_batch->length], command, len + 1); // Copy the NULL too
+  _batch->length += len;
+  _batch->timeout[_batch->commands] = commandTimeout;
+  _batch->result[_batch->commands] = SARA_R5_ERROR_SUCCESS;
+  _batch->commands++;
+
+  if (_printDebug == true)
+  {
+    _debugPort->print(F("addBatchCommand: "));
+    _debugPort->println(command);
+  }
+  return true;
 }
 
-SARA_R5_error_t SARA_R5::getMNOprofile(mobile_network_operator_t *mno)
+// Send a configuration set command - or add it to the batch between beginBatch and endBatch.
+// Only commands which return just OK or ERROR, have no URC result and can safely be repeated may be sent this way
+SARA_R5_error_t SARA_R5::sendBatchableCommand(const char *command, unsigned long commandTimeout)
+{
+  if ((_batchActive == true) && (command[0] == '+') && addBatchCommand(command, commandTimeout))
+    return SARA_R5_ERROR_SUCCESS; // The real result is returned by endBatch
+  return sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR, nullptr, commandTimeout);
+}
+
+// Send the batched commands which have not been sent yet as one AT+X;+Y;+Z command line
+SARA_R5_error_t SARA_R5::sendBatch(void)
 {
   SARA_R5_error_t err;
-  char *command;
-  char *response;
-  mobile_network_operator_t o;
-  int d;
-  int r;
-  int u;
-  int oStore;
+  unsigned long timeout = 0;
 
-  command = sara_r5_calloc_char(strlen(SARA_R5_COMMAND_MNO) + 2);
-  if (command == nullptr)
-    return SARA_R5_ERROR_OUT_OF_MEMORY;
-  sprintf(command, "%s?", SARA_R5_COMMAND_MNO);
+  if ((nullptr == _batch) || (_batch->length == 0))
+    return SARA_R5_ERROR_SUCCESS;
 
-  response = sara_r5_calloc_char(minimumResponseAllocation);
-  if (response == nullptr)
-  {
-    free(command);
-    return SARA_R5_ERROR_OUT_OF_MEMORY;
-  }
+  for (int i = _batch->first; i < _batch->commands; i++)
+    timeout += _batch->timeout[i]; // The module executes the commands one after the other
+
+  _batchActive = false; // Stop sendCommandWithResponse from batching the line again
+  _batchSending = true;
+  err = sendCommandWithResponse(_batch->line, SARA_R5_RESPONSE_OK_OR_ERROR, nullptr, timeout);
+  _batchSending = false;
 
-  err = sendCommandWithResponse(command, SARA_R5_RESPONSE_OK_OR_ERROR,
-                                response, SARA_R5_STANDARD_RESPONSE_TIMEOUT);
   if (err != SARA_R5_ERROR_SUCCESS)
   {
-    free(command);
-    free(response);
-    return err;
+    // The module stops at the first command which fails, but does not say which one it was.
+    // So send the commands again one by one
+    if (_printDebug == true)
+      _debugPort->println(F("sendBatch: batch failed. Sending the commands individually"));
+    invalidateConfigShadow(); // The shadowed commands in the batch were recorded as successful
+    for (int i = _batch->first; i < _batch->commands; i++)
+    {
+      if (i < (_batch->commands - 1))
+        _batch->line[_batch->start[i + 1] - 1] = '\0'; // Replace the ';' with a NULL
+      _batch->result[i] = sendCommandWithResponse(&_batch->line[_batch->start[i]], SARA_R5_RESPONSE_OK_OR_ERROR, nullptr,
+                                                  _batch->timeout[i]);
+    }
   }
 
-  int scanned = 0;
-  char *searchPtr = strstr(response, "+UMNOPROF:");
-  if (searchPtr != nullptr)
+  _batch->length = 0;
+  _batch->line[0] = '\0';
+  _batch->first = _batch->commands;
+  _batchActive = true;
+  return err;
+}
+
+SARA_R5_error_t SARA_R5::setAdaptiveTimeouts(bool enable)
+{
+  if (enable == false)
   {
-    searchPtr += strlen("+UMNOPROF:"); //  Move searchPtr to first char
-    while (*searchPtr == ' ') searchPtr++; // skip spaces
-    scanned = sscanf(searchPtr, "%d,%d,%d,%d", &oStore, &d, &r, &u);
+    if (nullptr != _commandLatency)
+      delete[] _commandLatency;
+    _commandLatency = nullptr;
+    return SARA_R5_ERROR_SUCCESS;
   }
-  o = (mobile_network_operator_t)oStore;
 
-  if (scanned >= 1)
+  if (nullptr == _commandLatency)
   {
-    if (_printDebug == true)
+    _commandLatency = new SARA_R5_command_latency_t[SARA_R5_LATENCY_TABLE_SIZE];
+    if (nullptr == _commandLatency)
     {
-      _debugPort->print(F("getMNOprofile: MNO is: "));
-      _debugPort->println(o);
+      if (_printDebug == true)
+        _debugPort->println(F("setAdaptiveTimeouts: not enough memory for _commandLatency!"));
+      return SARA_R5_ERROR_OUT_OF_MEMORY;
     }
-    *mno = o;
+    memset(_commandLatency, 0, SARA_R5_LATENCY_TABLE_SIZE * sizeof(SARA_R5_command_latency_t));
   }
-  else
-  {
-    err = SARA_R5_ERROR_INVALID;
-  }
-
-  free(command);
-  free(response);
+  return SARA_R5_ERROR_SUCCESS;
+}
 
-  return err;
+bool SARA_R5::getCommandLatency(const char *command, SARA_R5_command_latency_t *latency)
+{
+  int index = commandLatencyIndex(command, false);
+  if ((index < 0) || (latency == nullptr))
+    return false;
+  *latency = _commandLatency[index];
+  return true;
 }
 
-SARA_R5_error_t SARA_R5::waitForResponse(const char *expectedResponse, const char *expectedError, uint16_t timeout)
+unsigned long SARA_R5::getAdaptiveTimeout(const char *command, unsigned long defaultTimeout)
 {
-  unsigned long timeIn;
-  bool found = false;
-  bool error = false;
-  int responseIndex = 0, errorIndex = 0;
-  // bool printedSomething = false;
+  return adaptiveTimeout(commandLatencyIndex(command, false), defaultTimeout);
+}
 
-  timeIn = millis();
+// Find the latency table entry for command. The key is the command name plus its form: "?" for a read, "=?" for a test,
+// or "=" plus the first two parameters (while they are numbers of up to 3 digits) for a set or action. So +COPS?, +COPS=?
+// and +COPS=1 are tracked separately, as are a +UHTTPC GET and POST. If add is true and the key is not in the table, the least recently used entry is replaced.
+int SARA_R5::commandLatencyIndex(const char *command, bool add)
+{
+  char name[SARA_R5_LATENCY_COMMAND_LENGTH];
+  int len = 0;
+  int oldest = -1;
 
-  int responseLen = (int)strlen(expectedResponse);
-  int errorLen = (int)strlen(expectedError);
+  if ((_commandLatency == nullptr) || (command == nullptr))
+    return -1;
 
-  while ((!found) && ((timeIn + timeout) > millis()))
+  while ((len < (SARA_R5_LATENCY_COMMAND_LENGTH - 10)) && (command[len] != '\0') && (command[len] != '=') && (command[len] != '?'))
   {
-    if (hwAvailable() > 0) //hwAvailable can return -1 if the serial port is nullptr
-    {
-      char c = readChar();
-      // if (_printDebug == true)
-      // {
-      //   if (printedSomething == false)
-      //     _debugPort->print(F("waitForResponse: "));
-      //   _debugPort->write(c);
-      //   printedSomething = true;
-      // }
-      if ((responseIndex < responseLen) && (c == expectedResponse[responseIndex]))
-      {
-        if (++responseIndex == responseLen)
-        {
-          found = true;
-        }
-      }
-      else
-      {
-        responseIndex = ((responseIndex < responseLen) && (c == expectedResponse[0])) ? 1 : 0;
-      }
-      if ((errorIndex < errorLen) && (c == expectedError[errorIndex]))
-      {
-        if (++errorIndex == errorLen)
-        {
-          error = true;
-          found = true;
-        }
-      }
-      else
-      {
-        errorIndex = ((errorIndex < errorLen) && (c == expectedError[0])) ? 1 : 0;
-      }
-      //_saraResponseBacklog is a global array that holds the backlog of any events
-      //that came in while waiting for response. To be processed later within bufferedPoll().
-      //Note: the expectedResponse or expectedError will also be added to the backlog.
-      //The backlog is only used by bufferedPoll to process the URCs - which are all readable.
-      //bufferedPoll uses strtok - which does not like nullptr characters.
-      //So let's make sure no NULLs end up in the backlog!
-      if (_saraResponseBacklogLength < _RXBuffSize) // Don't overflow the buffer
-      {
-        if (c == '\0')
-          _saraResponseBacklog[_saraResponseBacklogLength++] = '0'; // Change NULLs to ASCII Zeros
-        else
-          _saraResponseBacklog[_saraResponseBacklogLength++] = c;
-      }
-    } else {
-      yield();
-    }
+    name[len] = command[len];
+    len++;
   }
-
-  // if (_printDebug == true)
-  //   if (printedSomething)
-  //     _debugPort->println();
-
-  pruneBacklog(); // Prune any incoming non-actionable URC's and responses/errors from the backlog
-
-  if (found == true)
+  const char *form = command + len;
+  if ((*form == '?') || ((*form == '=') && (*(form + 1) == '?')))
   {
-    if (true == _printAtDebug) {
-      _debugAtPort->print((error == true) ? expectedError : expectedResponse);
+    name[len++] = *form++; // "?" or "=?"
+    if (*form == '?')
+      name[len++] = '?';
+  }
+  else if (*form == '=')
+  {
+    name[len++] = '=';
+    for (int param = 0; param < 2; param++)
+    {
+      int digits = 0;
+      while ((form[1 + digits] >= '0') && (form[1 + digits] <= '9') && (digits < 4))
+        digits++;
+      if ((digits == 0) || (digits > 3) || ((form[1 + digits] != ',') && (form[1 + digits] != '\0')))
+        break;
+      if (param > 0)
+        name[len++] = ',';
+      memcpy(&name[len], form + 1, digits);
+      len += digits;
+      form += 1 + digits; // form now points to the ',' (or the NULL) after the parameter
+      if (*form != ',')
+        break;
     }
+  }
+  name[len] = '\0';
+  if (len == 0)
+    strcpy(name, SARA_R5_COMMAND_AT); // Plain "AT". An empty name marks an unused entry
 
-    return (error == true) ? SARA_R5_ERROR_ERROR : SARA_R5_ERROR_SUCCESS;
+  for (int i = 0; i < SARA_R5_LATENCY_TABLE_SIZE; i++)
+  {
+    if (strcmp(_commandLatency[i].command, name) == 0)
+      return i;
+    // Prefer an unused entry - then the least recently used
+    if ((oldest < 0) || ((_commandLatency[oldest].command[0] != '\0')
+        && ((_commandLatency[i].command[0] == '\0') || (_commandLatency[i].lastUsed < _commandLatency[oldest].lastUsed))))
+      oldest = i;
   }
 
-  return SARA_R5_ERROR_NO_RESPONSE;
+  if (add == false)
+    return -1;
+
+  memset(&_commandLatency[oldest], 0, sizeof(SARA_R5_command_latency_t));
+  strcpy(_commandLatency[oldest].command, name);
+  _commandLatency[oldest].lastUsed = millis();
+  return oldest;
 }
 
-SARA_R5_error_t SARA_R5::sendCommandWithResponse(
-    const char *command, const char *expectedResponse, char *responseDest,
-    unsigned long commandTimeout, int destSize, bool at)
+// Return the timeout to use for the command at index in the latency table.
+// defaultTimeout is the static timeout used by the library. It is the upper limit
+unsigned long SARA_R5::adaptiveTimeout(int index, unsigned long defaultTimeout)
 {
-  bool found = false;
-  bool error = false;
-  int responseIndex = 0;
-  int errorIndex = 0;
-  int destIndex = 0;
-  unsigned int charsRead = 0;
-  int responseLen = 0;
-  int errorLen = 0;
-  const char* expectedError= nullptr;
-  bool printResponse = false; // Change to true to print the full response
-  bool printedSomething = false;
+  if ((index < 0) || (_commandLatency[index].samples < SARA_R5_ADAPTIVE_TIMEOUT_SAMPLES))
+    return defaultTimeout;
 
-  if (_printDebug == true)
-  {
-    _debugPort->print(F("sendCommandWithResponse: Command: "));
-    _debugPort->println(String(command));
-  }
+  unsigned long timeout = _commandLatency[index].latency + (4 * _commandLatency[index].deviation) + SARA_R5_ADAPTIVE_TIMEOUT_MARGIN;
+  if (timeout < SARA_R5_ADAPTIVE_TIMEOUT_MIN)
+    timeout = SARA_R5_ADAPTIVE_TIMEOUT_MIN;
+  if (timeout > defaultTimeout)
+    timeout = defaultTimeout;
+  return timeout;
+}
 
-  sendCommand(command, at); //Sending command needs to dump data to backlog buffer as well.
-  unsigned long timeIn = millis();
-  if (SARA_R5_RESPONSE_OK_OR_ERROR == expectedResponse) {
-    expectedResponse = SARA_R5_RESPONSE_OK;
-    expectedError = SARA_R5_RESPONSE_ERROR;
-    responseLen = sizeof(SARA_R5_RESPONSE_OK)-1;
-    errorLen = sizeof(SARA_R5_RESPONSE_ERROR)-1;
-  } else {
-    responseLen = (int)strlen(expectedResponse);
-  }
+// Update the latency estimate for the command at index
+void SARA_R5::updateCommandLatency(int index, bool responded, unsigned long latency, unsigned long timeout, unsigned long defaultTimeout)
+{
+  SARA_R5_command_latency_t *entry = &_commandLatency[index];
 
-  while ((!found) && ((timeIn + commandTimeout) > millis()))
+  entry->lastUsed = millis();
+
+  if (responded == false)
   {
-    if (hwAvailable() > 0) //hwAvailable can return -1 if the serial port is nullptr
+    // If the shortened timeout expired, double the deviation so the next attempt waits longer - up to defaultTimeout.
+    // Failures are not counted as samples
+    if (timeout < defaultTimeout)
     {
-      char c = readChar();
-      if ((printResponse = true) && (_printDebug == true))
-      {
-        if (printedSomething == false)
-        {
-          _debugPort->print(F("sendCommandWithResponse: Response: "));
-          printedSomething = true;
-        }
-        _debugPort->write(c);
-      }
-      if (responseDest != nullptr)
-      {
-        if (destIndex < destSize) // Only add this char to response if there is room for it
-          responseDest[destIndex] = c;
-        destIndex++;
-        if (destIndex == destSize)
-        {
-          if (_printDebug == true)
-          {
-            if ((printResponse = true) && (printedSomething))
-              _debugPort->println();
-            _debugPort->print(F("sendCommandWithResponse: Panic! responseDest is full!"));
-            if ((printResponse = true) && (printedSomething))
-              _debugPort->print(F("sendCommandWithResponse: Ignored response: "));
-          }
-        }
-      }
-      charsRead++;
-      if ((errorIndex < errorLen) && (c == expectedError[errorIndex]))
-      {
-        if (++errorIndex == errorLen)
-        {
-          error = true;
-          found = true;
-        }
-      }
-      else
-      {
-        errorIndex = ((errorIndex < errorLen) && (c == expectedError[0])) ? 1 : 0;
-      }
-      if ((responseIndex < responseLen) && (c == expectedResponse[responseIndex]))
-      {
-        if (++responseIndex == responseLen)
-        {
-          found = true;
-        }
-      }
-      else
-      {
-        responseIndex = ((responseIndex < responseLen) && (c == expectedResponse[0])) ? 1 : 0;
-      }
-      //_saraResponseBacklog is a global array that holds the backlog of any events
-      //that came in while waiting for response. To be processed later within bufferedPoll().
-      //Note: the expectedResponse or expectedError will also be added to the backlog
-      //The backlog is only used by bufferedPoll to process the URCs - which are all readable.
-      //bufferedPoll uses strtok - which does not like NULL characters.
-      //So let's make sure no NULLs end up in the backlog!
-      if (_saraResponseBacklogLength < _RXBuffSize) // Don't overflow the buffer
-      {
-        if (c == '\0')
-          _saraResponseBacklog[_saraResponseBacklogLength++] = '0'; // Change NULLs to ASCII Zeros
-        else
-          _saraResponseBacklog[_saraResponseBacklogLength++] = c;
-      }
-    } else {
-      yield();
+      entry->deviation = (entry->deviation * 2) + 1;
+      if (entry->deviation > (defaultTimeout / 4))
+        entry->deviation = defaultTimeout / 4;
     }
+    return;
   }
 
-  if (_printDebug == true)
-    if ((printResponse = true) && (printedSomething))
-      _debugPort->println();
-
-  pruneBacklog(); // Prune any incoming non-actionable URC's and responses/errors from the backlog
-
-  if (found)
-  {
-    if ((true == _printAtDebug) && ((nullptr != responseDest) || (nullptr != expectedResponse))) {
-      _debugAtPort->print((nullptr != responseDest) ? responseDest : expectedResponse);
-    }
-    return error ? SARA_R5_ERROR_ERROR : SARA_R5_ERROR_SUCCESS;
-  }
-  else if (charsRead == 0)
+  if (entry->samples == 0)
   {
-    return SARA_R5_ERROR_NO_RESPONSE;
+    entry->latency = latency;
+    entry->deviation = latency / 2;
   }
   else
   {
-    if ((true == _printAtDebug) && (nullptr != responseDest)) {
-      _debugAtPort->print(responseDest);
-    }
-    return SARA_R5_ERROR_UNEXPECTED_RESPONSE;
+    // latency = 7/8 latency + 1/8 sample. deviation = 3/4 deviation + 1/4 |error|
+    long error = (long)latency - (long)entry->latency;
+    entry->latency = (uint32_t)((long)entry->latency + (error / 8));
+    if (error < 0)
+      error = -error;
+    entry->deviation = (uint32_t)((long)entry->deviation + ((error - (long)entry->deviation) / 4));
   }
-}
 
-// Send a custom command with an expected (potentially partial) response, store entire response
-SARA_R5_error_t SARA_R5::sendCustomCommandWithResponse(const char *command, const char *expectedResponse,
-                                                       char *responseDest, unsigned long commandTimeout, bool at)
-{
-  // Assume the user has allocated enough storage for any response. Set destSize to 32766.
-  return sendCommandWithResponse(command, expectedResponse, responseDest, commandTimeout, 32766, at);
+  if (entry->samples < 0xFFFF)
+    entry->samples++;
+
+  if (_printDebug == true)
+  {
+    _debugPort->print(F("updateCommandLatency: "));
+    _debugPort->print(entry->command);
+    _debugPort->print(F(" latency "));
+    _debugPort->print(entry->latency);
+    _debugPort->print(F(" deviation "));
+    _debugPort->println(entry->deviation);
+  }
 }
 
 void SARA_R5::sendCommand(const char *command, bool at)
 {
-  //Check for incoming serial data. Copy it into the backlog
+  if (isOperatorScanActive()) // Any command would abort the scan. waitForResponse will return SARA_R5_ERROR_INVALID
+    return;
+
+  // Send any batched commands first, so the commands are always sent in order
+  if ((_batchActive == true) && (_batch->length > 0))
+    sendBatch();
+
+  //Check for incoming serial data. Queue any URCs
 
   // Important note:
   // On ESP32, Serial.available only provides an update every ~120 bytes during the reception of long messages:
@@ -6329,20 +11939,18 @@ void SARA_R5::sendCommand(const char *command, bool at)
   unsigned long timeIn = millis();
   if (hwAvailable() > 0) //hwAvailable can return -1 if the serial port is NULL
   {
-    while (((millis() - timeIn) < _rxWindowMillis) && (_saraResponseBacklogLength < _RXBuffSize)) //May need to escape on newline?
+    int avail = 0;
+    while (((millis() - timeIn) < _rxWindowMillis) && (avail < _RXBuffSize)) //May need to escape on newline?
     {
       if (hwAvailable() > 0) //hwAvailable can return -1 if the serial port is NULL
       {
-        //_saraResponseBacklog is a global array that holds the backlog of any events
-        //that came in while waiting for response. To be processed later within bufferedPoll().
-        //Note: the expectedResponse or expectedError will also be added to the backlog
-        //The backlog is only used by bufferedPoll to process the URCs - which are all readable.
-        //bufferedPoll uses strtok - which does not like NULL characters.
-        //So let's make sure no NULLs end up in the backlog!
+        //Any URCs that arrive before the command is sent are converted into events and queued.
+        //They are dispatched later within bufferedPoll().
+        //In RX task mode, rxTask has already queued them. The stale characters are simply discarded.
         char c = readChar();
-        if (c == '\0') // Make sure no NULL characters end up in the backlog! Change them to ASCII Zeros
-          c = '0';
-        _saraResponseBacklog[_saraResponseBacklogLength++] = c;
+        avail++;
+        if (_rxTaskMode == false)
+          bufferURCChar(c);
         timeIn = millis();
       } else {
         yield();
@@ -6350,6 +11958,10 @@ void SARA_R5::sendCommand(const char *command, bool at)
     }
   }
 
+#ifdef SARA_R5_RX_TASK_ENABLED
+  _rxResponseDroppedAtCommand = _rxResponseDropped; // Any characters dropped from now on were part of the response
+#endif
+
   //Now send the command
   if (at)
   {
@@ -6597,6 +12209,20 @@ char SARA_R5::readChar(void)
 {
   char ret = 0;
 
+#ifdef SARA_R5_RX_TASK_ENABLED
+  if (_rxTaskMode == true) // In RX task mode, rxTask owns the UART. Read from the response ring instead
+  {
+    uint16_t head = _rxResponseHead;
+    if (head != _rxResponseTail)
+    {
+      ret = _rxResponseRing[head];
+      _rxResponseHead = (head + 1) % _RXBuffSize;
+      trackResponseChar(ret); // rxTask cannot do this: the state belongs to the application side
+    }
+    return ret;
+  }
+#endif
+
   if (_hardSerial != nullptr)
   {
     ret = (char)_hardSerial->read();
@@ -6613,6 +12239,13 @@ char SARA_R5::readChar(void)
 
 int SARA_R5::hwAvailable(void)
 {
+#ifdef SARA_R5_RX_TASK_ENABLED
+  if (_rxTaskMode == true) // In RX task mode, rxTask owns the UART. Report what is in the response ring instead
+  {
+    return (((int)_rxResponseTail + _RXBuffSize) - (int)_rxResponseHead) % _RXBuffSize;
+  }
+#endif
+
   if (_hardSerial != nullptr)
   {
     return _hardSerial->available();
@@ -6627,22 +12260,26 @@ int SARA_R5::hwAvailable(void)
   return -1;
 }
 
-void SARA_R5::beginSerial(unsigned long baud)
+SARA_R5_error_t SARA_R5::beginSerial(unsigned long baud)
 {
-  delay(100);
+  if (_rxTaskMode == true) // rxTask owns the UART
+    return SARA_R5_ERROR_INVALID;
+
   if (_hardSerial != nullptr)
   {
+    _hardSerial->flush(); // Wait for any outgoing data to be sent before changing the baud rate
     _hardSerial->end();
     _hardSerial->begin(baud);
   }
 #ifdef SARA_R5_SOFTWARE_SERIAL_ENABLED
   else if (_softSerial != nullptr)
   {
-    _softSerial->end();
+    _softSerial->end(); // SoftwareSerial writes are blocking. There is nothing to flush
     _softSerial->begin(baud);
   }
 #endif
-  delay(100);
+  delay(SARA_R5_SERIAL_SETTLE_PERIOD);
+  return SARA_R5_ERROR_SUCCESS;
 }
 
 void SARA_R5::setTimeout(unsigned long timeout)
@@ -6675,97 +12312,217 @@ bool SARA_R5::find(char *target)
   return found;
 }
 
-SARA_R5_error_t SARA_R5::autobaud(unsigned long desiredBaud)
+// Step up through the supported baud rates - see negotiateBaud in the header file
+SARA_R5_error_t SARA_R5::negotiateBaud(unsigned long maxBaud, bool flowControl, bool persist, int burstSize)
 {
-  SARA_R5_error_t err = SARA_R5_ERROR_INVALID;
-  int b = 0;
+  SARA_R5_LOCK_TRANSACTION(SARA_R5_PRIORITY_HIGH); // Nothing else may use the port while the rate changes
+  SARA_R5_error_t err;
+  unsigned long goodBaud = _baud;
 
-  while ((err != SARA_R5_ERROR_SUCCESS) && (b < NUM_SUPPORTED_BAUD))
+  if (_rxTaskMode == true) // rxTask owns the UART
+    return SARA_R5_ERROR_INVALID;
+
+  if ((burstSize < 1) || (burstSize > SARA_R5_BAUD_PROBE_MAX_BURST))
+    return SARA_R5_ERROR_UNEXPECTED_PARAM;
+
+  err = at();
+  if (err != SARA_R5_ERROR_SUCCESS)
+    return err;
+
+  if (flowControl == true)
   {
-    beginSerial(SARA_R5_SUPPORTED_BAUD[b++]);
-    setBaud(desiredBaud);
-    beginSerial(desiredBaud);
-    err = at();
+    err = setFlowControl(SARA_R5_ENABLE_FLOW_CONTROL);
+    if (err != SARA_R5_ERROR_SUCCESS)
+      return err;
   }
-  if (err == SARA_R5_ERROR_SUCCESS)
+
+  while (true)
   {
-    beginSerial(desiredBaud);
+    // Find the next supported rate above goodBaud
+    unsigned long nextBaud = 0;
+    for (int b = 0; b < NUM_SUPPORTED_BAUD; b++)
+    {
+      if ((SARA_R5_SUPPORTED_BAUD[b] > goodBaud) && (SARA_R5_SUPPORTED_BAUD[b] <= maxBaud)
+          && ((nextBaud == 0) || (SARA_R5_SUPPORTED_BAUD[b] < nextBaud)))
+        nextBaud = SARA_R5_SUPPORTED_BAUD[b];
+    }
+    if (nextBaud == 0)
+      break;
+
+    if (_printDebug == true)
+    {
+      _debugPort->print(F("negotiateBaud: trying "));
+      _debugPort->println(nextBaud);
+    }
+
+    if (setBaud(nextBaud) != SARA_R5_ERROR_SUCCESS)
+      break;
+    beginSerial(nextBaud);
+
+    bool passed = (waitForReady(SARA_R5_BAUD_PROBE_TIMEOUT) == SARA_R5_ERROR_SUCCESS);
+    if (passed)
+      passed = (enableEcho(true) == SARA_R5_ERROR_SUCCESS); // The probe relies on the echo
+    for (int i = 0; (i < SARA_R5_BAUD_PROBE_BURSTS) && (passed == true); i++)
+      passed = baudProbe(burstSize);
+
+    if (passed)
+    {
+      enableEcho(false);
+      goodBaud = nextBaud;
+      _baud = nextBaud;
+      continue;
+    }
+
+    // Go back to the last good rate. The link may be too noisy for +IPR to get through, so fall back to autobaud
+    if (_printDebug == true)
+      _debugPort->println(F("negotiateBaud: probe failed. Going back to the last good rate"));
+    setBaud(goodBaud);
+    beginSerial(goodBaud);
+    if (waitForReady(SARA_R5_BAUD_PROBE_TIMEOUT) != SARA_R5_ERROR_SUCCESS)
+    {
+      if (autobaud(goodBaud) != SARA_R5_ERROR_SUCCESS)
+        return SARA_R5_ERROR_NO_RESPONSE;
+    }
+    enableEcho(false);
+    break;
   }
-  return err;
-}
 
-char *SARA_R5::sara_r5_calloc_char(size_t num)
-{
-  return (char *)calloc(num, sizeof(char));
+  _baud = goodBaud;
+
+  if (_printDebug == true)
+  {
+    _debugPort->print(F("negotiateBaud: settled on "));
+    _debugPort->println(_baud);
+  }
+
+  if (persist == true)
+  {
+    // Store the current configuration - including +IPR and &K - in the profile
+    err = sendCommandWithResponse(SARA_R5_COMMAND_STORE_PROFILE, SARA_R5_RESPONSE_OK_OR_ERROR,
+                                  nullptr, SARA_R5_STANDARD_RESPONSE_TIMEOUT);
+    if (err != SARA_R5_ERROR_SUCCESS)
+      return err;
+  }
+
+  return SARA_R5_ERROR_SUCCESS;
 }
 
-//This prunes the backlog of non-actionable events. If new actionable events are added, you must modify the if statement.
-void SARA_R5::pruneBacklog()
+// Send a burst of burstSize characters as the (invalid) parameter of +CGMI and check the echo with a Fletcher-16 checksum.
+// +CGMI takes no parameters, so the module rejects the command without doing anything. Echo must be enabled.
+bool SARA_R5::baudProbe(int burstSize)
 {
-  char *event;
+  char *burst;
+  char *response;
+  int responseSize = burstSize + 64; // Room for the echo of the command and the ERROR
+  int len = 0;
+  uint16_t sum1 = 0;
+  uint16_t sum2 = 0;
+  bool passed = false;
 
-  // if (_printDebug == true)
-  // {
-  //   if (_saraResponseBacklogLength > 0) //Handy for debugging new parsing.
-  //   {
-  //     _debugPort->println(F("pruneBacklog: before pruning, backlog was:"));
-  //     _debugPort->println(_saraResponseBacklog);
-  //     _debugPort->println(F("pruneBacklog: end of backlog"));
-  //   }
-  //   else
-  //   {
-  //     _debugPort->println(F("pruneBacklog: backlog was empty"));
-  //   }
-  // }
+  burst = sara_r5_calloc_char(burstSize + 1);
+  if (burst == nullptr)
+    return false;
+  response = sara_r5_calloc_char(responseSize);
+  if (response == nullptr)
+  {
+    free(burst);
+    return false;
+  }
 
-  memset(_pruneBuffer, 0, _RXBuffSize); // Clear the _pruneBuffer
+  // Letters and digits only. Vary the pattern with millis so repeated bursts are different
+  const char pattern[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz";
+  unsigned long seed = millis();
+  for (int i = 0; i < burstSize; i++)
+  {
+    burst[i] = pattern[(seed + (unsigned long)i * 37) % (sizeof(pattern) - 1)];
+    sum1 = (sum1 + (uint8_t)burst[i]) % 255;
+    sum2 = (sum2 + sum1) % 255;
+  }
+
+  while (hwAvailable() > 0) // Discard anything left over
+  {
+    char c = readChar();
+    if (_rxTaskMode == false)
+      bufferURCChar(c);
+  }
 
-  _saraResponseBacklogLength = 0; // Zero the backlog length
+  hwPrint(SARA_R5_COMMAND_AT);
+  hwPrint(SARA_R5_COMMAND_MANU_ID);
+  hwPrint("=\"");
+  hwWriteData(burst, burstSize);
+  hwPrint("\"\r\n");
 
-  char *preservedEvent;
-  event = strtok_r(_saraResponseBacklog, "\r\n", &preservedEvent); // Look for an 'event' - something ending in \r\n
+  // Wait for the echo and the response. Allow for the transmission time, then wait until the module goes quiet
+  unsigned long timeout = SARA_R5_BAUD_PROBE_TIMEOUT + (((unsigned long)burstSize * 20000) / _baud);
+  unsigned long timeIn = millis();
+  unsigned long lastChar = millis();
+  while ((millis() - timeIn) < timeout)
+  {
+    if (hwAvailable() > 0) //hwAvailable can return -1 if the serial port is NULL
+    {
+      char c = readChar();
+      if (len < (responseSize - 1))
+        response[len++] = c;
+      lastChar = millis();
+    }
+    else
+    {
+      if ((len > burstSize) && ((millis() - lastChar) > SARA_R5_BAUD_PROBE_QUIET))
+        break;
+      yield();
+    }
+  }
 
-  while (event != nullptr) //If event is actionable, add it to pruneBuffer.
+  char *start = strchr(response, '\"');
+  char *end = (start == nullptr) ? nullptr : strchr(start + 1, '\"');
+  if ((end != nullptr) && ((end - start - 1) == burstSize) && (strstr(end, SARA_R5_RESPONSE_ERROR) != nullptr))
   {
-    // These are the events we want to keep so they can be processed by poll / bufferedPoll
-    if ((strstr(event, SARA_R5_READ_SOCKET_URC) != nullptr)
-        || (strstr(event, SARA_R5_READ_UDP_SOCKET_URC) != nullptr)
-        || (strstr(event, SARA_R5_LISTEN_SOCKET_URC) != nullptr)
-        || (strstr(event, SARA_R5_CLOSE_SOCKET_URC) != nullptr)
-        || (strstr(event, SARA_R5_GNSS_REQUEST_LOCATION_URC) != nullptr)
-        || (strstr(event, SARA_R5_SIM_STATE_URC) != nullptr)
-        || (strstr(event, SARA_R5_MESSAGE_PDP_ACTION_URC) != nullptr)
-        || (strstr(event, SARA_R5_HTTP_COMMAND_URC) != nullptr)
-        || (strstr(event, SARA_R5_MQTT_COMMAND_URC) != nullptr)
-        || (strstr(event, SARA_R5_PING_COMMAND_URC) != nullptr)
-        || (strstr(event, SARA_R5_REGISTRATION_STATUS_URC) != nullptr)
-        || (strstr(event, SARA_R5_EPSREGISTRATION_STATUS_URC) != nullptr)
-        || (strstr(event, SARA_R5_FTP_COMMAND_URC) != nullptr))
+    uint16_t echo1 = 0;
+    uint16_t echo2 = 0;
+    for (char *p = start + 1; p < end; p++)
     {
-      strcat(_pruneBuffer, event); // The URCs are all readable text so using strcat is OK
-      strcat(_pruneBuffer, "\r\n"); // strtok blows away delimiter, but we want that for later.
-      _saraResponseBacklogLength += strlen(event) + 2; // Add the length of this event to _saraResponseBacklogLength
+      echo1 = (echo1 + (uint8_t)*p) % 255;
+      echo2 = (echo2 + echo1) % 255;
     }
+    passed = ((echo1 == sum1) && (echo2 == sum2));
+  }
 
-    event = strtok_r(nullptr, "\r\n", &preservedEvent); // Walk though any remaining events
+  if (_printDebug == true)
+  {
+    _debugPort->print(F("baudProbe: "));
+    _debugPort->println(passed ? F("passed") : F("failed"));
   }
 
-  memset(_saraResponseBacklog, 0, _RXBuffSize); //Clear out backlog buffer.
-  memcpy(_saraResponseBacklog, _pruneBuffer, _saraResponseBacklogLength); //Copy the pruned buffer back into the backlog
+  free(burst);
+  free(response);
+  return passed;
+}
 
-  // if (_printDebug == true)
-  // {
-  //   if (_saraResponseBacklogLength > 0) //Handy for debugging new parsing.
-  //   {
-  //     _debugPort->println(F("pruneBacklog: after pruning, backlog is now:"));
-  //     _debugPort->println(_saraResponseBacklog);
-  //     _debugPort->println(F("pruneBacklog: end of backlog"));
-  //   }
-  //   else
-  //   {
-  //     _debugPort->println(F("pruneBacklog: backlog is now empty"));
-  //   }
-  // }
+SARA_R5_error_t SARA_R5::autobaud(unsigned long desiredBaud)
+{
+  SARA_R5_error_t err = SARA_R5_ERROR_INVALID;
+  int b = 0;
+
+  if (_rxTaskMode == true) // rxTask owns the UART
+    return SARA_R5_ERROR_INVALID;
+
+  while ((err != SARA_R5_ERROR_SUCCESS) && (b < NUM_SUPPORTED_BAUD))
+  {
+    beginSerial(SARA_R5_SUPPORTED_BAUD[b++]);
+    setBaud(desiredBaud);
+    beginSerial(desiredBaud);
+    err = at();
+  }
+  if (err == SARA_R5_ERROR_SUCCESS)
+  {
+    beginSerial(desiredBaud);
+  }
+  return err;
+}
+
+char *SARA_R5::sara_r5_calloc_char(size_t num)
+{
+  return (char *)calloc(num, sizeof(char));
 }
 
 // GPS Helper Functions:
@@ -72,6 +72,60 @@
 
 #include <IPAddress.h>
 
+// RX task mode
+// On platforms which provide <atomic> (ESP32, ARM, Linux host builds) the URC event queue is a lock-free
+// single-producer / single-consumer queue. A dedicated task or thread can then own the UART - see SARA_R5::rxTask.
+#if defined(__has_include)
+#if __has_include(<atomic>)
+#define SARA_R5_RX_TASK_ENABLED
+#endif
+#endif
+
+#ifdef SARA_R5_RX_TASK_ENABLED
+#include <atomic>
+typedef std::atomic<uint16_t> SARA_R5_spsc_index_t; // Each index is written by the producer or the consumer - never both
+typedef std::atomic<bool> SARA_R5_spsc_flag_t;
+// Order the plain copies of a coalesced event against its sequence number
+#define SARA_R5_SPSC_FENCE_ACQUIRE() std::atomic_thread_fence(std::memory_order_acquire)
+#define SARA_R5_SPSC_FENCE_RELEASE() std::atomic_thread_fence(std::memory_order_release)
+#else
+typedef volatile uint16_t SARA_R5_spsc_index_t;
+typedef volatile bool SARA_R5_spsc_flag_t;
+#define SARA_R5_SPSC_FENCE_ACQUIRE()
+#define SARA_R5_SPSC_FENCE_RELEASE()
+#endif
+
+// Thread-safe transactions
+// On platforms which also provide the C++ threading library, AT transactions from several tasks or threads
+// are serialized through a priority queue - see SARA_R5::lockTransaction.
+#if defined(SARA_R5_RX_TASK_ENABLED) && defined(__has_include)
+#if __has_include(<mutex>) && __has_include(<condition_variable>) && __has_include(<future>) && __has_include(<functional>)
+#define SARA_R5_THREAD_SAFE_ENABLED
+#endif
+#endif
+
+#ifdef SARA_R5_THREAD_SAFE_ENABLED
+#include <mutex>
+#include <condition_variable>
+#include <future>
+#include <functional>
+#include <thread>
+#endif
+
+// Coroutines
+// On C++20 host builds (Linux gateways etc.) the long-running operations can be awaited with co_await.
+// The coroutines are resumed by bufferedPoll when the matching URC arrives - see SARA_R5::awaitURC.
+#if defined(__has_include) && defined(__cpp_impl_coroutine)
+#if __has_include(<coroutine>)
+#define SARA_R5_COROUTINES_ENABLED
+#endif
+#endif
+
+#ifdef SARA_R5_COROUTINES_ENABLED
+#include <coroutine>
+#include <exception>
+#endif
+
 #define SARA_R5_POWER_PIN -1 // Default to no pin
 #define SARA_R5_RESET_PIN -1
 
@@ -90,6 +144,124 @@
 #define SARA_R5_POLL_DELAY 1
 #define SARA_R5_SOCKET_WRITE_TIMEOUT 10000
 #define SARA_R5_SECURITY_RESPONSE_TIMEOUT 10000
+#define SARA_R5_POWER_ON_READY_TIMEOUT 10000 // Upper bound for the module to respond to AT after power-on
+#define SARA_R5_READY_PROBE_INITIAL 50 // waitForReady probes with AT after 50ms, 100ms, 200ms ... up to SARA_R5_READY_PROBE_MAX
+#define SARA_R5_READY_PROBE_MAX 1000
+#define SARA_R5_READY_PROBE_TIMEOUT 100 // The module responds to AT within a few ms once it is ready
+#define SARA_R5_SERIAL_SETTLE_PERIOD 10 // Delay after (re)starting the serial port
+
+// Adaptive command timeouts
+// The response latency of each command form (+CSQ, +COPS?, +COPS=?, +COPS=1, +UHTTPC=0,5 ...) is tracked separately: a read can
+// be much faster than a set or a test of the same command. Once enough samples have been collected, the timeout is the
+// smoothed latency plus four times its mean deviation plus a margin (as TCP does for its RTO).
+// It is never longer than the (datasheet) timeout used by the library, nor shorter than SARA_R5_ADAPTIVE_TIMEOUT_MIN.
+#define SARA_R5_LATENCY_TABLE_SIZE 16 // Number of commands tracked. The least recently used is replaced
+#define SARA_R5_LATENCY_COMMAND_LENGTH 20
+#define SARA_R5_ADAPTIVE_TIMEOUT_SAMPLES 8 // Use the static timeout until this many responses have been seen
+#define SARA_R5_ADAPTIVE_TIMEOUT_MIN 1000
+#define SARA_R5_ADAPTIVE_TIMEOUT_MARGIN 250
+
+// Batched commands
+// Configuration set commands which only return OK or ERROR can be combined into one AT+X;+Y;+Z command line
+#define SARA_R5_BATCH_LINE_LENGTH 512 // Must not exceed the module's command line limit (1024)
+#define SARA_R5_BATCH_MAX_COMMANDS 16
+
+// Configuration shadow
+// The last value successfully written by each shadowed set command is remembered, so the command can be skipped
+// if the module already holds that value
+#define SARA_R5_CONFIG_SHADOW_SIZE 32 // Number of settings remembered. The oldest is replaced
+
+// Identity record
+// The identity of the module and SIM is read once and remembered - see getIdentity
+#define SARA_R5_IDENTITY_RESPONSE_LENGTH 320 // Must hold the response to the compound identity command
+#define SARA_R5_IDENTITY_SIM_RETRY 60000 // After the SIM part fails, wait this long (millis) before reading it again
+
+// Registration state
+// The +CREG and +CEREG status is kept up to date by the URCs - see setRegistrationTracking
+#define SARA_R5_REGISTRATION_MAX_AGE 60000 // Read the status from the module if it has not been updated for this long (millis)
+
+// Signal quality sampler
+// +CESQ is read in the background (by bufferedPoll / poll) and the samples are kept in a ring - see setSignalSampler
+#define SARA_R5_SIGNAL_HISTORY_SIZE 32 // Number of samples kept. The oldest is replaced
+#define SARA_R5_SIGNAL_SAMPLE_PERIOD 10000 // Default sample period (millis)
+#define SARA_R5_SIGNAL_MAX_PERIOD_FACTOR 8 // In adaptive mode, the period can grow to this many times the sample period
+#define SARA_R5_SIGNAL_STABLE_DELTA 3 // The signal is stable if RSRP and RXLEV are within this of their EWMA (dB)
+#define SARA_R5_SIGNAL_EWMA_ALPHA 0.25 // Weight of each new sample in the EWMA
+
+// Operator scan
+// The operators found by startOperatorScan and getOperators are kept in a table - see getScannedOperator
+#define SARA_R5_OPERATOR_TABLE_SIZE 8 // Number of operators remembered. The one seen longest ago is replaced
+#define SARA_R5_OPERATOR_TUPLE_LENGTH 64 // Must hold one (stat,"long","short","numeric",act)
+
+// Power saving (PSM and eDRX)
+#define SARA_R5_PSM_DEFAULT_TAU 3600 // Requested periodic TAU (T3412) in seconds
+#define SARA_R5_PSM_DEFAULT_ACTIVE_TIME 60 // Requested active time (T3324) in seconds
+#define SARA_R5_PSM_QUEUE_SIZE 1024 // Socket data held by socketWriteWhenAwake while the module is in PSM
+#define SARA_R5_PSM_QUEUE_RETRIES 3 // A queued write which fails this many times in a row is dropped
+#define SARA_R5_EDRX_ACT_LTE_M 4 // eDRX access technology: E-UTRAN (LTE Cat M1)
+
+// File streams
+#define SARA_R5_FILE_STREAM_CHUNK_SIZE 512 // Default maximum +URDBLOCK size
+#define SARA_R5_FILE_STREAM_NAME_LENGTH 64 // Longest file name (including the NULL)
+
+// File uploads
+#define SARA_R5_UPLOAD_CHUNK_SIZE 512 // The first +UDWNFILE chunk. The chunk size doubles after each success and halves after an error
+#define SARA_R5_UPLOAD_MIN_CHUNK_SIZE 128
+#define SARA_R5_UPLOAD_MAX_CHUNK_SIZE 4096 // Default maximum chunk size. Each chunk is held in RAM while it is sent
+#define SARA_R5_UPLOAD_RETRIES 2 // The number of times a failed chunk is retried
+
+// File system index
+// The names and sizes of the files in the module file system are remembered and kept up to date by the library's own
+// file, FTP and HTTP commands - see setFileIndex
+#define SARA_R5_FILE_INDEX_SIZE 32 // The number of files which can be indexed
+#define SARA_R5_FILE_INDEX_RESPONSE_LENGTH 1024 // Must hold the +ULSTFILE=0 response. Files which do not fit are not indexed
+
+// Store-and-forward journal
+// Records are appended to rotating segment files in the module file system - see SARA_R5_journal
+// Each record is framed as: magic, length (2 bytes, LSB first), data, CRC-32 of the data (4 bytes, LSB first)
+// In the batches passed to the sinks, each record is preceded by its length (2 bytes, LSB first)
+#define SARA_R5_JOURNAL_NAME_LENGTH 24 // Longest segment file name (including the NULL). The segments are name.0, name.1, ...
+#define SARA_R5_JOURNAL_SEGMENT_SIZE 8192 // Default segment size (bytes)
+#define SARA_R5_JOURNAL_SEGMENTS 8 // Default number of segments. The oldest segment is dropped when they are all full
+#define SARA_R5_JOURNAL_MAX_SEGMENTS 100
+#define SARA_R5_JOURNAL_MAX_RECORD 512 // Longest record
+#define SARA_R5_JOURNAL_BATCH_SIZE 1024 // Default largest batch when flushing. Must hold the largest record and its length
+#define SARA_R5_JOURNAL_READ_SIZE 1024 // Largest +URDBLOCK used to read the records back. Must hold the largest frame
+#define SARA_R5_JOURNAL_OVERHEAD 7 // Framing bytes per record
+#define SARA_R5_JOURNAL_BATCH_OVERHEAD 2 // Length bytes per record in a batch
+#define SARA_R5_JOURNAL_RECORD_MAGIC 0xA5
+#define SARA_R5_JOURNAL_SEGMENT_MAGIC 0x5A // The first record in each segment holds its sequence number
+
+// HTTP response streaming
+#define SARA_R5_HTTP_LINE_LENGTH 256 // Longest status or header line. Longer lines are truncated
+#define SARA_R5_HTTP_CONTENT_TYPE_LENGTH 64
+#define SARA_R5_HTTP_RESULT_TIMEOUT 60000 // Default wait for +UUHTTPCR (millis)
+
+// MQTT publish pipeline
+#define SARA_R5_MQTT_PIPELINE_WINDOW 4 // Default maximum number of QoS 1/2 messages waiting for their +UUMQTTC result
+#define SARA_R5_MQTT_PIPELINE_ACK_TIMEOUT 10000 // Default wait for a +UUMQTTC publish result (millis)
+#define SARA_R5_MQTT_PIPELINE_RETRIES 2 // Default number of times a message is published again after an ack timeout
+#define SARA_R5_MQTT_RESULT_TIMEOUT 30000 // Default wait for the +UUMQTTC result of mqttPublishFromFile (millis)
+
+// MQTT-SN
+#define SARA_R5_MQTTSN_TOPIC_CACHE_SIZE 8 // The number of registered topic IDs held by the cache
+#define SARA_R5_MQTTSN_TOPIC_NAME_LENGTH 64 // The longest topic name the cache can hold, including the NULL
+#define SARA_R5_MQTTSN_RESPONSE_TIMEOUT 30000 // Wait for a +UUMQTTSNC register or subscribe result (millis)
+
+// MQTT inbound messages
+#define SARA_R5_MQTT_INBOUND_BUFFER_SIZE 512 // Default largest topic plus payload drainMQTT can read (bytes)
+#define SARA_R5_MQTT_DRAIN_MAX_MESSAGES 16 // Default maximum number of messages read by each drainMQTT
+#define SARA_R5_MQTT_DRAIN_RETRIES 3 // Failed reads in a row before drainMQTT waits for the next +UUMQTTC unread count
+
+// HTTP POST from memory
+#define SARA_R5_HTTP_POST_INLINE_MAX 128 // Longest body sent inline in +UHTTPC. Longer bodies are staged in a file
+#define SARA_R5_HTTP_POST_STAGING_FILE "post%d.tmp" // Default staging file name. %d is the profile
+#define SARA_R5_HTTP_POST_STAGING_NAME_LENGTH 32 // Longest staging file name (including the NULL)
+#define SARA_R5_HTTP_POST_STAGING_CHUNK 4096 // +UDWNFILE chunk size used for staging
+
+// HTTP request queue
+#define SARA_R5_HTTP_SERVER_LENGTH 64 // Longest server name (including the NULL)
+#define SARA_R5_HTTP_REQUEST_TIMEOUT 180000 // A request fails if +UUHTTPCR has not arrived after this long (millis)
 
 // ## Suported AT Commands
 // ### General
@@ -118,6 +290,9 @@ const char SARA_R5_REGISTRATION_STATUS[] = "+CREG";
 const char SARA_R5_EPSREGISTRATION_STATUS[] = "+CEREG";
 const char SARA_R5_READ_OPERATOR_NAMES[] = "+COPN";
 const char SARA_R5_COMMAND_MNO[] = "+UMNOPROF"; // MNO (mobile network operator) Profile
+const char SARA_R5_PSM_SETTINGS[] = "+CPSMS"; // Power Saving Mode settings
+const char SARA_R5_PSM_REPORT[] = "+UPSMR"; // PSM state reporting
+const char SARA_R5_EDRX_SETTINGS[] = "+CEDRXS"; // eDRX settings
 // ### SIM
 const char SARA_R5_SIM_STATE[] = "+USIMSTAT";
 const char SARA_R5_COMMAND_SIMPIN[] = "+CPIN";    // SIM PIN
@@ -131,6 +306,7 @@ const char SARA_R5_DELETE_MESSAGE[] = "+CMGD";     // Delete message
 // V24 control and V25ter (UART interface)
 const char SARA_R5_FLOW_CONTROL[] = "&K";   // Flow control
 const char SARA_R5_COMMAND_BAUD[] = "+IPR"; // Baud rate
+const char SARA_R5_COMMAND_STORE_PROFILE[] = "&W"; // Store the current configuration in the profile
 // ### Packet switched data services
 const char SARA_R5_MESSAGE_PDP_DEF[] = "+CGDCONT";            // Packet switched Data Profile context definition
 const char SARA_R5_MESSAGE_PDP_CONFIG[] = "+UPSD";            // Packet switched Data Profile configuration
@@ -165,6 +341,8 @@ const char SARA_R5_MQTT_NVM[] = "+UMQTTNV";
 const char SARA_R5_MQTT_PROFILE[] = "+UMQTT";
 const char SARA_R5_MQTT_COMMAND[] = "+UMQTTC";
 const char SARA_R5_MQTT_PROTOCOL_ERROR[] = "+UMQTTER";
+const char SARA_R5_MQTTSN_PROFILE[] = "+UMQTTSN";
+const char SARA_R5_MQTTSN_COMMAND[] = "+UMQTTSNC";
 // ### FTP
 const char SARA_R5_FTP_PROFILE[] = "+UFTP";
 const char SARA_R5_FTP_COMMAND[] = "+UFTPC";
@@ -203,10 +381,13 @@ const char SARA_R5_SIM_STATE_URC[] = "+UUSIMSTAT:";
 const char SARA_R5_MESSAGE_PDP_ACTION_URC[] = "+UUPSDA:";
 const char SARA_R5_HTTP_COMMAND_URC[] = "+UUHTTPCR:";
 const char SARA_R5_MQTT_COMMAND_URC[] = "+UUMQTTC:";
+const char SARA_R5_MQTTSN_COMMAND_URC[] = "+UUMQTTSNC:";
 const char SARA_R5_PING_COMMAND_URC[] = "+UUPING:";
 const char SARA_R5_REGISTRATION_STATUS_URC[] = "+CREG:";
 const char SARA_R5_EPSREGISTRATION_STATUS_URC[] = "+CEREG:";
 const char SARA_R5_FTP_COMMAND_URC[] = "+UUFTPCR:";
+const char SARA_R5_PSM_STATE_URC[] = "+UUPSMR:";
+const char SARA_R5_EDRX_URC[] = "+CEDRXP:";
 
 // ### Response
 const char SARA_R5_RESPONSE_MORE[] = "\n>";
@@ -231,7 +412,54 @@ const char ASCII_ESC = 0x1B;
 
 #define SARA_R5_NUM_SOCKETS 6
 
-#define NUM_SUPPORTED_BAUD 6
+// URC event queue
+// URCs which arrive while the library is waiting for a command response are converted into compact event records
+// as they are received. The events are held in a fixed-size queue until bufferedPoll dispatches them to the callbacks.
+#define SARA_R5_URC_EVENT_QUEUE_SIZE 16
+#define SARA_R5_URC_LINE_BUFFER_SIZE 256 // Needs to be long enough for the longest URC (+UULOC detailed). Longer lines are truncated
+#define SARA_R5_URC_TEXT_SLOTS 4 // +UULOC and +UUPING contain strings and floats. They are queued as text
+#define SARA_R5_URC_TEXT_SLOT_SIZE 128
+#define SARA_R5_URC_NUM_LATEST (SARA_R5_NUM_SOCKETS + 3) // Coalesced events: +UUSORD for each socket, +UUSIMSTAT, +CREG and +CEREG
+
+typedef enum
+{
+  SARA_R5_URC_EVENT_NONE = 0,
+  SARA_R5_URC_EVENT_SOCKET_READ,      // +UUSORD: param[0] socket, param[1] length
+  SARA_R5_URC_EVENT_SOCKET_READ_UDP,  // +UUSORF: param[0] socket, param[1] length
+  SARA_R5_URC_EVENT_SOCKET_LISTEN,    // +UUSOLI: param[0] socket, param[1] port, param[2] listening socket, param[3] listening port, remoteIP, localIP
+  SARA_R5_URC_EVENT_SOCKET_CLOSE,     // +UUSOCL: param[0] socket
+  SARA_R5_URC_EVENT_GNSS_LOCATION,    // +UULOC: param[0] text slot
+  SARA_R5_URC_EVENT_SIM_STATE,        // +UUSIMSTAT: param[0] state
+  SARA_R5_URC_EVENT_PDP_ACTION,       // +UUPSDA: param[0] result, remoteIP
+  SARA_R5_URC_EVENT_HTTP_COMMAND,     // +UUHTTPCR: param[0] profile, param[1] command, param[2] result
+  SARA_R5_URC_EVENT_MQTT_COMMAND,     // +UUMQTTC: param[0] command, param[1] result, param[2] QoS (subscribe only)
+  SARA_R5_URC_EVENT_FTP_COMMAND,      // +UUFTPCR: param[0] command, param[1] result
+  SARA_R5_URC_EVENT_MQTTSN_COMMAND,   // +UUMQTTSNC: param[0] command, param[1] result, param[2] and param[3] command specific
+  SARA_R5_URC_EVENT_PING,             // +UUPING: param[0] text slot
+  SARA_R5_URC_EVENT_REGISTRATION,     // +CREG: param[0] status, param[1] lac, param[2] ci, param[3] Act
+  SARA_R5_URC_EVENT_EPS_REGISTRATION, // +CEREG: param[0] status, param[1] tac, param[2] ci, param[3] Act
+  SARA_R5_URC_EVENT_PSM_STATE,        // +UUPSMR: param[0] state
+  SARA_R5_URC_EVENT_EDRX              // +CEDRXP: param[0] AcT, param[1] requested eDRX, param[2] network eDRX, param[3] paging time window
+} SARA_R5_urc_event_type_t;
+
+typedef struct
+{
+  SARA_R5_urc_event_type_t type;
+  int32_t param[4];
+  uint8_t remoteIP[4];
+  uint8_t localIP[4];
+} SARA_R5_urc_event_t;
+
+// The latest values of a coalesced event. The producer updates event while the consumer may be reading it:
+// sequence is odd while an update is in progress. The consumer re-reads event if sequence changes
+typedef struct
+{
+  SARA_R5_urc_event_t event;
+  SARA_R5_spsc_index_t sequence;
+  SARA_R5_spsc_flag_t pending; // Set by the producer when the event is queued. Cleared by the consumer
+} SARA_R5_urc_latest_t;
+
+#define NUM_SUPPORTED_BAUD 8
 const unsigned long SARA_R5_SUPPORTED_BAUD[NUM_SUPPORTED_BAUD] =
     {
         115200,
@@ -239,9 +467,18 @@ const unsigned long SARA_R5_SUPPORTED_BAUD[NUM_SUPPORTED_BAUD] =
         19200,
         38400,
         57600,
-        230400};
+        230400,
+        460800,
+        921600};
 #define SARA_R5_DEFAULT_BAUD_RATE 115200
 
+// Baud rate negotiation
+#define SARA_R5_BAUD_PROBE_BURST_SIZE 128 // The default number of characters in each echo probe
+#define SARA_R5_BAUD_PROBE_MAX_BURST 512 // Must fit in one command line
+#define SARA_R5_BAUD_PROBE_BURSTS 3 // Every burst must pass at a rate for it to be used
+#define SARA_R5_BAUD_PROBE_TIMEOUT 1000
+#define SARA_R5_BAUD_PROBE_QUIET 50 // The probe response is complete when nothing has been received for this long
+
 // Flow control definitions for AT&K
 // Note: SW (XON/XOFF) flow control is not supported on the SARA_R5
 typedef enum
@@ -308,6 +545,18 @@ typedef enum
   SARA_R5_REGISTRATION_ROAMING_CSFB_NOT_PREFERRED = 10
 } SARA_R5_registration_status_t;
 
+typedef struct
+{
+  SARA_R5_registration_status_t status; // The last known status
+  unsigned int area; // LAC (+CREG) or TAC (+CEREG). 0 if not known
+  unsigned int ci; // Cell ID. 0 if not known
+  int Act; // Access technology. -1 if not known
+  unsigned long lastChange; // millis when the status last changed
+  unsigned long lastUpdate; // millis of the last URC or query
+  uint32_t changes; // The number of status changes (flaps)
+  bool valid; // False if the status may be out of date (after a reset)
+} SARA_R5_registration_state_t;
+
 struct DateData
 {
   uint8_t day;
@@ -357,6 +606,56 @@ struct operator_stats
   uint8_t act;
 };
 
+typedef enum
+{
+  SARA_R5_POWER_STATE_UNKNOWN = 0,
+  SARA_R5_POWER_STATE_AWAKE,
+  SARA_R5_POWER_STATE_PSM // In PSM deep sleep
+} SARA_R5_power_state_t;
+
+typedef struct
+{
+  SARA_R5_power_state_t state;
+  unsigned long lastChange; // millis when the state last changed
+  bool statePending; // True if the callback has not been told about the state yet
+  int requestedEDRX; // The eDRX cycle codes (and paging time window) from +CEDRXP. -1 if not known
+  int networkEDRX;
+  int pagingTimeWindow;
+  unsigned long lastWakeLatency; // Time from the PWR_ON pulse to the first response (millis). Measured by wakeFromPSM
+  unsigned long minWakeLatency;
+  unsigned long maxWakeLatency;
+  unsigned long totalWakeLatency;
+  uint32_t wakeCount;
+  char *queue; // Allocated by socketWriteWhenAwake
+  int queueLength;
+  int queueAttempts; // Failed attempts to send the write at the head of the queue
+  uint32_t queueDropped; // Queued writes dropped because the socket rejected them or they failed too often
+} SARA_R5_power_saving_t;
+
+typedef struct
+{
+  unsigned long numOp; // E.g. 310410
+  unsigned long time; // millis when the operator was last seen
+  char longOp[26]; // E.g. AT&T
+  char shortOp[11];
+  uint8_t stat; // 0: unknown, 1: available, 2: current, 3: forbidden
+  uint8_t act;
+} SARA_R5_operator_entry_t;
+
+typedef struct
+{
+  SARA_R5_operator_entry_t table[SARA_R5_OPERATOR_TABLE_SIZE];
+  int count;
+  SARA_R5_spsc_flag_t active; // Set by startOperatorScan. Cleared when the final result code arrives
+  unsigned long start; // millis when the scan was started
+  SARA_R5_error_t result;
+  int found; // The number of operators found by this scan
+  char tuple[SARA_R5_OPERATOR_TUPLE_LENGTH]; // The operator being received
+  int tupleLength; // -1 when not inside a tuple
+  char line[16]; // The start of the line being received. Used to find the final result code
+  int lineLength;
+} SARA_R5_operator_scan_t;
+
 typedef struct ext_signal_quality_ {
     unsigned int rxlev;
     unsigned int ber;
@@ -366,6 +665,33 @@ typedef struct ext_signal_quality_ {
     unsigned int rsrp;
 } signal_quality;
 
+typedef enum
+{
+  SARA_R5_SIGNAL_RXLEV = 0,
+  SARA_R5_SIGNAL_BER,
+  SARA_R5_SIGNAL_RSRQ,
+  SARA_R5_SIGNAL_RSRP,
+  SARA_R5_SIGNAL_NUM_FIELDS
+} SARA_R5_signal_field_t;
+
+typedef struct
+{
+  unsigned long time; // millis when the sample was taken
+  uint8_t rxlev; // +CESQ units. 99 = unknown
+  uint8_t ber; // 99 = unknown
+  uint8_t rsrq; // 255 = unknown
+  uint8_t rsrp; // 255 = unknown
+} SARA_R5_signal_sample_t;
+
+typedef struct
+{
+  int count; // The number of known values the statistics are based on
+  uint8_t min;
+  uint8_t max;
+  float mean;
+  float ewma; // Exponentially weighted moving average - see SARA_R5_SIGNAL_EWMA_ALPHA
+} SARA_R5_signal_stats_t;
+
 typedef enum
 {
   SARA_R5_TCP = 6,
@@ -507,6 +833,38 @@ typedef enum
   SARA_R5_MQTT_COMMAND_PUBLISHBINARY,
 } SARA_R5_mqtt_command_opcode_t;
 
+typedef enum
+{
+    SARA_R5_MQTTSN_PROFILE_CLIENT_ID = 0,
+    SARA_R5_MQTTSN_PROFILE_SERVERNAME,
+    SARA_R5_MQTTSN_PROFILE_IPADDRESS,
+    SARA_R5_MQTTSN_PROFILE_RADIUS,
+    SARA_R5_MQTTSN_PROFILE_DURATION,
+    SARA_R5_MQTTSN_PROFILE_CLEANSESSION,
+} SARA_R5_mqttsn_profile_opcode_t;
+
+typedef enum
+{
+  SARA_R5_MQTTSN_COMMAND_DISCONNECT = 0, // With a duration: sleep
+  SARA_R5_MQTTSN_COMMAND_CONNECT,
+  SARA_R5_MQTTSN_COMMAND_REGISTER,       // +UUMQTTSNC: 2,<result>,<topic_id>
+  SARA_R5_MQTTSN_COMMAND_PUBLISH,
+  SARA_R5_MQTTSN_COMMAND_SUBSCRIBE,      // +UUMQTTSNC: 4,<result>,<QoS>,<topic_id>
+  SARA_R5_MQTTSN_COMMAND_UNSUBSCRIBE,
+  SARA_R5_MQTTSN_COMMAND_READ,           // +UUMQTTSNC: 6,<unread messages>
+  SARA_R5_MQTTSN_COMMAND_WILL_TOPIC_UPDATE,
+  SARA_R5_MQTTSN_COMMAND_WILL_MESSAGE_UPDATE,
+  SARA_R5_MQTTSN_COMMAND_PING,           // Awake
+  SARA_R5_MQTTSN_NUM_COMMANDS
+} SARA_R5_mqttsn_command_opcode_t;
+
+typedef enum
+{
+  SARA_R5_MQTTSN_TOPIC_NORMAL = 0, // A topic ID from registerMQTTSNtopic or subscribeMQTTSNtopic
+  SARA_R5_MQTTSN_TOPIC_PREDEFINED, // A topic ID agreed with the gateway in advance
+  SARA_R5_MQTTSN_TOPIC_SHORT       // A two character topic name
+} SARA_R5_mqttsn_topic_type_t;
+
 constexpr uint16_t MAX_MQTT_HEX_MSG_LEN = 512;
 constexpr uint16_t MAX_MQTT_DIRECT_MSG_LEN = 1024;
 
@@ -637,6 +995,552 @@ typedef enum
   //DEEP_LOW_POWER_STATE = 127 // Not supported on SARA-R5
 } SARA_R5_functionality_t;
 
+typedef enum
+{
+  SARA_R5_PRIORITY_LOW = 0, // E.g. file transfers
+  SARA_R5_PRIORITY_NORMAL,
+  SARA_R5_PRIORITY_HIGH, // E.g. short status queries
+  SARA_R5_NUM_PRIORITIES
+} SARA_R5_priority_t;
+
+#ifdef SARA_R5_COROUTINES_ENABLED
+#define SARA_R5_AWAIT_TIMEOUT 120000 // Default time to wait for the result URC
+
+typedef struct
+{
+  SARA_R5_error_t error; // SARA_R5_ERROR_SUCCESS if urc is valid. SARA_R5_ERROR_TIMEOUT if the URC did not arrive in time
+  SARA_R5_urc_event_t urc;
+} SARA_R5_await_result_t;
+
+class SARA_R5;
+
+// Returned by awaitURC and the ...Async methods. co_await it to suspend until the URC arrives.
+// If the command itself fails, co_await returns the error immediately
+class SARA_R5_urc_awaiter
+{
+public:
+  SARA_R5_urc_awaiter(SARA_R5 *sara, SARA_R5_urc_event_type_t type, int key, unsigned long timeout, SARA_R5_error_t err = SARA_R5_ERROR_SUCCESS);
+  ~SARA_R5_urc_awaiter(); // Removes the awaiter from the list if its coroutine is destroyed while it is suspended
+  bool await_ready(void) { return (_result.error != SARA_R5_ERROR_SUCCESS); }
+  void await_suspend(std::coroutine_handle<> handle);
+  SARA_R5_await_result_t await_resume(void) { return _result; }
+
+private:
+  friend class SARA_R5;
+  bool matches(const SARA_R5_urc_event_t *urc);
+  SARA_R5 *_sara;
+  SARA_R5_urc_event_type_t _type;
+  int _key; // param[0] must match this. -1 matches anything
+  unsigned long _timeout;
+  unsigned long _start;
+  SARA_R5_await_result_t _result;
+  std::coroutine_handle<> _handle;
+  bool _ready; // True once _result holds the URC or the timeout. The coroutine is resumed next
+  SARA_R5_urc_awaiter *_next; // The waiting awaiters are held in a linked list
+};
+
+// A minimal coroutine return type. The coroutine starts immediately and frees itself when it completes.
+// An exception which escapes the coroutine calls std::terminate: there is no caller to rethrow it to. E.g.:
+// SARA_R5_coroutine getPage(SARA_R5 &sara)
+// {
+//   SARA_R5_await_result_t result = co_await sara.sendHTTPGETAsync(0, "/", "page.txt");
+//   ...
+// }
+struct SARA_R5_coroutine
+{
+  struct promise_type
+  {
+    SARA_R5_coroutine get_return_object(void) { return {}; }
+    std::suspend_never initial_suspend(void) noexcept { return {}; }
+    std::suspend_never final_suspend(void) noexcept { return {}; }
+    void return_void(void) {}
+    void unhandled_exception(void) { std::terminate(); }
+  };
+};
+#endif
+
+typedef struct
+{
+  char command[SARA_R5_LATENCY_COMMAND_LENGTH]; // E.g. "+CSQ", "+COPS?" or "+COPS=1". Empty if the entry is unused
+  uint16_t samples;
+  uint32_t latency;   // Smoothed response latency (millis)
+  uint32_t deviation; // Smoothed mean deviation of the latency (millis)
+  unsigned long lastUsed;
+} SARA_R5_command_latency_t;
+
+typedef struct
+{
+  char line[SARA_R5_BATCH_LINE_LENGTH]; // The commands which have not been sent yet: "+X;+Y;+Z"
+  int length;
+  uint8_t commands; // The number of commands in the batch - including the ones which have been sent
+  uint8_t first; // The index of the first command in line
+  uint16_t start[SARA_R5_BATCH_MAX_COMMANDS]; // The offset of each command in line
+  unsigned long timeout[SARA_R5_BATCH_MAX_COMMANDS];
+  SARA_R5_error_t result[SARA_R5_BATCH_MAX_COMMANDS];
+} SARA_R5_batch_t;
+
+typedef struct
+{
+  uint32_t key; // Hash of the command and its selectors (profile, op code, etc.). 0 if the entry is unused
+  uint32_t value; // Hash of the value
+} SARA_R5_config_shadow_t;
+
+typedef struct
+{
+  // Module identity. Cleared by reset, hwReset, the power functions and init
+  char manufacturer[16]; // E.g. u-blox
+  char model[32]; // E.g. SARA-R510M8S
+  char firmware[32]; // E.g. 02.06
+  char serialNo[32];
+  char imei[32]; // E.g. 004999010640000
+  char capabilities[64]; // E.g. +FCLASS, +CGSM
+  bool moduleValid;
+  // SIM identity. Also cleared by +UUSIMSTAT and functionality
+  char imsi[32]; // E.g. 222107701772423
+  char ccid[32]; // E.g. 8939107900010087330
+  char subscriberNo[64]; // E.g. "ABCD . AAA","123456789012",129
+  bool simValid;
+  bool simFailed; // The SIM part could not be read (no SIM, or it is locked). Not tried again until it is invalidated
+                  // (setSimPin, +UUSIMSTAT, functionality) or SARA_R5_IDENTITY_SIM_RETRY has passed
+  unsigned long simFailedTime; // millis of the failure
+} SARA_R5_identity_t;
+
+typedef struct
+{
+  char name[SARA_R5_FILE_STREAM_NAME_LENGTH];
+  int size; // -1 if not known. Read with +ULSTFILE=2 when it is needed
+} SARA_R5_file_index_entry_t;
+
+typedef struct
+{
+  SARA_R5_file_index_entry_t files[SARA_R5_FILE_INDEX_SIZE];
+  int count;
+  long freeSpace; // -1 if not known
+  bool valid; // False until the file list has been read
+  bool complete; // False if some of the files could not be indexed. Then a file which is not in the index may still exist
+  char pendingFile[SARA_R5_NUM_HTTP_PROFILES + 1][SARA_R5_FILE_STREAM_NAME_LENGTH]; // Being written by each HTTP profile, then FTP
+} SARA_R5_file_index_t;
+
+class SARA_R5;
+
+// Reads a file from the module file system one block (+URDBLOCK) at a time, straight into the caller's buffer.
+// The whole file never needs to fit in RAM. Open it with SARA_R5::openFileStream. E.g.:
+//   SARA_R5_file_stream stream;
+//   if (mySARA.openFileStream(stream, "response.txt") == SARA_R5_ERROR_SUCCESS)
+//     while ((len = stream.read(buffer, sizeof(buffer))) > 0) { ... }
+// Not supported in RX task mode
+class SARA_R5_file_stream
+{
+public:
+  SARA_R5_file_stream(void) : _sara(nullptr), _chunkSize(SARA_R5_FILE_STREAM_CHUNK_SIZE), _size(0), _position(0),
+                              _error(SARA_R5_ERROR_INVALID) { _filename[0] = 0; }
+  int read(char *buffer, size_t length); // Returns the number of bytes read. 0 at the end of the file. -1 on error
+  // Read the rest of the file in chunks of up to bufferSize bytes. Each chunk is passed to the callback
+  SARA_R5_error_t readAll(char *buffer, size_t bufferSize,
+                          void (*callback)(const char *data, size_t length, size_t offset, void *context),
+                          void *context = nullptr);
+  bool seek(size_t position);
+  size_t size(void) { return _size; }
+  size_t position(void) { return _position; }
+  size_t available(void) { return _size - _position; }
+  SARA_R5_error_t getError(void) { return _error; }
+
+private:
+  friend class SARA_R5;
+  SARA_R5 *_sara;
+  char _filename[SARA_R5_FILE_STREAM_NAME_LENGTH];
+  size_t _chunkSize; // The largest block requested with +URDBLOCK
+  size_t _size;
+  size_t _position;
+  SARA_R5_error_t _error;
+};
+
+// Uploads a file to the module file system in chunks (+UDWNFILE), keeping a running CRC-32 of the data which the module
+// has acknowledged. A failed upload can be resumed from the end of the file. E.g.:
+//   SARA_R5_file_upload upload;
+//   mySARA.beginFileUpload(upload, "post.bin", sizeof(body));
+//   while (mySARA.continueFileUpload(upload, body) != SARA_R5_ERROR_SUCCESS)
+//     mySARA.beginFileUpload(upload, "post.bin", sizeof(body)); // Resume
+class SARA_R5_file_upload
+{
+public:
+  SARA_R5_file_upload(void) : _size(0), _offset(0), _chunkSize(SARA_R5_UPLOAD_CHUNK_SIZE), _maxChunkSize(SARA_R5_UPLOAD_MAX_CHUNK_SIZE),
+                              _crc(0xFFFFFFFF), _bytesTimed(0), _timeTaken(0), _error(SARA_R5_ERROR_SUCCESS) { _filename[0] = 0; }
+  size_t size(void) { return _size; }
+  size_t offset(void) { return _offset; } // The number of bytes acknowledged by the module
+  bool complete(void) { return ((_size > 0) && (_offset == _size)); }
+  uint32_t getCRC(void) { return ~_crc; } // CRC-32 of the acknowledged bytes
+  size_t getChunkSize(void) { return _chunkSize; } // The size of the next chunk
+  unsigned long getThroughput(void); // Bytes per second
+  SARA_R5_error_t getError(void) { return _error; }
+
+private:
+  friend class SARA_R5;
+  char _filename[SARA_R5_FILE_STREAM_NAME_LENGTH];
+  size_t _size;
+  size_t _offset;
+  size_t _chunkSize;
+  size_t _maxChunkSize;
+  uint32_t _crc;
+  unsigned long _bytesTimed; // The bytes and millis of the successful chunks - for the throughput
+  unsigned long _timeTaken;
+  SARA_R5_error_t _error;
+};
+
+// An append-only store-and-forward journal in the module file system. Records are written to a set of rotating
+// segment files. When every segment is full, the oldest is dropped. Open it with SARA_R5::openJournal, add records with
+// journalAppend and deliver them in batches with journalFlush (or journalFlushSocket, journalFlushMQTT, journalFlushHTTP).
+// Each segment is deleted once all of its records have been delivered.
+// Delivery is at-least-once. The read position within the oldest segment is only held in RAM - it is not written to
+// the file system on every commit. After a restart (or openJournal), the records of a partly flushed segment which
+// were delivered already are sent again. A record is also sent again if the sink fails after delivering it.
+// The receiver must tolerate duplicates: e.g. put a sequence number or timestamp in each record and ignore repeats
+class SARA_R5_journal
+{
+public:
+  SARA_R5_journal(void) : _segmentSize(SARA_R5_JOURNAL_SEGMENT_SIZE), _segments(SARA_R5_JOURNAL_SEGMENTS), _headSeq(0), _tailSeq(0),
+                          _headSize(0), _tailOffset(0), _droppedSegments(0), _corruptRecords(0) { _name[0] = 0; }
+  bool isOpen(void) { return (_name[0] != 0); }
+  int getSegmentCount(void) { return (int)(_headSeq - _tailSeq) + ((_headSize > 0) ? 1 : 0); } // Segments in use
+  uint32_t getDroppedSegments(void) { return _droppedSegments; } // Segments dropped because the journal was full
+  uint32_t getCorruptRecords(void) { return _corruptRecords; } // Records which failed their CRC (or were cut short)
+
+private:
+  friend class SARA_R5;
+  char _name[SARA_R5_JOURNAL_NAME_LENGTH];
+  size_t _segmentSize;
+  int _segments;
+  uint32_t _headSeq; // The sequence number of the segment being written
+  uint32_t _tailSeq; // The oldest segment
+  size_t _headSize;
+  size_t _tailOffset; // The first record in the tail segment which has not been delivered
+  uint32_t _droppedSegments;
+  uint32_t _corruptRecords;
+};
+
+typedef struct
+{
+  uint32_t seq; // The segment being read
+  size_t offset;
+  long segmentEnd; // -1 until known
+  char *buffer; // SARA_R5_JOURNAL_READ_SIZE bytes read from segment bufferSeq, starting at bufferOffset
+  uint32_t bufferSeq;
+  size_t bufferOffset;
+  size_t bufferLength;
+} SARA_R5_journal_cursor_t;
+
+typedef enum
+{
+  SARA_R5_HTTP_PARSER_STATUS_LINE = 0,
+  SARA_R5_HTTP_PARSER_HEADER,
+  SARA_R5_HTTP_PARSER_BODY,
+  SARA_R5_HTTP_PARSER_CHUNK_SIZE,
+  SARA_R5_HTTP_PARSER_CHUNK_DATA,
+  SARA_R5_HTTP_PARSER_CHUNK_END, // The CRLF after the chunk data
+  SARA_R5_HTTP_PARSER_TRAILER,
+  SARA_R5_HTTP_PARSER_DONE,
+  SARA_R5_HTTP_PARSER_ERROR
+} SARA_R5_http_parser_state_t;
+
+// Parses an HTTP response incrementally: the status line, the headers, then the body - which may use chunked transfer
+// encoding. The body is passed to the body sink as it arrives, so the response never needs to fit in RAM. The response
+// is fed in with parse. SARA_R5::streamHTTPResponse feeds it from the response file, one +URDBLOCK at a time. E.g.:
+//   SARA_R5_http_parser parser(&pushToGNSS);
+//   mySARA.sendHTTPGETstream(0, path, "assist.ubx", parser);
+class SARA_R5_http_parser
+{
+public:
+  SARA_R5_http_parser(void (*bodySink)(const char *data, size_t length, void *context) = nullptr, void *context = nullptr,
+                      void (*headerCallback)(const char *name, const char *value, void *context) = nullptr)
+                      : _bodySink(bodySink), _headerCallback(headerCallback), _context(context) { reset(); }
+  void reset(void);
+  void parse(const char *data, size_t length);
+  void finish(void); // Call at the end of the response
+  bool headersComplete(void) { return (_state > SARA_R5_HTTP_PARSER_HEADER); }
+  bool complete(void) { return (_state == SARA_R5_HTTP_PARSER_DONE); }
+  bool failed(void) { return (_state == SARA_R5_HTTP_PARSER_ERROR); }
+  int getStatusCode(void) { return _statusCode; }
+  long getContentLength(void) { return _contentLength; } // -1 if there was no Content-Length header
+  bool isChunked(void) { return _chunked; }
+  const char *getContentType(void) { return _contentType; }
+  size_t getBodyLength(void) { return _bodyLength; } // The number of body bytes passed to the sink
+
+private:
+  void parseLine(void);
+  void (*_bodySink)(const char *data, size_t length, void *context);
+  void (*_headerCallback)(const char *name, const char *value, void *context);
+  void *_context;
+  SARA_R5_http_parser_state_t _state;
+  char _line[SARA_R5_HTTP_LINE_LENGTH];
+  size_t _lineLength;
+  int _statusCode;
+  long _contentLength;
+  long _remaining; // The bytes left in the body or chunk. -1 if the body runs to the end
+  bool _chunked;
+  size_t _bodyLength;
+  char _contentType[SARA_R5_HTTP_CONTENT_TYPE_LENGTH];
+};
+
+typedef struct
+{
+  bool staged; // True if the body was staged in a file (+UDWNFILE) and sent with +UHTTPC=..,4. False if it was sent inline
+  size_t length;
+  unsigned long stageTime; // millis spent writing the staging file. 0 if the body was sent inline
+  unsigned long commandTime; // millis from sending +UHTTPC to its OK
+} SARA_R5_http_post_report_t;
+
+typedef enum
+{
+  SARA_R5_HTTP_REQUEST_IDLE = 0,
+  SARA_R5_HTTP_REQUEST_QUEUED,
+  SARA_R5_HTTP_REQUEST_IN_FLIGHT,
+  SARA_R5_HTTP_REQUEST_SUCCEEDED, // The response is in the response file
+  SARA_R5_HTTP_REQUEST_FAILED // See getError, getErrorClass and getErrorCode
+} SARA_R5_http_request_state_t;
+
+// An HTTP request for the request queue - see SARA_R5::setHTTPQueue. Describe the request with setGET, setPOSTdata or
+// setPOSTfile, then queue it with SARA_R5::queueHTTPRequest. The queue runs up to one request per profile at a time,
+// and reuses a profile which is already configured for the same server. When +UUHTTPCR arrives, the request is
+// completed - with the +UHTTPER error if it failed - and the callback is called. E.g.:
+//   SARA_R5_http_request status, config;
+//   status.setGET("api.example.com", "/status", "status.json");
+//   config.setGET("api.example.com", "/config", "config.json");
+//   mySARA.queueHTTPRequest(status);
+//   mySARA.queueHTTPRequest(config);
+//   while (!status.isDone() || !config.isDone()) mySARA.bufferedPoll();
+class SARA_R5_http_request
+{
+public:
+  SARA_R5_http_request(void) : _port(80), _secure(false), _secprofile(-1), _command(SARA_R5_HTTP_COMMAND_GET),
+                               _httpContentType(SARA_R5_HTTP_CONTENT_APPLICATION_X_WWW), _callback(nullptr), _context(nullptr),
+                               _state(SARA_R5_HTTP_REQUEST_IDLE), _profile(-1), _result(0), _error(SARA_R5_ERROR_SUCCESS),
+                               _errorClass(0), _errorCode(0), _sentAt(0), _next(nullptr) {}
+  void setGET(const String &server, const String &path, const String &responseFilename);
+  void setPOSTdata(const String &server, const String &path, const String &responseFilename,
+                   const String &data, SARA_R5_http_content_types_t httpContentType);
+  void setPOSTfile(const String &server, const String &path, const String &responseFilename,
+                   const String &requestFile, SARA_R5_http_content_types_t httpContentType);
+  void setServerPort(int port) { _port = port; } // Default: 80
+  void setSecure(bool secure, int secprofile = -1) { _secure = secure; _secprofile = secprofile; }
+  // The callback is called from bufferedPoll (or poll) when the request is done. It may queue more requests
+  void setCallback(void (*callback)(SARA_R5_http_request *request, void *context), void *context = nullptr)
+  {
+    _callback = callback;
+    _context = context;
+  }
+  SARA_R5_http_request_state_t getState(void) { return _state; }
+  bool isDone(void) { return (_state >= SARA_R5_HTTP_REQUEST_SUCCEEDED); }
+  int getProfile(void) { return _profile; } // The profile the request was sent on. -1 if not sent yet
+  SARA_R5_error_t getError(void) { return _error; }
+  int getErrorClass(void) { return _errorClass; } // From +UHTTPER, if the module reported a failure
+  int getErrorCode(void) { return _errorCode; }
+  const String &getResponseFilename(void) { return _responseFilename; }
+
+private:
+  friend class SARA_R5;
+  String _server;
+  int _port;
+  bool _secure;
+  int _secprofile;
+  int _command; // SARA_R5_http_commands_t
+  String _path;
+  String _responseFilename;
+  String _data; // The POST data - or the request file name for setPOSTfile
+  SARA_R5_http_content_types_t _httpContentType;
+  void (*_callback)(SARA_R5_http_request *request, void *context);
+  void *_context;
+  SARA_R5_http_request_state_t _state;
+  int _profile;
+  int _result; // From +UUHTTPCR
+  SARA_R5_error_t _error;
+  int _errorClass;
+  int _errorCode;
+  unsigned long _sentAt;
+  SARA_R5_http_request *_next; // The next request in the queue
+};
+
+typedef struct
+{
+  char server[SARA_R5_HTTP_SERVER_LENGTH]; // What the profile is configured for. Empty if not known
+  int port;
+  bool secure;
+  int secprofile;
+  SARA_R5_http_request *request; // The request in flight on this profile
+  bool resultReady; // +UUHTTPCR has arrived for request
+  unsigned long lastUsed;
+  int staleResults; // The +UUHTTPCR results still owed for timed-out requests. The profile is not used until they arrive
+  unsigned long staleSince; // millis of the last timeout. After another SARA_R5_HTTP_REQUEST_TIMEOUT the results are given up on
+} SARA_R5_http_profile_state_t;
+
+typedef struct
+{
+  SARA_R5_http_profile_state_t profile[SARA_R5_NUM_HTTP_PROFILES];
+  int numProfiles; // The queue uses profiles 0 to numProfiles - 1
+  SARA_R5_http_request *queue; // The requests waiting for a free profile. First in first out
+  SARA_R5_http_request *failed; // The requests failed by a module reset. Their callbacks are called by serviceHTTPQueue
+} SARA_R5_http_scheduler_t;
+
+typedef enum
+{
+  SARA_R5_MQTT_MESSAGE_IDLE = 0,
+  SARA_R5_MQTT_MESSAGE_QUEUED,
+  SARA_R5_MQTT_MESSAGE_IN_FLIGHT, // Published. Waiting for the +UUMQTTC result
+  SARA_R5_MQTT_MESSAGE_DELIVERED, // Acknowledged - or accepted by the module for QoS 0
+  SARA_R5_MQTT_MESSAGE_FAILED // See getError
+} SARA_R5_mqtt_message_state_t;
+
+// A message for the MQTT publish pipeline - see SARA_R5::setMQTTPublishPipeline. The topic and payload are not copied:
+// they must stay valid until the message is done. The pipeline publishes up to its window of QoS 1/2 messages without
+// waiting for each result. The +UUMQTTC publish results are matched to the messages in publish order, so while the
+// pipeline is enabled, do not publish with QoS 1 or 2 by other means (mqttPublishTextMsg, mqttPublishBinaryMsg): their
+// results would be matched to the pipeline's messages. QoS 2 messages are never sent twice
+class SARA_R5_mqtt_message
+{
+public:
+  SARA_R5_mqtt_message(void) : _topic(nullptr), _payload(nullptr), _length(0), _binary(false), _qos(0), _retain(false),
+                               _callback(nullptr), _context(nullptr), _state(SARA_R5_MQTT_MESSAGE_IDLE),
+                               _error(SARA_R5_ERROR_SUCCESS), _attempts(0), _sentAt(0), _ackLatency(0), _acked(false), _next(nullptr) {}
+  void setText(const char *topic, const char *text, uint8_t qos = 1, bool retain = false);
+  void setBinary(const char *topic, const char *data, size_t length, uint8_t qos = 1, bool retain = false);
+  // The callback is called from bufferedPoll (or poll) when the message is done. It may queue more messages
+  void setCallback(void (*callback)(SARA_R5_mqtt_message *message, void *context), void *context = nullptr)
+  {
+    _callback = callback;
+    _context = context;
+  }
+  SARA_R5_mqtt_message_state_t getState(void) { return _state; }
+  bool isDone(void) { return (_state >= SARA_R5_MQTT_MESSAGE_DELIVERED); }
+  SARA_R5_error_t getError(void) { return _error; }
+  int getAttempts(void) { return _attempts; } // The number of times the message was published
+  unsigned long getAckLatency(void) { return _ackLatency; } // millis from the publish OK to the +UUMQTTC result
+
+private:
+  friend class SARA_R5;
+  const char *_topic;
+  const char *_payload;
+  size_t _length;
+  bool _binary; // Published with +UMQTTC=9 instead of +UMQTTC=2
+  uint8_t _qos;
+  bool _retain;
+  void (*_callback)(SARA_R5_mqtt_message *message, void *context);
+  void *_context;
+  SARA_R5_mqtt_message_state_t _state;
+  SARA_R5_error_t _error;
+  int _attempts;
+  unsigned long _sentAt;
+  unsigned long _ackLatency;
+  bool _acked; // The +UUMQTTC result has arrived
+  SARA_R5_mqtt_message *_next; // The next message in the queue or window
+};
+
+typedef struct
+{
+  uint32_t published;
+  uint32_t delivered;
+  uint32_t failed;
+  uint32_t retries;
+  unsigned long minAckLatency; // millis
+  unsigned long maxAckLatency;
+  unsigned long meanAckLatency;
+  float publishRate; // Delivered messages per second
+} SARA_R5_mqtt_publish_stats_t;
+
+typedef struct
+{
+  SARA_R5_mqtt_message *queue; // Waiting to be published. First in first out
+  SARA_R5_mqtt_message *inFlight; // Published and waiting for their results. In publish order
+  int inFlightCount;
+  int window;
+  unsigned long ackTimeout;
+  int retries;
+  uint32_t published;
+  uint32_t delivered;
+  uint32_t failed;
+  uint32_t retried;
+  uint32_t latencyCount;
+  unsigned long sumAckLatency;
+  unsigned long minAckLatency;
+  unsigned long maxAckLatency;
+  unsigned long firstPublish;
+  unsigned long lastDelivery;
+  int staleAcks[2]; // The late results still owed after an ack timeout (text, binary). They are ignored when they arrive
+  unsigned long staleSince; // millis of the ack timeout. The queue is held until the late results arrive or ackTimeout passes
+} SARA_R5_mqtt_pipeline_t;
+
+// A topic filter and its handler for the MQTT inbound engine - see SARA_R5::setMQTTInbound. The filter can use the
+// + and # wildcards. It is not copied: it must stay valid while the subscription is added. The handler is passed the
+// topic and payload in place, in the inbound buffer. They are not zero-terminated and are only valid during the call.
+// Handlers must not call setMQTTInbound, drainMQTT or add or remove subscriptions: those return SARA_R5_ERROR_INVALID
+class SARA_R5_mqtt_subscription
+{
+public:
+  SARA_R5_mqtt_subscription(void) : _filter(nullptr), _handler(nullptr), _context(nullptr), _matches(0), _next(nullptr), _nodeNext(nullptr) {}
+  bool setFilter(const char *filter,
+                 void (*handler)(const char *topic, int topicLength, const uint8_t *payload, int payloadLength, int qos, void *context),
+                 void *context = nullptr);
+  const char *getFilter(void) { return _filter; }
+  uint32_t getMatches(void) { return _matches; } // The number of messages passed to the handler
+
+private:
+  friend class SARA_R5;
+  const char *_filter;
+  void (*_handler)(const char *topic, int topicLength, const uint8_t *payload, int payloadLength, int qos, void *context);
+  void *_context;
+  uint32_t _matches;
+  SARA_R5_mqtt_subscription *_next; // The next subscription added
+  SARA_R5_mqtt_subscription *_nodeNext; // The next subscription with the same filter
+};
+
+// One level of a compiled topic filter
+class SARA_R5_mqtt_topic_node
+{
+public:
+  SARA_R5_mqtt_topic_node(void) : _level(nullptr), _length(0), _children(nullptr), _sibling(nullptr), _subscriptions(nullptr) {}
+
+private:
+  friend class SARA_R5;
+  const char *_level; // Points into the filter of the subscription which created the node
+  int _length;
+  SARA_R5_mqtt_topic_node *_children; // The next levels
+  SARA_R5_mqtt_topic_node *_sibling;
+  SARA_R5_mqtt_subscription *_subscriptions; // The subscriptions whose filters end at this level
+};
+
+typedef struct
+{
+  char *buffer; // Reused for every +UMQTTC read response
+  int bufferSize;
+  int maxMessages;
+  int pending; // From the +UUMQTTC unread message count
+  int readFailures; // Failed reads in a row. The pending messages are read again on the next poll
+  bool dispatching; // True while the handlers are being called. The trie and the buffer must not change
+  SARA_R5_mqtt_subscription *subscriptions; // Newest first
+  SARA_R5_mqtt_topic_node *root;
+  uint32_t received;
+  uint32_t unmatched;
+  uint32_t truncated;
+} SARA_R5_mqtt_inbound_t;
+
+typedef struct
+{
+  char name[SARA_R5_MQTTSN_TOPIC_NAME_LENGTH];
+  uint16_t id; // 0 if the entry is empty
+  unsigned long lastUsed;
+} SARA_R5_mqttsn_topic_t;
+
+typedef struct
+{
+  SARA_R5_mqttsn_topic_t topics[SARA_R5_MQTTSN_TOPIC_CACHE_SIZE]; // Topic name to topic ID. Cleared for each session
+  bool connected;
+  bool resultReady; // A +UUMQTTSNC result has arrived
+  int command;
+  int result;
+  int32_t param; // The topic ID for register and subscribe
+  int unread; // From the +UUMQTTSNC: 6 unread message count. Read them with readMQTTSN
+  int staleResults[SARA_R5_MQTTSN_NUM_COMMANDS]; // The late results still owed after waitForMQTTSNResult timed out. Discarded
+  unsigned long staleSince[SARA_R5_MQTTSN_NUM_COMMANDS]; // millis of the last timeout. After another timeout they are given up on
+} SARA_R5_mqttsn_t;
+
 class SARA_R5 : public Print
 {
 public:
@@ -679,6 +1583,72 @@ public:
   // Retained for backward-compatibility and just in case you do want to (temporarily) ignore any data in the backlog
   bool poll(void);
 
+  // URC event queue
+  // URCs which arrive during AT commands are queued as pre-parsed events until bufferedPoll is called.
+  // +UUSORD (per socket), +UUSIMSTAT, +CREG and +CEREG are coalesced: only the latest values are kept.
+  // Other events are dropped - and counted - if the queue is full when they arrive.
+  int getURCEventsQueued(void);
+  uint32_t getURCEventsDropped(void) { return _urcEventsDropped; }
+  uint32_t getURCEventsCoalesced(void) { return _urcEventsCoalesced; }
+
+#ifdef SARA_R5_RX_TASK_ENABLED
+  // RX task mode
+  // A dedicated task or thread owns the UART and calls rxTask repeatedly (e.g. every millisecond). It frames the incoming lines,
+  // queues any URCs as events (the producer) and passes the rest to the command which is waiting for a response.
+  // The application calls bufferedPoll (the consumer) to dispatch the events and can send commands as normal.
+  // The RX task changes no other state: the operator scan and the power state are tracked when bufferedPoll or a command
+  // reads the characters. With SARA_R5_THREAD_SAFE_ENABLED, any number of application tasks may send commands and call
+  // bufferedPoll - the transaction lock serializes them. Otherwise only one application task may do so.
+  // If the response ring overflows while a command is waiting, the command returns SARA_R5_ERROR_UNEXPECTED_RESPONSE.
+  // Start the RX task before calling setRxTaskMode(true). Call setRxTaskMode(false) before calling reset or begin.
+  // setBaud, negotiateBaud and autobaud return SARA_R5_ERROR_INVALID in RX task mode.
+  // getFileBlock and the file streams are not supported in RX task mode.
+  SARA_R5_error_t setRxTaskMode(bool enable);
+  bool getRxTaskMode(void) { return _rxTaskMode; }
+  int rxTask(void); // Returns the number of characters received
+  uint32_t getRxResponseDropped(void) { return _rxResponseDropped; } // Characters dropped because the waiting command did not read them in time
+#endif
+
+#ifdef SARA_R5_THREAD_SAFE_ENABLED
+  // Thread-safe transactions
+  // Every AT transaction holds the transaction lock, so several tasks or threads can share one SARA_R5.
+  // Waiting callers are served highest priority first - and first-come first-served within each priority.
+  // The lock is recursive. Hold it across several calls with lockTransaction / unlockTransaction or a SARA_R5_Transaction.
+  // The callbacks are called by bufferedPoll with the lock held, so they can send commands.
+  void lockTransaction(SARA_R5_priority_t priority = SARA_R5_PRIORITY_NORMAL);
+  void unlockTransaction(void);
+  // Run transaction on a new thread, holding the transaction lock at the chosen priority.
+  // The future completes with its result. E.g.: std::future<int8_t> f = sara.async<int8_t>(SARA_R5_PRIORITY_HIGH, [](SARA_R5 &s) { return s.rssi(); });
+  template <typename T>
+  std::future<T> async(SARA_R5_priority_t priority, std::function<T(SARA_R5 &)> transaction)
+  {
+    return std::async(std::launch::async, [this, priority, transaction]() -> T
+    {
+      lockTransaction(priority);
+      T result = transaction(*this);
+      unlockTransaction();
+      return result;
+    });
+  }
+#endif
+
+#ifdef SARA_R5_COROUTINES_ENABLED
+  // Coroutines
+  // awaitURC suspends the calling coroutine until bufferedPoll dispatches a matching URC - after the callbacks have been called.
+  // key must match param[0] of the event (socket, profile or command - see SARA_R5_urc_event_type_t). -1 matches any event of that type.
+  // Call bufferedPoll regularly from the same thread which runs the coroutines: that resumes them and expires the timeouts.
+  SARA_R5_urc_awaiter awaitURC(SARA_R5_urc_event_type_t type, int key = -1, unsigned long timeout = SARA_R5_AWAIT_TIMEOUT);
+  // These send the command and then await the result URC
+  SARA_R5_urc_awaiter sendHTTPGETAsync(int profile, String path, String responseFilename, unsigned long timeout = SARA_R5_AWAIT_TIMEOUT); // +UUHTTPCR
+  SARA_R5_urc_awaiter sendHTTPPOSTdataAsync(int profile, String path, String responseFilename, String data, SARA_R5_http_content_types_t httpContentType, unsigned long timeout = SARA_R5_AWAIT_TIMEOUT); // +UUHTTPCR
+  SARA_R5_urc_awaiter connectMQTTAsync(unsigned long timeout = SARA_R5_AWAIT_TIMEOUT); // +UUMQTTC
+  SARA_R5_urc_awaiter ftpGetFileAsync(const String& filename, unsigned long timeout = SARA_R5_AWAIT_TIMEOUT); // +UUFTPCR
+  SARA_R5_urc_awaiter performPDPactionAsync(int profile, SARA_R5_pdp_actions_t action, unsigned long timeout = SARA_R5_AWAIT_TIMEOUT); // +UUPSDA
+  // Await +UUSORD / +UUSORF for socket. result.urc.param[1] is the number of bytes available - read them with socketRead / socketReadUDP.
+  // If a socket read callback has been set, it will have read the data already.
+  SARA_R5_urc_awaiter socketReadAvailableAsync(int socket, unsigned long timeout = SARA_R5_AWAIT_TIMEOUT);
+#endif
+
   // Callbacks (called during polling)
   void setSocketListenCallback(void (*socketListenCallback)(int, IPAddress, unsigned int, int, IPAddress, unsigned int)); // listen Socket, local IP Address, listen Port, socket, remote IP Address, port
   // This is the original read socket callback - called when a +UUSORD or +UUSORF URC is received
@@ -695,6 +1665,7 @@ public:
   void setHTTPCommandCallback(void (*httpCommandRequestCallback)(int profile, int command, int result));
   void setMQTTCommandCallback(void (*mqttCommandRequestCallback)(int command, int result));
   void setFTPCommandCallback(void (*ftpCommandRequestCallback)(int command, int result));
+  void setMQTTSNCommandCallback(void (*mqttsnCommandRequestCallback)(int command, int result));
 
   SARA_R5_error_t setRegistrationCallback(void (*registrationCallback)(SARA_R5_registration_status_t status,
                                                                        unsigned int lac, unsigned int ci, int Act));
@@ -709,6 +1680,8 @@ public:
 
   // General AT Commands
   SARA_R5_error_t at(void);
+  SARA_R5_error_t waitForReady(unsigned long timeout = SARA_R5_POWER_ON_READY_TIMEOUT); // Wait for the module to respond to AT
+  unsigned long getBootTime(void) { return _bootTime; } // The time the module took to respond in the last waitForReady (millis)
   SARA_R5_error_t enableEcho(bool enable = true);
   String getManufacturerID(void);
   String getModelID(void);
@@ -719,6 +1692,13 @@ public:
   String getCCID(void);
   String getSubscriberNo(void);
   String getCapabilities(void);
+  // The identity getters above are served from the identity record. getIdentity returns it without allocating a String.
+  // The module part and the SIM part are read separately on first use (one compound command each): the module getters
+  // only need the module part. They are read again after invalidateIdentity, a reset or power cycle, or (the SIM part)
+  // a SIM state change (+UUSIMSTAT). If the SIM part cannot be read, it is not tried again until then.
+  // Returns nullptr if the record could not be allocated
+  const SARA_R5_identity_t *getIdentity(void);
+  void invalidateIdentity(bool simOnly = false);
 
   // Control and status AT commands
   SARA_R5_error_t reset(void);
@@ -730,6 +1710,10 @@ public:
   SARA_R5_error_t setClock(uint8_t y, uint8_t mo, uint8_t d,
                             uint8_t h, uint8_t min, uint8_t s, int8_t tz); // TZ can be +/- and is in increments of 15 minutes. -28 == 7 hours behind UTC/GMT
   void autoTimeZoneForBegin(bool enable = true); // Call autoTimeZoneForBegin(false) _before_ .begin if you want to disable the automatic time zone
+  // Call warmStartForBegin() _before_ .begin to skip the full init if the module is already running - e.g. after a watchdog reset of the processor.
+  // The module settings are queried with one command and only the differences are applied.
+  // If keepSockets is true, the open sockets are kept and adopted. Otherwise they are closed. If the module does not respond, a full init is done
+  void warmStartForBegin(bool enable = true, bool keepSockets = true);
   SARA_R5_error_t autoTimeZone(bool enable); // Enable/disable automatic time zone adjustment
   SARA_R5_error_t setUtimeMode(SARA_R5_utime_mode_t mode = SARA_R5_UTIME_MODE_PPS, SARA_R5_utime_sensor_t sensor = SARA_R5_UTIME_SENSOR_GNSS_LTE); // Time mode, source etc. (+UTIME)
   SARA_R5_error_t getUtimeMode(SARA_R5_utime_mode_t *mode, SARA_R5_utime_sensor_t *sensor);
@@ -741,8 +1725,26 @@ public:
   // Network service AT commands
   int8_t rssi(void); // Receive signal strength
   SARA_R5_error_t getExtSignalQuality(signal_quality& signal_quality);
+  // Background signal quality sampler - see SARA_R5_SIGNAL_HISTORY_SIZE. Disabled by default
+  // Enabling allocates the sample ring. +CESQ is then read every period millis by bufferedPoll (or poll).
+  // If adaptive is true, the period is doubled while the signal is stable - up to SARA_R5_SIGNAL_MAX_PERIOD_FACTOR * period
+  SARA_R5_error_t setSignalSampler(bool enable, unsigned long period = SARA_R5_SIGNAL_SAMPLE_PERIOD, bool adaptive = true);
+  unsigned long getSignalSamplePeriod(void) { return _signalSamplePeriod; } // The current (adaptive) period
+  int getSignalSampleCount(void);
+  bool getSignalSample(int index, SARA_R5_signal_sample_t *sample); // index 0 is the newest
+  bool getSignalStats(SARA_R5_signal_field_t field, SARA_R5_signal_stats_t *stats); // Min, max and mean of the history. In +CESQ units
 
   SARA_R5_registration_status_t registration(bool eps = true);
+  // Registration state tracking. setRegistrationTracking enables the +CREG and +CEREG URCs (as do setRegistrationCallback
+  // and setEpsRegistrationCallback). While they are enabled, registration is answered from the state, which is updated by
+  // the URCs (processed by bufferedPoll). The module is only asked if the state is older than maxAge.
+  // registration does not call bufferedPoll: it queues any URCs which have arrived and applies the latest +CREG / +CEREG
+  // to the state. No callbacks are called; the events stay queued for the next bufferedPoll.
+  // Call setRegistrationTracking again after a reset or power cycle
+  SARA_R5_error_t setRegistrationTracking(bool enable = true, unsigned long maxAge = SARA_R5_REGISTRATION_MAX_AGE);
+  const SARA_R5_registration_state_t *getRegistrationState(bool eps = true);
+  unsigned long getRegistrationTimeInState(bool eps = true); // millis since the status last changed
+  uint32_t getRegistrationChanges(bool eps = true) { return _registrationState[eps ? 1 : 0].changes; }
   bool setNetworkProfile(mobile_network_operator_t mno, bool autoReset = false, bool urcNotification = false);
   mobile_network_operator_t getNetworkProfile(void);
   typedef enum
@@ -785,6 +1787,34 @@ public:
   SARA_R5_error_t automaticOperatorSelection();
   SARA_R5_error_t getOperator(String *oper);
   SARA_R5_error_t deregisterOperator(void);
+  // Non-blocking operator scan. The response to AT+COPS=? is parsed by bufferedPoll (or rxTask) as it arrives.
+  // Each operator is added to the operator table and passed to the callback as soon as it is parsed.
+  // No other command can be sent while the scan is active - they return SARA_R5_ERROR_INVALID
+  SARA_R5_error_t startOperatorScan(void (*operatorScanCallback)(const SARA_R5_operator_entry_t *entry) = nullptr);
+  bool isOperatorScanActive(void);
+  SARA_R5_error_t getOperatorScanResult(void); // SARA_R5_ERROR_INVALID while the scan is active
+  SARA_R5_error_t abortOperatorScan(void);
+  int getScannedOperatorCount(void); // The number of operators in the table (from startOperatorScan and getOperators)
+  bool getScannedOperator(int index, SARA_R5_operator_entry_t *entry);
+  SARA_R5_error_t registerOperator(const SARA_R5_operator_entry_t *entry); // Register with an operator from the table
+
+  // Power saving: PSM and eDRX
+  // setPSM requests the periodic TAU (T3412) and active time (T3324) in seconds, and enables the +UUPSMR URC.
+  // setEDRX requests the eDRX cycle (the 4-bit code from 3GPP TS 24.008) and enables the +CEDRXP URC.
+  // The power state is tracked from +UUPSMR and - if setVIntPin has been called - from the V_INT line.
+  // socketWriteWhenAwake queues the data while the module is in PSM. bufferedPoll sends it once the module is awake.
+  // A write which the module rejects with ERROR (e.g. the socket has been closed) is dropped; one which fails for
+  // any other reason is tried again on the next poll - up to SARA_R5_PSM_QUEUE_RETRIES times. See queueDropped
+  // wakeFromPSM pulses PWR_ON and measures the time until the module responds - see getPowerSaving
+  SARA_R5_error_t setPSM(bool enable, unsigned long periodicTAU = SARA_R5_PSM_DEFAULT_TAU,
+                         unsigned long activeTime = SARA_R5_PSM_DEFAULT_ACTIVE_TIME);
+  SARA_R5_error_t setEDRX(bool enable, uint8_t eDRXvalue = 5, int act = SARA_R5_EDRX_ACT_LTE_M);
+  void setVIntPin(int pin);
+  void setPowerStateCallback(void (*powerStateCallback)(SARA_R5_power_state_t state));
+  SARA_R5_power_state_t getPowerState(void);
+  const SARA_R5_power_saving_t *getPowerSaving(void) { return &_powerSaving; } // The eDRX values and the wake latency statistics
+  SARA_R5_error_t wakeFromPSM(unsigned long timeout = SARA_R5_POWER_ON_READY_TIMEOUT);
+  SARA_R5_error_t socketWriteWhenAwake(int socket, const char *str, int len = -1, bool wake = false);
 
   // SMS -- Short Messages Service
   SARA_R5_error_t setSMSMessageFormat(SARA_R5_message_format_t textMode = SARA_R5_MESSAGE_FORMAT_TEXT);
@@ -800,6 +1830,13 @@ public:
   // V24 Control and V25ter (UART interface) AT commands
   SARA_R5_error_t setBaud(unsigned long baud);
   SARA_R5_error_t setFlowControl(SARA_R5_flow_control_t value = SARA_R5_ENABLE_FLOW_CONTROL);
+  // Step up through the supported baud rates, up to maxBaud. Each rate is checked with SARA_R5_BAUD_PROBE_BURSTS echo probes
+  // of burstSize characters. The fastest rate with no errors is used. Call this after .begin.
+  // Set flowControl to true if RTS and CTS are connected (and enabled on your serial port): hardware flow control is enabled first.
+  // Set persist to true to store the rate in the module profile (AT&W). Then pass the new rate to .begin next time
+  SARA_R5_error_t negotiateBaud(unsigned long maxBaud = 921600, bool flowControl = false, bool persist = false,
+                                int burstSize = SARA_R5_BAUD_PROBE_BURST_SIZE);
+  unsigned long getBaud(void) { return _baud; }
 
   // GPIO
   // GPIO pin map
@@ -925,6 +1962,30 @@ public:
   SARA_R5_error_t sendHTTPGET(int profile, String path, String responseFilename);
   SARA_R5_error_t sendHTTPPOSTdata(int profile, String path, String responseFilename, String data, SARA_R5_http_content_types_t httpContentType);
   SARA_R5_error_t sendHTTPPOSTfile(int profile, String path, String responseFilename, String requestFile, SARA_R5_http_content_types_t httpContentType);
+  // POST from memory or from a producer callback, without copying the body into a String. Short bodies are sent inline.
+  // Others are staged in stagingFile first (post<profile>.tmp if it is nullptr). The file is deleted once +UUHTTPCR
+  // has arrived. See SARA_R5_http_post_report_t
+  SARA_R5_error_t sendHTTPPOST(int profile, String path, String responseFilename, const uint8_t *data, size_t length,
+                               SARA_R5_http_content_types_t httpContentType, SARA_R5_http_post_report_t *report = nullptr,
+                               const char *stagingFile = nullptr);
+  SARA_R5_error_t sendHTTPPOST(int profile, String path, String responseFilename,
+                               size_t (*producer)(char *buffer, size_t offset, size_t length, void *context), void *context,
+                               size_t length, SARA_R5_http_content_types_t httpContentType, SARA_R5_http_post_report_t *report = nullptr,
+                               const char *stagingFile = nullptr);
+  // HTTP response streaming - see SARA_R5_http_parser
+  SARA_R5_error_t waitForHTTPResult(int profile, int *result, unsigned long timeout = SARA_R5_HTTP_RESULT_TIMEOUT); // result is 1 for success
+  SARA_R5_error_t streamHTTPResponse(String responseFilename, SARA_R5_http_parser &parser, bool deleteWhenRead = false);
+  SARA_R5_error_t sendHTTPGETstream(int profile, String path, String responseFilename, SARA_R5_http_parser &parser,
+                                    bool deleteWhenRead = true, unsigned long timeout = SARA_R5_HTTP_RESULT_TIMEOUT);
+  // Asynchronous HTTP request queue - see SARA_R5_http_request. Disabled by default. Enabling allocates the scheduler,
+  // which uses profiles 0 to (profiles - 1). Do not use those profiles directly while the queue is enabled.
+  // A request whose +UUHTTPCR has not arrived after SARA_R5_HTTP_REQUEST_TIMEOUT fails. Its profile is not used again
+  // until the late +UUHTTPCR arrives (it is discarded) or another SARA_R5_HTTP_REQUEST_TIMEOUT has passed
+  SARA_R5_error_t setHTTPQueue(bool enable, int profiles = SARA_R5_NUM_HTTP_PROFILES);
+  bool getHTTPQueue(void) { return (_httpScheduler != nullptr); }
+  SARA_R5_error_t queueHTTPRequest(SARA_R5_http_request &request);
+  bool cancelHTTPRequest(SARA_R5_http_request &request); // Only a request which is still queued can be cancelled
+  int getHTTPRequestsInFlight(void);
 
   SARA_R5_error_t nvMQTT(SARA_R5_mqtt_nv_parameter_t parameter);
   SARA_R5_error_t setMQTTclientId(const String& clientId);
@@ -939,7 +2000,46 @@ public:
   SARA_R5_error_t mqttPublishTextMsg(const String& topic, const char * const msg, uint8_t qos = 0, bool retain = false);
   SARA_R5_error_t mqttPublishBinaryMsg(const String& topic, const char * const msg, size_t msg_len, uint8_t qos = 0, bool retain = false);
   SARA_R5_error_t mqttPublishFromFile(const String& topic, const String& filename, uint8_t qos = 0, bool retain = false);
+  // Wait for the +UUMQTTC result of the last mqttPublishFromFile. result is 1 for success
+  SARA_R5_error_t waitForMQTTPublishFileResult(int *result, unsigned long timeout = SARA_R5_MQTT_RESULT_TIMEOUT);
   SARA_R5_error_t getMQTTprotocolError(int *error_code, int *error_code2);
+  // MQTT publish pipeline - see SARA_R5_mqtt_message. Disabled by default. Enabling allocates the pipeline
+  SARA_R5_error_t setMQTTPublishPipeline(bool enable, int window = SARA_R5_MQTT_PIPELINE_WINDOW,
+                                         unsigned long ackTimeout = SARA_R5_MQTT_PIPELINE_ACK_TIMEOUT,
+                                         int retries = SARA_R5_MQTT_PIPELINE_RETRIES);
+  bool getMQTTPublishPipeline(void) { return (_mqttPipeline != nullptr); }
+  SARA_R5_error_t queueMQTTPublish(SARA_R5_mqtt_message &message);
+  int getMQTTPublishesInFlight(void);
+  bool getMQTTPublishStats(SARA_R5_mqtt_publish_stats_t *stats);
+  // MQTT inbound engine - see SARA_R5_mqtt_subscription. Disabled by default. Enabling allocates the inbound buffer
+  SARA_R5_error_t setMQTTInbound(bool enable, int bufferSize = SARA_R5_MQTT_INBOUND_BUFFER_SIZE,
+                                 int maxMessages = SARA_R5_MQTT_DRAIN_MAX_MESSAGES);
+  bool getMQTTInbound(void) { return (_mqttInbound != nullptr); }
+  SARA_R5_error_t addMQTTSubscriptionHandler(SARA_R5_mqtt_subscription &subscription);
+  SARA_R5_error_t removeMQTTSubscriptionHandler(SARA_R5_mqtt_subscription &subscription);
+  SARA_R5_error_t drainMQTT(int *messagesRead = nullptr); // Called automatically by bufferedPoll and poll
+  int getMQTTMessagesPending(void);
+  bool getMQTTInboundStats(uint32_t *received, uint32_t *unmatched, uint32_t *truncated);
+
+  // MQTT-SN over UDP. Publishes use 2-byte topic IDs: registered topics are cached for the session
+  SARA_R5_error_t setMQTTSNclientId(const String& clientId);
+  SARA_R5_error_t setMQTTSNserver(const String& serverName, int port);
+  SARA_R5_error_t connectMQTTSN(void);
+  SARA_R5_error_t disconnectMQTTSN(void);
+  SARA_R5_error_t sleepMQTTSN(int duration);
+  SARA_R5_error_t awakeMQTTSN(void);
+  SARA_R5_error_t registerMQTTSNtopic(const String& topic, uint16_t *topicId = nullptr);
+  // A short topic name must not contain " or , or NULL: SARA_R5_ERROR_UNEXPECTED_PARAM is returned
+  SARA_R5_error_t publishMQTTSN(const String& topic, const char *msg, int qos = 0, bool retain = false);
+  SARA_R5_error_t publishMQTTSN(uint16_t topicId, const char *msg, int qos = 0, bool retain = false,
+                                SARA_R5_mqttsn_topic_type_t type = SARA_R5_MQTTSN_TOPIC_NORMAL);
+  SARA_R5_error_t subscribeMQTTSNtopic(int maxQos, const String& topic, uint16_t *topicId = nullptr);
+  SARA_R5_error_t unsubscribeMQTTSNtopic(const String& topic); // Also removes the topic ID from the cache
+  // Read one received message. topic is the topic name, or the topic ID (in decimal) if the gateway sent one
+  SARA_R5_error_t readMQTTSN(int *pQos, String *pTopic, uint8_t *readDest, int readLength, int *bytesRead);
+  int getMQTTSNmessagesPending(void); // From the +UUMQTTSNC: 6 URC, less the messages read since
+  int getMQTTSNtopicId(const String& topic);
+  bool getMQTTSNconnected(void);
 
   // FTP
   SARA_R5_error_t setFTPserver(const String& serverName);
@@ -1015,6 +2115,33 @@ public:
   SARA_R5_error_t getFileContents(String filename, String *contents); // OK for text files. But will fail with binary files (containing \0) on some platforms.
   SARA_R5_error_t getFileContents(String filename, char *contents); // OK for binary files. Make sure contents can hold the entire file. Get the size first with getFileSize.
   SARA_R5_error_t getFileBlock(const String& filename, char* buffer, size_t offset, size_t requestedLength, size_t& bytesRead); // OK for binary files. Make sure buffer can hold the requested block size.
+  // Open a file stream - see SARA_R5_file_stream. chunkSize is the largest block which will be requested with +URDBLOCK
+  SARA_R5_error_t openFileStream(SARA_R5_file_stream &stream, const char *filename, size_t chunkSize = SARA_R5_FILE_STREAM_CHUNK_SIZE);
+  // Chunked, resumable uploads - see SARA_R5_file_upload. beginFileUpload learns how much of the file the module already
+  // has (with getFileSize) when resume is true. continueFileUpload sends the rest, from memory or from a source callback
+  SARA_R5_error_t beginFileUpload(SARA_R5_file_upload &upload, const char *filename, size_t size, bool resume = true,
+                                  size_t maxChunkSize = SARA_R5_UPLOAD_MAX_CHUNK_SIZE);
+  SARA_R5_error_t continueFileUpload(SARA_R5_file_upload &upload,
+                                     size_t (*source)(char *buffer, size_t offset, size_t length, void *context),
+                                     void *context = nullptr, void (*progress)(size_t offset, size_t size, void *context) = nullptr);
+  SARA_R5_error_t continueFileUpload(SARA_R5_file_upload &upload, const char *data,
+                                     void (*progress)(size_t offset, size_t size, void *context) = nullptr);
+  // Store-and-forward journal - see SARA_R5_journal. Delivery is at-least-once: after openJournal, the delivered records
+  // of a partly flushed segment are delivered again. Make the records idempotent or give them sequence numbers
+  SARA_R5_error_t openJournal(SARA_R5_journal &journal, const char *name, size_t segmentSize = SARA_R5_JOURNAL_SEGMENT_SIZE,
+                              int segments = SARA_R5_JOURNAL_SEGMENTS);
+  SARA_R5_error_t journalAppend(SARA_R5_journal &journal, const char *data, size_t length);
+  // The sink is passed each batch (each record preceded by its length, 2 bytes LSB first) and returns
+  // SARA_R5_ERROR_SUCCESS once it has been delivered
+  SARA_R5_error_t journalFlush(SARA_R5_journal &journal, SARA_R5_error_t (*sink)(const char *data, size_t length, void *context),
+                               void *context = nullptr, size_t maxBytes = SARA_R5_JOURNAL_BATCH_SIZE, int maxBatches = 0);
+  SARA_R5_error_t journalFlushSocket(SARA_R5_journal &journal, int socket, size_t maxBytes = SARA_R5_JOURNAL_BATCH_SIZE);
+  // These write one batch to the file name.out and send it with mqttPublishFromFile or sendHTTPPOSTfile.
+  // The batch is removed from the journal only when the +UUMQTTC or +UUHTTPCR result reports success
+  SARA_R5_error_t journalFlushMQTT(SARA_R5_journal &journal, const String& topic, uint8_t qos = 0, bool retain = false,
+                                   size_t maxBytes = SARA_R5_JOURNAL_BATCH_SIZE);
+  SARA_R5_error_t journalFlushHTTP(SARA_R5_journal &journal, int profile, String path, String responseFilename,
+                                   SARA_R5_http_content_types_t httpContentType, size_t maxBytes = SARA_R5_JOURNAL_BATCH_SIZE);
 
   // Append data to a file, delete file first to not appends the data.
   SARA_R5_error_t appendFileContents(String filename, String str);
@@ -1022,6 +2149,17 @@ public:
   SARA_R5_error_t getFileSize(String filename, int *size);
   SARA_R5_error_t deleteFile(String filename);
 
+  // File system index - see SARA_R5_FILE_INDEX_SIZE. Disabled by default. Enabling allocates the index. Disabling frees it
+  // The file list is read on first use. Each file size, and the free space, is read the first time it is needed.
+  // After that the index is kept up to date by appendFileContents, deleteFile, ftpGetFile and the HTTP commands,
+  // so getFileSize and getFileContents do not need to ask the module
+  SARA_R5_error_t setFileIndex(bool enable);
+  bool getFileIndex(void) { return (_fileIndex != nullptr); }
+  void invalidateFileIndex(void); // Call this if the file system has been changed by other means
+  int getFileCount(void); // Returns -1 if the index is not enabled or cannot be read
+  SARA_R5_error_t getFileName(int index, String *filename);
+  SARA_R5_error_t getFreeSpace(long *freeSpace); // Bytes
+
   // Functionality
   SARA_R5_error_t functionality(SARA_R5_functionality_t function = FULL_FUNCTIONALITY);
 
@@ -1029,6 +2167,37 @@ public:
   SARA_R5_error_t sendCustomCommandWithResponse(const char *command, const char *expectedResponse,
                                                 char *responseDest, unsigned long commandTimeout = SARA_R5_STANDARD_RESPONSE_TIMEOUT, bool at = true);
 
+  // Adaptive command timeouts - see SARA_R5_ADAPTIVE_TIMEOUT_SAMPLES. Disabled by default
+  // Enabling allocates the latency table. Disabling frees it
+  SARA_R5_error_t setAdaptiveTimeouts(bool enable);
+  bool getAdaptiveTimeouts(void) { return (_commandLatency != nullptr); }
+  bool getCommandLatency(const char *command, SARA_R5_command_latency_t *latency); // command is e.g. "+CSQ" or "+COPS=1". Returns false if it has not been seen
+  unsigned long getAdaptiveTimeout(const char *command, unsigned long defaultTimeout); // The timeout which would be used for command
+
+  // Batched commands
+  // Between beginBatch and endBatch, the configuration setters (setHTTPserverName, setMQTTclientId, configSecurityProfile,
+  // setGpioMode, etc. - the ones which are also shadowed) are not sent immediately. They return SARA_R5_ERROR_SUCCESS and
+  // are combined into as few AT+X;+Y;+Z command lines as possible. Any other command - including the action commands
+  // with a URC result (connectMQTT, sendHTTPGET, ...) - sends the batch first and is then sent on its own, so the order
+  // is always kept.
+  // endBatch sends the rest and returns the first error. If a combined line fails, its commands are sent again one by one
+  // to find which failed: only batch commands which can safely be repeated. Use a SARA_R5_Transaction around the batch
+  // if several tasks share the SARA_R5.
+  SARA_R5_error_t beginBatch(void);
+  SARA_R5_error_t endBatch(void);
+  int getBatchCommandCount(void); // The number of commands in the last batch
+  SARA_R5_error_t getBatchResult(int index); // The result of each command in the last batch
+
+  // Configuration shadow - see SARA_R5_CONFIG_SHADOW_SIZE. Disabled by default
+  // When enabled, setPDPconfiguration, setHTTP..., setMQTTclientId/server/credentials/secure, configSecurityProfile...,
+  // setGpioMode (except outputs) and setSMSMessageFormat return SARA_R5_ERROR_SUCCESS without sending the command if the
+  // module already holds the value. The shadow is cleared by reset, hwReset, functionality, the power functions, init and
+  // the profile reset / NVM commands. Call invalidateConfigShadow if you change the settings with sendCustomCommandWithResponse
+  SARA_R5_error_t setConfigShadow(bool enable);
+  bool getConfigShadow(void) { return (_configShadow != nullptr); }
+  void invalidateConfigShadow(void);
+  uint32_t getConfigShadowHits(void) { return _configShadowHits; } // The number of commands which have been skipped
+
 protected:
   HardwareSerial *_hardSerial;
 #ifdef SARA_R5_SOFTWARE_SERIAL_ENABLED
@@ -1049,15 +2218,86 @@ protected:
   IPAddress _lastLocalIP;
   uint8_t _maxInitTries;
   bool _autoTimeZoneForBegin = true;
+  bool _warmStartForBegin = false;
+  bool _warmStartKeepSockets = true;
+  unsigned long _bootTime = 0;
   bool _bufferedPollReentrant = false; // Prevent reentry of bufferedPoll - just in case it gets called from a callback
   bool _pollReentrant = false; // Prevent reentry of poll - just in case it gets called from a callback
 
   #define _RXBuffSize 2056
   const unsigned long _rxWindowMillis = 2; // 1ms is not quite long enough for a single char at 9600 baud. millis roll over much less often than micros. See notes in .cpp re. ESP32!
   char *_saraRXBuffer; // Allocated in SARA_R5::begin
-  char *_pruneBuffer;
-  char *_saraResponseBacklog;
-  int _saraResponseBacklogLength = 0; // The backlog could contain binary data so we can't use strlen to find its length
+
+  // The URC event queue is single-producer / single-consumer.
+  // The producer is whoever reads the UART: sendCommandWithResponse, waitForResponse, bufferedPoll or rxTask.
+  // The consumer is dispatchURCEvents (called by bufferedPoll).
+  SARA_R5_urc_event_t *_urcEventQueue; // Allocated in SARA_R5::begin. SARA_R5_URC_EVENT_QUEUE_SIZE + 1 entries
+  SARA_R5_spsc_index_t _urcEventHead; // Index of the oldest event in the queue. Written by the consumer
+  SARA_R5_spsc_index_t _urcEventTail; // Index of the next free entry. Written by the producer
+  SARA_R5_urc_latest_t *_urcLatest; // Allocated in SARA_R5::begin. The latest values of the coalesced events
+  uint32_t _urcEventsDropped = 0;
+  uint32_t _urcEventsCoalesced = 0;
+  char *_urcLineBuffer; // Allocated in SARA_R5::begin. Holds the line currently being received
+  int _urcLineBufferLength = 0;
+  char *_urcTextBuffer; // Allocated in SARA_R5::begin. Holds the text of the queued +UULOC and +UUPING events
+  SARA_R5_spsc_flag_t _urcTextSlotFull[SARA_R5_URC_TEXT_SLOTS]; // Set by the producer. Cleared by the consumer
+
+  SARA_R5_spsc_flag_t _rxTaskMode; // When true, rxTask owns the UART. Written by the application, read by rxTask
+
+  SARA_R5_command_latency_t *_commandLatency; // Allocated by setAdaptiveTimeouts
+
+  SARA_R5_batch_t *_batch; // Allocated by beginBatch
+  bool _batchActive; // True between beginBatch and endBatch
+  bool _batchSending; // True while a combined command line is being sent
+
+  SARA_R5_config_shadow_t *_configShadow; // Allocated by setConfigShadow
+  int _configShadowNext; // The next entry to be replaced
+  uint32_t _configShadowHits;
+
+  SARA_R5_identity_t *_identity; // Allocated by getIdentity
+
+  SARA_R5_file_index_t *_fileIndex; // Allocated by setFileIndex
+
+  SARA_R5_signal_sample_t *_signalHistory; // Allocated by setSignalSampler
+  int _signalHistoryHead; // The next sample to be written
+  int _signalHistoryCount;
+  float _signalEwma[SARA_R5_SIGNAL_NUM_FIELDS];
+  uint8_t _signalEwmaValid; // Bit n is set once _signalEwma[n] holds a value
+  unsigned long _signalSampleBasePeriod;
+  unsigned long _signalSamplePeriod;
+  unsigned long _signalLastSample;
+  bool _signalSampleAdaptive;
+
+  SARA_R5_operator_scan_t *_operatorScan; // Allocated by startOperatorScan or getOperators
+  void (*_operatorScanCallback)(const SARA_R5_operator_entry_t *entry);
+
+  SARA_R5_power_saving_t _powerSaving;
+  int _vIntPin; // -1 if V_INT is not connected
+  void (*_powerStateCallback)(SARA_R5_power_state_t state);
+#ifdef SARA_R5_RX_TASK_ENABLED
+  char *_rxResponseRing; // Allocated by setRxTaskMode. Holds the characters received by rxTask until the command reads them
+  SARA_R5_spsc_index_t _rxResponseHead; // Written by the command (consumer)
+  SARA_R5_spsc_index_t _rxResponseTail; // Written by rxTask (producer)
+  std::atomic<uint32_t> _rxResponseDropped; // Written by rxTask (producer)
+  uint32_t _rxResponseDroppedAtCommand; // The value of _rxResponseDropped when the last command was sent
+#endif
+
+#ifdef SARA_R5_THREAD_SAFE_ENABLED
+  std::mutex _transactionMutex; // Protects the members below. Only held while the queue is updated - never during a transaction
+  std::condition_variable _transactionCondition;
+  std::thread::id _transactionOwner; // The thread which holds the transaction lock. Default (no thread) when free
+  int _transactionDepth = 0;
+  uint32_t _transactionNextTicket[SARA_R5_NUM_PRIORITIES]; // One ticket queue per priority
+  uint32_t _transactionNowServing[SARA_R5_NUM_PRIORITIES];
+#endif
+
+#ifdef SARA_R5_COROUTINES_ENABLED
+  friend class SARA_R5_urc_awaiter;
+  SARA_R5_urc_awaiter *_urcAwaiters; // The awaiters which are waiting for a URC. Guarded by the transaction lock
+  bool resumeURCAwaiters(const SARA_R5_urc_event_t *urc);
+  void expireURCAwaiters(void);
+  bool resumeReadyURCAwaiters(void);
+#endif
 
   void (*_socketListenCallback)(int, IPAddress, unsigned int, int, IPAddress, unsigned int);
   void (*_socketReadCallback)(int, String);
@@ -1068,11 +2308,23 @@ protected:
   void (*_psdActionRequestCallback)(int, IPAddress);
   void (*_pingRequestCallback)(int, int, String, IPAddress, int, long);
   void (*_httpCommandRequestCallback)(int, int, int);
+  int _httpCommandResult[SARA_R5_NUM_HTTP_PROFILES]; // The result of the last +UUHTTPCR. -1 while a command is in progress
+  char _httpStagingFile[SARA_R5_NUM_HTTP_PROFILES][SARA_R5_HTTP_POST_STAGING_NAME_LENGTH]; // Deleted after +UUHTTPCR. Empty if none
+  int _mqttPublishFileResult; // The result of the last mqttPublishFromFile. -1 while it is in progress
+  SARA_R5_http_scheduler_t *_httpScheduler; // Allocated by setHTTPQueue
+  SARA_R5_mqtt_pipeline_t *_mqttPipeline; // Allocated by setMQTTPublishPipeline
+  SARA_R5_mqtt_inbound_t *_mqttInbound; // Allocated by setMQTTInbound
+  SARA_R5_mqttsn_t *_mqttsn; // Allocated by connectMQTTSN
   void (*_mqttCommandRequestCallback)(int, int);
   void (*_ftpCommandRequestCallback)(int, int);
+  void (*_mqttsnCommandRequestCallback)(int, int);
   void (*_registrationCallback)(SARA_R5_registration_status_t status, unsigned int lac, unsigned int ci, int Act);
   void (*_epsRegistrationCallback)(SARA_R5_registration_status_t status, unsigned int tac, unsigned int ci, int Act);
 
+  SARA_R5_registration_state_t _registrationState[2]; // [0] is +CREG, [1] is +CEREG
+  bool _registrationURC[2]; // True if the URCs are enabled and registration can be answered from _registrationState
+  unsigned long _registrationMaxAge;
+
 
   int _lastSocketProtocol[SARA_R5_NUM_SOCKETS]; // Record the protocol for each socket to avoid having to call querySocketType in parseSocketReadIndication
 
@@ -1084,6 +2336,7 @@ protected:
   } SARA_R5_init_type_t;
 
   SARA_R5_error_t init(unsigned long baud, SARA_R5_init_type_t initType = SARA_R5_INIT_STANDARD);
+  SARA_R5_error_t warmStart(unsigned long baud);
 
   void powerOn(void); // Brief pulse on PWR_ON to turn module back on
   void powerOff(void); // Long pulse on PWR_ON to do a graceful shutdown. Note modulePowerOff (+CPWROFF) is preferred.
@@ -1117,20 +2370,118 @@ protected:
   int readAvailable(char *inString);
   char readChar(void);
   int hwAvailable(void);
-  virtual void beginSerial(unsigned long baud);
+  virtual SARA_R5_error_t beginSerial(unsigned long baud); // Returns SARA_R5_ERROR_INVALID in RX task mode
   void setTimeout(unsigned long timeout);
   bool find(char *target);
 
   SARA_R5_error_t autobaud(unsigned long desiredBaud);
+  bool baudProbe(int burstSize);
 
   char *sara_r5_calloc_char(size_t num);
 
   bool processURCEvent(const char *event);
-  void pruneBacklog(void);
+  bool parseURCEvent(const char *event, SARA_R5_urc_event_t *urc);
+  bool dispatchURCEvent(const SARA_R5_urc_event_t *urc);
+  bool bufferURCChar(char c); // Add a received char to the URC line buffer. Complete URCs are converted into events and queued
+  void trackResponseChar(char c); // Track the operator scan and the power state. Always called on the application side
+  bool rxResponseLost(void);
+#ifdef SARA_R5_RX_TASK_ENABLED
+  void discardRxResponse(void);
+#endif
+  bool queueURCLine(const char *line);
+  bool queueURCEvent(const SARA_R5_urc_event_t *urc);
+  bool dispatchURCEvents(void);
+  int urcLatestIndex(const SARA_R5_urc_event_t *urc);
+  bool allocateURCQueue(void);
+  int commandLatencyIndex(const char *command, bool add);
+  unsigned long adaptiveTimeout(int index, unsigned long defaultTimeout);
+  void updateCommandLatency(int index, bool responded, unsigned long latency, unsigned long timeout, unsigned long defaultTimeout);
+  bool addBatchCommand(const char *command, unsigned long commandTimeout);
+  SARA_R5_error_t sendBatchableCommand(const char *command, unsigned long commandTimeout);
+  SARA_R5_error_t sendBatch(void);
+  uint32_t configShadowHash(const char *str, size_t len);
+  void forgetShadowedCommand(const char *selector);
+  SARA_R5_error_t sendShadowedCommand(const char *command, int selectors, unsigned long commandTimeout);
+  const SARA_R5_identity_t *loadIdentity(bool module, bool sim);
+  bool insideBufferedPoll(void); // True if called from a callback. Waits for a URC can't be served by bufferedPoll
+  void identityCopy(char *dest, size_t destSize, const char *src);
+  void updateRegistrationState(bool eps, int status, unsigned int area, unsigned int ci, int Act);
+  void peekRegistrationEvent(bool eps);
+  void invalidateRegistrationState(void);
+  void moduleWasReset(void);
+  void sampleSignalQuality(void);
+  uint8_t signalSampleField(const SARA_R5_signal_sample_t *sample, SARA_R5_signal_field_t field);
+  bool signalSampleUnknown(SARA_R5_signal_field_t field, uint8_t value);
+  bool allocateOperatorScan(void);
+  SARA_R5_operator_entry_t *storeScannedOperator(int stat, const char *longOp, const char *shortOp, unsigned long numOp, int act);
+  void operatorScanChar(char c);
+  void flushPowerSavingQueue(void);
+  void setPowerState(SARA_R5_power_state_t state);
+  void updatePowerStateFromVInt(void);
+  void psmEncodeTimer(char *timer, unsigned long seconds, bool timer3);
+  void powerPinPulse(unsigned long period);
+  friend class SARA_R5_file_stream;
+  SARA_R5_error_t readFileBlock(const char *filename, char *buffer, size_t offset, size_t length, size_t *bytesRead);
+  uint32_t crc32Update(uint32_t crc, const char *data, size_t length);
+  SARA_R5_error_t loadFileIndex(void);
+  SARA_R5_file_index_entry_t *fileIndexFind(const char *filename);
+  SARA_R5_file_index_entry_t *fileIndexAdd(const char *filename);
+  void fileIndexWritten(const char *filename, int bytesAdded);
+  void fileIndexRemove(const char *filename);
+  void fileIndexPending(int slot, const char *filename);
+  void fileIndexCompleted(int slot);
+  void journalSegmentName(const SARA_R5_journal &journal, uint32_t seq, char *filename);
+  size_t journalFrame(char *dest, uint8_t magic, const char *data, size_t length);
+  SARA_R5_error_t journalReadSegmentHeader(const char *filename, uint32_t *seq);
+  void journalRotate(SARA_R5_journal &journal);
+  SARA_R5_error_t journalNextRecord(SARA_R5_journal &journal, SARA_R5_journal_cursor_t *cursor, const char **data, size_t *length);
+  void journalCommit(SARA_R5_journal &journal, const SARA_R5_journal_cursor_t *cursor);
+  SARA_R5_error_t sendHTTPPOSTbody(int profile, const String &path, const String &responseFilename, const char *data,
+                                   size_t (*producer)(char *buffer, size_t offset, size_t length, void *context),
+                                   void *context, size_t length, SARA_R5_http_content_types_t httpContentType,
+                                   SARA_R5_http_post_report_t *report, const char *stagingFile);
+  void serviceHTTPQueue(void);
+  int chooseHTTPProfile(const SARA_R5_http_request *request);
+  void startHTTPRequest(SARA_R5_http_request *request, int p);
+  void invalidateHTTPProfiles(void);
+  void mqttPipelineResult(int command, int result);
+  void serviceMQTTPipeline(void);
+  void completeMQTTMessage(SARA_R5_mqtt_message *message);
+  void serviceMQTTInbound(void);
+  bool compileMQTTSubscription(SARA_R5_mqtt_subscription *subscription);
+  void freeMQTTTopicNodes(SARA_R5_mqtt_topic_node *node);
+  int matchMQTTTopic(SARA_R5_mqtt_topic_node *node, const char *topic, int topicLength, int position,
+                     const uint8_t *payload, int payloadLength, int qos);
+  void cacheMQTTSNtopic(const char *topic, uint16_t topicId);
+  void uncacheMQTTSNtopic(const char *topic);
+  void invalidateMQTTSNtopics(void);
+  SARA_R5_error_t sendMQTTSNCommand(SARA_R5_mqttsn_command_opcode_t opcode, int param);
+  SARA_R5_error_t sendMQTTSNRequest(const char *command);
+  SARA_R5_error_t waitForMQTTSNResult(int command, int32_t *param);
 
   // GPS Helper functions
   char *readDataUntil(char *destination, unsigned int destSize, char *source, char delimiter);
   bool parseGPRMCString(char *rmcString, PositionData *pos, ClockData *clk, SpeedData *spd);
 };
 
+#ifdef SARA_R5_THREAD_SAFE_ENABLED
+// Holds the SARA_R5 transaction lock for as long as it is in scope. E.g.:
+// {
+//   SARA_R5_Transaction transaction(mySARA, SARA_R5_PRIORITY_HIGH);
+//   mySARA.rssi();
+//   mySARA.registration();
+// }
+class SARA_R5_Transaction
+{
+public:
+  SARA_R5_Transaction(SARA_R5 &sara, SARA_R5_priority_t priority = SARA_R5_PRIORITY_NORMAL) : _sara(sara) { _sara.lockTransaction(priority); }
+  ~SARA_R5_Transaction() { _sara.unlockTransaction(); }
+
+private:
+  SARA_R5 &_sara;
+  SARA_R5_Transaction(const SARA_R5_Transaction &);
+  SARA_R5_Transaction &operator=(const SARA_R5_Transaction &);
+};
+#endif
+
 #endif //SPARKFUN_SARA_R5_ARDUINO_LIBRARY_H